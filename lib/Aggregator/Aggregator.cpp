@@ -0,0 +1,69 @@
+/*
+ Aggregator.cpp - Fixed-size min/max/mean accumulator table
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Aggregator.h"
+
+#include <math.h>
+
+Aggregator::Aggregator() : size_(0), dropped_(0) {
+  for (uint16_t i = 0; i < AGGREGATOR_MAX_FIELDS; ++i) {
+    slots_[i].name = nullptr;
+  }
+  reset();
+}
+
+bool Aggregator::add(uint16_t slot, const char *name, double value) {
+  if (slot >= AGGREGATOR_MAX_FIELDS) {
+    ++dropped_;
+    return false;
+  }
+  aggregator_slot_t *s = &slots_[slot];
+  s->name = name;
+  if (slot >= size_) {
+    size_ = slot + 1;
+  }
+
+  if (s->count == 0) {
+    s->min = value;
+    s->max = value;
+  } else {
+    if (value < s->min) s->min = value;
+    if (value > s->max) s->max = value;
+  }
+  s->last = value;
+  s->sum += value;
+  ++s->count;
+  return true;
+}
+
+void Aggregator::reset() {
+  for (uint16_t i = 0; i < AGGREGATOR_MAX_FIELDS; ++i) {
+    slots_[i].min = NAN;
+    slots_[i].max = NAN;
+    slots_[i].last = NAN;
+    slots_[i].sum = 0;
+    slots_[i].count = 0;
+  }
+}
+
+double Aggregator::mean(uint16_t i) const {
+  if (i >= size_ || slots_[i].count == 0) {
+    return NAN;
+  }
+  return slots_[i].sum / slots_[i].count;
+}
@@ -0,0 +1,55 @@
+/*
+ Aggregator.h - Fixed-size min/max/mean accumulator table headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_AGGREGATOR_AGGREGATOR_H_
+#define LIB_AGGREGATOR_AGGREGATOR_H_
+
+#include <stdint.h>
+
+#ifndef AGGREGATOR_MAX_FIELDS
+#define AGGREGATOR_MAX_FIELDS 96
+#endif
+
+typedef struct {
+  const char*   name;
+  double        min;
+  double        max;
+  double        last;
+  double        sum;
+  uint32_t      count;
+} aggregator_slot_t;
+
+// Running statistics over a publish window, one slot per decoded field.
+// The table is preallocated: adding a sample never allocates.
+class Aggregator {
+ public:
+  Aggregator();
+  bool add(uint16_t slot, const char *name, double value);  // false if slot is out of range
+  void reset();  // start a new window (slot names are kept)
+  uint16_t size() const { return size_; }
+  const aggregator_slot_t& slot(uint16_t i) const { return slots_[i]; }
+  double mean(uint16_t i) const;
+  uint32_t dropped() const { return dropped_; }  // samples refused by add() since boot
+
+ private:
+  aggregator_slot_t slots_[AGGREGATOR_MAX_FIELDS];
+  uint16_t size_;
+  uint32_t dropped_;
+};
+
+#endif  // LIB_AGGREGATOR_AGGREGATOR_H_
@@ -0,0 +1,105 @@
+/*
+ Arena.cpp - Fixed buffer allocator
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Arena.h"
+
+#include <string.h>
+
+static const size_t ALIGNMENT = 8;
+static const size_t HEADER = ALIGNMENT;  // block size, padded to keep the block aligned
+
+static size_t _align(size_t size) {
+  return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+Arena::Arena(void *buffer, size_t size)
+  : buffer_(static_cast<uint8_t *>(buffer)), size_(size), used_(0), last_(0), live_(0), high_water_(0),
+    failures_(0) {
+  // the first block starts on an aligned address
+  const size_t skew = _align(reinterpret_cast<uintptr_t>(buffer_)) - reinterpret_cast<uintptr_t>(buffer_);
+  buffer_ += skew;
+  size_ = size > skew ? size - skew : 0;
+}
+
+void *Arena::allocate(size_t size) {
+  const size_t needed = HEADER + _align(size);
+  if (needed > size_ - used_ || size > size_) {
+    ++failures_;
+    return nullptr;
+  }
+  uint8_t *header = &buffer_[used_];
+  memcpy(header, &size, sizeof(size));
+  last_ = used_;
+  used_ += needed;
+  if (used_ > high_water_) {
+    high_water_ = used_;
+  }
+  ++live_;
+  return header + HEADER;
+}
+
+void Arena::deallocate(void *ptr) {
+  if (ptr == nullptr || live_ == 0) {
+    return;
+  }
+  if (--live_ == 0) {
+    used_ = 0;
+    last_ = 0;
+  } else if (static_cast<uint8_t *>(ptr) - HEADER == &buffer_[last_]) {
+    used_ = last_;  // the last block can be reused right away
+  }
+}
+
+void *Arena::reallocate(void *ptr, size_t size) {
+  if (ptr == nullptr) {
+    return allocate(size);
+  }
+  uint8_t *header = static_cast<uint8_t *>(ptr) - HEADER;
+  if (header == &buffer_[last_] && used_ > last_) {
+    const size_t needed = HEADER + _align(size);
+    if (needed > size_ - last_ || size > size_) {
+      ++failures_;
+      return nullptr;
+    }
+    memcpy(header, &size, sizeof(size));
+    used_ = last_ + needed;
+    if (used_ > high_water_) {
+      high_water_ = used_;
+    }
+    return ptr;
+  }
+  const size_t old_size = blockSize(ptr);
+  void *moved = allocate(size);
+  if (moved == nullptr) {
+    return nullptr;
+  }
+  memcpy(moved, ptr, old_size < size ? old_size : size);
+  deallocate(ptr);
+  return moved;
+}
+
+bool Arena::owns(const void *ptr) const {
+  const uint8_t *byte = static_cast<const uint8_t *>(ptr);
+  return byte >= buffer_ && byte < buffer_ + size_;
+}
+
+size_t Arena::blockSize(const void *ptr) const {
+  size_t size;
+  memcpy(&size, static_cast<const uint8_t *>(ptr) - HEADER, sizeof(size));
+  return size;
+}
@@ -0,0 +1,54 @@
+/*
+ Arena.h - Fixed buffer allocator headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_ARENA_ARENA_H_
+#define LIB_ARENA_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump allocator over a static buffer, for objects built and released as a whole (e.g. a JSON document, cleared
+// after each publish): the memory of the blocks is reused once all of them have been released. Each block is
+// preceded by its size and aligned on 8 bytes.
+class Arena {
+ public:
+  Arena(void *buffer, size_t size);
+
+  void *allocate(size_t size);  // nullptr when the buffer is full
+  void deallocate(void *ptr);
+  // Grows or shrinks the last block in place, otherwise moves the block; nullptr (ptr untouched) when full
+  void *reallocate(void *ptr, size_t size);
+
+  bool owns(const void *ptr) const;
+  size_t blockSize(const void *ptr) const;
+  size_t used() const { return used_; }
+  size_t highWater() const { return high_water_; }
+  size_t capacity() const { return size_; }
+  uint32_t failures() const { return failures_; }
+
+ private:
+  uint8_t *buffer_;
+  size_t size_;
+  size_t used_;
+  size_t last_;  // offset of the last block (its header), used_ when there is none
+  uint32_t live_;
+  size_t high_water_;
+  uint32_t failures_;
+};
+
+#endif  // LIB_ARENA_ARENA_H_
@@ -0,0 +1,97 @@
+/*
+ Benchmark.cpp - Host micro-benchmark harness
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <new>
+
+static uint64_t allocations = 0;
+static uint64_t allocated_bytes = 0;
+
+#ifdef __GLIBC__
+// Catches every allocation, including the C ones (String uses realloc)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+  ++allocations;
+  allocated_bytes += size;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  ++allocations;
+  allocated_bytes += count * size;
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  ++allocations;
+  allocated_bytes += size;
+  return __libc_realloc(ptr, size);
+}
+}  // extern "C"
+#else
+// Other C libraries: only C++ allocations are counted
+void *operator new(size_t size) {
+  ++allocations;
+  allocated_bytes += size;
+  void *ptr = malloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+#endif  // __GLIBC__
+
+uint64_t benchmarkAllocations() {
+  return allocations;
+}
+
+uint64_t benchmarkAllocatedBytes() {
+  return allocated_bytes;
+}
+
+uint64_t benchmarkNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void benchmarkPrint(const benchmark_result_t &result) {
+  printf("  { \"%s\", %.1f, %.2f },\n", result.name, result.ns_per_op, result.allocs_per_op);
+}
+
+const benchmark_result_t *benchmarkFind(const benchmark_result_t *table, size_t count, const char *name) {
+  for (size_t i = 0; i < count; ++i) {
+    if (strcmp(table[i].name, name) == 0) {
+      return &table[i];
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,69 @@
+/*
+ Benchmark.h - Host micro-benchmark harness
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_BENCHMARK_BENCHMARK_H_
+#define LIB_BENCHMARK_BENCHMARK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// minimal measurement time of a benchmark, iterations are doubled until reached
+#ifndef BENCHMARK_MIN_TIME_MS
+#define BENCHMARK_MIN_TIME_MS 100
+#endif
+
+typedef struct {
+  const char *name;
+  double ns_per_op;
+  double allocs_per_op;
+} benchmark_result_t;
+
+// Heap allocations (malloc, calloc, realloc, new) made by the process so far. Linking this library
+// interposes the allocator, so it must only be used by benchmark and soak test programs.
+uint64_t benchmarkAllocations();
+uint64_t benchmarkAllocatedBytes();  // requested by these allocations
+uint64_t benchmarkNowNs();
+// Prints a result as a line of the baseline table
+void benchmarkPrint(const benchmark_result_t &result);
+const benchmark_result_t *benchmarkFind(const benchmark_result_t *table, size_t count, const char *name);
+
+// Keeps the compiler from optimizing away a result that is never used
+template <typename T>
+inline void benchmarkKeep(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template <typename F>
+benchmark_result_t runBenchmark(const char *name, F body) {
+  body();  // warm-up: caches, lazy initializations
+  for (uint32_t iterations = 1;; iterations *= 2) {
+    const uint64_t allocations = benchmarkAllocations();
+    const uint64_t start_ns = benchmarkNowNs();
+    for (uint32_t i = 0; i < iterations; ++i) {
+      body();
+    }
+    const uint64_t elapsed_ns = benchmarkNowNs() - start_ns;
+    if (elapsed_ns >= BENCHMARK_MIN_TIME_MS * 1000000ULL || iterations >= (1UL << 30)) {
+      const benchmark_result_t result = { name, static_cast<double>(elapsed_ns) / iterations,
+        static_cast<double>(benchmarkAllocations() - allocations) / iterations };
+      return result;
+    }
+  }
+}
+
+#endif  // LIB_BENCHMARK_BENCHMARK_H_
@@ -0,0 +1,194 @@
+/*
+ BinLog.cpp - Deferred binary logging
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "BinLog.h"
+
+#include <stdio.h>
+#include <string.h>
+
+BinLog::BinLog(const binlog_message_t *messages, uint16_t message_nb, const char *const *tags, uint8_t tag_nb,
+               uint8_t default_level)
+    : messages_(messages), message_nb_(message_nb), tags_(tags), tag_nb_(tag_nb), head_(0), tail_(0),
+      overwritten_(0) {
+  if (tag_nb_ > sizeof(levels_)) {
+    tag_nb_ = sizeof(levels_);
+  }
+  for (uint8_t i = 0; i < sizeof(levels_); ++i) {
+    levels_[i] = default_level;
+  }
+#ifdef ARDUINO
+  vPortCPUInitializeMutex(&mux_);
+#endif  // ARDUINO
+}
+
+void BinLog::lock() {
+#ifdef ARDUINO
+  portENTER_CRITICAL(&mux_);
+#else
+  mutex_.lock();
+#endif  // ARDUINO
+}
+
+void BinLog::unlock() {
+#ifdef ARDUINO
+  portEXIT_CRITICAL(&mux_);
+#else
+  mutex_.unlock();
+#endif  // ARDUINO
+}
+
+void BinLog::push(const binlog_record_t &record) {
+  lock();
+  records_[head_ % BINLOG_CAPACITY] = record;
+  ++head_;
+  if (head_ - tail_ > BINLOG_CAPACITY) {
+    ++tail_;
+    ++overwritten_;
+  }
+  unlock();
+}
+
+bool BinLog::read(binlog_record_t *record) {
+  bool available = false;
+  lock();
+  if (tail_ != head_) {
+    *record = records_[tail_ % BINLOG_CAPACITY];
+    ++tail_;
+    available = true;
+  }
+  unlock();
+  return available;
+}
+
+size_t BinLog::snapshot(uint8_t *out, size_t size) {
+  lock();
+  uint32_t count = head_ < BINLOG_CAPACITY ? head_ : BINLOG_CAPACITY;
+  if (count > size / sizeof(binlog_record_t)) {
+    count = size / sizeof(binlog_record_t);
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    memcpy(out + i * sizeof(binlog_record_t), &records_[(head_ - count + i) % BINLOG_CAPACITY],
+           sizeof(binlog_record_t));
+  }
+  unlock();
+  return count * sizeof(binlog_record_t);
+}
+
+bool BinLog::setLevel(const char *tag, uint8_t level) {
+  bool found = false;
+  for (uint8_t i = 0; i < tag_nb_; ++i) {
+    if (strcmp(tag, "*") == 0 || strcmp(tag, tags_[i]) == 0) {
+      levels_[i] = level;
+      found = true;
+    }
+  }
+  return found;
+}
+
+static double _toDouble(uintptr_t value, uint8_t type) {
+  if (type == BINLOG_ARG_FLOAT) {
+    union { uint32_t u; float f; } bits = { static_cast<uint32_t>(value) };
+    return bits.f;
+  }
+  if (type == BINLOG_ARG_INT) {
+    return static_cast<int32_t>(value);
+  }
+  return static_cast<uint32_t>(value);
+}
+
+size_t BinLog::format(const binlog_record_t &record, char *out, size_t size) const {
+  if (size == 0) {
+    return 0;
+  }
+  if (record.id >= message_nb_) {
+    return snprintf(out, size, "unknown message %u", record.id);
+  }
+
+  const char *p = messages_[record.id].format;
+  size_t length = 0;
+  uint8_t arg = 0;
+  while (*p != '\0' && length + 1 < size) {
+    if (*p != '%') {
+      out[length++] = *p++;
+      continue;
+    }
+
+    // copy the conversion spec without length modifiers, arguments are promoted by the record
+    char spec[16];
+    uint8_t n = 0;
+    spec[n++] = *p++;
+    while (*p != '\0' && strchr("-+ #0123456789.hlzjtL", *p) != nullptr) {
+      if (strchr("hlzjtL", *p) == nullptr && n < sizeof(spec) - 2) {
+        spec[n++] = *p;
+      }
+      ++p;
+    }
+    char conversion = *p;
+    if (conversion == '\0') {
+      break;
+    }
+    ++p;
+    spec[n++] = conversion;
+    spec[n] = '\0';
+
+    char *dst = out + length;
+    size_t available = size - length;
+    int written = 0;
+    if (conversion == '%') {
+      written = snprintf(dst, available, "%%");
+    } else if (arg >= record.argc) {
+      written = snprintf(dst, available, "?");
+    } else {
+      uintptr_t value = record.args[arg];
+      uint8_t type = (record.types >> (2 * arg)) & 0x03;
+      ++arg;
+      if (conversion == 'b') {
+        // 16-bit binary without leading zeros
+        char bits[17];
+        uint8_t b = 0;
+        for (int8_t i = 15; i >= 0; --i) {
+          if (b > 0 || (value >> i) & 1 || i == 0) {
+            bits[b++] = ((value >> i) & 1) ? '1' : '0';
+          }
+        }
+        bits[b] = '\0';
+        written = snprintf(dst, available, "%s", bits);
+      } else if (conversion == 's') {
+        const char *text = type == BINLOG_ARG_STRING ? reinterpret_cast<const char *>(value) : "?";
+        written = snprintf(dst, available, spec, text);
+      } else if (strchr("feEgG", conversion) != nullptr) {
+        written = snprintf(dst, available, spec, _toDouble(value, type));
+      } else if (strchr("dic", conversion) != nullptr) {
+        int number = type == BINLOG_ARG_FLOAT ? static_cast<int>(_toDouble(value, type)) : static_cast<int>(value);
+        written = snprintf(dst, available, spec, number);
+      } else if (strchr("uxXo", conversion) != nullptr) {
+        unsigned int number = type == BINLOG_ARG_FLOAT ? static_cast<unsigned int>(_toDouble(value, type))
+                                                       : static_cast<unsigned int>(value);
+        written = snprintf(dst, available, spec, number);
+      } else {
+        written = snprintf(dst, available, "?");
+      }
+    }
+    if (written < 0) {
+      break;
+    }
+    length += static_cast<size_t>(written) < available ? written : available - 1;
+  }
+  out[length] = '\0';
+  return length;
+}
@@ -0,0 +1,156 @@
+/*
+ BinLog.h - Deferred binary logging headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_BINLOG_BINLOG_H_
+#define LIB_BINLOG_BINLOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#else
+#include <mutex>
+#endif  // ARDUINO
+
+#ifndef BINLOG_CAPACITY
+#define BINLOG_CAPACITY 128  // records
+#endif
+
+#define BINLOG_MAX_ARGS 4
+
+// same values as esp_log_level_t
+typedef enum {
+  BINLOG_LEVEL_NONE = 0,
+  BINLOG_LEVEL_ERROR,
+  BINLOG_LEVEL_WARN,
+  BINLOG_LEVEL_INFO,
+  BINLOG_LEVEL_DEBUG,
+  BINLOG_LEVEL_VERBOSE
+} binlog_level_t;
+
+typedef enum {
+  BINLOG_ARG_INT = 0,
+  BINLOG_ARG_UINT,
+  BINLOG_ARG_FLOAT,
+  BINLOG_ARG_STRING  // pointer to a string that lives forever (literal, registers[] name...)
+} binlog_arg_t;
+
+// entry of the message catalogue, the record id is the index in the catalogue
+typedef struct {
+  uint8_t       tag;
+  uint8_t       level;
+  const char*   format;  // printf-like, plus %b for a 16-bit binary value
+} binlog_message_t;
+
+typedef struct {
+  uint32_t      timestamp_us;
+  uint16_t      id;
+  uint8_t       argc;
+  uint8_t       types;  // binlog_arg_t, 2 bits per argument
+  uintptr_t     args[BINLOG_MAX_ARGS];
+} binlog_record_t;
+
+inline uint8_t binlogEncode(float value, uintptr_t *out) {
+  union { float f; uint32_t u; } bits = { value };
+  *out = bits.u;
+  return BINLOG_ARG_FLOAT;
+}
+
+inline uint8_t binlogEncode(double value, uintptr_t *out) {
+  return binlogEncode(static_cast<float>(value), out);
+}
+
+inline uint8_t binlogEncode(const char *value, uintptr_t *out) {
+  *out = reinterpret_cast<uintptr_t>(value);
+  return BINLOG_ARG_STRING;
+}
+
+template <typename T>
+inline uint8_t binlogEncode(T value, uintptr_t *out) {
+  static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "unsupported binlog argument");
+  if (std::is_signed<T>::value) {
+    *out = static_cast<uint32_t>(static_cast<int32_t>(value));
+    return BINLOG_ARG_INT;
+  }
+  *out = static_cast<uint32_t>(value);
+  return BINLOG_ARG_UINT;
+}
+
+// Logging only copies the message id and its raw arguments into a ring of fixed-size records:
+// no formatting, no allocation. Records are formatted later by the consumer (format()), or
+// dumped as-is (snapshot()) and decoded on a host by tools/binlog_decode.py.
+// The ring is a flight recorder: when full, the oldest record is overwritten.
+class BinLog {
+ public:
+  BinLog(const binlog_message_t *messages, uint16_t message_nb, const char *const *tags, uint8_t tag_nb,
+         uint8_t default_level);
+
+  bool enabled(uint16_t id) const {
+    return id < message_nb_ && messages_[id].level <= levels_[messages_[id].tag];
+  }
+
+  template <typename... Args>
+  void log(uint16_t id, uint32_t timestamp_us, Args... args) {
+    static_assert(sizeof...(Args) <= BINLOG_MAX_ARGS, "too many binlog arguments");
+    if (!enabled(id)) {
+      return;
+    }
+    binlog_record_t record;
+    record.timestamp_us = timestamp_us;
+    record.id = id;
+    record.argc = sizeof...(Args);
+    record.types = 0;
+    uint8_t i = 0;
+    int expand[] = { 0, (record.types |= binlogEncode(args, &record.args[i]) << (2 * i), ++i)... };
+    (void)expand;
+    push(record);
+  }
+
+  bool read(binlog_record_t *record);  // oldest record not read yet
+  size_t format(const binlog_record_t &record, char *out, size_t size) const;
+  size_t snapshot(uint8_t *out, size_t size);  // latest records, read or not, oldest first
+
+  bool setLevel(const char *tag, uint8_t level);  // "*" for every tag
+  uint8_t level(uint8_t tag) const { return levels_[tag]; }
+  const char *tag(uint16_t id) const { return tags_[messages_[id].tag]; }
+  uint8_t messageLevel(uint16_t id) const { return messages_[id].level; }
+  uint32_t overwritten() const { return overwritten_; }
+
+ private:
+  void push(const binlog_record_t &record);
+  void lock();
+  void unlock();
+
+  const binlog_message_t *messages_;
+  uint16_t message_nb_;
+  const char *const *tags_;
+  uint8_t tag_nb_;
+  uint8_t levels_[32];
+  binlog_record_t records_[BINLOG_CAPACITY];
+  uint32_t head_;  // next record to write
+  uint32_t tail_;  // next record to read
+  uint32_t overwritten_;
+#ifdef ARDUINO
+  portMUX_TYPE mux_;
+#else
+  std::mutex mutex_;
+#endif  // ARDUINO
+};
+
+#endif  // LIB_BINLOG_BINLOG_H_
@@ -0,0 +1,212 @@
+/*
+ BusCapture.cpp - Flight recorder of Modbus frames
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "BusCapture.h"
+
+#include <string.h>
+
+static_assert((BUS_CAPTURE_SIZE & (BUS_CAPTURE_SIZE - 1)) == 0, "BUS_CAPTURE_SIZE must be a power of 2");
+
+static const uint8_t MAGIC[4] = { 'M', 'B', 'C', 'P' };
+
+static size_t _writeVarint(uint8_t *out, uint32_t value) {
+  size_t len = 0;
+  while (value >= 0x80) {
+    out[len++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  out[len++] = value;
+  return len;
+}
+
+static void _writeU32(uint8_t *out, uint32_t value) {
+  for (uint8_t i = 0; i < 4; ++i) {
+    out[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+static uint32_t _readU32(const uint8_t *in) {
+  return in[0] | in[1] << 8 | in[2] << 16 | static_cast<uint32_t>(in[3]) << 24;
+}
+
+BusCapture::BusCapture(uint8_t framing)
+  : framing_(framing), enabled_(true), head_(0), tail_(0), first_us_(0), last_us_(0), count_(0), dropped_(0) {
+#ifdef ARDUINO
+  portMUX_INITIALIZE(&mux_);
+#endif  // ARDUINO
+}
+
+void BusCapture::lock() {
+#ifdef ARDUINO
+  portENTER_CRITICAL(&mux_);
+#else
+  mutex_.lock();
+#endif  // ARDUINO
+}
+
+void BusCapture::unlock() {
+#ifdef ARDUINO
+  portEXIT_CRITICAL(&mux_);
+#else
+  mutex_.unlock();
+#endif  // ARDUINO
+}
+
+uint32_t BusCapture::readVarint(uint32_t *position) const {
+  uint32_t value = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    const uint8_t byte = at((*position)++);
+    value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      break;
+    }
+  }
+  return value;
+}
+
+// the delta of the record at position is added to *timestamp_us, the first record of a dump ignores its own
+uint32_t BusCapture::skip(uint32_t position, uint32_t *timestamp_us) const {
+  readVarint(&position);
+  ++position;  // direction
+  const uint32_t len = readVarint(&position);
+  position += len;
+  if (position != head_) {
+    uint32_t next = position;
+    *timestamp_us += readVarint(&next);
+  }
+  return position;
+}
+
+void BusCapture::record(uint8_t direction, const uint8_t *data, size_t len, uint32_t timestamp_us) {
+  if (!enabled_ || len > BUS_CAPTURE_MAX_FRAME) {
+    return;
+  }
+  uint8_t header[12];
+  lock();
+  size_t header_len = _writeVarint(header, count_ == 0 ? 0 : timestamp_us - last_us_);
+  header[header_len++] = direction;
+  header_len += _writeVarint(&header[header_len], len);
+  const size_t needed = header_len + len;
+  while (count_ > 0 && BUS_CAPTURE_SIZE - (head_ - tail_) < needed) {
+    tail_ = skip(tail_, &first_us_);
+    --count_;
+    ++dropped_;
+  }
+  if (count_ == 0) {
+    first_us_ = timestamp_us;
+  }
+  for (size_t i = 0; i < header_len; ++i) {
+    ring_[head_++ % BUS_CAPTURE_SIZE] = header[i];
+  }
+  for (size_t i = 0; i < len; ++i) {
+    ring_[head_++ % BUS_CAPTURE_SIZE] = data[i];
+  }
+  last_us_ = timestamp_us;
+  ++count_;
+  unlock();
+}
+
+size_t BusCapture::snapshot(uint8_t *out, size_t size) {
+  if (size < BUS_CAPTURE_HEADER) {
+    return 0;
+  }
+  lock();
+  uint32_t position = tail_;
+  uint32_t first_us = first_us_;
+  uint32_t count = count_;
+  while (count > 0 && head_ - position > size - BUS_CAPTURE_HEADER) {
+    position = skip(position, &first_us);
+    --count;
+  }
+  const size_t len = head_ - position;
+  for (size_t i = 0; i < len; ++i) {
+    out[BUS_CAPTURE_HEADER + i] = at(position + i);
+  }
+  memcpy(out, MAGIC, sizeof(MAGIC));
+  out[4] = BUS_CAPTURE_VERSION;
+  out[5] = framing_;
+  out[6] = 0;
+  out[7] = 0;
+  _writeU32(&out[8], first_us);
+  _writeU32(&out[12], count);
+  _writeU32(&out[16], dropped_ + count_ - count);
+  unlock();
+  return BUS_CAPTURE_HEADER + len;
+}
+
+void BusCapture::clear() {
+  lock();
+  tail_ = head_;
+  count_ = 0;
+  dropped_ = 0;
+  unlock();
+}
+
+BusCaptureReader::BusCaptureReader(const uint8_t *dump, size_t len)
+  : dump_(dump), len_(len), valid_(false), first_us_(0), records_(0), dropped_(0) {
+  if (len >= BUS_CAPTURE_HEADER && memcmp(dump, MAGIC, sizeof(MAGIC)) == 0 && dump[4] == BUS_CAPTURE_VERSION) {
+    valid_ = true;
+    first_us_ = _readU32(&dump[8]);
+    records_ = _readU32(&dump[12]);
+    dropped_ = _readU32(&dump[16]);
+  }
+  rewind();
+}
+
+void BusCaptureReader::rewind() {
+  position_.offset = BUS_CAPTURE_HEADER;
+  position_.timestamp_us = first_us_;
+  position_.index = 0;
+}
+
+bool BusCaptureReader::readVarint(uint32_t *value) {
+  *value = 0;
+  for (uint8_t shift = 0; shift < 35 && position_.offset < len_; shift += 7) {
+    const uint8_t byte = dump_[position_.offset++];
+    *value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool BusCaptureReader::next(bus_capture_record_t *record) {
+  if (!valid_ || position_.index >= records_) {
+    return false;
+  }
+  const position_t start = position_;
+  uint32_t delta;
+  uint32_t len;
+  if (!readVarint(&delta) || position_.offset >= len_) {
+    position_ = start;
+    return false;
+  }
+  record->direction = dump_[position_.offset++];
+  if (!readVarint(&len) || len > BUS_CAPTURE_MAX_FRAME || len > len_ - position_.offset) {
+    position_ = start;
+    return false;
+  }
+  record->timestamp_us = position_.index == 0 ? first_us_ : position_.timestamp_us + delta;
+  record->len = len;
+  record->data = &dump_[position_.offset];
+  position_.offset += len;
+  position_.timestamp_us = record->timestamp_us;
+  ++position_.index;
+  return true;
+}
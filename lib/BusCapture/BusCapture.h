@@ -0,0 +1,131 @@
+/*
+ BusCapture.h - Flight recorder of Modbus frames headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_BUSCAPTURE_BUSCAPTURE_H_
+#define LIB_BUSCAPTURE_BUSCAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#else
+#include <mutex>
+#endif  // ARDUINO
+
+#ifndef BUS_CAPTURE_SIZE
+#define BUS_CAPTURE_SIZE 8192  // bytes of records
+#endif
+
+#define BUS_CAPTURE_MAX_FRAME 260  // Modbus TCP frame: MBAP header and PDU, RTU frames are shorter
+#define BUS_CAPTURE_HEADER 20
+#define BUS_CAPTURE_VERSION 1
+
+typedef enum {
+  BUS_CAPTURE_TX = 0,  // sent by the master
+  BUS_CAPTURE_RX       // received
+} bus_capture_direction_t;
+
+typedef enum {
+  BUS_CAPTURE_RTU = 0,  // serial line or RTU over TCP
+  BUS_CAPTURE_TCP       // Modbus TCP (MBAP header)
+} bus_capture_framing_t;
+
+typedef struct {
+  uint32_t timestamp_us;
+  uint8_t direction;  // bus_capture_direction_t
+  uint16_t len;
+  const uint8_t *data;  // inside the dump
+} bus_capture_record_t;
+
+// Frames are stored as variable-size records in a byte ring: time since the previous record (varint, in
+// microseconds), direction, length (varint), then the bytes. A 8-byte read request takes 11 bytes. The ring is a
+// flight recorder: when full, the oldest records are dropped.
+//
+// A dump (snapshot()) is a 20-byte header then the records, oldest first. Header, little endian:
+// "MBCP", version, framing (bus_capture_framing_t), 2 reserved bytes, timestamp of the first record,
+// number of records, number of records dropped since the last clear().
+class BusCapture {
+ public:
+  explicit BusCapture(uint8_t framing = BUS_CAPTURE_RTU);
+
+  void record(uint8_t direction, const uint8_t *data, size_t len, uint32_t timestamp_us);
+  size_t snapshot(uint8_t *out, size_t size);  // latest records that fit in size, oldest first
+  void clear();
+
+  void setEnabled(bool enabled) { enabled_ = enabled; }
+  bool enabled() const { return enabled_; }
+  uint32_t records() const { return count_; }
+  uint32_t dropped() const { return dropped_; }
+  size_t used() const { return head_ - tail_; }
+
+ private:
+  uint8_t at(uint32_t position) const { return ring_[position % BUS_CAPTURE_SIZE]; }
+  uint32_t readVarint(uint32_t *position) const;
+  uint32_t skip(uint32_t position, uint32_t *timestamp_us) const;  // returns the position of the next record
+  void lock();
+  void unlock();
+
+  uint8_t framing_;
+  volatile bool enabled_;
+  uint8_t ring_[BUS_CAPTURE_SIZE];
+  uint32_t head_;  // free-running byte positions
+  uint32_t tail_;
+  uint32_t first_us_;  // timestamp of the record at tail_
+  uint32_t last_us_;   // timestamp of the latest record
+  uint32_t count_;
+  uint32_t dropped_;
+#ifdef ARDUINO
+  portMUX_TYPE mux_;
+#else
+  std::mutex mutex_;
+#endif  // ARDUINO
+};
+
+// Walks through a dump, e.g. on the host
+class BusCaptureReader {
+ public:
+  typedef struct {
+    size_t offset;
+    uint32_t timestamp_us;  // of the previous record
+    uint32_t index;
+  } position_t;
+
+  BusCaptureReader(const uint8_t *dump, size_t len);
+  bool valid() const { return valid_; }
+  uint8_t framing() const { return dump_[5]; }
+  uint32_t records() const { return records_; }
+  uint32_t dropped() const { return dropped_; }
+
+  bool next(bus_capture_record_t *record);  // false at the end, or on a truncated record
+  position_t tell() const { return position_; }
+  void seek(const position_t &position) { position_ = position; }
+  void rewind();
+
+ private:
+  bool readVarint(uint32_t *value);
+
+  const uint8_t *dump_;
+  size_t len_;
+  bool valid_;
+  uint32_t first_us_;
+  uint32_t records_;
+  uint32_t dropped_;
+  position_t position_;
+};
+
+#endif  // LIB_BUSCAPTURE_BUSCAPTURE_H_
@@ -0,0 +1,74 @@
+/*
+ CaptureTransport.cpp - Transport recording the frames it carries
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "CaptureTransport.h"
+
+#include <string.h>
+
+CaptureTransport::CaptureTransport(ModbusTransport *transport, BusCapture *capture, uint32_t frame_gap_us)
+  : transport_(transport), capture_(capture), frame_gap_us_(frame_gap_us), rx_len_(0), rx_us_(0), last_rx_us_(0) {
+}
+
+void CaptureTransport::commit() {
+  if (rx_len_ > 0) {
+    capture_->record(BUS_CAPTURE_RX, rx_, rx_len_, rx_us_);
+    rx_len_ = 0;
+  }
+}
+
+bool CaptureTransport::send(const uint8_t *data, size_t len) {
+  commit();
+  capture_->record(BUS_CAPTURE_TX, data, len, transport_->micros());
+  return transport_->send(data, len);
+}
+
+size_t CaptureTransport::receive(uint8_t *buffer, size_t size) {
+  const bool frame_open = transport_->rxFrameOpen();  // the pending record goes on in these bytes
+  const size_t n = transport_->receive(buffer, size);
+  const uint32_t now = transport_->micros();
+  if (rx_len_ > 0 && !frame_open && now - last_rx_us_ >= frame_gap_us_) {
+    commit();  // silence: the pending frame is over
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (rx_len_ == sizeof(rx_)) {
+      commit();  // longer than any frame: split
+    }
+    if (rx_len_ == 0) {
+      rx_us_ = now;
+    }
+    rx_[rx_len_++] = buffer[i];
+  }
+  if (n > 0) {
+    last_rx_us_ = now;
+  }
+  return n;
+}
+
+void CaptureTransport::wait(uint32_t timeout_us) {
+  if (rx_len_ > 0 && !transport_->rxFrameOpen()) {
+    const uint32_t silence_us = transport_->micros() - last_rx_us_;
+    const uint32_t remaining_us = silence_us < frame_gap_us_ ? frame_gap_us_ - silence_us : 0;
+    if (remaining_us < timeout_us) {
+      timeout_us = remaining_us;
+    }
+  }
+  transport_->wait(timeout_us);
+  if (rx_len_ > 0 && !transport_->rxFrameOpen() && transport_->micros() - last_rx_us_ >= frame_gap_us_) {
+    commit();
+  }
+}
@@ -0,0 +1,55 @@
+/*
+ CaptureTransport.h - Transport recording the frames it carries headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_BUSCAPTURE_CAPTURETRANSPORT_H_
+#define LIB_BUSCAPTURE_CAPTURETRANSPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <BusCapture.h>
+#include <ModbusTransport.h>
+
+// Sits between a master (or the sniffer) and the real transport. Every send() is a TX record. Received bytes are
+// gathered into an RX record until a send() or a silence of frame_gap_us (t3.5 on a serial line), so that a
+// record holds a frame rather than whatever the UART driver returned; it is timestamped with its first byte.
+// No silence is counted while the real transport reports the frame open (FIFO threshold chunks).
+class CaptureTransport : public ModbusTransport {
+ public:
+  CaptureTransport(ModbusTransport *transport, BusCapture *capture, uint32_t frame_gap_us);
+
+  bool send(const uint8_t *data, size_t len) override;
+  size_t receive(uint8_t *buffer, size_t size) override;
+  void wait(uint32_t timeout_us) override;  // returns at the end of a frame, to record it
+  void wake() override { transport_->wake(); }
+  uint32_t micros() override { return transport_->micros(); }
+  bool rxFrameOpen() override { return transport_->rxFrameOpen(); }
+
+ private:
+  void commit();
+
+  ModbusTransport *transport_;
+  BusCapture *capture_;
+  uint32_t frame_gap_us_;
+  uint8_t rx_[BUS_CAPTURE_MAX_FRAME];
+  size_t rx_len_;
+  uint32_t rx_us_;       // first byte of the pending RX record
+  uint32_t last_rx_us_;  // last byte
+};
+
+#endif  // LIB_BUSCAPTURE_CAPTURETRANSPORT_H_
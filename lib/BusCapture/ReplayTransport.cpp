@@ -0,0 +1,116 @@
+/*
+ ReplayTransport.cpp - Recorded slave played back to a master
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ReplayTransport.h"
+
+#include <string.h>
+
+static bool _reached(uint32_t now_us, uint32_t due_us) {
+  return static_cast<int32_t>(now_us - due_us) >= 0;
+}
+
+ReplayTransport::ReplayTransport(const uint8_t *dump, size_t len)
+  : reader_(dump, len), tcp_(reader_.valid() && reader_.framing() == BUS_CAPTURE_TCP), now_us_(0), pending_nb_(0),
+    matched_(0), unmatched_(0), passes_(0), recorded_us_(0) {
+}
+
+bool ReplayTransport::lookup(const uint8_t *data, size_t len, bus_capture_record_t *request) {
+  const size_t skipped = tcp_ ? 2 : 0;  // transaction id
+  const BusCaptureReader::position_t start = reader_.tell();
+  const uint32_t passes = passes_;
+  for (uint32_t i = 0; i < reader_.records(); ++i) {
+    if (!reader_.next(request)) {
+      reader_.rewind();
+      ++passes_;
+      if (!reader_.next(request)) {
+        break;
+      }
+    }
+    if (request->direction == BUS_CAPTURE_TX && request->len == len && len >= skipped
+        && memcmp(request->data + skipped, data + skipped, len - skipped) == 0) {
+      return true;
+    }
+  }
+  reader_.seek(start);
+  passes_ = passes;
+  return false;
+}
+
+// the frames received after the request, up to the next request
+void ReplayTransport::schedule(const bus_capture_record_t &request, uint16_t transaction_id) {
+  const BusCaptureReader::position_t after_request = reader_.tell();
+  bus_capture_record_t record;
+  uint16_t offset = 0;
+  while (reader_.next(&record) && record.direction == BUS_CAPTURE_RX && pending_nb_ < REPLAY_MAX_PENDING) {
+    const delivery_t delivery = { now_us_ + (record.timestamp_us - request.timestamp_us), record.data, record.len, 0,
+                                  offset, transaction_id };
+    offset += record.len;
+    size_t i = pending_nb_;
+    while (i > 0 && static_cast<int32_t>(pending_[i - 1].due_us - delivery.due_us) > 0) {
+      pending_[i] = pending_[i - 1];
+      --i;
+    }
+    pending_[i] = delivery;
+    ++pending_nb_;
+  }
+  reader_.seek(after_request);
+}
+
+bool ReplayTransport::send(const uint8_t *data, size_t len) {
+  bus_capture_record_t request;
+  if (!lookup(data, len, &request)) {
+    ++unmatched_;
+    return true;  // lost on the bus
+  }
+  ++matched_;
+  recorded_us_ = request.timestamp_us;
+  schedule(request, tcp_ && len >= 2 ? data[0] << 8 | data[1] : 0);
+  return true;
+}
+
+size_t ReplayTransport::receive(uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (n < size && pending_nb_ > 0 && _reached(now_us_, pending_[0].due_us)) {
+    delivery_t *delivery = &pending_[0];
+    const size_t left = delivery->len - delivery->sent;
+    const size_t chunk = left < size - n ? left : size - n;
+    memcpy(&buffer[n], &delivery->data[delivery->sent], chunk);
+    for (size_t i = 0; tcp_ && i < chunk; ++i) {
+      const size_t position = delivery->offset + delivery->sent + i;  // in the answer
+      if (position < 2) {
+        buffer[n + i] = delivery->transaction_id >> (position == 0 ? 8 : 0);
+      }
+    }
+    delivery->sent += chunk;
+    n += chunk;
+    if (delivery->sent == delivery->len) {
+      memmove(&pending_[0], &pending_[1], (pending_nb_ - 1) * sizeof(delivery_t));
+      --pending_nb_;
+    }
+  }
+  return n;
+}
+
+void ReplayTransport::wait(uint32_t timeout_us) {
+  if (pending_nb_ > 0) {
+    const uint32_t until_us = _reached(now_us_, pending_[0].due_us) ? 0 : pending_[0].due_us - now_us_;
+    now_us_ += until_us < timeout_us ? until_us : timeout_us;
+  } else if (timeout_us != UINT32_MAX) {
+    now_us_ += timeout_us;
+  }
+}
@@ -0,0 +1,79 @@
+/*
+ ReplayTransport.h - Recorded slave played back to a master headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_BUSCAPTURE_REPLAYTRANSPORT_H_
+#define LIB_BUSCAPTURE_REPLAYTRANSPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <BusCapture.h>
+#include <ModbusTransport.h>
+
+// answers scheduled and not delivered yet
+#ifndef REPLAY_MAX_PENDING
+#define REPLAY_MAX_PENDING 16
+#endif
+
+// Plays a capture back to a master, on a simulated clock: wait() returns at once, moving the clock to the next
+// answer or to the time-out. Each request sent is looked up among the recorded ones (the next one with the same
+// bytes, from the previous match on, wrapping around at the end of the capture) and the frames received after it
+// are delivered with the same delays, corrupted or late ones included. A request that was never recorded gets no
+// answer. With Modbus TCP framing, transaction ids are ignored by the lookup and rewritten in the answers; answers
+// recorded while several requests were in flight go to the last one sent.
+class ReplayTransport : public ModbusTransport {
+ public:
+  ReplayTransport(const uint8_t *dump, size_t len);
+  bool valid() const { return reader_.valid(); }
+
+  bool send(const uint8_t *data, size_t len) override;
+  size_t receive(uint8_t *buffer, size_t size) override;
+  void wait(uint32_t timeout_us) override;
+  void wake() override {}
+  uint32_t micros() override { return now_us_; }
+
+  uint32_t matched() const { return matched_; }
+  uint32_t unmatched() const { return unmatched_; }
+  uint32_t passes() const { return passes_; }  // times the lookup reached the end of the capture
+  uint32_t recordedTimeUs() const { return recorded_us_; }  // capture time of the last request matched
+
+ private:
+  typedef struct {
+    uint32_t due_us;
+    const uint8_t *data;  // inside the dump
+    uint16_t len;
+    uint16_t sent;
+    uint16_t offset;  // of the record in the frames received after the request
+    uint16_t transaction_id;
+  } delivery_t;
+
+  bool lookup(const uint8_t *data, size_t len, bus_capture_record_t *request);
+  void schedule(const bus_capture_record_t &request, uint16_t transaction_id);
+
+  BusCaptureReader reader_;
+  bool tcp_;
+  uint32_t now_us_;
+  delivery_t pending_[REPLAY_MAX_PENDING];  // by due time
+  size_t pending_nb_;
+  uint32_t matched_;
+  uint32_t unmatched_;
+  uint32_t passes_;
+  uint32_t recorded_us_;
+};
+
+#endif  // LIB_BUSCAPTURE_REPLAYTRANSPORT_H_
@@ -0,0 +1,344 @@
+/*
+ Deflate.cpp - Small-window zlib compression with a preset dictionary
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Deflate.h"
+
+#include <string.h>
+
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_END_OF_BLOCK 256
+
+// RFC 1951 3.2.5: length codes 257 to 285 and distance codes 0 to 29
+static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                                          67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5,
+                                          5, 5, 5, 0 };
+static const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+                                            513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10,
+                                            10, 11, 11, 12, 12, 13, 13 };
+
+uint32_t adler32(const uint8_t *data, size_t len, uint32_t adler) {
+  uint32_t a = adler & 0xFFFF;
+  uint32_t b = adler >> 16;
+  while (len > 0) {
+    const size_t block = len < 5552 ? len : 5552;  // largest block without overflow before the modulo
+    for (size_t i = 0; i < block; ++i) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    data += block;
+    len -= block;
+  }
+  return b << 16 | a;
+}
+
+DeflateCompressor::DeflateCompressor()
+  : dictionary_(nullptr), dictionary_len_(0), dictionary_id_(0), in_(nullptr), out_(nullptr), size_(0), written_(0),
+    bit_buffer_(0), bit_count_(0), overflow_(false) {
+}
+
+void DeflateCompressor::setDictionary(const uint8_t *dictionary, size_t len) {
+  if (len > DEFLATE_WINDOW_SIZE) {
+    dictionary += len - DEFLATE_WINDOW_SIZE;  // out of reach anyway
+    len = DEFLATE_WINDOW_SIZE;
+  }
+  dictionary_ = len > 0 ? dictionary : nullptr;
+  dictionary_len_ = len;
+  dictionary_id_ = len > 0 ? adler32(dictionary, len) : 0;
+}
+
+uint16_t DeflateCompressor::hash(uint32_t position) const {
+  const uint32_t key = at(position) << 16 | at(position + 1) << 8 | at(position + 2);
+  return (key * 2654435761U) >> (32 - DEFLATE_HASH_BITS);
+}
+
+void DeflateCompressor::insert(uint32_t position) {
+  const uint16_t h = hash(position);
+  prev_[position & (DEFLATE_WINDOW_SIZE - 1)] = head_[h];
+  head_[h] = position + 1;
+}
+
+uint16_t DeflateCompressor::longestMatch(uint32_t position, uint32_t end, uint16_t *distance_ptr) const {
+  const uint32_t max_len = end - position < DEFLATE_MAX_MATCH ? end - position : DEFLATE_MAX_MATCH;
+  uint16_t best_len = 0;
+  uint32_t candidate = head_[hash(position)];
+  for (uint16_t chain = 0; candidate > 0 && chain < DEFLATE_MAX_CHAIN; ++chain) {
+    const uint32_t match = candidate - 1;
+    if (match >= position || position - match > DEFLATE_WINDOW_SIZE) {
+      break;  // slot reused by a newer position, or out of the window
+    }
+    uint16_t len = 0;
+    while (len < max_len && at(match + len) == at(position + len)) {
+      ++len;
+    }
+    if (len > best_len) {
+      best_len = len;
+      *distance_ptr = position - match;
+      if (len == max_len) {
+        break;
+      }
+    }
+    candidate = prev_[match & (DEFLATE_WINDOW_SIZE - 1)];
+  }
+  return best_len;
+}
+
+void DeflateCompressor::writeBits(uint32_t value, uint8_t bits) {
+  bit_buffer_ |= value << bit_count_;
+  bit_count_ += bits;
+  while (bit_count_ >= 8) {
+    if (written_ < size_) {
+      out_[written_++] = bit_buffer_;
+    } else {
+      overflow_ = true;
+    }
+    bit_buffer_ >>= 8;
+    bit_count_ -= 8;
+  }
+}
+
+void DeflateCompressor::writeCode(uint16_t code, uint8_t bits) {
+  uint16_t reversed = 0;
+  for (uint8_t i = 0; i < bits; ++i) {
+    reversed = reversed << 1 | ((code >> i) & 1);
+  }
+  writeBits(reversed, bits);
+}
+
+// RFC 1951 3.2.6: fixed literal/length codes
+void DeflateCompressor::writeLiteral(uint16_t literal) {
+  if (literal < 144) {
+    writeCode(0x30 + literal, 8);
+  } else if (literal < 256) {
+    writeCode(0x190 + literal - 144, 9);
+  } else if (literal < 280) {
+    writeCode(literal - 256, 7);
+  } else {
+    writeCode(0xC0 + literal - 280, 8);
+  }
+}
+
+void DeflateCompressor::writeMatch(uint16_t length, uint16_t distance) {
+  uint8_t code = 28;
+  while (LENGTH_BASE[code] > length) {
+    --code;
+  }
+  writeLiteral(257 + code);
+  writeBits(length - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+  code = 29;
+  while (DISTANCE_BASE[code] > distance) {
+    --code;
+  }
+  writeCode(code, 5);
+  writeBits(distance - DISTANCE_BASE[code], DISTANCE_EXTRA[code]);
+}
+
+size_t DeflateCompressor::compress(const uint8_t *in, size_t len, uint8_t *out, size_t size) {
+  if (dictionary_len_ + len > DEFLATE_MAX_INPUT) {
+    return 0;
+  }
+  in_ = in;
+  out_ = out;
+  size_ = size;
+  written_ = 0;
+  bit_buffer_ = 0;
+  bit_count_ = 0;
+  overflow_ = false;
+  memset(head_, 0, sizeof(head_));
+
+  // header: deflate with the window size, FDICT and the check bits, then the dictionary id
+  const uint8_t cmf = (DEFLATE_WINDOW_BITS - 8) << 4 | 8;
+  uint8_t flg = dictionary_len_ > 0 ? 0x20 : 0;
+  flg += (31 - (cmf << 8 | flg) % 31) % 31;
+  writeBits(cmf, 8);
+  writeBits(flg, 8);
+  if (dictionary_len_ > 0) {
+    for (int8_t shift = 24; shift >= 0; shift -= 8) {
+      writeBits((dictionary_id_ >> shift) & 0xFF, 8);
+    }
+  }
+
+  writeBits(1, 1);  // last block
+  writeBits(1, 2);  // fixed Huffman codes
+  const uint32_t end = dictionary_len_ + len;
+  for (uint32_t position = 0; position < dictionary_len_ && position + DEFLATE_MIN_MATCH <= end; ++position) {
+    insert(position);
+  }
+  uint32_t position = dictionary_len_;
+  while (position < end && !overflow_) {
+    uint16_t distance = 0;
+    const uint16_t match_len = end - position >= DEFLATE_MIN_MATCH ? longestMatch(position, end, &distance) : 0;
+    if (match_len >= DEFLATE_MIN_MATCH) {
+      writeMatch(match_len, distance);
+      const uint32_t match_end = position + match_len;
+      for (; position < match_end; ++position) {
+        if (position + DEFLATE_MIN_MATCH <= end) {
+          insert(position);
+        }
+      }
+    } else {
+      writeLiteral(at(position));
+      if (position + DEFLATE_MIN_MATCH <= end) {
+        insert(position);
+      }
+      ++position;
+    }
+  }
+  writeLiteral(DEFLATE_END_OF_BLOCK);
+  writeBits(0, (8 - bit_count_) & 7);  // pads the last byte
+
+  const uint32_t checksum = adler32(in, len);
+  for (int8_t shift = 24; shift >= 0; shift -= 8) {
+    writeBits((checksum >> shift) & 0xFF, 8);
+  }
+  return overflow_ ? 0 : written_;
+}
+
+namespace {
+
+// LSB-first bit reader over a buffer, bits past the end read as errors
+class BitReader {
+ public:
+  BitReader(const uint8_t *data, size_t len) : data_(data), len_(len), position_(0), error_(false) {}
+  uint32_t bits(uint8_t count) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < count; ++i, ++position_) {
+      if (position_ >= len_ * 8) {
+        error_ = true;
+        return 0;
+      }
+      value |= ((data_[position_ >> 3] >> (position_ & 7)) & 1U) << i;
+    }
+    return value;
+  }
+  uint32_t code(uint8_t count) {  // most significant bit first
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < count; ++i) {
+      value = value << 1 | bits(1);
+    }
+    return value;
+  }
+  void alignToByte() { position_ = (position_ + 7) & ~static_cast<size_t>(7); }
+  size_t byteOffset() const { return position_ >> 3; }
+  void skipBytes(size_t count) { position_ += count * 8; }
+  bool error() const { return error_; }
+
+ private:
+  const uint8_t *data_;
+  size_t len_;
+  size_t position_;
+  bool error_;
+};
+
+int16_t _readFixedLiteral(BitReader *reader) {
+  uint32_t code = reader->code(7);
+  if (code <= 0x17) {
+    return 256 + code;
+  }
+  code = code << 1 | reader->code(1);
+  if (code >= 0x30 && code <= 0xBF) {
+    return code - 0x30;
+  }
+  if (code >= 0xC0 && code <= 0xC7) {
+    return 280 + code - 0xC0;
+  }
+  code = code << 1 | reader->code(1);
+  return code >= 0x190 && code <= 0x1FF ? 144 + code - 0x190 : -1;
+}
+
+}  // namespace
+
+size_t zlibInflate(const uint8_t *in, size_t len, const uint8_t *dictionary, size_t dictionary_len, uint8_t *out,
+    size_t size) {
+  if (len < 6 || (in[0] & 0x0F) != 8 || (in[0] << 8 | in[1]) % 31 != 0) {
+    return 0;
+  }
+  size_t offset = 2;
+  if (in[1] & 0x20) {
+    const uint32_t id = static_cast<uint32_t>(in[2]) << 24 | in[3] << 16 | in[4] << 8 | in[5];
+    if (dictionary == nullptr || len < 10 || adler32(dictionary, dictionary_len) != id) {
+      return 0;
+    }
+    offset = 6;
+  } else {
+    dictionary_len = 0;
+  }
+  BitReader reader(in + offset, len - offset);
+  size_t n = 0;
+  bool last = false;
+  while (!last) {
+    last = reader.bits(1);
+    const uint32_t type = reader.bits(2);
+    if (type == 0) {  // stored
+      reader.alignToByte();
+      const uint32_t block_len = reader.bits(16);
+      if ((reader.bits(16) ^ 0xFFFF) != block_len || reader.byteOffset() + block_len > len - offset
+          || n + block_len > size) {
+        return 0;
+      }
+      memcpy(&out[n], in + offset + reader.byteOffset(), block_len);
+      reader.skipBytes(block_len);
+      n += block_len;
+      continue;
+    }
+    if (type != 1) {
+      return 0;  // dynamic Huffman codes, not written by DeflateCompressor
+    }
+    for (;;) {
+      const int16_t symbol = _readFixedLiteral(&reader);
+      if (symbol < 0 || symbol > 285 || reader.error()) {
+        return 0;
+      }
+      if (symbol < 256) {
+        if (n == size) {
+          return 0;
+        }
+        out[n++] = symbol;
+        continue;
+      }
+      if (symbol == DEFLATE_END_OF_BLOCK) {
+        break;
+      }
+      const uint8_t length_code = symbol - 257;
+      const size_t length = LENGTH_BASE[length_code] + reader.bits(LENGTH_EXTRA[length_code]);
+      const uint32_t distance_code = reader.code(5);
+      if (distance_code >= 30) {
+        return 0;
+      }
+      const size_t distance = DISTANCE_BASE[distance_code] + reader.bits(DISTANCE_EXTRA[distance_code]);
+      if (reader.error() || distance > n + dictionary_len || n + length > size) {
+        return 0;
+      }
+      for (size_t i = 0; i < length; ++i, ++n) {
+        out[n] = n >= distance ? out[n - distance] : dictionary[dictionary_len - (distance - n)];
+      }
+    }
+  }
+  reader.alignToByte();
+  const size_t trailer = offset + reader.byteOffset();
+  if (reader.error() || trailer + 4 > len) {
+    return 0;
+  }
+  const uint32_t checksum = static_cast<uint32_t>(in[trailer]) << 24 | in[trailer + 1] << 16 | in[trailer + 2] << 8
+                            | in[trailer + 3];
+  return adler32(out, n) == checksum ? n : 0;
+}
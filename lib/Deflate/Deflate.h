@@ -0,0 +1,90 @@
+/*
+ Deflate.h - Small-window zlib compression with a preset dictionary headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_DEFLATE_DEFLATE_H_
+#define LIB_DEFLATE_DEFLATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// largest match distance: 2^DEFLATE_WINDOW_BITS bytes, 8 to 15
+#ifndef DEFLATE_WINDOW_BITS
+#define DEFLATE_WINDOW_BITS 11
+#endif
+#ifndef DEFLATE_HASH_BITS
+#define DEFLATE_HASH_BITS 9
+#endif
+// candidates tried for each match, more compress better and slower
+#ifndef DEFLATE_MAX_CHAIN
+#define DEFLATE_MAX_CHAIN 16
+#endif
+
+static_assert(DEFLATE_WINDOW_BITS >= 8 && DEFLATE_WINDOW_BITS <= 15, "DEFLATE_WINDOW_BITS must be within 8 and 15");
+
+#define DEFLATE_WINDOW_SIZE (1U << DEFLATE_WINDOW_BITS)
+#define DEFLATE_MAX_INPUT 65000  // dictionary and input: positions are 16-bit
+
+uint32_t adler32(const uint8_t *data, size_t len, uint32_t adler = 1);
+
+// Compresses a whole buffer into a zlib stream (RFC 1950) of a single deflate block with the fixed Huffman codes
+// (RFC 1951): greedy LZ77 over hash chains, no allocation. RAM is the two tables below, 4.5 KB with the defaults.
+// With a preset dictionary (FDICT), matches reach back into the dictionary from the first byte of the input: short
+// messages made of the same keys compress as well as long ones. Any zlib decodes the stream given the same
+// dictionary, e.g. zlib.decompressobj(zdict=dictionary) in Python; its adler32 is the id in the stream header.
+class DeflateCompressor {
+ public:
+  DeflateCompressor();
+
+  // only the last DEFLATE_WINDOW_SIZE bytes can be referenced, the most frequent strings should come last
+  void setDictionary(const uint8_t *dictionary, size_t len);
+  uint32_t dictionaryId() const { return dictionary_id_; }
+  // Returns the length of the stream, 0 when it does not fit in size (e.g. for data that does not compress)
+  size_t compress(const uint8_t *in, size_t len, uint8_t *out, size_t size);
+
+ private:
+  uint8_t at(uint32_t position) const {
+    return position < dictionary_len_ ? dictionary_[position] : in_[position - dictionary_len_];
+  }
+  uint16_t hash(uint32_t position) const;
+  void insert(uint32_t position);
+  uint16_t longestMatch(uint32_t position, uint32_t end, uint16_t *distance_ptr) const;
+  void writeBits(uint32_t value, uint8_t bits);
+  void writeCode(uint16_t code, uint8_t bits);  // Huffman codes go most significant bit first
+  void writeLiteral(uint16_t literal);
+  void writeMatch(uint16_t length, uint16_t distance);
+
+  const uint8_t *dictionary_;
+  size_t dictionary_len_;
+  uint32_t dictionary_id_;
+  const uint8_t *in_;
+  uint8_t *out_;
+  size_t size_;
+  size_t written_;
+  uint32_t bit_buffer_;
+  uint8_t bit_count_;
+  bool overflow_;
+  uint16_t head_[1 << DEFLATE_HASH_BITS];  // latest position + 1 of each hash, 0 for none
+  uint16_t prev_[DEFLATE_WINDOW_SIZE];    // previous position + 1 with the same hash
+};
+
+// Decompresses a zlib stream made of stored or fixed Huffman blocks, as written by DeflateCompressor (dynamic
+// Huffman blocks are rejected): for tests and host tools. Returns the length of the data, 0 on error.
+size_t zlibInflate(const uint8_t *in, size_t len, const uint8_t *dictionary, size_t dictionary_len, uint8_t *out,
+  size_t size);
+
+#endif  // LIB_DEFLATE_DEFLATE_H_
@@ -0,0 +1,86 @@
+/*
+ DerivedFields.cpp - Fields computed from several registers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "DerivedFields.h"
+
+DerivedFields::DerivedFields(const derived_field_t *fields, uint8_t count)
+  : fields_(fields), count_(count < DERIVED_MAX_FIELDS ? count : DERIVED_MAX_FIELDS) {
+  for (uint8_t i = 0; i < DERIVED_MAX_FIELDS; ++i) {
+    previous_[i].valid = false;
+  }
+}
+
+bool DerivedFields::combine(const derived_field_t &field, derived_source_t source, void *source_context,
+    double *value_ptr) const {
+  uint16_t raw[DERIVED_MAX_OPERANDS];
+  if (field.count == 0 || field.count > DERIVED_MAX_OPERANDS
+      || ((field.op == DERIVED_OP_WORDS || field.op == DERIVED_OP_COMBINE) && field.count != 2)) {
+    return false;
+  }
+  for (uint8_t i = 0; i < field.count; ++i) {
+    if (!source(field.registers[i], &raw[i], source_context)) {
+      return false;
+    }
+  }
+  switch (field.op) {
+    case DERIVED_OP_WORDS:
+      *value_ptr = static_cast<uint32_t>(raw[0]) << 16 | raw[1];
+      return true;
+    case DERIVED_OP_COMBINE:
+      *value_ptr = raw[0] * field.factor + raw[1];
+      return true;
+    case DERIVED_OP_SUM:
+      *value_ptr = 0;
+      for (uint8_t i = 0; i < field.count; ++i) {
+        *value_ptr += raw[i];
+      }
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint8_t DerivedFields::evaluate(derived_source_t source, void *source_context, uint32_t now_ms,
+    uint16_t first_field_id, modbus_field_callback_t callback, void *context) {
+  uint8_t values = 0;
+  for (uint8_t i = 0; i < count_; ++i) {
+    const derived_field_t &field = fields_[i];
+    previous_t *previous = &previous_[i];
+    double value;
+    if (!combine(field, source, source_context, &value)) {
+      previous->valid = false;  // a rate over a missed scan would be averaged over two periods
+      continue;
+    }
+    value = value * field.scale + field.offset;
+    if (field.rate_s > 0) {
+      const bool has_previous = previous->valid && now_ms != previous->ms;
+      const double change = value - previous->value;
+      const uint32_t elapsed_ms = now_ms - previous->ms;
+      previous->value = value;
+      previous->ms = now_ms;
+      previous->valid = true;
+      if (!has_previous) {
+        continue;
+      }
+      value = change * field.rate_s * 1000.0 / elapsed_ms;
+    }
+    callback(first_field_id + i, field.name, value, context);
+    ++values;
+  }
+  return values;
+}
@@ -0,0 +1,80 @@
+/*
+ DerivedFields.h - Fields computed from several registers headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_DERIVEDFIELDS_DERIVEDFIELDS_H_
+#define LIB_DERIVEDFIELDS_DERIVEDFIELDS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <RegisterMap.h>
+
+#ifndef DERIVED_MAX_FIELDS
+#define DERIVED_MAX_FIELDS 16
+#endif
+
+#define DERIVED_MAX_OPERANDS 4
+
+typedef enum {
+  DERIVED_OP_WORDS = 0,  // registers[0] << 16 | registers[1]: 32-bit value, high word first
+  DERIVED_OP_COMBINE,    // registers[0] * factor + registers[1]: counter split in two ranges
+  DERIVED_OP_SUM,        // registers[0] + ... + registers[count - 1]
+} derived_op_t;
+
+// The value is then scaled (value * scale + offset) and, when rate_s is not 0, replaced by its change over rate_s
+// seconds between two scans (e.g. 3600 for a rate per hour).
+typedef struct {
+  const char *name;
+  derived_op_t op;
+  uint8_t count;
+  uint16_t registers[DERIVED_MAX_OPERANDS];
+  double factor;
+  double scale;  // in double like the value: a float 0.1 would add noise to exact counters
+  double offset;
+  uint32_t rate_s;
+} derived_field_t;
+
+// Raw value of a register read by the current scan, false if it is not available
+typedef bool (*derived_source_t)(uint16_t register_id, uint16_t *value_ptr, void *context);
+
+// Evaluates a static table of derived fields over the register image, after decoding. A field is skipped when one
+// of its registers is not available; a rate needs two consecutive scans with all of them.
+class DerivedFields {
+ public:
+  DerivedFields(const derived_field_t *fields, uint8_t count);  // fields beyond DERIVED_MAX_FIELDS are ignored
+
+  uint8_t size() const { return count_; }
+  // Calls callback with field ids first_field_id + index in the table, returns the number of values
+  uint8_t evaluate(derived_source_t source, void *source_context, uint32_t now_ms, uint16_t first_field_id,
+    modbus_field_callback_t callback, void *context);
+
+ private:
+  typedef struct {
+    double value;  // before rate, a 32-bit counter does not fit in a float
+    uint32_t ms;
+    bool valid;
+  } previous_t;
+
+  bool combine(const derived_field_t &field, derived_source_t source, void *source_context, double *value_ptr) const;
+
+  const derived_field_t *fields_;
+  uint8_t count_;
+  previous_t previous_[DERIVED_MAX_FIELDS];
+};
+
+#endif  // LIB_DERIVEDFIELDS_DERIVEDFIELDS_H_
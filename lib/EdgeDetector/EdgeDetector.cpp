@@ -0,0 +1,112 @@
+/*
+ EdgeDetector.cpp - Bit transitions of sampled bitfield registers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "EdgeDetector.h"
+
+#include <string.h>
+
+EdgeDetector::EdgeDetector() : count_(0), events_(0) {
+  memset(states_, 0, sizeof(states_));
+}
+
+bool EdgeDetector::addRegister(uint16_t register_id) {
+  if (count_ == EDGE_DETECTOR_MAX_REGISTERS || find(register_id) != nullptr) {
+    return false;
+  }
+  states_[count_++].id = register_id;
+  return true;
+}
+
+EdgeDetector::register_state_t *EdgeDetector::find(uint16_t register_id) {
+  for (uint8_t i = 0; i < count_; ++i) {
+    if (states_[i].id == register_id) {
+      return &states_[i];
+    }
+  }
+  return nullptr;
+}
+
+const EdgeDetector::register_state_t *EdgeDetector::find(uint16_t register_id) const {
+  return const_cast<EdgeDetector *>(this)->find(register_id);
+}
+
+int8_t EdgeDetector::update(uint16_t register_id, uint16_t value, uint32_t now_ms, edge_callback_t callback,
+    void *context) {
+  register_state_t *state = find(register_id);
+  if (state == nullptr) {
+    return -1;
+  }
+  if (!state->valid) {
+    for (uint16_t set = value; set != 0; set &= set - 1) {
+      state->rose_ms[__builtin_ctz(set)] = now_ms;
+    }
+    state->value = value;
+    state->valid = true;
+    return 0;
+  }
+
+  int8_t transitions = 0;
+  for (uint16_t changed = state->value ^ value; changed != 0; changed &= changed - 1) {
+    const uint8_t bit = __builtin_ctz(changed);
+    edge_event_t event = { now_ms, register_id, bit, static_cast<uint8_t>(value >> bit & 1), 0 };
+    if (event.state) {
+      state->rose_ms[bit] = now_ms;
+      ++state->rises[bit];
+    } else {
+      event.on_ms = now_ms - state->rose_ms[bit];
+      state->on_ms[bit] += event.on_ms;
+    }
+    ++transitions;
+    ++events_;
+    if (callback != nullptr) {
+      callback(event, context);
+    }
+  }
+  state->value = value;
+  return transitions;
+}
+
+void EdgeDetector::invalidate(uint16_t register_id, uint32_t now_ms) {
+  register_state_t *state = find(register_id);
+  if (state == nullptr || !state->valid) {
+    return;
+  }
+  // the ON periods in progress are accounted until now, the next sample restarts them
+  for (uint16_t set = state->value; set != 0; set &= set - 1) {
+    const uint8_t bit = __builtin_ctz(set);
+    state->on_ms[bit] += now_ms - state->rose_ms[bit];
+  }
+  state->valid = false;
+}
+
+uint64_t EdgeDetector::onTimeMs(uint16_t register_id, uint8_t bit, uint32_t now_ms) const {
+  const register_state_t *state = find(register_id);
+  if (state == nullptr || bit >= 16) {
+    return 0;
+  }
+  uint64_t on_ms = state->on_ms[bit];
+  if (state->valid && (state->value >> bit & 1)) {
+    on_ms += now_ms - state->rose_ms[bit];
+  }
+  return on_ms;
+}
+
+uint32_t EdgeDetector::rises(uint16_t register_id, uint8_t bit) const {
+  const register_state_t *state = find(register_id);
+  return state == nullptr || bit >= 16 ? 0 : state->rises[bit];
+}
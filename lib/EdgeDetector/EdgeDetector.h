@@ -0,0 +1,77 @@
+/*
+ EdgeDetector.h - Bit transitions of sampled bitfield registers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_EDGEDETECTOR_EDGEDETECTOR_H_
+#define LIB_EDGEDETECTOR_EDGEDETECTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef EDGE_DETECTOR_MAX_REGISTERS
+#define EDGE_DETECTOR_MAX_REGISTERS 4
+#endif
+
+typedef struct {
+  uint32_t timestamp_ms;
+  uint16_t register_id;
+  uint8_t bit;
+  uint8_t state;  // new state, the old one is its complement
+  uint32_t on_ms;  // length of the ON period ending with a falling edge, otherwise 0
+} edge_event_t;
+
+typedef void (*edge_callback_t)(const edge_event_t &event, void *context);
+
+// Compares each sample of a register with the previous one (one XOR finds all the changed bits) and
+// keeps, per bit, the number of rising edges and the cumulative ON time. The first sample of a register
+// is the reference: it starts the ON periods of the bits already set but raises no event.
+class EdgeDetector {
+ public:
+  EdgeDetector();
+
+  bool addRegister(uint16_t register_id);
+  uint8_t registers() const { return count_; }
+  uint16_t registerId(uint8_t index) const { return states_[index].id; }
+
+  // Returns the number of transitions, or -1 when register_id is not tracked
+  int8_t update(uint16_t register_id, uint16_t value, uint32_t now_ms, edge_callback_t callback, void *context);
+  // Forgets the previous sample (e.g. after a read failure): the next one is a new reference
+  void invalidate(uint16_t register_id, uint32_t now_ms);
+
+  uint64_t onTimeMs(uint16_t register_id, uint8_t bit, uint32_t now_ms) const;  // including the current period
+  uint32_t rises(uint16_t register_id, uint8_t bit) const;
+  uint32_t events() const { return events_; }
+
+ private:
+  typedef struct {
+    uint16_t id;
+    uint16_t value;
+    bool valid;
+    uint32_t rose_ms[16];  // start of the current ON period
+    uint64_t on_ms[16];  // completed ON periods
+    uint32_t rises[16];
+  } register_state_t;
+
+  register_state_t *find(uint16_t register_id);
+  const register_state_t *find(uint16_t register_id) const;
+
+  register_state_t states_[EDGE_DETECTOR_MAX_REGISTERS];
+  uint8_t count_;
+  uint32_t events_;
+};
+
+#endif  // LIB_EDGEDETECTOR_EDGEDETECTOR_H_
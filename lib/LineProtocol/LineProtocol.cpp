@@ -0,0 +1,177 @@
+/*
+ LineProtocol.cpp - InfluxDB line protocol writer
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "LineProtocol.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *MEASUREMENT_SPECIAL = ", ";
+static const char *KEY_SPECIAL = ",= ";  // tag keys, tag values and field keys
+
+LineProtocolWriter::LineProtocolWriter(char *buffer, size_t size)
+    : buffer_(buffer), size_(size), dropped_(0), tags_() {
+  clear();
+}
+
+void LineProtocolWriter::clear() {
+  length_ = 0;
+  line_start_ = 0;
+  lines_ = 0;
+  in_line_ = false;
+  line_failed_ = false;
+  if (size_ > 0) {
+    buffer_[0] = '\0';
+  }
+}
+
+void LineProtocolWriter::setTag(uint8_t index, const char *key, const char *value) {
+  if (index < sizeof(tags_) / sizeof(tags_[0])) {
+    tags_[index][0] = key;
+    tags_[index][1] = value;
+  }
+}
+
+bool LineProtocolWriter::append(const char *text, size_t length) {
+  if (length_ + length + 1 > size_) {  // keeps room for the terminating null
+    return false;
+  }
+  memcpy(buffer_ + length_, text, length);
+  length_ += length;
+  buffer_[length_] = '\0';
+  return true;
+}
+
+bool LineProtocolWriter::appendEscaped(const char *text, size_t length, const char *special) {
+  for (size_t i = 0; i < length && text[i] != '\0'; ++i) {
+    if (strchr(special, text[i]) != nullptr && !append("\\", 1)) {
+      return false;
+    }
+    if (!append(&text[i], 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void LineProtocolWriter::abortLine() {
+  if (!line_failed_) {
+    ++dropped_;
+  }
+  line_failed_ = true;
+  length_ = line_start_;
+  if (size_ > 0) {
+    buffer_[length_] = '\0';
+  }
+}
+
+bool LineProtocolWriter::beginLine(const char *measurement, size_t length) {
+  if (in_line_) {
+    abortLine();  // previous line never ended
+  }
+  in_line_ = true;
+  line_failed_ = false;
+  line_fields_ = 0;
+  line_start_ = length_;
+  if (lines_ > 0 && !append("\n", 1)) {
+    abortLine();
+    return false;
+  }
+  if (!appendEscaped(measurement, length, MEASUREMENT_SPECIAL)) {
+    abortLine();
+    return false;
+  }
+  for (uint8_t i = 0; i < sizeof(tags_) / sizeof(tags_[0]); ++i) {
+    if (tags_[i][0] == nullptr || tags_[i][1] == nullptr || tags_[i][1][0] == '\0') {
+      continue;
+    }
+    if (!append(",", 1) || !appendEscaped(tags_[i][0], SIZE_MAX, KEY_SPECIAL) || !append("=", 1)
+        || !appendEscaped(tags_[i][1], SIZE_MAX, KEY_SPECIAL)) {
+      abortLine();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool LineProtocolWriter::beginField(const char *key) {
+  if (!in_line_ || line_failed_) {
+    return false;
+  }
+  if (!append(line_fields_ == 0 ? " " : ",", 1) || !appendEscaped(key, SIZE_MAX, KEY_SPECIAL) || !append("=", 1)) {
+    abortLine();
+    return false;
+  }
+  ++line_fields_;
+  return true;
+}
+
+bool LineProtocolWriter::addField(const char *key, double value) {
+  if (isnan(value) || isinf(value)) {
+    return false;  // not representable, the field is skipped
+  }
+  if (!beginField(key)) {
+    return false;
+  }
+  char text[24];
+  const int n = snprintf(text, sizeof(text), "%.15g", value);  // a 32-bit counter needs 10 digits
+  if (!append(text, n)) {
+    abortLine();
+    return false;
+  }
+  return true;
+}
+
+bool LineProtocolWriter::addField(const char *key, int32_t value) {
+  if (!beginField(key)) {
+    return false;
+  }
+  char text[16];
+  const int n = snprintf(text, sizeof(text), "%ldi", static_cast<long>(value));
+  if (!append(text, n)) {
+    abortLine();
+    return false;
+  }
+  return true;
+}
+
+bool LineProtocolWriter::endLine(uint64_t timestamp_ns) {
+  if (!in_line_) {
+    return false;
+  }
+  in_line_ = false;
+  if (line_failed_) {
+    return false;
+  }
+  if (line_fields_ == 0) {  // a point needs at least one field
+    length_ = line_start_;
+    buffer_[length_] = '\0';
+    return false;
+  }
+  if (timestamp_ns != 0) {
+    char text[24];
+    const int n = snprintf(text, sizeof(text), " %llu", static_cast<unsigned long long>(timestamp_ns));
+    if (!append(text, n)) {
+      abortLine();
+      return false;
+    }
+  }
+  ++lines_;
+  return true;
+}
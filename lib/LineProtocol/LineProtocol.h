@@ -0,0 +1,64 @@
+/*
+ LineProtocol.h - InfluxDB line protocol writer headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_LINEPROTOCOL_LINEPROTOCOL_H_
+#define LIB_LINEPROTOCOL_LINEPROTOCOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Appends InfluxDB line protocol lines to a fixed buffer:
+//   measurement,host=ESP-MM-ABCDEF012345,unit=10 field_1=1.5,field_2=3i 1600000000000000000
+// Only complete lines are kept: a line that does not fit is dropped as a whole (see dropped()),
+// so the content can be flushed between two lines and the line written again.
+class LineProtocolWriter {
+ public:
+  LineProtocolWriter(char *buffer, size_t size);
+
+  void setTag(uint8_t index, const char *key, const char *value);  // added to every line, up to 4
+  bool beginLine(const char *measurement, size_t length);
+  bool addField(const char *key, double value);
+  bool addField(const char *key, int32_t value);
+  bool endLine(uint64_t timestamp_ns);  // 0 lets the server timestamp the point
+
+  bool inLine() const { return in_line_; }
+  size_t lines() const { return lines_; }
+  size_t length() const { return length_; }
+  const char *data() const { return buffer_; }
+  uint32_t dropped() const { return dropped_; }
+  void clear();
+
+ private:
+  bool append(const char *text, size_t length);
+  bool appendEscaped(const char *text, size_t length, const char *special);
+  bool beginField(const char *key);
+  void abortLine();
+
+  char *buffer_;
+  size_t size_;
+  size_t length_;
+  size_t line_start_;
+  size_t lines_;
+  uint8_t line_fields_;
+  bool in_line_;
+  bool line_failed_;
+  uint32_t dropped_;
+  const char *tags_[4][2];
+};
+
+#endif  // LIB_LINEPROTOCOL_LINEPROTOCOL_H_
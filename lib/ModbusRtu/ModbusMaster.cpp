@@ -0,0 +1,178 @@
+/*
+ ModbusMaster.cpp - Transport independent Modbus master
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ModbusMaster.h"
+
+const char *modbusStatusString(uint8_t status) {
+  switch (status) {
+    case MODBUS_STATUS_SUCCESS:
+      return "Success";
+    case MODBUS_STATUS_ILLEGAL_FUNCTION:
+      return "Illegal Function";
+    case MODBUS_STATUS_ILLEGAL_DATA_ADDRESS:
+      return "Illegal Data Address";
+    case MODBUS_STATUS_ILLEGAL_DATA_VALUE:
+      return "Illegal Data Value";
+    case MODBUS_STATUS_SLAVE_DEVICE_FAILURE:
+      return "Slave Device Failure";
+    case MODBUS_STATUS_INVALID_SLAVE_ID:
+      return "Invalid Slave ID";
+    case MODBUS_STATUS_INVALID_FUNCTION:
+      return "Invalid Function";
+    case MODBUS_STATUS_TIMEOUT:
+      return "Response Timed Out";
+    case MODBUS_STATUS_INVALID_CRC:
+      return "Invalid CRC";
+    case MODBUS_STATUS_INVALID_RESPONSE:
+      return "Invalid Response";
+    default:
+      return "Unknown error";
+  }
+}
+
+uint8_t modbusEncodeRequest(const rtu_request_t &request, uint8_t *pdu, size_t *len_ptr,
+    size_t *response_len_ptr) {
+  size_t len = 0;
+  pdu[len++] = request.function;
+  pdu[len++] = request.address >> 8;
+  pdu[len++] = request.address & 0xFF;
+  switch (request.function) {
+    case 0x01:
+    case 0x02:
+      if (request.count == 0 || request.count > RTU_MASTER_MAX_BITS) {
+        return MODBUS_STATUS_ILLEGAL_DATA_VALUE;
+      }
+      pdu[len++] = request.count >> 8;
+      pdu[len++] = request.count & 0xFF;
+      *response_len_ptr = 2 + (request.count + 7) / 8;
+      break;
+    case 0x03:
+    case 0x04:
+      if (request.count == 0 || request.count > RTU_MASTER_MAX_REGISTERS) {
+        return MODBUS_STATUS_ILLEGAL_DATA_VALUE;
+      }
+      pdu[len++] = request.count >> 8;
+      pdu[len++] = request.count & 0xFF;
+      *response_len_ptr = 2 + 2 * request.count;
+      break;
+    case 0x06:
+      pdu[len++] = request.write_values[0] >> 8;
+      pdu[len++] = request.write_values[0] & 0xFF;
+      *response_len_ptr = 5;
+      break;
+    case 0x10:
+      if (request.count == 0 || request.count > RTU_MASTER_MAX_REGISTERS - 2) {
+        return MODBUS_STATUS_ILLEGAL_DATA_VALUE;
+      }
+      pdu[len++] = request.count >> 8;
+      pdu[len++] = request.count & 0xFF;
+      pdu[len++] = 2 * request.count;
+      for (uint16_t i = 0; i < request.count; ++i) {
+        pdu[len++] = request.write_values[i] >> 8;
+        pdu[len++] = request.write_values[i] & 0xFF;
+      }
+      *response_len_ptr = 5;
+      break;
+    default:
+      return MODBUS_STATUS_INVALID_FUNCTION;
+  }
+  *len_ptr = len;
+  return MODBUS_STATUS_SUCCESS;
+}
+
+uint8_t modbusDecodeResponse(const rtu_request_t &request, const uint8_t *pdu, size_t len, uint16_t *values) {
+  if (len < 2) {
+    return MODBUS_STATUS_INVALID_RESPONSE;
+  }
+  if ((pdu[0] & 0x7F) != request.function) {
+    return MODBUS_STATUS_INVALID_FUNCTION;
+  }
+  if (pdu[0] & 0x80) {
+    // exception code, 0x01 to 0x0B: anything else must not pass for a success or for a status of the master
+    return pdu[1] >= 0x01 && pdu[1] <= 0x0B ? pdu[1] : static_cast<uint8_t>(MODBUS_STATUS_INVALID_RESPONSE);
+  }
+  switch (request.function) {
+    case 0x01:
+    case 0x02: {
+      const uint8_t byte_count = (request.count + 7) / 8;
+      if (pdu[1] != byte_count || len != 2U + byte_count) {
+        return MODBUS_STATUS_INVALID_RESPONSE;
+      }
+      // first bit in the least significant bit of the first byte, as on the wire
+      for (uint8_t i = 0; i < byte_count; i += 2) {
+        values[i / 2] = static_cast<uint16_t>(pdu[2 + i] | (i + 1 < byte_count ? pdu[3 + i] << 8 : 0));
+      }
+      break;
+    }
+    case 0x03:
+    case 0x04:
+      if (pdu[1] != 2 * request.count || len != 2U + 2 * request.count) {
+        return MODBUS_STATUS_INVALID_RESPONSE;
+      }
+      for (uint16_t i = 0; i < request.count; ++i) {
+        values[i] = static_cast<uint16_t>(pdu[2 + 2 * i] << 8 | pdu[3 + 2 * i]);
+      }
+      break;
+    default:  // 0x06 and 0x10 echo the address
+      if (len != 5 || pdu[1] != request.address >> 8 || pdu[2] != (request.address & 0xFF)) {
+        return MODBUS_STATUS_INVALID_RESPONSE;
+      }
+      break;
+  }
+  return MODBUS_STATUS_SUCCESS;
+}
+
+ModbusMaster::ModbusMaster()
+  : round_trip_us_(0), transactions_(0), retries_(0), timeouts_(0), crc_errors_(0), head_(0), count_(0) {
+}
+
+bool ModbusMaster::submit(const rtu_request_t &request) {
+  if (full()) {
+    return false;
+  }
+  size_t position = count_;
+  if (request.urgent) {
+    // after the requests already sent (or between two attempts) and the urgent ones already queued
+    position = started();
+    while (position < count_ && at(position).urgent) {
+      ++position;
+    }
+    for (size_t i = count_; i > position; --i) {
+      at(i) = at(i - 1);
+    }
+  }
+  at(position) = request;
+  ++count_;
+  return true;
+}
+
+void ModbusMaster::complete(size_t position, uint8_t status, const uint16_t *values) {
+  const rtu_request_t request = at(position);
+  if (position == 0) {
+    head_ = (head_ + 1) % MODBUS_MASTER_QUEUE_SIZE;
+  } else {
+    for (size_t i = position; i + 1 < count_; ++i) {
+      at(i) = at(i + 1);
+    }
+  }
+  --count_;
+  ++transactions_;
+  if (request.callback != nullptr) {
+    request.callback(&request, status, status == MODBUS_STATUS_SUCCESS ? values : nullptr, request.context);
+  }
+}
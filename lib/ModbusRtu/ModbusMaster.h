@@ -0,0 +1,113 @@
+/*
+ ModbusMaster.h - Transport independent Modbus master headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_MODBUSRTU_MODBUSMASTER_H_
+#define LIB_MODBUSRTU_MODBUSMASTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MODBUS_MASTER_QUEUE_SIZE
+#define MODBUS_MASTER_QUEUE_SIZE 16
+#endif
+
+#define RTU_MASTER_MAX_REGISTERS 125
+#define RTU_MASTER_MAX_BITS 2000  // coils or discrete inputs, packed in RTU_MASTER_MAX_REGISTERS values
+
+// largest request or response PDU (function code and data)
+#define MODBUS_MAX_PDU 253
+
+// Exception codes (0x01-0x0B) are reported as received; other codes match ModbusMaster's
+typedef enum {
+  MODBUS_STATUS_SUCCESS = 0x00,
+  MODBUS_STATUS_ILLEGAL_FUNCTION = 0x01,
+  MODBUS_STATUS_ILLEGAL_DATA_ADDRESS = 0x02,
+  MODBUS_STATUS_ILLEGAL_DATA_VALUE = 0x03,
+  MODBUS_STATUS_SLAVE_DEVICE_FAILURE = 0x04,
+  MODBUS_STATUS_INVALID_SLAVE_ID = 0xE0,
+  MODBUS_STATUS_INVALID_FUNCTION = 0xE1,
+  MODBUS_STATUS_TIMEOUT = 0xE2,
+  MODBUS_STATUS_INVALID_CRC = 0xE3,
+  MODBUS_STATUS_INVALID_RESPONSE = 0xE4
+} modbus_status_t;
+
+const char *modbusStatusString(uint8_t status);
+
+typedef struct rtu_request_s rtu_request_t;
+
+// values holds request->count registers on success (read functions only), and is only valid during the call.
+// Bits (0x01 and 0x02) are packed 16 per value: bit i of the request is values[i / 16] >> (i % 16) & 1.
+typedef void (*rtu_completion_t)(const rtu_request_t *request, uint8_t status, const uint16_t *values,
+                                 void *context);
+
+struct rtu_request_s {
+  uint8_t             unit;
+  uint8_t             function;       /*!< 0x01, 0x02, 0x03, 0x04, 0x06 or 0x10 */
+  uint16_t            address;
+  uint16_t            count;
+  const uint16_t*     write_values;   /*!< owned by the caller until completion */
+  uint8_t             retries;
+  uint16_t            timeout_ms;
+  rtu_completion_t    callback;
+  void*               context;
+  bool                urgent;         /*!< runs before the queued non-urgent requests */
+};
+
+// Writes the PDU of request to pdu (MODBUS_MAX_PDU bytes) and the length of its response PDU. Returns
+// MODBUS_STATUS_SUCCESS, or the status the request fails with (unsupported function, invalid count).
+uint8_t modbusEncodeRequest(const rtu_request_t &request, uint8_t *pdu, size_t *len_ptr, size_t *response_len_ptr);
+// Checks a response PDU against its request, stores the values read (RTU_MASTER_MAX_REGISTERS) and returns the
+// status of the request
+uint8_t modbusDecodeResponse(const rtu_request_t &request, const uint8_t *pdu, size_t len, uint16_t *values);
+
+// Request queue shared by the transports: urgent requests overtake the queued ones that have not been sent.
+// Nothing blocks: poll() must be called whenever the transport has data or the returned delay has elapsed.
+// Completion callbacks run from poll().
+class ModbusMaster {
+ public:
+  virtual ~ModbusMaster() {}
+  bool submit(const rtu_request_t &request);  // false if the queue is full
+  virtual uint32_t poll() = 0;  // returns microseconds until poll() needs to run again
+  size_t pending() const { return count_; }
+  bool full() const { return count_ == MODBUS_MASTER_QUEUE_SIZE; }
+  uint32_t roundTripUs() const { return round_trip_us_; }  // in completion callbacks
+
+  uint32_t transactions() const { return transactions_; }
+  uint32_t retries() const { return retries_; }
+  uint32_t timeouts() const { return timeouts_; }
+  uint32_t crcErrors() const { return crc_errors_; }
+
+ protected:
+  ModbusMaster();
+  virtual size_t started() const = 0;  // requests at the head of the queue already on their way
+  rtu_request_t &at(size_t position) { return queue_[(head_ + position) % MODBUS_MASTER_QUEUE_SIZE]; }
+  void complete(size_t position, uint8_t status, const uint16_t *values);  // dequeues, then calls back
+
+  uint32_t round_trip_us_;
+  uint32_t transactions_;
+  uint32_t retries_;
+  uint32_t timeouts_;
+  uint32_t crc_errors_;
+
+ private:
+  rtu_request_t queue_[MODBUS_MASTER_QUEUE_SIZE];
+  size_t head_;
+  size_t count_;
+};
+
+#endif  // LIB_MODBUSRTU_MODBUSMASTER_H_
@@ -0,0 +1,123 @@
+/*
+ ModbusRtu.cpp - Modbus RTU framing helpers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ModbusRtu.h"
+
+uint16_t modbusCrc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; ++i) {
+    crc ^= data[i];
+    for (uint8_t j = 0; j < 8; ++j) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+bool modbusCheckCrc(const uint8_t *frame, size_t len) {
+  if (len < 4) {
+    return false;
+  }
+  const uint16_t crc = modbusCrc16(frame, len - 2);
+  return frame[len - 2] == (crc & 0xFF) && frame[len - 1] == (crc >> 8);
+}
+
+uint32_t modbusT15(uint32_t baudrate) {
+  if (baudrate > 19200) {
+    return 750;
+  }
+  return 15UL * 11 * 1000000 / (10 * baudrate);  // 11 bits per character
+}
+
+uint32_t modbusT35(uint32_t baudrate) {
+  if (baudrate > 19200) {
+    return 1750;
+  }
+  return 35UL * 11 * 1000000 / (10 * baudrate);
+}
+
+RtuFramer::RtuFramer(uint32_t baudrate, rtu_frame_callback_t callback, void *context)
+  : callback_(callback), context_(context), t35_us_(modbusT35(baudrate)), last_byte_us_(0),
+    len_(0), overrun_(false), frames_(0), crc_errors_(0), overruns_(0) {
+}
+
+void RtuFramer::push(uint8_t byte, uint32_t timestamp_us) {
+  if (len_ > 0 && timestamp_us - last_byte_us_ >= t35_us_) {
+    flush();
+  }
+  last_byte_us_ = timestamp_us;
+  if (len_ >= sizeof(buffer_)) {
+    overrun_ = true;  // keep discarding until the next silence
+    return;
+  }
+  buffer_[len_++] = byte;
+}
+
+void RtuFramer::poll(uint32_t now_us) {
+  if (len_ > 0 && now_us - last_byte_us_ >= t35_us_) {
+    flush();
+  }
+}
+
+void RtuFramer::hold(uint32_t now_us) {
+  if (len_ > 0) {
+    last_byte_us_ = now_us;
+  }
+}
+
+void RtuFramer::flush() {
+  if (overrun_) {
+    ++overruns_;
+  } else if (len_ > 0) {
+    if (modbusCheckCrc(buffer_, len_)) {
+      emit(buffer_, len_);
+    } else {
+      // Frames may have been glued together when the silence between them was not seen
+      // (burst reads). Carve out the shortest CRC-valid prefix, repeatedly.
+      size_t start = 0;
+      while (start < len_) {
+        uint16_t crc = 0xFFFF;
+        size_t end = 0;
+        for (size_t i = start; i + 2 < len_ && end == 0; ++i) {
+          crc ^= buffer_[i];
+          for (uint8_t j = 0; j < 8; ++j) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+          }
+          if (i - start >= 1 && buffer_[i + 1] == (crc & 0xFF) && buffer_[i + 2] == (crc >> 8)) {
+            end = i + 3;
+          }
+        }
+        if (end == 0) {
+          ++crc_errors_;
+          break;
+        }
+        emit(&buffer_[start], end - start);
+        start = end;
+      }
+    }
+  }
+  len_ = 0;
+  overrun_ = false;
+}
+
+void RtuFramer::emit(const uint8_t *frame, size_t len) {
+  ++frames_;
+  if (callback_ != nullptr) {
+    callback_(frame, len, context_);
+  }
+}
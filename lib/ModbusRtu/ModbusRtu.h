@@ -0,0 +1,69 @@
+/*
+ ModbusRtu.h - Modbus RTU framing helpers headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_MODBUSRTU_MODBUSRTU_H_
+#define LIB_MODBUSRTU_MODBUSRTU_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MODBUS_RTU_MAX_FRAME 256
+
+uint16_t modbusCrc16(const uint8_t *data, size_t len);
+bool modbusCheckCrc(const uint8_t *frame, size_t len);  // CRC is the last 2 bytes, low byte first
+
+// Inter-character silence (in microseconds) for a given baudrate, as defined by
+// Modbus over Serial Line V1.02 section 2.5.1.1 (fixed values above 19200 bauds)
+uint32_t modbusT15(uint32_t baudrate);
+uint32_t modbusT35(uint32_t baudrate);
+
+typedef void (*rtu_frame_callback_t)(const uint8_t *frame, size_t len, void *context);
+
+// Splits a raw RTU byte stream into frames using t3.5 silences, then checks CRC.
+// Bytes may be pushed one by one with their reception timestamp, or in bursts
+// followed by flush() when the silence is detected elsewhere (e.g. UART RX timeout).
+// Back-to-back frames received in a single burst are separated by CRC matching.
+class RtuFramer {
+ public:
+  RtuFramer(uint32_t baudrate, rtu_frame_callback_t callback, void *context);
+  void push(uint8_t byte, uint32_t timestamp_us);
+  void poll(uint32_t now_us);  // ends the pending frame if the line has been idle long enough
+  void hold(uint32_t now_us);  // the pending frame is still arriving (see ModbusTransport::rxFrameOpen())
+  void flush();  // ends the pending frame now
+  bool pending() const { return len_ > 0; }
+
+  uint32_t frames() const { return frames_; }
+  uint32_t crcErrors() const { return crc_errors_; }
+  uint32_t overruns() const { return overruns_; }
+
+ private:
+  void emit(const uint8_t *frame, size_t len);
+
+  rtu_frame_callback_t callback_;
+  void *context_;
+  uint32_t t35_us_;
+  uint32_t last_byte_us_;
+  uint8_t buffer_[MODBUS_RTU_MAX_FRAME];
+  size_t len_;
+  bool overrun_;
+  uint32_t frames_;
+  uint32_t crc_errors_;
+  uint32_t overruns_;
+};
+
+#endif  // LIB_MODBUSRTU_MODBUSRTU_H_
@@ -0,0 +1,41 @@
+/*
+ ModbusTransport.h - Byte transport abstraction for the Modbus engines
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_MODBUSRTU_MODBUSTRANSPORT_H_
+#define LIB_MODBUSRTU_MODBUSTRANSPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// All calls are non-blocking except wait(). Implementations exist for the ESP32 UART
+// driver (src/esp_uart_transport.h) and for POSIX serial ports and ptys (PosixSerialTransport.h).
+class ModbusTransport {
+ public:
+  virtual ~ModbusTransport() {}
+  virtual bool send(const uint8_t *data, size_t len) = 0;  // queue bytes for transmission
+  virtual size_t receive(uint8_t *buffer, size_t size) = 0;  // bytes already received, if any
+  virtual void wait(uint32_t timeout_us) = 0;  // sleep until data arrives, wake() or time-out
+  virtual void wake() = 0;  // interrupt wait() from another task
+  virtual uint32_t micros() = 0;  // monotonic clock
+  // The bytes received so far stop in the middle of a frame: the receiver handed them over on a FIFO threshold and
+  // has not seen the line idle since. The time they were read at is then no silence on the line, however late the
+  // rest is read. Transports that cannot tell leave the framing to the t3.5 of their caller.
+  virtual bool rxFrameOpen() { return false; }
+};
+
+#endif  // LIB_MODBUSRTU_MODBUSTRANSPORT_H_
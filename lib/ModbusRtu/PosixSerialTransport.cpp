@@ -0,0 +1,123 @@
+/*
+ PosixSerialTransport.cpp - Modbus transport over POSIX serial ports and ptys
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ARDUINO
+
+#include "PosixSerialTransport.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+static speed_t _speed(uint32_t baudrate) {
+  switch (baudrate) {
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    default: return B9600;
+  }
+}
+
+static void _setNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+PosixSerialTransport::PosixSerialTransport(int fd) : fd_(fd) {
+  struct termios tio;
+  if (tcgetattr(fd_, &tio) == 0) {
+    cfmakeraw(&tio);
+    tcsetattr(fd_, TCSANOW, &tio);
+  }
+  _setNonBlocking(fd_);
+  if (pipe(wake_pipe_) == 0) {
+    _setNonBlocking(wake_pipe_[0]);
+    _setNonBlocking(wake_pipe_[1]);
+  } else {
+    wake_pipe_[0] = wake_pipe_[1] = -1;
+  }
+}
+
+PosixSerialTransport::~PosixSerialTransport() {
+  if (wake_pipe_[0] >= 0) {
+    close(wake_pipe_[0]);
+    close(wake_pipe_[1]);
+  }
+}
+
+int PosixSerialTransport::open(const char *path, uint32_t baudrate) {
+  const int fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) {
+    return -1;
+  }
+  struct termios tio;
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, _speed(baudrate));
+    cfsetospeed(&tio, _speed(baudrate));
+    tio.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  return fd;
+}
+
+bool PosixSerialTransport::send(const uint8_t *data, size_t len) {
+  size_t written = 0;
+  while (written < len) {
+    const ssize_t n = write(fd_, data + written, len - written);
+    if (n <= 0) {
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+
+size_t PosixSerialTransport::receive(uint8_t *buffer, size_t size) {
+  const ssize_t n = read(fd_, buffer, size);
+  return n > 0 ? n : 0;
+}
+
+void PosixSerialTransport::wait(uint32_t timeout_us) {
+  struct pollfd fds[2] = { { fd_, POLLIN, 0 }, { wake_pipe_[0], POLLIN, 0 } };
+  const int timeout_ms = timeout_us == UINT32_MAX ? -1 : static_cast<int>((timeout_us + 999) / 1000);
+  if (poll(fds, 2, timeout_ms) > 0 && (fds[1].revents & POLLIN)) {
+    uint8_t drain[16];
+    while (read(wake_pipe_[0], drain, sizeof(drain)) > 0) continue;
+  }
+}
+
+void PosixSerialTransport::wake() {
+  const uint8_t byte = 0;
+  if (write(wake_pipe_[1], &byte, 1) < 0) {
+    // pipe full: a wake-up is already pending
+  }
+}
+
+uint32_t PosixSerialTransport::micros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint32_t>(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+#endif  // ARDUINO
@@ -0,0 +1,47 @@
+/*
+ PosixSerialTransport.h - Modbus transport over POSIX serial ports and ptys headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_MODBUSRTU_POSIXSERIALTRANSPORT_H_
+#define LIB_MODBUSRTU_POSIXSERIALTRANSPORT_H_
+
+#ifndef ARDUINO
+
+#include "ModbusTransport.h"
+
+// Native (Linux/macOS) transport used to run the Modbus engines against a pty
+// or a USB RS-485 adapter, e.g. for tests with a simulated slave.
+class PosixSerialTransport : public ModbusTransport {
+ public:
+  explicit PosixSerialTransport(int fd);  // fd is put in raw non-blocking mode, not closed
+  ~PosixSerialTransport();
+  static int open(const char *path, uint32_t baudrate);  // returns -1 on error
+
+  bool send(const uint8_t *data, size_t len) override;
+  size_t receive(uint8_t *buffer, size_t size) override;
+  void wait(uint32_t timeout_us) override;
+  void wake() override;
+  uint32_t micros() override;
+
+ private:
+  int fd_;
+  int wake_pipe_[2];
+};
+
+#endif  // ARDUINO
+
+#endif  // LIB_MODBUSRTU_POSIXSERIALTRANSPORT_H_
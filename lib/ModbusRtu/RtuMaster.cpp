@@ -0,0 +1,163 @@
+/*
+ RtuMaster.cpp - Event-driven Modbus RTU master
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "RtuMaster.h"
+
+// delay after a broadcast request (no response expected)
+static const uint32_t BROADCAST_TURNAROUND_US = 100000;
+
+// wrap-around safe "has delay_us elapsed since since_us", since_us may be in the future
+static bool _elapsed(uint32_t now_us, uint32_t since_us, uint32_t delay_us) {
+  return static_cast<int32_t>(now_us - since_us - delay_us) >= 0;
+}
+
+static uint32_t _remaining(uint32_t now_us, uint32_t since_us, uint32_t delay_us) {
+  return since_us + delay_us - now_us;
+}
+
+static uint32_t _min(uint32_t a, uint32_t b) {
+  return a < b ? a : b;
+}
+
+RtuMaster::RtuMaster(ModbusTransport *transport, uint32_t baudrate)
+  : transport_(transport), t35_us_(modbusT35(baudrate)), char_us_(11UL * 1000000 / baudrate),
+    state_(STATE_IDLE), attempt_(0), bus_active_(false), last_activity_us_(0), sent_us_(0), deadline_us_(0),
+    rx_len_(0), rx_expected_(0) {
+}
+
+uint32_t RtuMaster::poll() {
+  const uint32_t now = transport_->micros();
+
+  // drain the receiver, whatever the state (bytes outside a transaction are dropped)
+  for (;;) {
+    uint8_t scratch[32];
+    const bool keep = state_ == STATE_WAITING && rx_len_ < sizeof(rx_);
+    const size_t n = keep ? transport_->receive(&rx_[rx_len_], sizeof(rx_) - rx_len_)
+                          : transport_->receive(scratch, sizeof(scratch));
+    if (n == 0) {
+      break;
+    }
+    if (keep) {
+      rx_len_ += n;
+    }
+    bus_active_ = true;
+    last_activity_us_ = now;
+  }
+  // a frame handed over in chunks goes on however late its next chunk is read: no silence yet
+  if (transport_->rxFrameOpen()) {
+    bus_active_ = true;
+    last_activity_us_ = now;
+  }
+
+  switch (state_) {
+    case STATE_WAITING: {
+      const size_t expected = (rx_len_ >= 2 && (rx_[1] & 0x80)) ? 5 : rx_expected_;
+      if (rx_len_ >= expected) {
+        finish(decode());
+      } else if (rx_len_ > 0 && _elapsed(now, last_activity_us_, t35_us_)) {
+        finish(decode());  // frame ended early
+      } else if (_elapsed(now, deadline_us_, 0)) {
+        finish(rx_len_ > 0 ? decode() : static_cast<uint8_t>(MODBUS_STATUS_TIMEOUT));
+      } else if (rx_len_ > 0) {
+        return _min(_remaining(now, deadline_us_, 0), _remaining(now, last_activity_us_, t35_us_));
+      } else {
+        return _remaining(now, deadline_us_, 0);
+      }
+      break;
+    }
+    case STATE_BROADCAST:
+      if (!_elapsed(now, deadline_us_, 0)) {
+        return _remaining(now, deadline_us_, 0);
+      }
+      finish(MODBUS_STATUS_SUCCESS);
+      break;
+    default:
+      break;
+  }
+
+  // STATE_IDLE
+  if (pending() == 0) {
+    return UINT32_MAX;
+  }
+  if (bus_active_ && !_elapsed(now, last_activity_us_, t35_us_)) {
+    return _remaining(now, last_activity_us_, t35_us_);
+  }
+  transmit(now);
+  return state_ == STATE_IDLE ? 0 : _remaining(now, deadline_us_, 0);
+}
+
+void RtuMaster::transmit(uint32_t now) {
+  const rtu_request_t &request = at(0);
+  uint8_t frame[MODBUS_RTU_MAX_FRAME];
+  size_t len;
+  size_t response_len;
+  frame[0] = request.unit;
+  const uint8_t status = modbusEncodeRequest(request, &frame[1], &len, &response_len);
+  if (status != MODBUS_STATUS_SUCCESS) {
+    attempt_ = 0;
+    complete(0, status, nullptr);  // rejected without reaching the bus: nothing to retry, no round trip
+    return;
+  }
+  ++len;
+  rx_expected_ = 1 + response_len + 2;
+  const uint16_t crc = modbusCrc16(frame, len);
+  frame[len++] = crc & 0xFF;
+  frame[len++] = crc >> 8;
+
+  rx_len_ = 0;
+  transport_->send(frame, len);
+  bus_active_ = true;
+  last_activity_us_ = now + len * char_us_;  // end of transmission
+  sent_us_ = last_activity_us_;
+  if (request.unit == 0) {
+    state_ = STATE_BROADCAST;
+    deadline_us_ = last_activity_us_ + BROADCAST_TURNAROUND_US;
+  } else {
+    state_ = STATE_WAITING;
+    deadline_us_ = last_activity_us_ + request.timeout_ms * 1000UL;
+  }
+}
+
+uint8_t RtuMaster::decode() {
+  const rtu_request_t &request = at(0);
+  if (!modbusCheckCrc(rx_, rx_len_)) {
+    ++crc_errors_;
+    return MODBUS_STATUS_INVALID_CRC;
+  }
+  if (rx_[0] != request.unit) {
+    return MODBUS_STATUS_INVALID_SLAVE_ID;
+  }
+  return modbusDecodeResponse(request, &rx_[1], rx_len_ - 3, values_);
+}
+
+void RtuMaster::finish(uint8_t status) {
+  state_ = STATE_IDLE;
+  if (status == MODBUS_STATUS_TIMEOUT) {
+    ++timeouts_;
+  }
+  // an exception is an answer: retrying would get the same one
+  const bool retryable = status >= MODBUS_STATUS_INVALID_SLAVE_ID;
+  if (retryable && attempt_ < at(0).retries) {
+    ++attempt_;
+    ++retries_;
+    return;
+  }
+  attempt_ = 0;
+  round_trip_us_ = last_activity_us_ - sent_us_;
+  complete(0, status, values_);
+}
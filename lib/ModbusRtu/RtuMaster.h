@@ -0,0 +1,61 @@
+/*
+ RtuMaster.h - Event-driven Modbus RTU master headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_MODBUSRTU_RTUMASTER_H_
+#define LIB_MODBUSRTU_RTUMASTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ModbusMaster.h"
+#include "ModbusRtu.h"
+#include "ModbusTransport.h"
+
+// Runs the queued requests one at a time on a serial bus (or a transparent RTU over TCP link), honouring the t3.5
+// inter-frame delay.
+class RtuMaster : public ModbusMaster {
+ public:
+  RtuMaster(ModbusTransport *transport, uint32_t baudrate);
+  uint32_t poll() override;
+
+ protected:
+  size_t started() const override { return (state_ != STATE_IDLE || attempt_ > 0) ? 1 : 0; }
+
+ private:
+  typedef enum { STATE_IDLE, STATE_WAITING, STATE_BROADCAST } state_t;
+
+  void transmit(uint32_t now);
+  uint8_t decode();
+  void finish(uint8_t status);
+
+  ModbusTransport *transport_;
+  uint32_t t35_us_;
+  uint32_t char_us_;
+  state_t state_;
+  uint8_t attempt_;
+  bool bus_active_;  // last_activity_us_ is set (the clock may start anywhere)
+  uint32_t last_activity_us_;  // end of the last frame seen or sent
+  uint32_t sent_us_;  // end of the last request sent
+  uint32_t deadline_us_;
+  uint8_t rx_[MODBUS_RTU_MAX_FRAME];
+  size_t rx_len_;
+  size_t rx_expected_;
+  uint16_t values_[RTU_MASTER_MAX_REGISTERS];
+};
+
+#endif  // LIB_MODBUSRTU_RTUMASTER_H_
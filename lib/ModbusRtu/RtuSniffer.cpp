@@ -0,0 +1,81 @@
+/*
+ RtuSniffer.cpp - Passive Modbus RTU traffic decoder
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "RtuSniffer.h"
+
+static uint16_t _word(const uint8_t *data) {
+  return static_cast<uint16_t>(data[0] << 8 | data[1]);
+}
+
+RtuSniffer::RtuSniffer(rtu_register_callback_t callback, void *context)
+  : callback_(callback), context_(context), pending_(false), pending_unit_(0), pending_function_(0),
+    pending_address_(0), pending_count_(0), registers_(0), ignored_(0) {
+}
+
+void RtuSniffer::onFrame(const uint8_t *frame, size_t len) {
+  // frame includes unit id, function code, data and CRC
+  const uint8_t unit = frame[0];
+  const uint8_t function = frame[1];
+
+  switch (function) {
+    case 0x03:  // Read Holding Registers
+    case 0x04:  // Read Input Registers
+      // a response has an even byte count, so it can't be 8 bytes long like a request
+      if (pending_ && unit == pending_unit_ && function == pending_function_
+          && len == 5U + frame[2] && frame[2] == 2 * pending_count_) {
+        emit(unit, pending_address_, &frame[3], pending_count_, false);
+        pending_ = false;
+        return;
+      } else if (len == 8) {
+        pending_ = true;
+        pending_unit_ = unit;
+        pending_function_ = function;
+        pending_address_ = _word(&frame[2]);
+        pending_count_ = _word(&frame[4]);
+        return;
+      }
+      break;
+    case 0x06:  // Write Single Register (the response is an echo of the request)
+      if (len == 8) {
+        emit(unit, _word(&frame[2]), &frame[4], 1, true);
+        return;
+      }
+      break;
+    case 0x10:  // Write Multiple Registers
+      if (len >= 9 && len == 9U + frame[6] && frame[6] == 2 * _word(&frame[4])) {
+        emit(unit, _word(&frame[2]), &frame[7], _word(&frame[4]), true);
+        return;
+      } else if (len == 8) {
+        return;  // response, nothing new
+      }
+      break;
+    default:
+      break;
+  }
+  pending_ = false;  // exception or unsupported function
+  ++ignored_;
+}
+
+void RtuSniffer::emit(uint8_t unit, uint16_t address, const uint8_t *data, uint16_t count, bool is_write) {
+  for (uint16_t i = 0; i < count; ++i) {
+    ++registers_;
+    if (callback_ != nullptr) {
+      callback_(unit, address + i, _word(&data[2 * i]), is_write, context_);
+    }
+  }
+}
@@ -0,0 +1,54 @@
+/*
+ RtuSniffer.h - Passive Modbus RTU traffic decoder headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_MODBUSRTU_RTUSNIFFER_H_
+#define LIB_MODBUSRTU_RTUSNIFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// is_write is true for values carried by a write request (FC06/FC16), false for
+// values carried by a read response (FC03/FC04) paired with the preceding request
+typedef void (*rtu_register_callback_t)(uint8_t unit, uint16_t address, uint16_t value, bool is_write,
+                                        void *context);
+
+// Extracts register values from CRC-valid frames seen on the bus, whoever the master is.
+// Feed it from an RtuFramer callback.
+class RtuSniffer {
+ public:
+  RtuSniffer(rtu_register_callback_t callback, void *context);
+  void onFrame(const uint8_t *frame, size_t len);
+
+  uint32_t registers() const { return registers_; }
+  uint32_t ignored() const { return ignored_; }
+
+ private:
+  void emit(uint8_t unit, uint16_t address, const uint8_t *data, uint16_t count, bool is_write);
+
+  rtu_register_callback_t callback_;
+  void *context_;
+  bool pending_;  // a read request is waiting for its response
+  uint8_t pending_unit_;
+  uint8_t pending_function_;
+  uint16_t pending_address_;
+  uint16_t pending_count_;
+  uint32_t registers_;
+  uint32_t ignored_;
+};
+
+#endif  // LIB_MODBUSRTU_RTUSNIFFER_H_
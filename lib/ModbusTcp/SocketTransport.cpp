@@ -0,0 +1,237 @@
+/*
+ SocketTransport.cpp - TCP client transport
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "SocketTransport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef ARDUINO
+#include <lwip/sockets.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#endif  // ARDUINO
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static bool _elapsed(uint32_t now_us, uint32_t since_us, uint32_t delay_us) {
+  return static_cast<int32_t>(now_us - since_us - delay_us) >= 0;
+}
+
+static void _setNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+SocketTransport::SocketTransport()
+  : address_(0), port_(0), fd_(-1), wake_fd_(-1), connecting_(false), connect_us_(0), attempted_(false),
+    tx_len_(0), connections_(0), disconnections_(0) {
+}
+
+SocketTransport::~SocketTransport() {
+  drop();
+  if (wake_fd_ >= 0) {
+    close(wake_fd_);
+  }
+}
+
+bool SocketTransport::begin(const char *ipv4, uint16_t port) {
+  struct in_addr address;
+  if (inet_pton(AF_INET, ipv4, &address) != 1) {
+    return false;
+  }
+  address_ = address.s_addr;
+  port_ = port;
+
+  // a datagram sent to itself breaks select()
+  wake_fd_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (wake_fd_ < 0) {
+    return false;
+  }
+  struct sockaddr_in loopback = {};
+  socklen_t len = sizeof(loopback);
+  loopback.sin_family = AF_INET;
+  loopback.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(wake_fd_, reinterpret_cast<struct sockaddr *>(&loopback), sizeof(loopback)) != 0
+      || getsockname(wake_fd_, reinterpret_cast<struct sockaddr *>(&loopback), &len) != 0
+      || connect(wake_fd_, reinterpret_cast<struct sockaddr *>(&loopback), sizeof(loopback)) != 0) {
+    close(wake_fd_);
+    wake_fd_ = -1;
+    return false;
+  }
+  _setNonBlocking(wake_fd_);
+  return true;
+}
+
+void SocketTransport::open() {
+  connect_us_ = micros();
+  attempted_ = true;
+  fd_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd_ < 0) {
+    return;
+  }
+  _setNonBlocking(fd_);
+  const int enable = 1;
+  setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));  // requests are small and latency-bound
+  struct sockaddr_in server = {};
+  server.sin_family = AF_INET;
+  server.sin_port = htons(port_);
+  server.sin_addr.s_addr = address_;
+  if (connect(fd_, reinterpret_cast<struct sockaddr *>(&server), sizeof(server)) == 0) {
+    ++connections_;
+  } else if (errno == EINPROGRESS) {
+    connecting_ = true;
+  } else {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void SocketTransport::drop() {
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+    if (!connecting_) {
+      ++disconnections_;
+    }
+  }
+  connecting_ = false;
+  tx_len_ = 0;  // the requests will time out
+}
+
+void SocketTransport::flush() {
+  while (connected() && tx_len_ > 0) {
+    const ssize_t n = ::send(fd_, tx_, tx_len_, MSG_NOSIGNAL);
+    if (n > 0) {
+      memmove(tx_, tx_ + n, tx_len_ - n);
+      tx_len_ -= n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;  // socket buffer full, resumed by wait()
+    } else {
+      drop();
+    }
+  }
+}
+
+bool SocketTransport::send(const uint8_t *data, size_t len) {
+  if (fd_ < 0) {
+    if (attempted_ && !_elapsed(micros(), connect_us_, SOCKET_TRANSPORT_RECONNECT_DELAY * 1000UL)) {
+      return false;
+    }
+    open();
+    if (fd_ < 0) {
+      return false;
+    }
+  }
+  if (tx_len_ + len > sizeof(tx_)) {
+    return false;
+  }
+  memcpy(tx_ + tx_len_, data, len);
+  tx_len_ += len;
+  flush();
+  return true;
+}
+
+size_t SocketTransport::receive(uint8_t *buffer, size_t size) {
+  if (!connected()) {
+    return 0;
+  }
+  const ssize_t n = recv(fd_, buffer, size, 0);
+  if (n > 0) {
+    return n;
+  }
+  if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+    drop();  // closed by the server, reopened by the next send()
+  }
+  return 0;
+}
+
+void SocketTransport::wait(uint32_t timeout_us) {
+  fd_set read_fds;
+  fd_set write_fds;
+  FD_ZERO(&read_fds);
+  FD_ZERO(&write_fds);
+  int max_fd = wake_fd_;
+  if (wake_fd_ >= 0) {
+    FD_SET(wake_fd_, &read_fds);
+  }
+  if (fd_ >= 0) {
+    if (connecting_) {
+      FD_SET(fd_, &write_fds);
+      const uint32_t connect_timeout_us = SOCKET_TRANSPORT_CONNECT_TIMEOUT * 1000UL;
+      const uint32_t remaining_us = connect_us_ + connect_timeout_us - micros();
+      if (remaining_us < timeout_us && remaining_us <= connect_timeout_us) {
+        timeout_us = remaining_us;
+      }
+    } else {
+      FD_SET(fd_, &read_fds);
+      if (tx_len_ > 0) {
+        FD_SET(fd_, &write_fds);
+      }
+    }
+    if (fd_ > max_fd) {
+      max_fd = fd_;
+    }
+  }
+  struct timeval timeout;
+  timeout.tv_sec = timeout_us / 1000000;
+  timeout.tv_usec = timeout_us % 1000000;
+  const int ready = select(max_fd + 1, &read_fds, &write_fds, nullptr, timeout_us == UINT32_MAX ? nullptr : &timeout);
+
+  if (ready > 0 && wake_fd_ >= 0 && FD_ISSET(wake_fd_, &read_fds)) {
+    uint8_t drain[16];
+    while (recv(wake_fd_, drain, sizeof(drain), 0) > 0) continue;
+  }
+  if (fd_ >= 0 && connecting_) {
+    if (ready > 0 && FD_ISSET(fd_, &write_fds)) {
+      int error = 0;
+      socklen_t len = sizeof(error);
+      if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0) {
+        connecting_ = false;
+        ++connections_;
+        flush();
+      } else {
+        drop();
+      }
+    } else if (_elapsed(micros(), connect_us_, SOCKET_TRANSPORT_CONNECT_TIMEOUT * 1000UL)) {
+      drop();
+    }
+  } else if (ready > 0 && fd_ >= 0 && FD_ISSET(fd_, &write_fds)) {
+    flush();
+  }
+}
+
+void SocketTransport::wake() {
+  const uint8_t byte = 0;
+  if (wake_fd_ >= 0 && ::send(wake_fd_, &byte, 1, 0) < 0) {
+    // socket buffer full: a wake-up is already pending
+  }
+}
+
+uint32_t SocketTransport::micros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint32_t>(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
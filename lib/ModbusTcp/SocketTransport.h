@@ -0,0 +1,80 @@
+/*
+ SocketTransport.h - TCP client transport headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_MODBUSTCP_SOCKETTRANSPORT_H_
+#define LIB_MODBUSTCP_SOCKETTRANSPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ModbusTransport.h>
+
+// bytes waiting for the connection to be established (or for room in the socket buffer)
+#ifndef SOCKET_TRANSPORT_TX_SIZE
+#define SOCKET_TRANSPORT_TX_SIZE 512
+#endif
+
+// delay between two connection attempts (in milliseconds)
+#ifndef SOCKET_TRANSPORT_RECONNECT_DELAY
+#define SOCKET_TRANSPORT_RECONNECT_DELAY 2000
+#endif
+
+#ifndef SOCKET_TRANSPORT_CONNECT_TIMEOUT
+#define SOCKET_TRANSPORT_CONNECT_TIMEOUT 3000
+#endif
+
+// Persistent TCP connection to a Modbus TCP server or an RTU over TCP gateway, on BSD sockets (lwIP on the
+// ESP32, the host stack for tests). The connection is opened by the first send() and kept open; when it breaks,
+// the next send() reconnects (at most every SOCKET_TRANSPORT_RECONNECT_DELAY). send() never blocks: bytes are
+// buffered until the connection is established. wake() goes through a loopback UDP socket, so that wait() is
+// a single select() on both sockets.
+class SocketTransport : public ModbusTransport {
+ public:
+  SocketTransport();
+  ~SocketTransport();
+  bool begin(const char *ipv4, uint16_t port);  // false if ipv4 is not a dotted IPv4 address
+
+  bool send(const uint8_t *data, size_t len) override;
+  size_t receive(uint8_t *buffer, size_t size) override;
+  void wait(uint32_t timeout_us) override;
+  void wake() override;
+  uint32_t micros() override;
+
+  bool connected() const { return fd_ >= 0 && !connecting_; }
+  uint32_t connections() const { return connections_; }
+  uint32_t disconnections() const { return disconnections_; }
+
+ private:
+  void open();
+  void flush();
+  void drop();
+
+  uint32_t address_;  // network byte order
+  uint16_t port_;
+  int fd_;
+  int wake_fd_;
+  bool connecting_;
+  uint32_t connect_us_;  // start of the connection attempt in progress, or of the last one
+  bool attempted_;
+  uint8_t tx_[SOCKET_TRANSPORT_TX_SIZE];
+  size_t tx_len_;
+  uint32_t connections_;
+  uint32_t disconnections_;
+};
+
+#endif  // LIB_MODBUSTCP_SOCKETTRANSPORT_H_
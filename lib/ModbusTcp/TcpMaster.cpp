@@ -0,0 +1,154 @@
+/*
+ TcpMaster.cpp - Pipelined Modbus TCP master
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "TcpMaster.h"
+
+#include <string.h>
+
+static bool _elapsed(uint32_t now_us, uint32_t since_us, uint32_t delay_us) {
+  return static_cast<int32_t>(now_us - since_us - delay_us) >= 0;
+}
+
+TcpMaster::TcpMaster(ModbusTransport *transport, uint8_t max_in_flight)
+  : transport_(transport),
+    max_in_flight_(max_in_flight == 0 || max_in_flight > TCP_MASTER_MAX_IN_FLIGHT ? TCP_MASTER_MAX_IN_FLIGHT
+                                                                                   : max_in_flight),
+    in_flight_(0), next_transaction_id_(1), rx_len_(0), late_answers_(0) {
+}
+
+uint32_t TcpMaster::poll() {
+  const uint32_t now = transport_->micros();
+
+  for (;;) {
+    const size_t n = transport_->receive(&rx_[rx_len_], sizeof(rx_) - rx_len_);
+    if (n == 0) {
+      break;
+    }
+    rx_len_ += n;
+    // the stream may hold several answers, the last one possibly incomplete
+    size_t offset = 0;
+    while (rx_len_ - offset >= MODBUS_TCP_HEADER) {
+      const uint8_t *frame = &rx_[offset];
+      const size_t length = frame[4] << 8 | frame[5];  // unit id and PDU
+      if (frame[2] != 0 || frame[3] != 0 || length < 2 || length > MODBUS_MAX_PDU + 1) {
+        offset = rx_len_;  // not Modbus: lost synchronization, the pending requests will time out
+        break;
+      }
+      if (rx_len_ - offset < 6 + length) {
+        break;
+      }
+      handleFrame(frame, 6 + length, now);
+      offset += 6 + length;
+    }
+    memmove(rx_, &rx_[offset], rx_len_ - offset);
+    rx_len_ -= offset;
+  }
+
+  for (size_t i = 0; i < in_flight_;) {
+    if (_elapsed(now, flights_[i].deadline_us, 0)) {
+      ++timeouts_;
+      const size_t before = in_flight_;
+      finish(i, MODBUS_STATUS_TIMEOUT);
+      if (in_flight_ < before) {
+        continue;  // completed: the next one took its position
+      }
+    }
+    ++i;
+  }
+  if (in_flight_ == 0) {
+    rx_len_ = 0;  // nothing can be expected anymore, an incomplete answer is dropped
+  }
+
+  transmit(now);
+
+  uint32_t delay_us = UINT32_MAX;
+  for (size_t i = 0; i < in_flight_; ++i) {
+    const uint32_t remaining_us = _elapsed(now, flights_[i].deadline_us, 0) ? 0 : flights_[i].deadline_us - now;
+    if (remaining_us < delay_us) {
+      delay_us = remaining_us;
+    }
+  }
+  return delay_us;
+}
+
+void TcpMaster::transmit(uint32_t now) {
+  while (in_flight_ < max_in_flight_ && in_flight_ < pending()) {
+    flights_[in_flight_].attempt = 0;
+    const uint8_t status = send(in_flight_, now);
+    if (status != MODBUS_STATUS_SUCCESS) {
+      complete(in_flight_, status, nullptr);  // rejected without reaching the server
+      continue;
+    }
+    ++in_flight_;
+  }
+}
+
+uint8_t TcpMaster::send(size_t position, uint32_t now) {
+  const rtu_request_t &request = at(position);
+  uint8_t frame[MODBUS_TCP_MAX_FRAME];
+  size_t len;
+  size_t response_len;
+  const uint8_t status = modbusEncodeRequest(request, &frame[MODBUS_TCP_HEADER], &len, &response_len);
+  if (status != MODBUS_STATUS_SUCCESS) {
+    return status;
+  }
+  flight_t *flight = &flights_[position];
+  flight->transaction_id = next_transaction_id_++;
+  flight->sent_us = now;
+  flight->deadline_us = now + request.timeout_ms * 1000UL;
+  frame[0] = flight->transaction_id >> 8;
+  frame[1] = flight->transaction_id & 0xFF;
+  frame[2] = 0;  // protocol: Modbus
+  frame[3] = 0;
+  frame[4] = (len + 1) >> 8;
+  frame[5] = (len + 1) & 0xFF;
+  frame[6] = request.unit;
+  transport_->send(frame, MODBUS_TCP_HEADER + len);  // on failure, the request times out and is retried
+  return MODBUS_STATUS_SUCCESS;
+}
+
+void TcpMaster::handleFrame(const uint8_t *frame, size_t len, uint32_t now) {
+  const uint16_t transaction_id = frame[0] << 8 | frame[1];
+  for (size_t i = 0; i < in_flight_; ++i) {
+    if (flights_[i].transaction_id != transaction_id) {
+      continue;
+    }
+    const rtu_request_t &request = at(i);
+    round_trip_us_ = now - flights_[i].sent_us;
+    finish(i, frame[6] != request.unit ? static_cast<uint8_t>(MODBUS_STATUS_INVALID_SLAVE_ID)
+                                       : modbusDecodeResponse(request, &frame[MODBUS_TCP_HEADER],
+                                                              len - MODBUS_TCP_HEADER, values_));
+    return;
+  }
+  ++late_answers_;  // its request has timed out (or been retried with another transaction id)
+}
+
+void TcpMaster::finish(size_t position, uint8_t status) {
+  flight_t *flight = &flights_[position];
+  // an exception is an answer: retrying would get the same one
+  const bool retryable = status >= MODBUS_STATUS_INVALID_SLAVE_ID;
+  if (retryable && flight->attempt < at(position).retries) {
+    ++flight->attempt;
+    ++retries_;
+    send(position, transport_->micros());  // keeps its place and its attempt count
+    return;
+  }
+  memmove(&flights_[position], &flights_[position + 1], (in_flight_ - position - 1) * sizeof(flight_t));
+  --in_flight_;
+  complete(position, status, values_);
+}
@@ -0,0 +1,74 @@
+/*
+ TcpMaster.h - Pipelined Modbus TCP master headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_MODBUSTCP_TCPMASTER_H_
+#define LIB_MODBUSTCP_TCPMASTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ModbusMaster.h>
+#include <ModbusTransport.h>
+
+// requests sent without waiting for the previous answers
+#ifndef TCP_MASTER_MAX_IN_FLIGHT
+#define TCP_MASTER_MAX_IN_FLIGHT 4
+#endif
+
+// MBAP header (transaction id, protocol id, length, unit id) followed by the PDU
+#define MODBUS_TCP_HEADER 7
+#define MODBUS_TCP_MAX_FRAME (MODBUS_TCP_HEADER + MODBUS_MAX_PDU)
+
+// Modbus TCP client: up to max_in_flight requests are on the connection at once, each one with its own
+// transaction id, and answers are matched by transaction id whatever their order. An answer arriving after the
+// time-out of its request is ignored.
+class TcpMaster : public ModbusMaster {
+ public:
+  explicit TcpMaster(ModbusTransport *transport, uint8_t max_in_flight = TCP_MASTER_MAX_IN_FLIGHT);
+  uint32_t poll() override;
+
+  uint32_t lateAnswers() const { return late_answers_; }
+
+ protected:
+  size_t started() const override { return in_flight_; }
+
+ private:
+  typedef struct {
+    uint16_t transaction_id;
+    uint8_t attempt;
+    uint32_t sent_us;
+    uint32_t deadline_us;
+  } flight_t;
+
+  void transmit(uint32_t now);
+  uint8_t send(size_t position, uint32_t now);
+  void handleFrame(const uint8_t *frame, size_t len, uint32_t now);
+  void finish(size_t position, uint8_t status);
+
+  ModbusTransport *transport_;
+  uint8_t max_in_flight_;
+  size_t in_flight_;  // the first in_flight_ requests of the queue have been sent
+  flight_t flights_[TCP_MASTER_MAX_IN_FLIGHT];  // flights_[i] is the request at position i
+  uint16_t next_transaction_id_;
+  uint8_t rx_[MODBUS_TCP_MAX_FRAME];
+  size_t rx_len_;
+  uint16_t values_[RTU_MASTER_MAX_REGISTERS];
+  uint32_t late_answers_;
+};
+
+#endif  // LIB_MODBUSTCP_TCPMASTER_H_
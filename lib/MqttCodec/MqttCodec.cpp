@@ -0,0 +1,208 @@
+/*
+ MqttCodec.cpp - MQTT 3.1.1 packet encoding and decoding
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "MqttCodec.h"
+
+#include <string.h>
+
+static const size_t MQTT_MAX_REMAINING_LENGTH = 268435455;
+
+// fixed header: type and flags, then the remaining length on 1 to 4 bytes
+static size_t _writeFixedHeader(uint8_t *buffer, uint8_t header, size_t remaining_len) {
+  size_t n = 0;
+  buffer[n++] = header;
+  do {
+    uint8_t digit = remaining_len & 0x7F;
+    remaining_len >>= 7;
+    if (remaining_len > 0) {
+      digit |= 0x80;
+    }
+    buffer[n++] = digit;
+  } while (remaining_len > 0);
+  return n;
+}
+
+static size_t _fixedHeaderLength(size_t remaining_len) {
+  return remaining_len < 128 ? 2 : remaining_len < 16384 ? 3 : remaining_len < 2097152 ? 4 : 5;
+}
+
+static size_t _writeString(uint8_t *buffer, const char *string, size_t len) {
+  buffer[0] = len >> 8;
+  buffer[1] = len & 0xFF;
+  memcpy(buffer + 2, string, len);
+  return len + 2;
+}
+
+size_t mqttEncodeConnect(uint8_t *buffer, size_t size, const char *client_id, uint16_t keep_alive_s,
+    bool clean_session) {
+  const size_t id_len = strlen(client_id);
+  const size_t remaining_len = 10 + 2 + id_len;
+  if (id_len > 0xFFFF || _fixedHeaderLength(remaining_len) + remaining_len > size) {
+    return 0;
+  }
+  size_t n = _writeFixedHeader(buffer, MQTT_CONNECT << 4, remaining_len);
+  n += _writeString(buffer + n, "MQTT", 4);
+  buffer[n++] = 4;  // protocol level: 3.1.1
+  buffer[n++] = clean_session ? 0x02 : 0x00;
+  buffer[n++] = keep_alive_s >> 8;
+  buffer[n++] = keep_alive_s & 0xFF;
+  n += _writeString(buffer + n, client_id, id_len);
+  return n;
+}
+
+size_t mqttEncodePublishHeader(uint8_t *buffer, size_t size, const char *topic, size_t payload_len, bool retain) {
+  const size_t topic_len = strlen(topic);
+  const size_t remaining_len = 2 + topic_len + payload_len;
+  const size_t header_len = _fixedHeaderLength(remaining_len) + 2 + topic_len;
+  if (topic_len > 0xFFFF || remaining_len > MQTT_MAX_REMAINING_LENGTH || header_len > size) {
+    return 0;
+  }
+  size_t n = _writeFixedHeader(buffer, MQTT_PUBLISH << 4 | (retain ? 0x01 : 0x00), remaining_len);
+  n += _writeString(buffer + n, topic, topic_len);
+  return n;
+}
+
+size_t mqttEncodeSubscribe(uint8_t *buffer, size_t size, uint16_t packet_id, const char *topic, uint8_t qos) {
+  const size_t topic_len = strlen(topic);
+  const size_t remaining_len = 2 + 2 + topic_len + 1;
+  if (topic_len > 0xFFFF || _fixedHeaderLength(remaining_len) + remaining_len > size) {
+    return 0;
+  }
+  size_t n = _writeFixedHeader(buffer, MQTT_SUBSCRIBE << 4 | 0x02, remaining_len);
+  buffer[n++] = packet_id >> 8;
+  buffer[n++] = packet_id & 0xFF;
+  n += _writeString(buffer + n, topic, topic_len);
+  buffer[n++] = qos;
+  return n;
+}
+
+size_t mqttEncodePuback(uint8_t *buffer, size_t size, uint16_t packet_id) {
+  if (size < 4) {
+    return 0;
+  }
+  buffer[0] = MQTT_PUBACK << 4;
+  buffer[1] = 2;
+  buffer[2] = packet_id >> 8;
+  buffer[3] = packet_id & 0xFF;
+  return 4;
+}
+
+size_t mqttEncodePingreq(uint8_t *buffer, size_t size) {
+  if (size < 2) {
+    return 0;
+  }
+  buffer[0] = MQTT_PINGREQ << 4;
+  buffer[1] = 0;
+  return 2;
+}
+
+MqttReader::MqttReader(uint8_t *buffer, size_t size) : buffer_(buffer), size_(size), oversized_(0) {
+  reset();
+}
+
+void MqttReader::reset() {
+  state_ = STATE_HEADER;
+  header_ = 0;
+  length_ = 0;
+  received_ = 0;
+  length_shift_ = 0;
+}
+
+void MqttReader::next() {
+  if (state_ == STATE_READY) {
+    reset();
+  }
+}
+
+size_t MqttReader::feed(const uint8_t *data, size_t len) {
+  size_t i = 0;
+  while (i < len && state_ != STATE_READY) {
+    switch (state_) {
+      case STATE_HEADER:
+        header_ = data[i++];
+        state_ = STATE_LENGTH;
+        break;
+      case STATE_LENGTH: {
+        const uint8_t digit = data[i++];
+        length_ |= static_cast<size_t>(digit & 0x7F) << length_shift_;
+        length_shift_ += 7;
+        if (digit & 0x80) {
+          if (length_shift_ >= 28) {  // malformed, resynchronization is hopeless anyway
+            reset();
+          }
+          break;
+        }
+        if (length_ > size_) {
+          ++oversized_;
+          state_ = STATE_SKIP;
+        } else {
+          state_ = length_ == 0 ? STATE_READY : STATE_BODY;
+        }
+        break;
+      }
+      case STATE_BODY: {
+        const size_t n = len - i < length_ - received_ ? len - i : length_ - received_;
+        memcpy(buffer_ + received_, data + i, n);
+        received_ += n;
+        i += n;
+        if (received_ == length_) {
+          state_ = STATE_READY;
+        }
+        break;
+      }
+      case STATE_SKIP: {
+        const size_t n = len - i < length_ - received_ ? len - i : length_ - received_;
+        received_ += n;
+        i += n;
+        if (received_ == length_) {
+          reset();
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return i;
+}
+
+bool MqttReader::parsePublish(mqtt_publish_t *publish) const {
+  if (state_ != STATE_READY || type() != MQTT_PUBLISH || length_ < 2) {
+    return false;
+  }
+  publish->qos = flags() >> 1 & 0x03;
+  publish->retain = flags() & 0x01;
+  publish->dup = flags() & 0x08;
+  publish->topic_len = buffer_[0] << 8 | buffer_[1];
+  publish->topic = reinterpret_cast<const char *>(buffer_ + 2);
+  size_t offset = 2 + publish->topic_len;
+  publish->packet_id = 0;
+  if (publish->qos > 0) {
+    if (offset + 2 > length_) {
+      return false;
+    }
+    publish->packet_id = buffer_[offset] << 8 | buffer_[offset + 1];
+    offset += 2;
+  }
+  if (offset > length_) {
+    return false;
+  }
+  publish->payload = buffer_ + offset;
+  publish->payload_len = length_ - offset;
+  return true;
+}
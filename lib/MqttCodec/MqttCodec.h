@@ -0,0 +1,93 @@
+/*
+ MqttCodec.h - MQTT 3.1.1 packet encoding and decoding
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_MQTTCODEC_MQTTCODEC_H_
+#define LIB_MQTTCODEC_MQTTCODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// control packet types (high nibble of the first byte)
+#define MQTT_CONNECT 1
+#define MQTT_CONNACK 2
+#define MQTT_PUBLISH 3
+#define MQTT_PUBACK 4
+#define MQTT_SUBSCRIBE 8
+#define MQTT_SUBACK 9
+#define MQTT_PINGREQ 12
+#define MQTT_PINGRESP 13
+#define MQTT_DISCONNECT 14
+
+// Encoders write a whole packet to buffer and return its length, 0 if it does not fit.
+size_t mqttEncodeConnect(uint8_t *buffer, size_t size, const char *client_id, uint16_t keep_alive_s,
+  bool clean_session);
+// PUBLISH without its payload, sent right after (no copy of large payloads), QoS 0 only
+size_t mqttEncodePublishHeader(uint8_t *buffer, size_t size, const char *topic, size_t payload_len, bool retain);
+size_t mqttEncodeSubscribe(uint8_t *buffer, size_t size, uint16_t packet_id, const char *topic, uint8_t qos);
+size_t mqttEncodePuback(uint8_t *buffer, size_t size, uint16_t packet_id);
+size_t mqttEncodePingreq(uint8_t *buffer, size_t size);
+
+typedef struct {
+  const char *topic;  // not null-terminated
+  uint16_t topic_len;
+  uint16_t packet_id;  // 0 for QoS 0
+  uint8_t qos;
+  bool retain;
+  bool dup;
+  const uint8_t *payload;
+  size_t payload_len;
+} mqtt_publish_t;
+
+// Splits a received byte stream into packets. A packet larger than the buffer is skipped (see oversized()).
+class MqttReader {
+ public:
+  MqttReader(uint8_t *buffer, size_t size);
+
+  // Consumes bytes until a packet is complete, returns the number of bytes consumed
+  size_t feed(const uint8_t *data, size_t len);
+  bool ready() const { return state_ == STATE_READY; }
+  uint8_t type() const { return header_ >> 4; }
+  uint8_t flags() const { return header_ & 0x0F; }
+  const uint8_t *body() const { return buffer_; }
+  size_t length() const { return length_; }
+  void next();  // releases the packet
+  void reset();
+  uint32_t oversized() const { return oversized_; }
+
+  bool parsePublish(mqtt_publish_t *publish) const;
+
+ private:
+  typedef enum {
+    STATE_HEADER = 0,
+    STATE_LENGTH,
+    STATE_BODY,
+    STATE_SKIP,
+    STATE_READY
+  } state_t;
+
+  uint8_t *buffer_;
+  size_t size_;
+  state_t state_;
+  uint8_t header_;
+  size_t length_;  // remaining length of the packet
+  size_t received_;
+  uint8_t length_shift_;
+  uint32_t oversized_;
+};
+
+#endif  // LIB_MQTTCODEC_MQTTCODEC_H_
@@ -0,0 +1,134 @@
+/*
+ MqttRouter.cpp - MQTT command dispatch
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "MqttRouter.h"
+
+#include <string.h>
+
+const char *mqttRouteString(uint8_t route) {
+  switch (route) {
+    case MQTT_ROUTE_DISPATCHED:
+      return "dispatched";
+    case MQTT_ROUTE_PENDING:
+      return "pending";
+    case MQTT_ROUTE_UNKNOWN:
+      return "unknown command";
+    case MQTT_ROUTE_TOO_LARGE:
+      return "payload too large";
+    case MQTT_ROUTE_OUT_OF_SEQUENCE:
+      return "chunk out of sequence";
+    default:
+      return "unknown";
+  }
+}
+
+MqttRouter::MqttRouter(const mqtt_command_t *commands, size_t count)
+  : commands_(commands), count_(count), prefix_len_(0), assembling_(nullptr), expected_(0), received_(0),
+    dispatched_(0), rejected_(0) {
+  prefix_[0] = '\0';
+}
+
+bool MqttRouter::begin(const char *prefix) {
+  const size_t len = strlen(prefix);
+  if (len >= sizeof(prefix_)) {
+    return false;
+  }
+  memcpy(prefix_, prefix, len + 1);
+  prefix_len_ = len;
+  for (size_t i = 1; i < count_; ++i) {
+    if (strcmp(commands_[i - 1].suffix, commands_[i].suffix) >= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const mqtt_command_t *MqttRouter::find(const char *topic) const {
+  if (strncmp(topic, prefix_, prefix_len_) != 0) {
+    return nullptr;
+  }
+  const char *suffix = topic + prefix_len_;
+  size_t low = 0;
+  size_t high = count_;
+  while (low < high) {
+    const size_t middle = (low + high) / 2;
+    const int order = strcmp(suffix, commands_[middle].suffix);
+    if (order == 0) {
+      return &commands_[middle];
+    }
+    if (order < 0) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return nullptr;
+}
+
+void MqttRouter::abandon() {
+  if (assembling_ != nullptr) {
+    assembling_ = nullptr;
+    ++rejected_;
+  }
+}
+
+uint8_t MqttRouter::route(const char *topic, const char *payload, size_t len, size_t index, size_t total) {
+  const mqtt_command_t *command = find(topic);
+  if (command == nullptr) {
+    rejected_ += index == 0;
+    return MQTT_ROUTE_UNKNOWN;
+  }
+  if (index == 0) {
+    abandon();  // chunks of different messages are never interleaved
+  }
+  if (command->max_len == 0) {  // only the end of the message matters
+    if (index + len < total) {
+      return MQTT_ROUTE_PENDING;
+    }
+    command->handler(payload, 0);
+    ++dispatched_;
+    return MQTT_ROUTE_DISPATCHED;
+  }
+  if (total > command->max_len || (len < total && total > sizeof(buffer_))) {
+    rejected_ += index == 0;
+    return MQTT_ROUTE_TOO_LARGE;
+  }
+  if (index == 0 && len == total) {
+    command->handler(payload, len);
+    ++dispatched_;
+    return MQTT_ROUTE_DISPATCHED;
+  }
+
+  if (index == 0) {
+    assembling_ = command;
+    expected_ = total;
+    received_ = 0;
+  } else if (assembling_ != command || index != received_ || total != expected_ || index + len > total) {
+    abandon();
+    return MQTT_ROUTE_OUT_OF_SEQUENCE;
+  }
+  memcpy(&buffer_[received_], payload, len);
+  received_ += len;
+  if (received_ < expected_) {
+    return MQTT_ROUTE_PENDING;
+  }
+  assembling_ = nullptr;
+  command->handler(buffer_, expected_);
+  ++dispatched_;
+  return MQTT_ROUTE_DISPATCHED;
+}
@@ -0,0 +1,83 @@
+/*
+ MqttRouter.h - MQTT command dispatch headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_MQTTROUTER_MQTTROUTER_H_
+#define LIB_MQTTROUTER_MQTTROUTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// largest payload received in several chunks
+#ifndef MQTT_ROUTER_BUFFER_SIZE
+#define MQTT_ROUTER_BUFFER_SIZE 2048
+#endif
+
+// topic before the command suffix, e.g. "MyTopic/ESP-MM-ABCDEF012345/action/"
+#define MQTT_ROUTER_MAX_PREFIX 96
+
+// payload is not null-terminated
+typedef void (*mqtt_command_handler_t)(const char *payload, size_t len);
+
+typedef struct {
+  const char *suffix;
+  mqtt_command_handler_t handler;
+  size_t max_len;  // largest accepted payload, 0 if the payload is ignored
+} mqtt_command_t;
+
+typedef enum {
+  MQTT_ROUTE_DISPATCHED = 0,
+  MQTT_ROUTE_PENDING,  // chunk stored, waiting for the next ones
+  MQTT_ROUTE_UNKNOWN,
+  MQTT_ROUTE_TOO_LARGE,
+  MQTT_ROUTE_OUT_OF_SEQUENCE,
+} mqtt_route_t;
+
+const char *mqttRouteString(uint8_t route);
+
+// Dispatches the messages received on prefix + suffix to the handler of suffix, found by a binary search in a
+// static table sorted by suffix. A payload delivered in several chunks (index/total of AsyncMqttClient) is
+// reassembled in a fixed buffer first; a single-chunk payload is handed over without copy. Handlers run in the
+// caller's context.
+class MqttRouter {
+ public:
+  MqttRouter(const mqtt_command_t *commands, size_t count);
+  // false if prefix is too long or if the table is not sorted by suffix
+  bool begin(const char *prefix);
+
+  const mqtt_command_t *find(const char *topic) const;
+  uint8_t route(const char *topic, const char *payload, size_t len, size_t index, size_t total);
+
+  uint32_t dispatched() const { return dispatched_; }
+  uint32_t rejected() const { return rejected_; }  // messages, not chunks
+
+ private:
+  void abandon();
+
+  const mqtt_command_t *commands_;
+  size_t count_;
+  char prefix_[MQTT_ROUTER_MAX_PREFIX];
+  size_t prefix_len_;
+  const mqtt_command_t *assembling_;  // command of the payload in buffer_, if incomplete
+  size_t expected_;
+  size_t received_;
+  char buffer_[MQTT_ROUTER_BUFFER_SIZE];
+  uint32_t dispatched_;
+  uint32_t rejected_;
+};
+
+#endif  // LIB_MQTTROUTER_MQTTROUTER_H_
@@ -0,0 +1,199 @@
+/*
+ MetricsServer.cpp - Minimal HTTP server of a Prometheus metrics page
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "MetricsServer.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef ARDUINO
+#include <lwip/sockets.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#endif  // ARDUINO
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static const char *CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+
+static uint32_t _micros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint32_t>(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+MetricsServer::MetricsServer(metrics_render_t render, void *context)
+  : render_(render), context_(context), listen_fd_(-1), port_(0), client_fd_(-1), chunked_(false), scrapes_(0),
+    errors_(0), last_scrape_us_(0), last_page_bytes_(0) {
+}
+
+MetricsServer::~MetricsServer() {
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+  }
+}
+
+bool MetricsServer::begin(uint16_t port) {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (listen_fd_ < 0) {
+    return false;
+  }
+  const int enable = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  struct sockaddr_in address = {};
+  socklen_t len = sizeof(address);
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(listen_fd_, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0
+      || listen(listen_fd_, 2) != 0
+      || getsockname(listen_fd_, reinterpret_cast<struct sockaddr *>(&address), &len) != 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  port_ = ntohs(address.sin_port);
+  // a client gone between select() and accept() must not block the caller
+  fcntl(listen_fd_, F_SETFL, fcntl(listen_fd_, F_GETFL, 0) | O_NONBLOCK);
+  return true;
+}
+
+void MetricsServer::poll(uint32_t timeout_ms) {
+  if (listen_fd_ < 0) {
+    return;
+  }
+  fd_set read_fds;
+  FD_ZERO(&read_fds);
+  FD_SET(listen_fd_, &read_fds);
+  struct timeval timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_usec = (timeout_ms % 1000) * 1000;
+  if (select(listen_fd_ + 1, &read_fds, nullptr, nullptr, &timeout) <= 0) {
+    return;
+  }
+  const int fd = accept(listen_fd_, nullptr, nullptr);
+  if (fd < 0) {
+    return;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);  // the time-outs below apply to blocking calls
+  serve(fd);
+  // unread bytes would make close() reset the connection, possibly before the client has read the page
+  char drain[64];
+  while (recv(fd, drain, sizeof(drain), MSG_DONTWAIT) > 0) continue;
+  close(fd);
+}
+
+void MetricsServer::serve(int fd) {
+  client_fd_ = fd;
+  struct timeval timeout;
+  timeout.tv_sec = METRICS_SERVER_TIMEOUT / 1000;
+  timeout.tv_usec = (METRICS_SERVER_TIMEOUT % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  size_t len = 0;
+  request_[0] = '\0';
+  while (len < sizeof(request_) - 1 && strstr(request_, "\r\n\r\n") == nullptr) {
+    const ssize_t n = recv(fd, &request_[len], sizeof(request_) - 1 - len, 0);
+    if (n <= 0) {
+      ++errors_;  // closed or idle before the end of the headers
+      return;
+    }
+    len += n;
+    request_[len] = '\0';
+  }
+
+  // request line: method, target and protocol version
+  char *method = request_;
+  char *target = strchr(method, ' ');
+  char *version = target != nullptr ? strchr(target + 1, ' ') : nullptr;
+  if (version == nullptr) {
+    ++errors_;
+    sendStatus("400 Bad Request");
+    return;
+  }
+  *target++ = '\0';
+  *version++ = '\0';
+  if (strcmp(method, "GET") != 0) {
+    ++errors_;
+    sendStatus("405 Method Not Allowed");
+    return;
+  }
+  if (strcspn(target, "?") != strlen("/metrics") || strncmp(target, "/metrics", strlen("/metrics")) != 0) {
+    ++errors_;
+    sendStatus("404 Not Found");
+    return;
+  }
+
+  // HTTP/1.0 clients do not know chunks: the end of the page is the end of the connection
+  chunked_ = strncmp(version, "HTTP/1.1", strlen("HTTP/1.1")) == 0;
+  const uint32_t start_us = _micros();
+  char head[160];
+  const int head_len = snprintf(head, sizeof(head),
+                                "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n%sConnection: close\r\n\r\n", CONTENT_TYPE,
+                                chunked_ ? "Transfer-Encoding: chunked\r\n" : "");
+  if (!sendAll(head, head_len)) {
+    ++errors_;
+    return;
+  }
+  PrometheusWriter writer(page_, sizeof(page_), sendChunk, this);
+  render_(&writer, context_);
+  if (!writer.finish() || (chunked_ && !sendAll("0\r\n\r\n", 5))) {
+    ++errors_;
+    return;
+  }
+  ++scrapes_;
+  last_scrape_us_ = _micros() - start_us;
+  last_page_bytes_ = writer.written();
+}
+
+bool MetricsServer::sendChunk(const char *data, size_t len, void *context) {
+  MetricsServer *server = static_cast<MetricsServer *>(context);
+  if (!server->chunked_) {
+    return server->sendAll(data, len);
+  }
+  char size[12];
+  const int size_len = snprintf(size, sizeof(size), "%x\r\n", static_cast<unsigned int>(len));
+  return server->sendAll(size, size_len) && server->sendAll(data, len) && server->sendAll("\r\n", 2);
+}
+
+bool MetricsServer::sendAll(const char *data, size_t len) {
+  while (len > 0) {
+    const ssize_t n = send(client_fd_, data, len, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;  // broken connection or send time-out
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool MetricsServer::sendStatus(const char *status) {
+  char head[128];
+  const int head_len = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\n%sContent-Length: 0\r\nConnection: close\r\n\r\n",
+                                status, strncmp(status, "405", 3) == 0 ? "Allow: GET\r\n" : "");
+  return sendAll(head, head_len);
+}
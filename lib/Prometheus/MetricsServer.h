@@ -0,0 +1,81 @@
+/*
+ MetricsServer.h - Minimal HTTP server of a Prometheus metrics page headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_PROMETHEUS_METRICSSERVER_H_
+#define LIB_PROMETHEUS_METRICSSERVER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <PrometheusWriter.h>
+
+// page written to the socket in chunks of this size (in bytes)
+#ifndef METRICS_SERVER_CHUNK_SIZE
+#define METRICS_SERVER_CHUNK_SIZE 1024
+#endif
+
+// request line and headers kept, the rest of a longer request is ignored
+#ifndef METRICS_SERVER_REQUEST_SIZE
+#define METRICS_SERVER_REQUEST_SIZE 512
+#endif
+
+// a client idle for longer is dropped (in milliseconds)
+#ifndef METRICS_SERVER_TIMEOUT
+#define METRICS_SERVER_TIMEOUT 2000
+#endif
+
+// renders the page, called once per scrape
+typedef void (*metrics_render_t)(PrometheusWriter *writer, void *context);
+
+// Serves GET /metrics on BSD sockets (lwIP on the ESP32, the host stack for tests), one client at a time and one
+// request per connection. The page is rendered while it is sent, with chunked transfer encoding (HTTP/1.1), so
+// neither the server nor the renderer hold more than one chunk.
+class MetricsServer {
+ public:
+  MetricsServer(metrics_render_t render, void *context);
+  ~MetricsServer();
+  bool begin(uint16_t port);  // 0 for any free port, see port()
+  void poll(uint32_t timeout_ms);  // waits up to timeout_ms for a client and serves it
+
+  uint16_t port() const { return port_; }
+  uint32_t scrapes() const { return scrapes_; }
+  uint32_t errors() const { return errors_; }  // bad requests and broken connections
+  uint32_t lastScrapeUs() const { return last_scrape_us_; }
+  size_t lastPageBytes() const { return last_page_bytes_; }
+
+ private:
+  static bool sendChunk(const char *data, size_t len, void *context);
+  void serve(int fd);
+  bool sendAll(const char *data, size_t len);
+  bool sendStatus(const char *status);
+
+  metrics_render_t render_;
+  void *context_;
+  int listen_fd_;
+  uint16_t port_;
+  int client_fd_;  // during serve()
+  bool chunked_;
+  char request_[METRICS_SERVER_REQUEST_SIZE];
+  char page_[METRICS_SERVER_CHUNK_SIZE];
+  uint32_t scrapes_;
+  uint32_t errors_;
+  uint32_t last_scrape_us_;
+  size_t last_page_bytes_;
+};
+
+#endif  // LIB_PROMETHEUS_METRICSSERVER_H_
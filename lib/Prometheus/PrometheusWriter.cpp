@@ -0,0 +1,126 @@
+/*
+ PrometheusWriter.cpp - Streaming Prometheus exposition format writer
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PrometheusWriter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+PrometheusWriter::PrometheusWriter(char *buffer, size_t size, prometheus_flush_t flush, void *context)
+  : buffer_(buffer), size_(size), len_(0), flush_(flush), context_(context), failed_(false), written_(0),
+    flushes_(0) {
+}
+
+void PrometheusWriter::family(const char *name, const char *help, const char *type) {
+  append("# HELP ");
+  append(name);
+  append(" ");
+  appendEscaped(help, true);
+  append("\n# TYPE ");
+  append(name);
+  append(" ");
+  append(type);
+  append("\n");
+}
+
+void PrometheusWriter::sample(const char *name, const prometheus_label_t *labels, uint8_t label_nb, double value) {
+  append(name);
+  for (uint8_t i = 0; i < label_nb; ++i) {
+    append(i == 0 ? "{" : ",");
+    append(labels[i].name);
+    append("=\"");
+    appendEscaped(labels[i].value, false);
+    append("\"");
+  }
+  if (label_nb > 0) {
+    append("}");
+  }
+  append(" ");
+  appendValue(value);
+  append("\n");
+}
+
+bool PrometheusWriter::finish() {
+  if (len_ > 0) {
+    flush();
+  }
+  return !failed_;
+}
+
+void PrometheusWriter::flush() {
+  if (!failed_ && !flush_(buffer_, len_, context_)) {
+    failed_ = true;
+  }
+  ++flushes_;
+  len_ = 0;
+}
+
+void PrometheusWriter::append(const char *data, size_t len) {
+  if (failed_) {
+    return;
+  }
+  written_ += len;
+  while (len > 0) {
+    const size_t n = len < size_ - len_ ? len : size_ - len_;
+    memcpy(&buffer_[len_], data, n);
+    len_ += n;
+    data += n;
+    len -= n;
+    if (len_ == size_) {
+      flush();
+    }
+  }
+}
+
+void PrometheusWriter::append(const char *text) {
+  append(text, strlen(text));
+}
+
+// backslash and line feed in HELP lines, double quote as well in label values
+void PrometheusWriter::appendEscaped(const char *text, bool help) {
+  const char *start = text;
+  for (; *text != '\0'; ++text) {
+    const char *escaped = nullptr;
+    if (*text == '\\') {
+      escaped = "\\\\";
+    } else if (*text == '\n') {
+      escaped = "\\n";
+    } else if (*text == '"' && !help) {
+      escaped = "\\\"";
+    }
+    if (escaped != nullptr) {
+      append(start, text - start);
+      append(escaped, 2);
+      start = text + 1;
+    }
+  }
+  append(start, text - start);
+}
+
+void PrometheusWriter::appendValue(double value) {
+  if (isnan(value)) {
+    append("NaN");
+  } else if (isinf(value)) {
+    append(value > 0 ? "+Inf" : "-Inf");
+  } else {
+    char text[24];
+    const int len = snprintf(text, sizeof(text), "%.9g", value);
+    append(text, len);
+  }
+}
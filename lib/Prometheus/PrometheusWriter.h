@@ -0,0 +1,67 @@
+/*
+ PrometheusWriter.h - Streaming Prometheus exposition format writer headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_PROMETHEUS_PROMETHEUSWRITER_H_
+#define LIB_PROMETHEUS_PROMETHEUSWRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// receives each full buffer, and the last partial one; returns false to abort the page
+typedef bool (*prometheus_flush_t)(const char *data, size_t len, void *context);
+
+typedef struct {
+  const char *name;
+  const char *value;  // escaped when written
+} prometheus_label_t;
+
+// Text exposition format (version 0.0.4) written through a fixed buffer: whenever it is full, it is handed to the
+// flush callback and reused, so the memory needed to render a page does not depend on the number of samples.
+// After a failed flush, everything else is dropped and finish() returns false.
+class PrometheusWriter {
+ public:
+  PrometheusWriter(char *buffer, size_t size, prometheus_flush_t flush, void *context);
+
+  // HELP and TYPE lines (type: counter, gauge, untyped...), before the samples of the metric
+  void family(const char *name, const char *help, const char *type);
+  void sample(const char *name, const prometheus_label_t *labels, uint8_t label_nb, double value);
+  void sample(const char *name, double value) { sample(name, nullptr, 0, value); }
+  bool finish();  // flushes the rest of the buffer
+
+  bool failed() const { return failed_; }
+  size_t written() const { return written_; }  // bytes of the page so far
+  uint32_t flushes() const { return flushes_; }
+
+ private:
+  void append(const char *data, size_t len);
+  void append(const char *text);
+  void appendEscaped(const char *text, bool help);
+  void appendValue(double value);
+  void flush();
+
+  char *buffer_;
+  size_t size_;
+  size_t len_;
+  prometheus_flush_t flush_;
+  void *context_;
+  bool failed_;
+  size_t written_;
+  uint32_t flushes_;
+};
+
+#endif  // LIB_PROMETHEUS_PROMETHEUSWRITER_H_
@@ -0,0 +1,160 @@
+/*
+ RegisterMap.cpp - Diematic register map decoding
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "RegisterMap.h"
+
+// avoids pow(): double precision is emulated in software on the ESP32
+static const double POW10[] = { 1.0, 10.0, 100.0, 1000.0, 10000.0 };
+
+bool decodeDiematicDecimal(uint16_t raw_value, uint8_t decimals, double *value_ptr) {
+  if (raw_value == 0xFFFF || decimals >= sizeof(POW10) / sizeof(POW10[0])) {
+    return false;
+  }
+  double output = raw_value & 0x7FFF;
+  if (raw_value & 0x8000) {
+    output = -output;
+  }
+  *value_ptr = output / POW10[decimals];
+  return true;
+}
+
+uint8_t registerFieldCount(const modbus_register_t *reg) {
+  switch (reg->type) {
+    case REGISTER_TYPE_U16:
+    case REGISTER_TYPE_DIEMATIC_ONE_DECIMAL:
+      return 1;
+    case REGISTER_TYPE_BITFIELD:
+      for (uint8_t j = 0; j < 16; ++j) {
+        if (reg->optional_param.bitfield[j] == nullptr) {
+          return j;
+        }
+      }
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+static bool _isBitEntity(modbus_entity_t modbus_entity) {
+  return modbus_entity == MODBUS_TYPE_COIL || modbus_entity == MODBUS_TYPE_DISCRETE;
+}
+
+uint16_t registerWidth(const modbus_register_t *reg) {
+  if (_isBitEntity(reg->modbus_entity) && reg->type == REGISTER_TYPE_BITFIELD) {
+    const uint8_t field_nb = registerFieldCount(reg);
+    return field_nb > 0 ? field_nb : 1;
+  }
+  return 1;
+}
+
+uint8_t modbusReadFunction(modbus_entity_t modbus_entity) {
+  switch (modbus_entity) {
+    case MODBUS_TYPE_HOLDING:
+      return 0x03;
+    case MODBUS_TYPE_INPUT:
+      return 0x04;
+    case MODBUS_TYPE_COIL:
+      return 0x01;
+    case MODBUS_TYPE_DISCRETE:
+      return 0x02;
+    default:
+      return 0;
+  }
+}
+
+int16_t findRegister(const modbus_register_t *table, uint8_t count, uint16_t register_id, uint16_t *field_id_ptr) {
+  uint16_t field_id = 0;
+  for (uint8_t i = 0; i < count; ++i) {
+    if (table[i].id == register_id) {
+      if (field_id_ptr != nullptr) {
+        *field_id_ptr = field_id;
+      }
+      return i;
+    }
+    if (field_id_ptr != nullptr) {
+      field_id += registerFieldCount(&table[i]);
+    }
+  }
+  return -1;
+}
+
+uint8_t decodeRegister(const modbus_register_t *reg, uint16_t raw_value, uint16_t field_id,
+    modbus_field_callback_t callback, void *context) {
+  switch (reg->type) {
+    case REGISTER_TYPE_U16:
+      callback(field_id, reg->name, raw_value, context);
+      return 1;
+    case REGISTER_TYPE_DIEMATIC_ONE_DECIMAL: {
+      double value;
+      if (!decodeDiematicDecimal(raw_value, 1, &value)) {
+        return 0;
+      }
+      callback(field_id, reg->name, value, context);
+      return 1;
+    }
+    case REGISTER_TYPE_BITFIELD: {
+      uint8_t j = 0;
+      for (; j < 16 && reg->optional_param.bitfield[j] != nullptr; ++j) {
+        callback(field_id + j, reg->optional_param.bitfield[j], raw_value >> j & 1, context);
+      }
+      return j;
+    }
+    default:
+      return 0;
+  }
+}
+
+uint8_t planRegisterBlocks(const modbus_register_t *table, uint8_t count, uint16_t max_gap, modbus_block_t *blocks) {
+  uint8_t block_nb = 0;
+  modbus_block_t *block = nullptr;
+  for (uint8_t i = 0; i < count; ++i) {
+    const modbus_register_t *reg = &table[i];
+    const uint32_t end = static_cast<uint32_t>(reg->id) + registerWidth(reg);
+    const uint32_t max_count = _isBitEntity(reg->modbus_entity) ? MODBUS_MAX_READ_BITS : MODBUS_MAX_READ_REGISTERS;
+    if (block != nullptr && reg->modbus_entity == block->modbus_entity && reg->id >= block->address
+        && reg->id <= static_cast<uint32_t>(block->address) + block->count + max_gap
+        && end - block->address <= max_count) {
+      ++block->entries;
+      if (end - block->address > block->count) {
+        block->count = end - block->address;
+      }
+      continue;
+    }
+    block = &blocks[block_nb++];
+    block->first = i;
+    block->entries = 1;
+    block->modbus_entity = reg->modbus_entity;
+    block->address = reg->id;
+    block->count = end - reg->id;
+  }
+  return block_nb;
+}
+
+uint16_t blockRegisterValue(const modbus_block_t *block, const modbus_register_t *reg, const uint16_t *values) {
+  const uint16_t offset = reg->id - block->address;
+  if (!_isBitEntity(block->modbus_entity)) {
+    return values[offset];
+  }
+  const uint16_t width = registerWidth(reg);
+  const uint8_t shift = offset % 16;
+  uint32_t bits = values[offset / 16] >> shift;
+  if (shift + width > 16) {
+    bits |= static_cast<uint32_t>(values[offset / 16 + 1]) << (16 - shift);
+  }
+  return bits & ((1UL << width) - 1);
+}
@@ -0,0 +1,99 @@
+/*
+ RegisterMap.h - Diematic register map decoding
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_REGISTERMAP_REGISTERMAP_H_
+#define LIB_REGISTERMAP_REGISTERMAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    MODBUS_TYPE_HOLDING = 0x00,         /*!< Modbus Holding register. */
+    MODBUS_TYPE_INPUT,                  /*!< Modbus Input register. */
+    MODBUS_TYPE_COIL,                   /*!< Modbus Coils. */
+    MODBUS_TYPE_DISCRETE,               /*!< Modbus Discrete bits. */
+    MODBUS_TYPE_COUNT,
+//    MODBUS_TYPE_UNKNOWN = 0xFF
+} modbus_entity_t;
+
+typedef enum {
+//    REGISTER_TYPE_U8 = 0x00,                   /*!< Unsigned 8 */
+    REGISTER_TYPE_U16 = 0x01,                  /*!< Unsigned 16 */
+//    REGISTER_TYPE_U32 = 0x02,                  /*!< Unsigned 32 */
+//    REGISTER_TYPE_FLOAT = 0x03,                /*!< Float type */
+//    REGISTER_TYPE_ASCII = 0x04,                 /*!< ASCII type */
+    REGISTER_TYPE_DIEMATIC_ONE_DECIMAL = 0x05,
+    REGISTER_TYPE_BITFIELD = 0x06,
+    REGISTER_TYPE_DEBUG = 0x07
+} register_type_t;
+
+typedef union {
+    const char* bitfield[16];
+} optional_param_t;
+
+// Coils and discrete inputs: id is the address of the (first) bit. A REGISTER_TYPE_BITFIELD entry names
+// consecutive bits, any other type reads a single bit as 0 or 1.
+typedef struct {
+    uint16_t            id;
+    modbus_entity_t     modbus_entity;      /*!< Type of modbus parameter */
+    register_type_t     type;               /*!< Float, U8, U16, U32, ASCII, etc. */
+    const char*         name;
+    optional_param_t    optional_param;
+} modbus_register_t;
+
+// protocol limits of a single read request
+#define MODBUS_MAX_READ_REGISTERS 125
+#define MODBUS_MAX_READ_BITS 2000
+
+// Entries of a register table read by a single request
+typedef struct {
+    uint8_t             first;              /*!< index of the first entry in the table */
+    uint8_t             entries;
+    modbus_entity_t     modbus_entity;
+    uint16_t            address;
+    uint16_t            count;              /*!< registers or bits */
+} modbus_block_t;
+
+// Called once per decoded value. field_id is the position of the value in the flattened
+// register list (one per U16/decimal register, one per bitfield bit), stable across scans.
+// The value is a double so that 32-bit counters (see DerivedFields) come out exact.
+typedef void (*modbus_field_callback_t)(uint16_t field_id, const char *name, double value, void *context);
+
+// Sign and magnitude, 0xFFFF meaning "no value": false is returned and *value_ptr is left untouched
+bool decodeDiematicDecimal(uint16_t raw_value, uint8_t decimals, double *value_ptr);
+// Number of values a register decodes to (0 for DEBUG registers)
+uint8_t registerFieldCount(const modbus_register_t *reg);
+// Number of addresses an entry spans: consecutive bits of a coil or discrete input bitfield, otherwise 1
+uint16_t registerWidth(const modbus_register_t *reg);
+// Read function code of a Modbus entity, 0 if there is none
+uint8_t modbusReadFunction(modbus_entity_t modbus_entity);
+// Index of register_id in table, or -1. The field id of its first value is stored in field_id_ptr when not null.
+int16_t findRegister(const modbus_register_t *table, uint8_t count, uint16_t register_id, uint16_t *field_id_ptr);
+// Calls callback for each value of raw_value, returns the number of values decoded
+uint8_t decodeRegister(const modbus_register_t *reg, uint16_t raw_value, uint16_t field_id,
+  modbus_field_callback_t callback, void *context);
+
+// Groups consecutive entries of table of the same entity into blocks, as long as the next entry starts at most
+// max_gap addresses after the end of the block and the block fits in a read request. blocks must have room for
+// count entries, the number of blocks is returned.
+uint8_t planRegisterBlocks(const modbus_register_t *table, uint8_t count, uint16_t max_gap, modbus_block_t *blocks);
+// Raw value of reg (an entry of block) from the values read for block. Bits come packed 16 per value (first bit
+// in the least significant bit), a bitfield gets its first bit in the least significant bit.
+uint16_t blockRegisterValue(const modbus_block_t *block, const modbus_register_t *reg, const uint16_t *values);
+
+#endif  // LIB_REGISTERMAP_REGISTERMAP_H_
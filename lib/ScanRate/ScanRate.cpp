@@ -0,0 +1,79 @@
+/*
+ ScanRate.cpp - Adaptive sampling period
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ScanRate.h"
+
+#include <math.h>
+
+ScanRate::ScanRate(uint32_t period_ms, uint32_t min_period_ms, uint32_t max_period_ms, uint8_t max_utilization,
+    float deadband)
+  : compared_(0), moved_(0), period_ms_(period_ms), min_period_ms_(min_period_ms), max_period_ms_(max_period_ms),
+    max_utilization_(max_utilization > 0 && max_utilization <= 100 ? max_utilization : 100), deadband_(deadband),
+    scan_us_(0), volatility_(0), scans_(0) {
+  for (uint16_t i = 0; i < SCAN_RATE_MAX_FIELDS; ++i) {
+    last_[i] = NAN;
+  }
+}
+
+void ScanRate::addValue(uint16_t field_id, float value) {
+  if (field_id >= SCAN_RATE_MAX_FIELDS) {
+    return;
+  }
+  if (!isnan(last_[field_id])) {
+    ++compared_;
+    if (fabsf(value - last_[field_id]) > deadband_) {
+      ++moved_;
+    }
+  }
+  last_[field_id] = value;
+}
+
+uint32_t ScanRate::endScan(uint32_t busy_us) {
+  scan_us_ = scans_ == 0 ? busy_us : (3ULL * scan_us_ + busy_us) / 4;
+  ++scans_;
+  uint64_t period_ms = period_ms_;
+  if (compared_ > 0) {  // not on the first scan, nor when every read failed
+    volatility_ = (volatility_ + static_cast<float>(moved_) / compared_) / 2;
+    if (volatility_ > SCAN_RATE_FAST_CHANGES) {
+      period_ms /= 2;
+    } else if (volatility_ < SCAN_RATE_SLOW_CHANGES) {
+      period_ms += period_ms / 4 > 0 ? period_ms / 4 : 1;
+    }
+  }
+  compared_ = 0;
+  moved_ = 0;
+
+  // a scan slowed down by time-outs counts at once, a faster one through the average
+  const uint64_t worst_us = busy_us > scan_us_ ? busy_us : scan_us_;
+  const uint64_t bus_min_ms = (worst_us * 100 + max_utilization_ * 1000ULL - 1) / (max_utilization_ * 1000ULL);
+  if (period_ms < min_period_ms_) {
+    period_ms = min_period_ms_;
+  }
+  if (period_ms < bus_min_ms) {
+    period_ms = bus_min_ms;
+  }
+  if (period_ms > max_period_ms_) {
+    period_ms = max_period_ms_;  // the bounds win over the utilization target
+  }
+  period_ms_ = period_ms;
+  return period_ms_;
+}
+
+float ScanRate::utilization() const {
+  return period_ms_ > 0 ? scan_us_ / (period_ms_ * 1000.0f) : 0;
+}
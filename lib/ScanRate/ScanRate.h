@@ -0,0 +1,70 @@
+/*
+ ScanRate.h - Adaptive sampling period headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_SCANRATE_SCANRATE_H_
+#define LIB_SCANRATE_SCANRATE_H_
+
+#include <stdint.h>
+
+#ifndef SCAN_RATE_MAX_FIELDS
+#define SCAN_RATE_MAX_FIELDS 96
+#endif
+
+// share of the fields moving at each scan above which the period is halved, below which it is stretched by 25%
+#ifndef SCAN_RATE_FAST_CHANGES
+#define SCAN_RATE_FAST_CHANGES 0.10f
+#endif
+#ifndef SCAN_RATE_SLOW_CHANGES
+#define SCAN_RATE_SLOW_CHANGES 0.02f
+#endif
+
+// Picks the sampling period from the last scans. Volatility is the share of the fields that moved by more than the
+// deadband since the previous scan (a bit that flips, a temperature rising), smoothed over a few scans: the period
+// is halved as soon as the values move, and stretched slowly while they are stable. It stays within
+// [min_period_ms, max_period_ms] and, whatever the volatility, long enough for the scans to keep the bus busy at
+// most max_utilization percent of the time (unless max_period_ms is too short for that). The table is
+// preallocated: a scan never allocates.
+class ScanRate {
+ public:
+  ScanRate(uint32_t period_ms, uint32_t min_period_ms, uint32_t max_period_ms, uint8_t max_utilization,
+    float deadband);
+
+  void addValue(uint16_t field_id, float value);  // each field decoded by the scan, beyond the table ignored
+  uint32_t endScan(uint32_t busy_us);  // time the scan kept the bus busy, returns the next period
+
+  uint32_t periodMs() const { return period_ms_; }
+  uint32_t scanUs() const { return scan_us_; }  // smoothed
+  float volatility() const { return volatility_; }
+  float utilization() const;  // of the bus by the scans at the current period, 0 to 1
+  uint32_t scans() const { return scans_; }
+
+ private:
+  float last_[SCAN_RATE_MAX_FIELDS];  // NAN until read once
+  uint16_t compared_;  // fields of the current scan with a previous value
+  uint16_t moved_;
+  uint32_t period_ms_;
+  uint32_t min_period_ms_;
+  uint32_t max_period_ms_;
+  uint8_t max_utilization_;
+  float deadband_;
+  uint32_t scan_us_;
+  float volatility_;
+  uint32_t scans_;
+};
+
+#endif  // LIB_SCANRATE_SCANRATE_H_
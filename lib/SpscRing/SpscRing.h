@@ -0,0 +1,76 @@
+/*
+ SpscRing.h - Lock-free single-producer/single-consumer ring buffer
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_SPSCRING_SPSCRING_H_
+#define LIB_SPSCRING_SPSCRING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Fixed-capacity FIFO shared by exactly one producer task and one consumer task,
+// possibly on different cores. push() and pop() never block nor allocate; when the
+// ring is full the new item is dropped and counted.
+template <typename T, size_t N>
+class SpscRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of 2");
+
+ public:
+  SpscRing() : head_(0), tail_(0), dropped_(0), high_water_(0) {}
+
+  bool push(const T &item) {  // producer only
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t depth = head - tail_.load(std::memory_order_acquire);
+    if (depth == N) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    items_[head & (N - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    if (depth + 1 > high_water_.load(std::memory_order_relaxed)) {
+      high_water_.store(depth + 1, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  bool pop(T *item) {  // consumer only
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *item = items_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+  size_t capacity() const { return N; }
+  uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+  size_t highWater() const { return high_water_.load(std::memory_order_relaxed); }
+
+ private:
+  T items_[N];
+  std::atomic<size_t> head_;  // written by the producer
+  std::atomic<size_t> tail_;  // written by the consumer
+  std::atomic<uint32_t> dropped_;
+  std::atomic<size_t> high_water_;
+};
+
+#endif  // LIB_SPSCRING_SPSCRING_H_
@@ -20,6 +20,10 @@
 
 #include <Arduino.h>
 
+#ifndef ESP_LOGV  // host builds
+#define ESP_LOGV(tag, ...)
+#endif
+
 Url::Url(const String& url_s) {
   // check for ://
   int index = url_s.indexOf("://");
@@ -19,6 +19,8 @@
 #include "esp_base.h"
 
 #include "Arduino.h"
+#include <esp_heap_caps.h>
+#include <ArduinoJson.h>
 #include <WiFiClientSecure.h>
 #include <HTTPClient.h>
 #include <Update.h>
@@ -31,6 +33,23 @@ static const char *VERSION_HEADER = "X-Object-Meta-Version";
 static const char __attribute__((__unused__)) *TAG = "ESP_base";
 
 
+void memoryStatsToJson(ArduinoJson::JsonVariant variant, const char *const *task_names, uint8_t task_nb) {
+  JsonObject heap = variant["heap"].to<JsonObject>();
+  heap["size"] = ESP.getHeapSize();
+  heap["free"] = ESP.getFreeHeap();
+  heap["min_free"] = ESP.getMinFreeHeap();  // lowest level since boot
+  heap["largest_block"] = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);  // fragmentation
+
+  // minimum free stack since the task started (in bytes on ESP32)
+  JsonObject tasks = variant["stack_min_free"].to<JsonObject>();
+  for (uint8_t i = 0; i < task_nb; ++i) {
+    TaskHandle_t task = xTaskGetHandle(task_names[i]);
+    if (task != NULL) {
+      tasks[task_names[i]] = uxTaskGetStackHighWaterMark(task);
+    }
+  }
+}
+
 bool _httpRequest(HTTPClient *http_client, const String& url_s) {
   bool ret = false;
   Url url(url_s);
@@ -20,7 +20,9 @@
 #define SRC_ESP_BASE_H_
 
 #include "Arduino.h"
+#include <ArduinoJson.h>
 
+void memoryStatsToJson(ArduinoJson::JsonVariant variant, const char *const *task_names, uint8_t task_nb);
 bool checkFirmwareUpdate(const String& url_s, const String& current_version);
 bool updateOTA(const String& url_s);
 
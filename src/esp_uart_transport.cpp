@@ -0,0 +1,134 @@
+/*
+ esp_uart_transport.cpp - Modbus transport over the ESP32 UART driver
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "esp_uart_transport.h"
+
+#include "Arduino.h"
+#include <esp_timer.h>
+#include <driver/uart.h>
+#include <ModbusRtu.h>
+
+static const char __attribute__((__unused__)) *TAG = "UART_transport";
+
+static const int UART_BUFFER_SIZE = 512;  // must be greater than the 128-byte hardware FIFO
+static const int UART_EVENT_QUEUE_SIZE = 16;
+static const int UART_RX_FULL_THRESHOLD = 120;  // the driver default, set explicitly for chunk_max_us_
+
+EspUartTransport::EspUartTransport(uart_port_t port)
+  : port_(port), event_queue_(NULL), chunk_left_(0), chunk_open_(false), chunk_us_(0), chunk_max_us_(0) {
+}
+
+bool EspUartTransport::begin(uint32_t baudrate, int rxd, int txd, int rts) {
+  uart_config_t config = {};
+  config.baud_rate = baudrate;
+  config.data_bits = UART_DATA_8_BITS;
+  config.parity = UART_PARITY_DISABLE;
+  config.stop_bits = UART_STOP_BITS_1;
+  config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+  config.rx_flow_ctrl_thresh = 122;
+
+  if (uart_driver_install(port_, UART_BUFFER_SIZE, UART_BUFFER_SIZE, UART_EVENT_QUEUE_SIZE, &event_queue_, 0)
+      != ESP_OK) {
+    ESP_LOGE(TAG, "Unable to install UART driver");
+    return false;
+  }
+  uart_param_config(port_, &config);
+  uart_set_pin(port_, txd, rxd, rts == NOT_A_PIN ? UART_PIN_NO_CHANGE : rts, UART_PIN_NO_CHANGE);
+  // with RTS, the transceiver direction is switched by the UART itself around each transmission
+  uart_set_mode(port_, rts == NOT_A_PIN ? UART_MODE_UART : UART_MODE_RS485_HALF_DUPLEX);
+  // RX timeout of t1.5 (in characters, rounded up): the driver reports data as soon as a frame ends
+  const uint8_t timeout_chars = (modbusT15(baudrate) * baudrate + 11000000 - 1) / 11000000;
+  uart_set_rx_timeout(port_, timeout_chars);
+  // Longer frames come in several chunks, all but the last one on the FIFO threshold. A frame of exactly a
+  // multiple of the threshold gets no time-out event: it is closed once another chunk would have come.
+  uart_set_rx_full_threshold(port_, UART_RX_FULL_THRESHOLD);
+  chunk_max_us_ = (UART_RX_FULL_THRESHOLD + timeout_chars + 1) * 11000000ULL / baudrate;
+  return true;
+}
+
+bool EspUartTransport::send(const uint8_t *data, size_t len) {
+  // copied into the TX ring buffer, sent by the ISR
+  return uart_write_bytes(port_, reinterpret_cast<const char *>(data), len) == static_cast<int>(len);
+}
+
+// Takes the queued events up to the next data event, false if there is none
+bool EspUartTransport::nextChunk() {
+  uart_event_t event;
+  while (xQueueReceive(event_queue_, &event, 0) == pdTRUE) {
+    switch (event.type) {
+      case UART_DATA:
+        if (event.size == 0) {
+          break;
+        }
+        chunk_left_ = event.size;
+        chunk_open_ = !event.timeout_flag;
+        chunk_us_ = micros();
+        return true;
+      case UART_FIFO_OVF:
+      case UART_BUFFER_FULL:
+        ESP_LOGW(TAG, "UART overflow, flushing input");
+        uart_flush_input(port_);
+        xQueueReset(event_queue_);
+        chunk_left_ = 0;
+        chunk_open_ = false;
+        return false;
+      default:  // wake() or line events
+        break;
+    }
+  }
+  return false;
+}
+
+size_t EspUartTransport::receive(uint8_t *buffer, size_t size) {
+  size_t received = 0;
+  while (received < size && (chunk_left_ > 0 || nextChunk())) {
+    const size_t wanted = size - received < chunk_left_ ? size - received : chunk_left_;
+    const int n = uart_read_bytes(port_, &buffer[received], wanted, 0);
+    if (n <= 0) {
+      chunk_left_ = 0;  // announced bytes gone (flushed)
+      break;
+    }
+    received += n;
+    chunk_left_ -= n;
+  }
+  return received;
+}
+
+// Leaves the events in the queue for receive(), which keeps them in step with the bytes
+void EspUartTransport::wait(uint32_t timeout_us) {
+  if (chunk_left_ > 0) {
+    return;
+  }
+  const TickType_t ticks = timeout_us == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS((timeout_us + 999) / 1000);
+  uart_event_t event;
+  xQueuePeek(event_queue_, &event, ticks);
+}
+
+bool EspUartTransport::rxFrameOpen() {
+  return chunk_left_ > 0 || (chunk_open_ && micros() - chunk_us_ < chunk_max_us_);
+}
+
+void EspUartTransport::wake() {
+  uart_event_t event = {};
+  event.type = UART_EVENT_MAX;  // not a driver event, only breaks wait()
+  xQueueSend(event_queue_, &event, 0);
+}
+
+uint32_t EspUartTransport::micros() {
+  return static_cast<uint32_t>(esp_timer_get_time());
+}
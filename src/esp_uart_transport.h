@@ -0,0 +1,54 @@
+/*
+ esp_uart_transport.h - Modbus transport over the ESP32 UART driver headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SRC_ESP_UART_TRANSPORT_H_
+#define SRC_ESP_UART_TRANSPORT_H_
+
+#include "Arduino.h"
+#include <driver/uart.h>
+#include <ModbusTransport.h>
+
+// Interrupt-driven UART: the driver fills ring buffers from the ISR and posts
+// events, so wait() sleeps on the event queue instead of polling the FIFO.
+// With an RTS pin, the UART runs in hardware RS-485 half-duplex mode and drives DE and /RE itself.
+// Bytes are received chunk by chunk as announced by the data events: a chunk handed over on the FIFO threshold
+// rather than on the RX time-out leaves the frame open (see rxFrameOpen()).
+class EspUartTransport : public ModbusTransport {
+ public:
+  explicit EspUartTransport(uart_port_t port);
+  bool begin(uint32_t baudrate, int rxd, int txd, int rts);
+
+  bool send(const uint8_t *data, size_t len) override;
+  size_t receive(uint8_t *buffer, size_t size) override;
+  void wait(uint32_t timeout_us) override;
+  void wake() override;
+  uint32_t micros() override;
+  bool rxFrameOpen() override;
+
+ private:
+  bool nextChunk();
+
+  uart_port_t port_;
+  QueueHandle_t event_queue_;
+  size_t chunk_left_;  // bytes of the current data event not received yet
+  bool chunk_open_;  // the current data event came on the FIFO threshold
+  uint32_t chunk_us_;  // time the current data event was taken
+  uint32_t chunk_max_us_;  // longest wait for the rest of a frame after a FIFO threshold event
+};
+
+#endif  // SRC_ESP_UART_TRANSPORT_H_
@@ -0,0 +1,77 @@
+/*
+ json_arena.h - ArduinoJson allocator on a static buffer
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SRC_JSON_ARENA_H_
+#define SRC_JSON_ARENA_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ArduinoJson.h>
+#include <Arena.h>
+
+// Lets a JsonDocument live in a static buffer instead of the heap: clearing (or destroying) the document releases
+// the whole arena for the next one. When the arena is full, the heap takes over (see fallbacks()), so a document
+// larger than expected is still complete.
+class JsonArenaAllocator : public ArduinoJson::Allocator {
+ public:
+  JsonArenaAllocator(void *buffer, size_t size) : arena_(buffer, size), fallbacks_(0) {}
+
+  void *allocate(size_t size) override {
+    void *ptr = arena_.allocate(size);
+    if (ptr == nullptr) {
+      ++fallbacks_;
+      ptr = malloc(size);
+    }
+    return ptr;
+  }
+
+  void deallocate(void *ptr) override {
+    if (arena_.owns(ptr)) {
+      arena_.deallocate(ptr);
+    } else {
+      free(ptr);
+    }
+  }
+
+  void *reallocate(void *ptr, size_t size) override {
+    if (ptr != nullptr && !arena_.owns(ptr)) {
+      return realloc(ptr, size);
+    }
+    void *moved = arena_.reallocate(ptr, size);
+    if (moved == nullptr) {
+      ++fallbacks_;
+      moved = malloc(size);
+      if (moved != nullptr && ptr != nullptr) {
+        const size_t old_size = arena_.blockSize(ptr);
+        memcpy(moved, ptr, old_size < size ? old_size : size);
+        arena_.deallocate(ptr);
+      }
+    }
+    return moved;
+  }
+
+  const Arena &arena() const { return arena_; }
+  uint32_t fallbacks() const { return fallbacks_; }
+
+ private:
+  Arena arena_;
+  uint32_t fallbacks_;
+};
+
+#endif  // SRC_JSON_ARENA_H_
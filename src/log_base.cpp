@@ -0,0 +1,88 @@
+/*
+ log_base.cpp - Deferred logging functions
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "log_base.h"
+
+#include "Arduino.h"
+#include <esp_log.h>
+
+// initial level of every tag, can be changed at runtime (see setLogLevel)
+#ifndef BINLOG_DEFAULT_LEVEL
+#ifdef CORE_DEBUG_LEVEL
+#define BINLOG_DEFAULT_LEVEL CORE_DEBUG_LEVEL
+#else
+#define BINLOG_DEFAULT_LEVEL BINLOG_LEVEL_INFO
+#endif  // CORE_DEBUG_LEVEL
+#endif  // BINLOG_DEFAULT_LEVEL
+
+static const char __attribute__((__unused__)) *TAG = "Log_base";
+
+#define BINLOG_TAG_ENTRY(id, name) name,
+static const char *const LOG_TAGS[] = { BINLOG_TAGS(BINLOG_TAG_ENTRY) };
+#undef BINLOG_TAG_ENTRY
+
+#define BINLOG_MESSAGE_ENTRY(id, tag, level, format) { tag, level, format },
+static const binlog_message_t LOG_MESSAGES[] = { BINLOG_MESSAGES(BINLOG_MESSAGE_ENTRY) };
+#undef BINLOG_MESSAGE_ENTRY
+
+BinLog binlog(LOG_MESSAGES, LOG_MESSAGE_NB, LOG_TAGS, LOG_TAG_NB, BINLOG_DEFAULT_LEVEL);
+
+// formats the pending records on the console, to be called from a low priority task
+void printBinLog() {
+  static const char LEVEL_LETTERS[] = "NEWIDV";
+  static uint32_t overwritten = 0;
+  binlog_record_t record;
+  char text[160];
+  while (binlog.read(&record)) {
+    binlog.format(record, text, sizeof(text));
+    log_printf("[%6u][%c][%s] %s\r\n", record.timestamp_us / 1000, LEVEL_LETTERS[binlog.messageLevel(record.id)],
+      binlog.tag(record.id), text);
+  }
+  if (binlog.overwritten() != overwritten) {
+    ESP_LOGW(TAG, "%u log records overwritten before being printed", binlog.overwritten() - overwritten);
+    overwritten = binlog.overwritten();
+  }
+}
+
+// raw records, to be decoded with tools/binlog_decode.py
+size_t dumpBinLog(uint8_t *buffer, size_t size) {
+  return binlog.snapshot(buffer, size);
+}
+
+// setting: "<level>" for every tag or "<tag>=<level>", level from 0 (none) to 5 (verbose)
+bool setLogLevel(const char *setting) {
+  char tag[24] = "*";
+  unsigned int level;
+  const bool parsed = strchr(setting, '=') != nullptr ? sscanf(setting, "%23[^=]=%u", tag, &level) == 2
+                                                     : sscanf(setting, "%u", &level) == 1;
+  if (!parsed) {
+    ESP_LOGE(TAG, "Invalid log level setting: %s", setting);
+    return false;
+  }
+  if (level > BINLOG_LEVEL_VERBOSE) {
+    ESP_LOGE(TAG, "Invalid log level: %u (expected 0 to 5)", level);
+    return false;
+  }
+  if (!binlog.setLevel(tag, level)) {
+    ESP_LOGE(TAG, "Unknown log tag: %s", tag);
+    return false;
+  }
+  esp_log_level_set(tag, static_cast<esp_log_level_t>(level));
+  ESP_LOGI(TAG, "Log level of %s changed to %u", tag, level);
+  return true;
+}
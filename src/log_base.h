@@ -0,0 +1,36 @@
+/*
+ log_base.h - Deferred logging functions headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SRC_LOG_BASE_H_
+#define SRC_LOG_BASE_H_
+
+#include <esp_timer.h>
+#include <BinLog.h>
+#include "log_messages.h"
+
+extern BinLog binlog;
+
+// Records a message of log_messages.h, e.g. BINLOG(LOG_REGISTER, reg->id, reg->type, reg->name).
+// Costs a level check and a copy of the arguments: formatting happens in printBinLog().
+#define BINLOG(id, ...) binlog.log(id, static_cast<uint32_t>(esp_timer_get_time()), ##__VA_ARGS__)
+
+void printBinLog();
+size_t dumpBinLog(uint8_t *buffer, size_t size);
+bool setLogLevel(const char *setting);
+
+#endif  // SRC_LOG_BASE_H_
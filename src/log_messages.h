@@ -0,0 +1,68 @@
+/*
+ log_messages.h - Binary log message catalogue
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SRC_LOG_MESSAGES_H_
+#define SRC_LOG_MESSAGES_H_
+
+// A record only carries the position of its message in this list: append new messages at the end, and keep
+// unused ones in place, so that dumps taken with older firmwares still decode (see tools/binlog_decode.py).
+// Arguments: up to 4 integers, floats or strings that are never freed (literals, registers[] names).
+
+// X(id, name)
+#define BINLOG_TAGS(X) \
+  X(LOG_TAG_MAIN, "Main") \
+  X(LOG_TAG_MODBUS, "Modbus_base")
+
+// X(id, tag, level, format)
+#define BINLOG_MESSAGES(X) \
+  X(LOG_POLLER_SUSPEND, LOG_TAG_MAIN, BINLOG_LEVEL_VERBOSE, "Suspending Modbus Poller task. Unused stack size: %d") \
+  X(LOG_POLLER_RESUME, LOG_TAG_MAIN, BINLOG_LEVEL_VERBOSE, "Resuming Modbus Poller task") \
+  X(LOG_POLLER_TIMER, LOG_TAG_MAIN, BINLOG_LEVEL_VERBOSE, "Time to resume Modbus Poller") \
+  X(LOG_SCAN_START, LOG_TAG_MODBUS, BINLOG_LEVEL_INFO, "Parsing all Modbus registers") \
+  X(LOG_SCAN_REQUEST, LOG_TAG_MODBUS, BINLOG_LEVEL_DEBUG, "Requesting data") \
+  X(LOG_BUS_STATS, LOG_TAG_MODBUS, BINLOG_LEVEL_DEBUG, "Bus: %u transactions, %u retries, %u timeouts, %u CRC errors") \
+  X(LOG_SNIFFER_FRAMES, LOG_TAG_MODBUS, BINLOG_LEVEL_DEBUG, "Sniffer: %u frames, %u CRC errors, %u overruns") \
+  X(LOG_SNIFFER_REGISTERS, LOG_TAG_MODBUS, BINLOG_LEVEL_DEBUG, "Sniffer: %u registers, %u ignored") \
+  X(LOG_SNIFFED_REGISTER, LOG_TAG_MODBUS, BINLOG_LEVEL_VERBOSE, "Sniffed register %d=%#06x (unit=%d, write=%d)") \
+  X(LOG_NOT_SNIFFED, LOG_TAG_MODBUS, BINLOG_LEVEL_DEBUG, "Register %d not seen on the bus yet") \
+  X(LOG_SNIFFED_TOO_OLD, LOG_TAG_MODBUS, BINLOG_LEVEL_DEBUG, "Register %d last seen %ums ago") \
+  X(LOG_UNSUPPORTED_ENTITY, LOG_TAG_MODBUS, BINLOG_LEVEL_WARN, "Unsupported Modbus entity type") \
+  X(LOG_REQUEST_STATUS, LOG_TAG_MODBUS, BINLOG_LEVEL_DEBUG, "%s (%#x)") \
+  X(LOG_DATA_READ, LOG_TAG_MODBUS, BINLOG_LEVEL_VERBOSE, "Data read: %x") \
+  X(LOG_REQUEST_FAILED, LOG_TAG_MODBUS, BINLOG_LEVEL_WARN, "Request failed! (register %d)") \
+  X(LOG_REGISTER, LOG_TAG_MODBUS, BINLOG_LEVEL_DEBUG, "Register id=%d type=0x%x name=%s") \
+  X(LOG_RAW_VALUE, LOG_TAG_MODBUS, BINLOG_LEVEL_VERBOSE, "Raw value: %s=%#06x") \
+  X(LOG_DECODING, LOG_TAG_MODBUS, BINLOG_LEVEL_VERBOSE, "Decoding %#x with %d decimal(s)") \
+  X(LOG_VALUE_U16, LOG_TAG_MODBUS, BINLOG_LEVEL_VERBOSE, "Value: %u") \
+  X(LOG_VALUE_DECIMAL, LOG_TAG_MODBUS, BINLOG_LEVEL_VERBOSE, "Value: %.1f") \
+  X(LOG_INVALID_DECIMAL, LOG_TAG_MODBUS, BINLOG_LEVEL_DEBUG, "Value: Invalid Diematic value") \
+  X(LOG_BITFIELD_END, LOG_TAG_MODBUS, BINLOG_LEVEL_VERBOSE, " [bit%02d] end of bitfield reached") \
+  X(LOG_BIT, LOG_TAG_MODBUS, BINLOG_LEVEL_VERBOSE, " [bit%02d] %s=%d") \
+  X(LOG_DEBUG_VALUE, LOG_TAG_MODBUS, BINLOG_LEVEL_INFO, "Raw DEBUG value: %s=%#06x %b") \
+  X(LOG_UNSUPPORTED_TYPE, LOG_TAG_MODBUS, BINLOG_LEVEL_WARN, "Unsupported register type %d") \
+  X(LOG_EDGE, LOG_TAG_MODBUS, BINLOG_LEVEL_VERBOSE, "Register %d bit %d -> %d (ON for %ums)") \
+  X(LOG_EDGE_OVERRUN, LOG_TAG_MODBUS, BINLOG_LEVEL_DEBUG, "Edge polling late: %d reads in progress") \
+  X(LOG_BLOCK_SPLIT, LOG_TAG_MODBUS, BINLOG_LEVEL_WARN, "Block %d (%d) answered by exception %d, read entry by entry") \
+  X(LOG_SCAN_PERIOD, LOG_TAG_MODBUS, BINLOG_LEVEL_INFO, "Scan period %ums (scan %ums, bus %u%%, volatility %u%%)")
+
+#define BINLOG_ENUM_ENTRY(id, ...) id,
+enum { BINLOG_TAGS(BINLOG_ENUM_ENTRY) LOG_TAG_NB };
+enum { BINLOG_MESSAGES(BINLOG_ENUM_ENTRY) LOG_MESSAGE_NB };
+#undef BINLOG_ENUM_ENTRY
+
+#endif  // SRC_LOG_MESSAGES_H_
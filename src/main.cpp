@@ -19,6 +19,7 @@
 #include "main.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <math.h>
 #if defined(ARDUINO_ARCH_ESP32)
 #include <WiFi.h>
@@ -38,12 +39,115 @@ extern "C" {
 #include <AsyncMqttClient.h>
 #include <WiFiManager.h>
 
+#include <MqttRouter.h>
 #include <Url.h>
 #include "esp_base.h"
+#include "log_base.h"
+#include "wifi_base.h"
+#ifdef METRICS_HTTP
+#include "metrics_http.h"
+#endif  // METRICS_HTTP
+#ifdef MQTT_TLS
+#include "mqtt_cert.h"
+#include "mqtt_tls.h"
+#endif  // MQTT_TLS
 #ifndef MODBUS_DISABLED
 #include <modbus_base.h>
+#include "modbus_rpc.h"
+#ifdef MODBUS_EDGES
+#include "modbus_edges.h"
+#endif  // MODBUS_EDGES
+#include <SpscRing.h>
+#ifndef MODBUS_FULL_RESOLUTION
+#include <Aggregator.h>
+#endif  // MODBUS_FULL_RESOLUTION
+#ifdef MQTT_FORMAT_INFLUX
+#include <LineProtocol.h>
+#include <sys/time.h>
+#else
+#include "json_arena.h"
+#endif  // MQTT_FORMAT_INFLUX
+#ifdef MQTT_COMPRESS
+#include <Deflate.h>
+#endif  // MQTT_COMPRESS
 #endif  // MODBUS_DISABLED
 
+#if defined(MQTT_COMPRESS) && defined(MODBUS_DISABLED)
+#error "MQTT_COMPRESS compresses the Modbus data messages, it cannot be built with MODBUS_DISABLED"
+#endif
+
+// sampling period (in seconds); MODBUS_SCANRATE is the publish window
+#ifndef MODBUS_SAMPLERATE
+#define MODBUS_SAMPLERATE MODBUS_SCANRATE
+#endif
+
+// line protocol output buffer (in bytes), published in several messages when a scan does not fit
+#ifndef INFLUX_PAYLOAD_SIZE
+#define INFLUX_PAYLOAD_SIZE 4096
+#endif
+
+// compressed data messages (in bytes): a message that does not fit is published uncompressed
+#ifndef MQTT_COMPRESS_BUFFER_SIZE
+#define MQTT_COMPRESS_BUFFER_SIZE 3072
+#endif
+#ifndef MQTT_COMPRESS_DICTIONARY_SIZE
+#define MQTT_COMPRESS_DICTIONARY_SIZE 1536
+#endif
+
+// memory of the JSON document of the data messages (in bytes), the heap is only used beyond
+#ifndef DATA_JSON_ARENA_SIZE
+#define DATA_JSON_ARENA_SIZE 12288
+#endif
+
+// longest MQTT topic, MQTT_TOPIC and hostname included
+#ifndef MQTT_TOPIC_SIZE
+#define MQTT_TOPIC_SIZE 128
+#endif
+
+// decoded values waiting to be published (power of 2)
+#ifndef SAMPLE_QUEUE_SIZE
+#define SAMPLE_QUEUE_SIZE 256
+#endif
+
+// diagnostics publishing period (in seconds)
+#ifndef DIAGNOSTICS_RATE
+#define DIAGNOSTICS_RATE 300
+#endif
+
+// task stack sizes (in bytes), see the "tasks" section of the diagnostics message
+#ifndef MODBUS_POLLER_STACK_SIZE
+#define MODBUS_POLLER_STACK_SIZE 5900
+#endif
+#ifndef PUBLISHER_STACK_SIZE
+#define PUBLISHER_STACK_SIZE 4096
+#endif
+#ifndef OTA_UPDATE_STACK_SIZE
+#define OTA_UPDATE_STACK_SIZE 4500
+#endif
+
+// time given to the cached Wi-Fi parameters before falling back to WiFiManager (in milliseconds)
+#ifndef WIFI_CONNECT_TIMEOUT
+#define WIFI_CONNECT_TIMEOUT 10000
+#endif
+
+// period of the console output of the binary log (in milliseconds)
+#ifndef BINLOG_PRINT_PERIOD
+#define BINLOG_PRINT_PERIOD 200
+#endif
+
+// publisher task notification bits
+static const uint32_t PUBLISHER_SCAN_DONE = 0x01;
+static const uint32_t PUBLISHER_DIAGNOSTICS = 0x02;
+static const uint32_t PUBLISHER_BINLOG = 0x04;
+static const uint32_t PUBLISHER_CONNECTED = 0x08;
+static const uint32_t PUBLISHER_MODBUS_RPC = 0x10;
+static const uint32_t PUBLISHER_EDGES = 0x20;
+static const uint32_t PUBLISHER_CAPTURE = 0x40;
+
+// tasks reported in the diagnostics message
+static const char *MONITORED_TASKS[] = { "modbus_poller", "modbus_bus", "publisher", "ota_update", "mqtt_tls",
+                                         "metrics", "async_tcp", "loopTask", "Tmr Svc" };
+
 static char HOSTNAME[24] = "ESP-MM-FFFFFFFFFFFFFFFF";
 static const char __attribute__((__unused__)) *TAG = "Main";
 
@@ -53,20 +157,112 @@ static const char *FIRMWARE_VERSION = "000.000.024";
 // instanciate WiFiManager object
 WiFiManager wifiManager;
 
-// instanciate AsyncMqttClient object
+// instanciate MQTT client object
+#ifdef MQTT_TLS
+TlsMqttClient mqtt_client;
+#else
 AsyncMqttClient mqtt_client;
+#endif  // MQTT_TLS
 
 // instanciate timers
 TimerHandle_t mqtt_reconnect_timer;
 TimerHandle_t wifi_reconnect_timer;
 TimerHandle_t modbus_poller_timer;
+TimerHandle_t diagnostics_timer;
 bool modbus_poller_inprogress = false;
 
+// esp_timer time (since reset) at which each boot phase was first reached, 0 until then
+typedef struct {
+  uint32_t setup_us;
+  uint32_t polling_us;
+  uint32_t first_sample_us;
+  uint32_t wifi_us;
+  uint32_t mqtt_us;
+  uint32_t first_publish_us;
+} boot_phases_t;
+
+boot_phases_t boot_phases = {};
+
+// MQTT payload buffer, only used by the publisher task
+static char mqtt_payload[6144];
+
+#ifndef MODBUS_DISABLED
+// decoded value handed over from the poller task to the publisher task
+typedef struct {
+  const char *name;  // nullptr marks the end of a scan
+  double value;
+  uint32_t read_us;  // esp_timer time of the read
+  uint16_t field_id;
+} sample_t;
+
+SpscRing<sample_t, SAMPLE_QUEUE_SIZE> sample_queue;
+
+// read-to-publish latency of the samples in the last published message
+typedef struct {
+  uint32_t samples;
+  uint64_t read_us_sum;
+  uint32_t oldest_read_us;
+  uint32_t latency_mean_us;
+  uint32_t latency_max_us;
+} pipeline_latency_t;
+
+pipeline_latency_t pipeline_latency = {};
+
+#ifndef MODBUS_FULL_RESOLUTION
+// running min/max/mean per field over the publish window
+Aggregator aggregator;
+uint32_t aggregator_window_start = 0;
+#endif  // MODBUS_FULL_RESOLUTION
+
+#ifdef MQTT_FORMAT_INFLUX
+// line protocol output, only used by the publisher task
+static char influx_payload[INFLUX_PAYLOAD_SIZE];
+LineProtocolWriter influx_writer(influx_payload, sizeof(influx_payload));
+static char influx_unit[6];
+#else
+// the data document is built and cleared on every publish: it stays in a static arena rather than the heap
+static uint64_t data_json_buffer[DATA_JSON_ARENA_SIZE / sizeof(uint64_t)];
+JsonArenaAllocator data_json_allocator(data_json_buffer, sizeof(data_json_buffer));
+#endif  // MQTT_FORMAT_INFLUX
+
+#ifdef MQTT_COMPRESS
+// zlib streams of the data messages, only used by the publisher task
+DeflateCompressor payload_compressor;
+static uint8_t compressed_payload[MQTT_COMPRESS_BUFFER_SIZE];
+static char compression_dictionary[MQTT_COMPRESS_DICTIONARY_SIZE];
+static size_t compression_dictionary_len = 0;
+
+typedef struct {
+  uint32_t messages;
+  uint32_t uncompressed;  // did not fit in compressed_payload
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t cpu_us_sum;
+  uint32_t cpu_us_max;
+} compression_stats_t;
+
+compression_stats_t compression_stats = {};
+#endif  // MQTT_COMPRESS
+#endif  // MODBUS_DISABLED
+
 // instanciate task handlers
 TaskHandle_t modbus_poller_task_handler = NULL;
+TaskHandle_t publisher_task_handler = NULL;
 TaskHandle_t ota_update_task_handler = NULL;
 
 
+void markBootPhase(uint32_t *phase_us, const char *name) {
+  if (*phase_us == 0) {
+    *phase_us = static_cast<uint32_t>(esp_timer_get_time());
+    ESP_LOGI(TAG, "Boot phase '%s' reached after %ums", name, *phase_us / 1000);
+  }
+}
+
+// MyTopic/ESP-MM-ABCDEF012345/<suffix>, written without heap allocation
+size_t formatTopic(char *topic, size_t size, const char *suffix) {
+  return snprintf(topic, size, "%s/%s/%s", MQTT_TOPIC, HOSTNAME, suffix);
+}
+
 void resetWiFi() {
   // Set WiFi to station mode
   // and disconnect from an AP if it was previously connected
@@ -76,8 +272,8 @@ void resetWiFi() {
 }
 
 void connectToWifi() {
-  ESP_LOGD(TAG, "Connecting to '%s'", WIFI_SSID);
-  WiFi.begin();
+  ESP_LOGD(TAG, "Connecting to Wi-Fi");
+  beginWifi();
 }
 
 void connectToMqtt() {
@@ -90,6 +286,8 @@ void wiFiEvent(WiFiEvent_t event) {
   switch (event) {
     case SYSTEM_EVENT_STA_GOT_IP:
       ESP_LOGI(TAG, "WiFi connected with IP address: %s", WiFi.localIP().toString().c_str());
+      markBootPhase(&boot_phases.wifi_us, "wifi");
+      onWifiConnected();
       if (!MDNS.begin(HOSTNAME)) {  // init mdns
         ESP_LOGW(TAG, "Error setting up MDNS responder");
       }
@@ -106,6 +304,7 @@ void wiFiEvent(WiFiEvent_t event) {
       break;
     case SYSTEM_EVENT_STA_DISCONNECTED:
       ESP_LOGW(TAG, "WiFi lost connection");
+      onWifiDisconnected();
       xTimerStop(mqtt_reconnect_timer, 0);  // ensure we don't reconnect to MQTT while reconnecting to Wi-Fi
       xTimerStart(wifi_reconnect_timer, 0);
       break;
@@ -117,12 +316,14 @@ void wiFiEvent(WiFiEvent_t event) {
 void onMqttConnect(bool sessionPresent) {
   ESP_LOGI(TAG, "Connected to MQTT");
   ESP_LOGD(TAG, "Session present: %s", sessionPresent ? "true" : "false");
+  markBootPhase(&boot_phases.mqtt_us, "mqtt");
+  xTaskNotify(publisher_task_handler, PUBLISHER_CONNECTED, eSetBits);  // flush what was sampled offline
 
-  String mqtt_topic = MQTT_TOPIC;
-  mqtt_topic += "/" + String(HOSTNAME) + "/action/#";
-  ESP_LOGI(TAG, "Subscribing at %s", mqtt_topic.c_str());
-  // uint16_t packetIdSub = mqtt_client.subscribe(mqtt_topic.c_str(), 1);
-  mqtt_client.subscribe(mqtt_topic.c_str(), 1);
+  char mqtt_topic[MQTT_TOPIC_SIZE];
+  formatTopic(mqtt_topic, sizeof(mqtt_topic), "action/#");
+  ESP_LOGI(TAG, "Subscribing at %s", mqtt_topic);
+  // uint16_t packetIdSub = mqtt_client.subscribe(mqtt_topic, 1);
+  mqtt_client.subscribe(mqtt_topic, 1);
 }
 
 void onMqttDisconnect(AsyncMqttClientDisconnectReason reason) {
@@ -141,58 +342,82 @@ void onMqttUnsubscribe(uint16_t packetId) {
   ESP_LOGD(TAG, "Unsubscribe acknowledged for packetId: %d", packetId);
 }
 
-void onMqttMessage(char *topic, char *payload,
-  AsyncMqttClientMessageProperties properties, size_t len, size_t index, size_t total) {
-  ESP_LOGV(TAG, "Message received (topic=%s, qos=%d, dup=%d, retain=%d, len=%d, index=%d, total=%d): %s",
-    topic, properties.qos, properties.dup, properties.retain, len, index, total, payload);
+void onUpgradeCommand(const char *payload, size_t len) {
+  ESP_LOGD(TAG, "MQTT OTA update requested");
+  vTaskResume(ota_update_task_handler);
+}
 
-  String suffix = String(topic).substring(strlen(MQTT_TOPIC) + strlen(HOSTNAME) + 9);
-          // substring(1 + strlen(MQTT_TOPIC) + strlen("/") + strlen(HOSTNAME) + strlen("/") + strlen("action"))
-  ESP_LOGV(TAG, "MQTT topic suffix=%s", suffix.c_str());
+void onDiagnosticsCommand(const char *payload, size_t len) {
+  ESP_LOGD(TAG, "MQTT diagnostics requested");
+  xTaskNotify(publisher_task_handler, PUBLISHER_DIAGNOSTICS, eSetBits);
+}
 
-  if (suffix == "upgrade") {
-    ESP_LOGD(TAG, "MQTT OTA update requested");
-    vTaskResume(ota_update_task_handler);
-    return;
-/*
-// TODO(gmasse): fix esp_log_level_set
-  } else if (suffix == "loglevel") {
-    ESP_LOGD(TAG, "MQTT log level update requested");
-    uint8_t log_level_nb;
-    if (sscanf(payload, "%hhu", &log_level_nb) == 1) {
-      switch (log_level_nb) {
-        case 0:
-          esp_log_level_set("*", ESP_LOG_NONE);
-          ESP_LOGI(TAG, "Log level changed to %#x", ESP_LOG_NONE);
-          break;
-        case 1:
-          esp_log_level_set("*", ESP_LOG_ERROR);
-          ESP_LOGI(TAG, "Log level changed to %#x", ESP_LOG_ERROR);
-          break;
-        case 2:
-          esp_log_level_set("*", ESP_LOG_WARN);
-          ESP_LOGI(TAG, "Log level changed to %#x", ESP_LOG_WARN);
-          break;
-        case 3:
-          esp_log_level_set("*", ESP_LOG_INFO);
-          ESP_LOGI(TAG, "Log level changed to %#x", ESP_LOG_INFO);
-          break;
-        case 4:
-          esp_log_level_set("*", ESP_LOG_DEBUG);
-          ESP_LOGI(TAG, "Log level changed to %#x", ESP_LOG_DEBUG);
-          break;
-        case 5:
-          esp_log_level_set("*", ESP_LOG_VERBOSE);
-          ESP_LOGI(TAG, "Log level changed to %#x", ESP_LOG_VERBOSE);
-          break;
-        default:
-          ESP_LOGE(TAG, "MQTT Invalid requested log level: %s (expected 0 to 5)", payload);
-          break;
-      }
-    }
-*/
+void onLogLevelCommand(const char *payload, size_t len) {
+  char setting[32];
+  memcpy(setting, payload, len);  // len < sizeof(setting), checked by the router
+  setting[len] = '\0';
+  ESP_LOGD(TAG, "MQTT log level update requested: %s", setting);
+  setLogLevel(setting);
+}
+
+#ifndef MODBUS_DISABLED
+void onModbusCommand(const char *payload, size_t len) {
+  JsonDocument error_doc;
+  if (!submitModbusRpc(payload, len, error_doc.to<JsonVariant>())) {
+    ESP_LOGW(TAG, "MQTT raw Modbus request rejected: %s", error_doc["error"].as<const char *>());
+    char error_payload[192];
+    const size_t n = serializeJson(error_doc, error_payload, sizeof(error_payload));
+    char mqtt_topic[MQTT_TOPIC_SIZE];
+    formatTopic(mqtt_topic, sizeof(mqtt_topic), "modbus");
+    mqtt_client.publish(mqtt_topic, 0, false, error_payload, n);
+  }
+}
+#endif  // MODBUS_DISABLED
+
+void onBinlogCommand(const char *payload, size_t len) {
+  ESP_LOGD(TAG, "MQTT binary log dump requested");
+  xTaskNotify(publisher_task_handler, PUBLISHER_BINLOG, eSetBits);
+}
+
+#if !defined(MODBUS_DISABLED) && defined(MODBUS_CAPTURE)
+// "stop" freezes the bus capture, "start" restarts it empty, anything else downloads it
+void onCaptureCommand(const char *payload, size_t len) {
+  if (len == 5 && strncmp(payload, "start", len) == 0) {
+    ESP_LOGD(TAG, "MQTT bus capture restarted");
+    setBusCaptureEnabled(true);
+  } else if (len == 4 && strncmp(payload, "stop", len) == 0) {
+    ESP_LOGD(TAG, "MQTT bus capture stopped");
+    setBusCaptureEnabled(false);
   } else {
-    ESP_LOGW(TAG, "Unknow MQTT topic received: %s", topic);
+    ESP_LOGD(TAG, "MQTT bus capture dump requested");
+    xTaskNotify(publisher_task_handler, PUBLISHER_CAPTURE, eSetBits);
+  }
+}
+#endif  // !MODBUS_DISABLED && MODBUS_CAPTURE
+
+// commands received on MyTopic/ESP-MM-ABCDEF012345/action/<suffix>, sorted by suffix
+const mqtt_command_t MQTT_COMMANDS[] = {
+  { "binlog", onBinlogCommand, 0 },
+#if !defined(MODBUS_DISABLED) && defined(MODBUS_CAPTURE)
+  { "capture", onCaptureCommand, 5 },
+#endif  // !MODBUS_DISABLED && MODBUS_CAPTURE
+  { "diagnostics", onDiagnosticsCommand, 0 },
+  { "loglevel", onLogLevelCommand, 31 },
+#ifndef MODBUS_DISABLED
+  { "modbus", onModbusCommand, MQTT_ROUTER_BUFFER_SIZE },
+#endif  // MODBUS_DISABLED
+  { "upgrade", onUpgradeCommand, 0 },
+};
+MqttRouter mqtt_router(MQTT_COMMANDS, sizeof(MQTT_COMMANDS) / sizeof(MQTT_COMMANDS[0]));
+
+void onMqttMessage(char *topic, char *payload,
+  AsyncMqttClientMessageProperties properties, size_t len, size_t index, size_t total) {
+  ESP_LOGV(TAG, "Message received (topic=%s, qos=%d, dup=%d, retain=%d, len=%d, index=%d, total=%d): %.*s",
+    topic, properties.qos, properties.dup, properties.retain, len, index, total, static_cast<int>(len), payload);
+
+  const uint8_t route = mqtt_router.route(topic, payload, len, index, total);
+  if (route != MQTT_ROUTE_DISPATCHED && route != MQTT_ROUTE_PENDING) {
+    ESP_LOGW(TAG, "MQTT message on %s rejected: %s", topic, mqttRouteString(route));
   }
 }
 
@@ -243,6 +468,370 @@ void runOtaUpdateTask(void * pvParameters) {
   }
 }
 
+#ifdef MQTT_COMPRESS
+// Preset dictionary of the data messages: the field names, then the keys repeated for every field, closest to
+// the data. Consumers get it from the retained MyTopic/ESP-MM-ABCDEF012345/dictionary message.
+void buildCompressionDictionary() {
+#ifdef MQTT_FORMAT_INFLUX
+  static const char NAME_FORMAT[] = ",%s=";
+#ifdef MODBUS_FULL_RESOLUTION
+  static const char KEYS[] = "";
+#else
+  static const char KEYS[] = "_min=_max=_mean=_last=_count=";
+#endif  // MODBUS_FULL_RESOLUTION
+#else
+  static const char NAME_FORMAT[] = "\"%s\":";
+#ifdef MODBUS_FULL_RESOLUTION
+  static const char KEYS[] = "";
+#else
+  static const char KEYS[] = "{\"min\":,\"max\":,\"mean\":,\"last\":,\"count\":}";
+#endif  // MODBUS_FULL_RESOLUTION
+#endif  // MQTT_FORMAT_INFLUX
+  const size_t names_size = sizeof(compression_dictionary) - sizeof(KEYS);
+  size_t n = 0;
+  const char *name;
+  for (uint16_t field_id = 0; (name = getModbusFieldName(field_id)) != nullptr; ++field_id) {
+    const size_t len = snprintf(&compression_dictionary[n], names_size - n, NAME_FORMAT, name);
+    if (n + len >= names_size) {
+      ESP_LOGW(TAG, "Compression dictionary truncated at field %u, see MQTT_COMPRESS_DICTIONARY_SIZE", field_id);
+      break;
+    }
+    n += len;
+  }
+  memcpy(&compression_dictionary[n], KEYS, sizeof(KEYS) - 1);
+  compression_dictionary_len = n + sizeof(KEYS) - 1;
+  payload_compressor.setDictionary(reinterpret_cast<uint8_t *>(compression_dictionary), compression_dictionary_len);
+  ESP_LOGI(TAG, "Compression dictionary: %u bytes, id %08x", compression_dictionary_len,
+    payload_compressor.dictionaryId());
+}
+
+void publishCompressionDictionary() {
+  char mqtt_topic[MQTT_TOPIC_SIZE];
+  formatTopic(mqtt_topic, sizeof(mqtt_topic), "dictionary");
+  mqtt_client.publish(mqtt_topic, 0, true, compression_dictionary, compression_dictionary_len);
+}
+
+// Returns the length of the zlib stream in compressed_payload, 0 when the payload is to be sent as is
+size_t compressPayload(const char *payload, size_t len) {
+  const uint32_t start_us = static_cast<uint32_t>(esp_timer_get_time());
+  const size_t n = payload_compressor.compress(reinterpret_cast<const uint8_t *>(payload), len, compressed_payload,
+    len < sizeof(compressed_payload) ? len : sizeof(compressed_payload));
+  const uint32_t cpu_us = static_cast<uint32_t>(esp_timer_get_time()) - start_us;
+  ++compression_stats.messages;
+  compression_stats.bytes_in += len;
+  compression_stats.bytes_out += n > 0 ? n : len;
+  compression_stats.cpu_us_sum += cpu_us;
+  compression_stats.cpu_us_max = cpu_us > compression_stats.cpu_us_max ? cpu_us : compression_stats.cpu_us_max;
+  if (n == 0) {
+    ++compression_stats.uncompressed;
+  }
+  ESP_LOGD(TAG, "Payload compressed from %u to %u bytes in %uus", len, n, cpu_us);
+  return n;
+}
+#endif  // MQTT_COMPRESS
+
+// With MQTT_COMPRESS, compressed messages go to <suffix>/deflate
+bool publishPayload(const char *suffix, const char *payload, size_t len, bool retain, bool compress) {
+  if (!mqtt_client.connected()) {
+    return false;
+  }
+  char mqtt_topic[MQTT_TOPIC_SIZE];
+#ifdef MQTT_COMPRESS
+  const size_t compressed_len = compress ? compressPayload(payload, len) : 0;
+  if (compressed_len > 0) {
+    char deflate_suffix[32];
+    snprintf(deflate_suffix, sizeof(deflate_suffix), "%s/deflate", suffix);
+    formatTopic(mqtt_topic, sizeof(mqtt_topic), deflate_suffix);
+    ESP_LOGI(TAG, "MQTT Publishing %u compressed bytes to topic: %s", compressed_len, mqtt_topic);
+    return mqtt_client.publish(mqtt_topic, 0, retain, reinterpret_cast<const char *>(compressed_payload),
+      compressed_len) != 0;
+  }
+#endif  // MQTT_COMPRESS
+  formatTopic(mqtt_topic, sizeof(mqtt_topic), suffix);
+  ESP_LOGI(TAG, "MQTT Publishing data to topic: %s", mqtt_topic);
+  return mqtt_client.publish(mqtt_topic, 0, retain, payload, len) != 0;
+}
+
+bool publishJson(const char *suffix, const JsonDocument &json_doc, bool retain, bool compress = false) {
+  size_t n = serializeJson(json_doc, mqtt_payload, sizeof(mqtt_payload));
+  ESP_LOGD(TAG, "JSON serialized: %s", mqtt_payload);
+  return publishPayload(suffix, mqtt_payload, n, retain, compress);
+}
+
+void publishBinLog() {
+  const size_t n = dumpBinLog(reinterpret_cast<uint8_t *>(mqtt_payload), sizeof(mqtt_payload));
+  if (mqtt_client.connected()) {
+    char mqtt_topic[MQTT_TOPIC_SIZE];
+    formatTopic(mqtt_topic, sizeof(mqtt_topic), "binlog");
+    ESP_LOGI(TAG, "MQTT Publishing %u bytes of binary log to topic: %s", n, mqtt_topic);
+    mqtt_client.publish(mqtt_topic, 0, false, mqtt_payload, n);
+  }
+}
+
+#if !defined(MODBUS_DISABLED) && defined(MODBUS_CAPTURE)
+// latest frames that fit in one message, see lib/BusCapture/BusCapture.h for the format
+void publishBusCapture() {
+  const size_t n = dumpBusCapture(reinterpret_cast<uint8_t *>(mqtt_payload), sizeof(mqtt_payload));
+  if (mqtt_client.connected()) {
+    char mqtt_topic[MQTT_TOPIC_SIZE];
+    formatTopic(mqtt_topic, sizeof(mqtt_topic), "capture");
+    ESP_LOGI(TAG, "MQTT Publishing %u bytes of bus capture to topic: %s", n, mqtt_topic);
+    mqtt_client.publish(mqtt_topic, 0, false, mqtt_payload, n);
+  }
+}
+#endif  // !MODBUS_DISABLED && MODBUS_CAPTURE
+
+void publishDiagnostics() {
+  JsonDocument json_doc;
+  json_doc["uptime_s"] = millis() / 1000;
+  JsonObject boot = json_doc["boot_ms"].to<JsonObject>();
+  const struct { const char *name; uint32_t us; } phases[] = {
+    { "setup", boot_phases.setup_us }, { "polling", boot_phases.polling_us },
+    { "first_sample", boot_phases.first_sample_us }, { "wifi", boot_phases.wifi_us },
+    { "mqtt", boot_phases.mqtt_us }, { "first_publish", boot_phases.first_publish_us } };
+  for (const auto &phase : phases) {
+    if (phase.us != 0) {
+      boot[phase.name] = phase.us / 1000;
+    }
+  }
+  memoryStatsToJson(json_doc["memory"].to<JsonVariant>(), MONITORED_TASKS,
+    sizeof(MONITORED_TASKS) / sizeof(MONITORED_TASKS[0]));
+#ifdef MQTT_TLS
+  mqtt_client.statsToJson(json_doc["mqtt_tls"].to<JsonVariant>());
+#endif  // MQTT_TLS
+#ifndef MODBUS_DISABLED
+  JsonObject pipeline = json_doc["pipeline"].to<JsonObject>();
+  pipeline["queue_depth"] = sample_queue.size();
+  pipeline["queue_high_water"] = sample_queue.highWater();
+  pipeline["queue_capacity"] = sample_queue.capacity();
+  pipeline["dropped"] = sample_queue.dropped();
+  pipeline["latency_mean_ms"] = pipeline_latency.latency_mean_us / 1000.0;
+  pipeline["latency_max_ms"] = pipeline_latency.latency_max_us / 1000.0;
+#ifndef MODBUS_FULL_RESOLUTION
+  pipeline["aggregator_dropped"] = aggregator.dropped();
+#endif  // MODBUS_FULL_RESOLUTION
+#ifdef MQTT_FORMAT_INFLUX
+  pipeline["influx_dropped_lines"] = influx_writer.dropped();
+#else
+  pipeline["json_arena_high_water"] = data_json_allocator.arena().highWater();
+  pipeline["json_arena_fallbacks"] = data_json_allocator.fallbacks();
+#endif  // MQTT_FORMAT_INFLUX
+#ifdef MQTT_COMPRESS
+  if (compression_stats.messages > 0) {
+    JsonObject compression = json_doc["compression"].to<JsonObject>();
+    compression["messages"] = compression_stats.messages;
+    compression["uncompressed"] = compression_stats.uncompressed;
+    compression["ratio"] = static_cast<float>(compression_stats.bytes_in) / compression_stats.bytes_out;
+    compression["cpu_mean_us"] = compression_stats.cpu_us_sum / compression_stats.messages;
+    compression["cpu_max_us"] = compression_stats.cpu_us_max;
+  }
+#endif  // MQTT_COMPRESS
+#ifndef MODBUS_SNIFFER
+  modbusBusToJson(json_doc["bus"].to<JsonVariant>());
+#endif  // MODBUS_SNIFFER
+#ifdef MODBUS_EDGES
+  modbusEdgesToJson(json_doc["edges"].to<JsonVariant>());
+#endif  // MODBUS_EDGES
+#ifdef MODBUS_ADAPTIVE_SCAN
+  modbusScanRateToJson(json_doc["scan_rate"].to<JsonVariant>());
+#endif  // MODBUS_ADAPTIVE_SCAN
+#endif  // MODBUS_DISABLED
+  publishJson("diagnostics", json_doc, false);
+}
+
+#if !defined(MODBUS_DISABLED) && defined(MODBUS_EDGES)
+// Publishes the bitfield transitions in batches; they wait in their queue while offline
+void publishEdgeEvents() {
+  while (mqtt_client.connected()) {
+    JsonDocument json_doc;
+    if (!modbusEdgeEventsToJson(json_doc.to<JsonArray>())) {
+      break;
+    }
+    publishJson("events", json_doc, false);
+  }
+}
+#endif  // MODBUS_EDGES
+
+void runDiagnosticsTimer() {
+  xTaskNotify(publisher_task_handler, PUBLISHER_DIAGNOSTICS, eSetBits);
+}
+
+#ifndef MODBUS_DISABLED
+void _onDataPublished() {
+  markBootPhase(&boot_phases.first_publish_us, "first_publish");
+  // every sample consumed since the last publish went out now
+  if (pipeline_latency.samples > 0) {
+    const uint32_t now = static_cast<uint32_t>(esp_timer_get_time());
+    const uint32_t read_us_mean = pipeline_latency.read_us_sum / pipeline_latency.samples;
+    pipeline_latency.latency_mean_us = now - read_us_mean;
+    pipeline_latency.latency_max_us = now - pipeline_latency.oldest_read_us;
+    pipeline_latency.samples = 0;
+    pipeline_latency.read_us_sum = 0;
+  }
+}
+
+bool publishData(const JsonDocument &json_doc) {
+  if (!publishJson("data", json_doc, true, true)) {
+    return false;
+  }
+  _onDataPublished();
+  return true;
+}
+
+#ifdef MQTT_FORMAT_INFLUX
+// wall clock time (in ns) of an esp_timer time, 0 while the clock is not set by NTP
+uint64_t _toEpochNs(uint32_t timer_us) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  if (now.tv_sec < 1600000000) {
+    return 0;  // the server will timestamp the points
+  }
+  const uint32_t age_us = static_cast<uint32_t>(esp_timer_get_time()) - timer_us;
+  return (static_cast<uint64_t>(now.tv_sec) * 1000000ULL + now.tv_usec - age_us) * 1000ULL;
+}
+
+bool _publishInfluxChunk() {
+  bool published = false;
+  if (influx_writer.lines() > 0) {
+    ESP_LOGD(TAG, "MQTT Publishing %u lines", influx_writer.lines());
+    published = publishPayload("influx", influx_payload, influx_writer.length(), false, true);
+  }
+  influx_writer.clear();
+  return published;
+}
+
+#ifdef MODBUS_FULL_RESOLUTION
+// line in progress: consecutive samples of the same group share a line and the time of its first read
+const char *influx_group = nullptr;
+size_t influx_group_length = 0;
+uint64_t influx_line_ns = 0;
+
+void influxAddSample(const sample_t &sample) {
+  const char *group;
+  const size_t group_length = getModbusFieldGroup(sample.field_id, &group);
+  if (!influx_writer.inLine() || group_length != influx_group_length
+      || strncmp(group, influx_group, group_length) != 0) {
+    if (influx_writer.inLine()) {
+      influx_writer.endLine(influx_line_ns);
+    }
+    if (influx_writer.length() > sizeof(influx_payload) / 2) {
+      _publishInfluxChunk();  // keeps room for the longest line (a 16-bit bitfield)
+    }
+    influx_group = group;
+    influx_group_length = group_length;
+    influx_line_ns = _toEpochNs(sample.read_us);
+    influx_writer.beginLine(group, group_length);
+  }
+  influx_writer.addField(sample.name, sample.value);
+}
+
+bool publishInflux() {
+  if (influx_writer.inLine()) {
+    influx_writer.endLine(influx_line_ns);
+  }
+  if (!_publishInfluxChunk()) {
+    return false;
+  }
+  _onDataPublished();
+  return true;
+}
+#endif  // MODBUS_FULL_RESOLUTION
+#endif  // MQTT_FORMAT_INFLUX
+
+#ifndef MODBUS_FULL_RESOLUTION
+void aggregatorToJson(ArduinoJson::JsonVariant variant) {
+  for (uint16_t i = 0; i < aggregator.size(); ++i) {
+    const aggregator_slot_t &slot = aggregator.slot(i);
+    if (slot.count == 0) {
+      continue;  // no successful read during this window
+    }
+    JsonObject field = variant[slot.name].to<JsonObject>();
+    field["min"] = slot.min;
+    field["max"] = slot.max;
+    field["mean"] = aggregator.mean(i);
+    field["last"] = slot.last;
+    field["count"] = slot.count;
+  }
+}
+
+#ifdef MQTT_FORMAT_INFLUX
+bool _writeAggregatorLine(uint16_t first, uint16_t last, const char *group, size_t group_length,
+    uint64_t timestamp_ns) {
+  char key[48];
+  influx_writer.beginLine(group, group_length);
+  for (uint16_t i = first; i < last; ++i) {
+    const aggregator_slot_t &slot = aggregator.slot(i);
+    if (slot.count == 0) {
+      continue;  // no successful read during this window
+    }
+    snprintf(key, sizeof(key), "%s_min", slot.name);
+    influx_writer.addField(key, slot.min);
+    snprintf(key, sizeof(key), "%s_max", slot.name);
+    influx_writer.addField(key, slot.max);
+    snprintf(key, sizeof(key), "%s_mean", slot.name);
+    influx_writer.addField(key, aggregator.mean(i));
+    snprintf(key, sizeof(key), "%s_last", slot.name);
+    influx_writer.addField(key, slot.last);
+    snprintf(key, sizeof(key), "%s_count", slot.name);
+    influx_writer.addField(key, static_cast<int32_t>(slot.count));
+  }
+  return influx_writer.endLine(timestamp_ns);
+}
+
+// one line per group of fields, timestamped at the end of the window
+bool aggregatorToInflux(uint64_t timestamp_ns) {
+  if (!mqtt_client.connected()) {
+    return false;
+  }
+  uint16_t first = 0;
+  while (first < aggregator.size()) {
+    const char *group;
+    const char *next_group;
+    const size_t group_length = getModbusFieldGroup(first, &group);
+    uint16_t last = first + 1;
+    while (last < aggregator.size() && getModbusFieldGroup(last, &next_group) == group_length
+           && strncmp(next_group, group, group_length) == 0) {
+      ++last;
+    }
+    const uint32_t dropped = influx_writer.dropped();
+    if (!_writeAggregatorLine(first, last, group, group_length, timestamp_ns) && influx_writer.dropped() != dropped) {
+      _publishInfluxChunk();  // buffer full: flush it and write the line again
+      _writeAggregatorLine(first, last, group, group_length, timestamp_ns);
+    }
+    first = last;
+  }
+  if (!_publishInfluxChunk()) {
+    return false;
+  }
+  _onDataPublished();
+  return true;
+}
+#endif  // MQTT_FORMAT_INFLUX
+
+// closes the current window, kept open as long as it cannot be published
+void publishAggregator() {
+#ifdef MQTT_FORMAT_INFLUX
+  const bool published = aggregatorToInflux(_toEpochNs(static_cast<uint32_t>(esp_timer_get_time())));
+#else
+  JsonDocument aggregator_doc(&data_json_allocator);
+  aggregatorToJson(aggregator_doc.to<JsonVariant>());
+  const bool published = publishData(aggregator_doc);
+#endif  // MQTT_FORMAT_INFLUX
+  if (published) {
+    aggregator.reset();
+    aggregator_window_start = millis();
+  }
+}
+#endif  // MODBUS_FULL_RESOLUTION
+
+// runs in the poller task (producer)
+void queueSample(uint16_t field_id, const char *name, double value, void *context) {
+  const sample_t sample = { name, value, static_cast<uint32_t>(esp_timer_get_time()), field_id };
+  sample_queue.push(sample);
+  markBootPhase(&boot_phases.first_sample_us, "first_sample");
+}
+#endif  // MODBUS_DISABLED
+
 void runModbusPollerTask(void * pvParameters) {
 #ifndef MODBUS_DISABLED
   UBaseType_t __attribute__((__unused__)) uxHighWaterMark;
@@ -250,37 +839,133 @@ void runModbusPollerTask(void * pvParameters) {
   uxHighWaterMark = uxTaskGetStackHighWaterMark(NULL);
   ESP_LOGV(TAG, "Entering Modbus Poller task. Unused stack size: %d", uxHighWaterMark);
 
-  for (;;) {
-    uxHighWaterMark = uxTaskGetStackHighWaterMark(NULL);
-    ESP_LOGV(TAG, "Suspending Modbus Poller task. Unused stack size: %d", uxHighWaterMark);
-    vTaskSuspend(NULL);  // Task is suspended by default
-
-    ESP_LOGV(TAG, "Resuming Modbus Poller task");
+  markBootPhase(&boot_phases.polling_us, "polling");
+  for (;;) {  // first scan right away, then on each timer tick
     if (modbus_poller_inprogress) {  // not sure if needed
       ESP_LOGV(TAG, "Modbus polling in already progress. Waiting for next cycle.");
       return;
     }
 
-    StaticJsonDocument<2000> json_doc;  // instanciate JSON storage
-    parseModbusToJson(json_doc.to<JsonVariant>());
-
-    char buffer[1600];
-    size_t n = serializeJson(json_doc, buffer);
-    ESP_LOGD(TAG, "JSON serialized: %s", buffer);
-    if (mqtt_client.connected()) {
-      String mqtt_topic = MQTT_TOPIC;
-      mqtt_topic += "/" + String(HOSTNAME) + "/data";
-      ESP_LOGI(TAG, "MQTT Publishing data to topic: %s", mqtt_topic.c_str());
-      mqtt_client.publish(mqtt_topic.c_str(), 0, true, buffer, n);
+    parseModbusFields(queueSample, nullptr);
+#ifdef MODBUS_ADAPTIVE_SCAN
+    // the next ticks follow the period picked by this scan; changing it restarts the timer from now
+    const TickType_t period = pdMS_TO_TICKS(getModbusScanPeriodMs());
+    if (modbus_poller_timer != NULL && xTimerIsTimerActive(modbus_poller_timer) &&
+        xTimerGetPeriod(modbus_poller_timer) != period) {
+      xTimerChangePeriod(modbus_poller_timer, period, 0);
     }
+#endif  // MODBUS_ADAPTIVE_SCAN
+    const sample_t end_of_scan = { nullptr, 0, static_cast<uint32_t>(esp_timer_get_time()), 0 };
+    sample_queue.push(end_of_scan);
+    xTaskNotify(publisher_task_handler, PUBLISHER_SCAN_DONE, eSetBits);
+
+    uxHighWaterMark = uxTaskGetStackHighWaterMark(NULL);
+    BINLOG(LOG_POLLER_SUSPEND, uxHighWaterMark);
+    vTaskSuspend(NULL);
+    BINLOG(LOG_POLLER_RESUME);
   }
 #endif  // MODBUS_DISABLED
 }
 
+void runPublisherTask(void * pvParameters) {
+  UBaseType_t __attribute__((__unused__)) uxHighWaterMark;
+  uxHighWaterMark = uxTaskGetStackHighWaterMark(NULL);
+  ESP_LOGV(TAG, "Entering Publisher task. Unused stack size: %d", uxHighWaterMark);
+#if !defined(MODBUS_DISABLED) && defined(MODBUS_FULL_RESOLUTION) && !defined(MQTT_FORMAT_INFLUX)
+  JsonDocument json_doc(&data_json_allocator);
+#endif
+
+  for (;;) {
+    uint32_t notification = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &notification, pdMS_TO_TICKS(BINLOG_PRINT_PERIOD));
+    printBinLog();
+
+    if (notification & PUBLISHER_DIAGNOSTICS) {
+      publishDiagnostics();
+    }
+    if (notification & PUBLISHER_BINLOG) {
+      publishBinLog();
+    }
+#ifndef MODBUS_DISABLED
+#ifdef MQTT_COMPRESS
+    if (notification & PUBLISHER_CONNECTED) {
+      publishCompressionDictionary();  // retained, ahead of the data it decodes
+    }
+#endif  // MQTT_COMPRESS
+    if (notification & PUBLISHER_MODBUS_RPC) {
+#ifdef MQTT_FORMAT_INFLUX
+      JsonDocument rpc_doc;
+#else
+      JsonDocument rpc_doc(&data_json_allocator);  // the arena is only used by this task
+#endif  // MQTT_FORMAT_INFLUX
+      while (modbusRpcResultToJson(rpc_doc.to<JsonVariant>())) {
+        publishJson("modbus", rpc_doc, false);
+      }
+    }
+#ifdef MODBUS_CAPTURE
+    if (notification & PUBLISHER_CAPTURE) {
+      publishBusCapture();
+    }
+#endif  // MODBUS_CAPTURE
+#ifdef MODBUS_EDGES
+    if (notification & (PUBLISHER_EDGES | PUBLISHER_CONNECTED)) {
+      publishEdgeEvents();
+    }
+#endif  // MODBUS_EDGES
+#endif  // MODBUS_DISABLED
+
+#ifndef MODBUS_DISABLED
+#ifdef MODBUS_FULL_RESOLUTION
+    const bool online = mqtt_client.connected();  // until then, samples wait in the queue
+#else
+    const bool online = true;  // the window stays open until it can be published
+#endif  // MODBUS_FULL_RESOLUTION
+    sample_t sample;
+    while (online && sample_queue.pop(&sample)) {
+      if (sample.name != nullptr) {
+        if (pipeline_latency.samples == 0) {
+          pipeline_latency.oldest_read_us = sample.read_us;
+        }
+        ++pipeline_latency.samples;
+        pipeline_latency.read_us_sum += sample.read_us;
+#if defined(MODBUS_FULL_RESOLUTION) && defined(MQTT_FORMAT_INFLUX)
+        influxAddSample(sample);
+#elif defined(MODBUS_FULL_RESOLUTION)
+        json_doc[sample.name] = sample.value;
+#else
+        aggregator.add(sample.field_id, sample.name, sample.value);  // counted in dropped() when out of range
+#endif  // MODBUS_FULL_RESOLUTION
+        continue;
+      }
+
+      // end of scan
+#if defined(MODBUS_FULL_RESOLUTION) && defined(MQTT_FORMAT_INFLUX)
+      publishInflux();
+#elif defined(MODBUS_FULL_RESOLUTION)
+      publishData(json_doc);
+      json_doc.clear();
+#else
+      if (millis() - aggregator_window_start >= MODBUS_SCANRATE * 1000UL) {
+        publishAggregator();
+      }
+#endif  // MODBUS_FULL_RESOLUTION
+    }
+#ifndef MODBUS_FULL_RESOLUTION
+    if ((notification & PUBLISHER_CONNECTED) && pipeline_latency.samples > 0) {
+      publishAggregator();  // what was sampled while offline (e.g. during boot)
+    }
+#endif  // MODBUS_FULL_RESOLUTION
+#endif  // MODBUS_DISABLED
+
+    if (notification & PUBLISHER_CONNECTED) {
+      publishDiagnostics();  // boot phases, once the data sampled offline went out
+    }
+  }
+}
+
 void runModbusPollerTimer() {
-  ESP_LOGV(TAG, "Time to resume Modbus Poller");
+  BINLOG(LOG_POLLER_TIMER);
   vTaskResume(modbus_poller_task_handler);
-  ESP_LOGV(TAG, "Modbus Poller resume done");
 }
 
 void setup() {
@@ -288,24 +973,6 @@ void setup() {
   Serial.begin(MONITOR_SPEED);
   while (!Serial) continue;
   Serial.setDebugOutput(true);
-/*
-// TODO(gmasse): fix esp_log_level_set
-  esp_log_level_set("*", ESP_LOG_VERBOSE);
-  esp_log_level_set("ESP_base", ESP_LOG_INFO);
-  esp_log_level_set("Modbus_base", ESP_LOG_INFO);
-  esp_log_level_set("Main", ESP_LOG_INFO);
-  ESP_LOGE("Main", "Error");
-  ESP_LOGW("Main", "Warning");
-  ESP_LOGI("Main", "Info");
-  ESP_LOGD("Main", "Debug");
-  ESP_LOGV("Main", "Verbose");
-  esp_log_level_set(TAG, ESP_LOG_INFO);
-  ESP_LOGE(TAG, "Error");
-  ESP_LOGW(TAG, "Warning");
-  ESP_LOGI(TAG, "Info");
-  ESP_LOGD(TAG, "Debug");
-  ESP_LOGV(TAG, "Verbose");
-*/
 
   snprintf(HOSTNAME, sizeof(HOSTNAME), "ESP-MM-%llX", ESP.getEfuseMac());  // setting hostname
 
@@ -313,6 +980,20 @@ void setup() {
   ESP_LOGI(TAG, "Firmware version %s (compiled at %s %s)", FIRMWARE_VERSION, __DATE__, __TIME__);
   ESP_LOGV(TAG, "Watchdog time-out: %ds", CONFIG_TASK_WDT_TIMEOUT_S);
   ESP_LOGI(TAG, "Hostname: %s", HOSTNAME);
+  char action_prefix[MQTT_ROUTER_MAX_PREFIX];
+  snprintf(action_prefix, sizeof(action_prefix), "%s/%s/action/", MQTT_TOPIC, HOSTNAME);
+  if (!mqtt_router.begin(action_prefix)) {
+    ESP_LOGE(TAG, "Invalid MQTT command table or topic");
+  }
+  markBootPhase(&boot_phases.setup_us, "setup");
+#if !defined(MODBUS_DISABLED) && defined(MQTT_FORMAT_INFLUX)
+  snprintf(influx_unit, sizeof(influx_unit), "%d", MODBUS_UNIT);
+  influx_writer.setTag(0, "host", HOSTNAME);
+  influx_writer.setTag(1, "unit", influx_unit);
+#endif
+#ifdef MQTT_COMPRESS
+  buildCompressionDictionary();
+#endif  // MQTT_COMPRESS
 
   mqtt_reconnect_timer = xTimerCreate("mqtt_timer", pdMS_TO_TICKS(2000), pdFALSE,
     NULL, reinterpret_cast<TimerCallbackFunction_t>(connectToMqtt));
@@ -331,16 +1012,42 @@ void setup() {
   IPAddress mqtt_ip;
   mqtt_ip.fromString(MQTT_HOST_IP);
   mqtt_client.setServer(mqtt_ip, MQTT_PORT);
+#ifdef MQTT_TLS
+  mqtt_client.setCaCert(mqttCACertificate);
+#ifdef MQTT_TLS_FINGERPRINT
+  mqtt_client.setFingerprint(MQTT_TLS_FINGERPRINT);
+#endif  // MQTT_TLS_FINGERPRINT
+#ifdef MQTT_TLS_HOSTNAME
+  mqtt_client.setHostname(MQTT_TLS_HOSTNAME);
+#endif  // MQTT_TLS_HOSTNAME
+#endif  // MQTT_TLS
 
-  wifiManager.autoConnect();
+  // Modbus tasks stay on the application core, publishing runs on the core of the network stack
+  xTaskCreatePinnedToCore(runPublisherTask, "publisher", PUBLISHER_STACK_SIZE, NULL, 1, &publisher_task_handler,
+    PRO_CPU_NUM);
+  configASSERT(publisher_task_handler);
+
+  diagnostics_timer = xTimerCreate("diagnostics_timer", pdMS_TO_TICKS(DIAGNOSTICS_RATE*1000), pdTRUE, NULL,
+    reinterpret_cast<TimerCallbackFunction_t>(runDiagnosticsTimer));
+  if (diagnostics_timer == NULL || xTimerStart(diagnostics_timer, 0) != pdPASS) {
+    ESP_LOGW(TAG, "Unable to start diagnostics timer");
+  }
 
 #ifndef MODBUS_DISABLED
   initModbus();
+  initModbusRpc(publisher_task_handler, PUBLISHER_MODBUS_RPC);
+#ifdef MODBUS_EDGES
+  initModbusEdges(publisher_task_handler, PUBLISHER_EDGES);
+#endif  // MODBUS_EDGES
 
-  xTaskCreate(runModbusPollerTask, "modbus_poller", 5900, NULL, 1, &modbus_poller_task_handler);
+  xTaskCreatePinnedToCore(runModbusPollerTask, "modbus_poller", MODBUS_POLLER_STACK_SIZE, NULL, 1,
+    &modbus_poller_task_handler, APP_CPU_NUM);
   configASSERT(modbus_poller_task_handler);
 
-  modbus_poller_timer = xTimerCreate("modbus_poller_timer", pdMS_TO_TICKS(MODBUS_SCANRATE*1000), pdTRUE, NULL,
+#ifndef MODBUS_FULL_RESOLUTION
+  aggregator_window_start = millis();
+#endif  // MODBUS_FULL_RESOLUTION
+  modbus_poller_timer = xTimerCreate("modbus_poller_timer", pdMS_TO_TICKS(MODBUS_SAMPLERATE*1000), pdTRUE, NULL,
     reinterpret_cast<TimerCallbackFunction_t>(runModbusPollerTimer));
   if (modbus_poller_timer == NULL) {
     // The timer was not created
@@ -351,8 +1058,19 @@ void setup() {
   }
 #endif  // MODBUS_DISABLED
 
-  xTaskCreate(runOtaUpdateTask, "ota_update", 4500, NULL, 2, &ota_update_task_handler);
+  // polling is already running: samples are kept until the network is up
+  WiFi.mode(WIFI_STA);
+  initWifiCache();
+  if (!beginWifi() || WiFi.waitForConnectResult(WIFI_CONNECT_TIMEOUT) != WL_CONNECTED) {
+    wifiManager.autoConnect();  // configuration portal when the stored credentials do not work
+  }
+
+  xTaskCreate(runOtaUpdateTask, "ota_update", OTA_UPDATE_STACK_SIZE, NULL, 2, &ota_update_task_handler);
   configASSERT(ota_update_task_handler);
+
+#ifdef METRICS_HTTP
+  initMetricsHttp();
+#endif  // METRICS_HTTP
 }
 
 void loop() {
@@ -0,0 +1,94 @@
+/*
+ metrics_http.cpp - Prometheus metrics endpoint
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "metrics_http.h"
+
+// built with -DMETRICS_HTTP only
+#ifdef METRICS_HTTP
+
+#include "Arduino.h"
+#include <WiFi.h>
+#include <esp_timer.h>
+#include <MetricsServer.h>
+#include <PrometheusWriter.h>
+
+#ifndef MODBUS_DISABLED
+#include "modbus_base.h"
+#endif  // MODBUS_DISABLED
+
+#ifndef METRICS_PORT
+#define METRICS_PORT 9100
+#endif
+
+// fields not refreshed for longer (in seconds) are left out of the page
+#ifndef METRICS_MAX_AGE
+#define METRICS_MAX_AGE (3 * MODBUS_SCANRATE)
+#endif
+
+#ifndef METRICS_STACK_SIZE
+#define METRICS_STACK_SIZE 4096
+#endif
+
+static const char __attribute__((__unused__)) *TAG = "Metrics";
+
+TaskHandle_t metrics_task_handler = NULL;
+
+void _writeGauge(PrometheusWriter *writer, const char *name, const char *help, double value) {
+  writer->family(name, help, "gauge");
+  writer->sample(name, value);
+}
+
+// runs in the metrics task, from the in-memory copies only: a scrape never waits for the bus
+void _renderMetrics(PrometheusWriter *writer, void *context) {
+#ifndef MODBUS_DISABLED
+  modbusFieldsToMetrics(writer, METRICS_MAX_AGE * 1000UL);
+#ifndef MODBUS_SNIFFER
+  modbusBusToMetrics(writer);
+#endif  // MODBUS_SNIFFER
+#endif  // MODBUS_DISABLED
+  const MetricsServer *server = static_cast<const MetricsServer *>(context);
+  _writeGauge(writer, "gateway_uptime_seconds", "Time since boot", esp_timer_get_time() / 1000000.0);
+  _writeGauge(writer, "gateway_heap_free_bytes", "Free heap", ESP.getFreeHeap());
+  _writeGauge(writer, "gateway_heap_min_free_bytes", "Lowest free heap since boot", ESP.getMinFreeHeap());
+  _writeGauge(writer, "gateway_wifi_rssi_dbm", "Signal strength of the access point", WiFi.RSSI());
+  _writeGauge(writer, "metrics_scrape_duration_seconds", "Time taken to render and send the previous page",
+    server->lastScrapeUs() / 1000000.0);
+  _writeGauge(writer, "metrics_page_bytes", "Size of the previous page", server->lastPageBytes());
+}
+
+MetricsServer metrics_server(_renderMetrics, &metrics_server);
+
+void runMetricsTask(void *pvParameters) {
+  while (!metrics_server.begin(METRICS_PORT)) {
+    ESP_LOGE(TAG, "Unable to listen on port %d", METRICS_PORT);
+    vTaskDelay(pdMS_TO_TICKS(5000));
+  }
+  ESP_LOGI(TAG, "Serving http://%s:%d/metrics", WiFi.localIP().toString().c_str(), metrics_server.port());
+  for (;;) {
+    metrics_server.poll(1000);
+  }
+}
+
+// to be called once the network stack is up
+void initMetricsHttp() {
+  xTaskCreatePinnedToCore(runMetricsTask, "metrics", METRICS_STACK_SIZE, NULL, 1, &metrics_task_handler,
+    PRO_CPU_NUM);
+  configASSERT(metrics_task_handler);
+}
+
+#endif  // METRICS_HTTP
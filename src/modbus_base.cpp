@@ -18,14 +18,47 @@
 
 #include "modbus_base.h"
 #include "modbus_registers.h"
+#include "modbus_derived.h"
 
 #include "Arduino.h"
-#include <ModbusMaster.h>
 #include <ArduinoJson.h>
+#include <ModbusRtu.h>
+#include <RtuMaster.h>
+#ifdef MODBUS_SNIFFER
+#include <RtuSniffer.h>
+#endif  // MODBUS_SNIFFER
+#if defined(MODBUS_TCP) || defined(MODBUS_RTU_OVER_TCP)
+#define MODBUS_OVER_TCP
+#include <SocketTransport.h>
+#include <TcpMaster.h>
+#else
+#include "esp_uart_transport.h"
+#endif  // MODBUS_TCP || MODBUS_RTU_OVER_TCP
+#include "log_base.h"
+#ifdef MODBUS_CAPTURE
+#include <CaptureTransport.h>
+#endif  // MODBUS_CAPTURE
+#ifdef MODBUS_EDGES
+#include "modbus_edges.h"
+#endif  // MODBUS_EDGES
+#ifdef MODBUS_ADAPTIVE_SCAN
+#include <ScanRate.h>
+#endif  // MODBUS_ADAPTIVE_SCAN
+#ifndef MODBUS_FULL_RESOLUTION
+#include <Aggregator.h>
+#endif  // MODBUS_FULL_RESOLUTION
 
 
 static const char __attribute__((__unused__)) *TAG = "Modbus_base";
 
+#if defined(MODBUS_OVER_TCP) && defined(MODBUS_SNIFFER)
+#error "The sniffer listens to a serial bus, it cannot be built with MODBUS_TCP or MODBUS_RTU_OVER_TCP"
+#endif
+
+#if defined(MODBUS_ADAPTIVE_SCAN) && defined(MODBUS_SNIFFER)
+#error "The sniffer does not poll, it cannot be built with MODBUS_ADAPTIVE_SCAN"
+#endif
+
 /* The following symbols are passed via BUILD parameters
 #define RXD 27 // aka R0
 #define TXD 26 // aka DI
@@ -37,186 +70,730 @@ static const char __attribute__((__unused__)) *TAG = "Modbus_base";
 #define MODBUS_UNIT 10
 #define MODBUS_RETRIES 2
 #define MODBUS_SCANRATE 30 // in seconds
+#define MODBUS_TCP_HOST "192.168.1.50" // with MODBUS_TCP or MODBUS_RTU_OVER_TCP
 */
 
-// instantiate ModbusMaster object
-ModbusMaster modbus_client;
+#ifndef MODBUS_TCP_PORT
+#define MODBUS_TCP_PORT 502
+#endif
+
+#if defined(MODBUS_OVER_TCP) && !defined(MODBUS_TCP_HOST)
+#error "MODBUS_TCP_HOST must be set to the IPv4 address of the Modbus server or gateway"
+#endif
+
+// a sniffed value older than this (in seconds) is considered lost
+#ifndef MODBUS_SNIFFER_MAX_AGE
+#define MODBUS_SNIFFER_MAX_AGE (3 * MODBUS_SCANRATE)
+#endif
+
+// urgent requests (see submitModbusRequest) waiting for the bus task
+#ifndef MODBUS_URGENT_QUEUE_SIZE
+#define MODBUS_URGENT_QUEUE_SIZE 8
+#endif
+
+// holes (in addresses) a read request may span to merge two entries of registers[], 0 to only merge contiguous ones
+#ifndef MODBUS_BLOCK_MAX_GAP
+#define MODBUS_BLOCK_MAX_GAP 0
+#endif
+
+#ifndef MODBUS_BUS_STACK_SIZE
+#define MODBUS_BUS_STACK_SIZE 3072
+#endif
+
+// with MODBUS_ADAPTIVE_SCAN: bounds of the sampling period (in seconds), largest share of the bus time taken by the
+// scans (in percent), and smallest change of a value that counts as a move
+#ifndef MODBUS_SAMPLERATE
+#define MODBUS_SAMPLERATE MODBUS_SCANRATE
+#endif
+#ifndef MODBUS_SAMPLERATE_MIN
+#define MODBUS_SAMPLERATE_MIN 1
+#endif
+#ifndef MODBUS_SAMPLERATE_MAX
+#define MODBUS_SAMPLERATE_MAX MODBUS_SCANRATE
+#endif
+#ifndef MODBUS_BUS_UTILIZATION_MAX
+#define MODBUS_BUS_UTILIZATION_MAX 50
+#endif
+#ifndef MODBUS_SAMPLE_DEADBAND
+#define MODBUS_SAMPLE_DEADBAND 0.5
+#endif
+
+// decoded fields kept for the metrics page, registers and derived fields
+#ifndef MODBUS_FIELD_CACHE_SIZE
+#define MODBUS_FIELD_CACHE_SIZE 128
+#endif
 
-void preTransmission() {
-  digitalWrite(RTS, 1);
+#ifdef MODBUS_OVER_TCP
+// persistent connection to a Modbus TCP server or to an RTU over TCP gateway
+SocketTransport modbus_transport;
+#else
+// Using ESP32 UART2 for Modbus
+EspUartTransport modbus_transport(UART_NUM_2);
+#endif  // MODBUS_OVER_TCP
+#ifdef MODBUS_CAPTURE
+// flight recorder of the frames on the bus, downloaded over MQTT and replayed on the host (test_bus_capture)
+#ifdef MODBUS_TCP
+BusCapture bus_capture(BUS_CAPTURE_TCP);
+#else
+BusCapture bus_capture(BUS_CAPTURE_RTU);
+#endif  // MODBUS_TCP
+CaptureTransport bus_transport(&modbus_transport, &bus_capture, modbusT35(MODBUS_BAUDRATE));
+#else
+ModbusTransport &bus_transport = modbus_transport;
+#endif  // MODBUS_CAPTURE
+TaskHandle_t modbus_bus_task_handler = NULL;
+
+// latest raw value of each entry of registers[], from polling or sniffing
+typedef struct {
+  uint16_t value;
+  uint32_t updated_ms;  // millis() of the last update
+  bool valid;
+} register_image_t;
+
+static const uint8_t REGISTER_NB = sizeof(registers) / sizeof(modbus_register_t);
+static register_image_t register_image[REGISTER_NB];
+static const uint8_t DERIVED_NB = sizeof(derived_fields) / sizeof(derived_field_t);
+// evaluated at the end of each scan, by the poller task only
+DerivedFields derived(derived_fields, DERIVED_NB);
+static portMUX_TYPE register_image_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#ifdef MODBUS_ADAPTIVE_SCAN
+// sampling period from the scan times and the values read, updated by the poller task
+ScanRate scan_rate(MODBUS_SAMPLERATE * 1000UL, MODBUS_SAMPLERATE_MIN * 1000UL, MODBUS_SAMPLERATE_MAX * 1000UL,
+  MODBUS_BUS_UTILIZATION_MAX, MODBUS_SAMPLE_DEADBAND);
+static portMUX_TYPE scan_rate_mux = portMUX_INITIALIZER_UNLOCKED;
+#endif  // MODBUS_ADAPTIVE_SCAN
+
+#if defined(METRICS_HTTP) || defined(MODBUS_ADAPTIVE_SCAN)
+// callback and context given to parseModbusFields
+typedef struct {
+  modbus_field_callback_t callback;
+  void *context;
+} field_forward_t;
+#endif  // METRICS_HTTP || MODBUS_ADAPTIVE_SCAN
+
+#ifdef METRICS_HTTP
+// latest decoded value of each field, written by the poller task at each scan and read by the metrics task
+typedef struct {
+  const char *name;  // nullptr until the field is decoded once
+  double value;
+  uint32_t updated_ms;
+} field_cache_t;
+
+static field_cache_t field_cache[MODBUS_FIELD_CACHE_SIZE];
+static uint16_t field_cache_nb = 0;
+static uint32_t scan_count = 0;
+static uint32_t last_scan_ms = 0;
+static portMUX_TYPE field_cache_mux = portMUX_INITIALIZER_UNLOCKED;
+#endif  // METRICS_HTTP
+
+const modbus_register_t *getModbusRegisters(uint8_t *count_ptr) {
+  *count_ptr = REGISTER_NB;
+  return registers;
 }
 
-void postTransmission() {
-  digitalWrite(RTS, 0);
+void _setRegisterImage(uint8_t index, uint16_t value) {
+  portENTER_CRITICAL(&register_image_mux);
+  register_image[index].value = value;
+  register_image[index].updated_ms = millis();
+  register_image[index].valid = true;
+  portEXIT_CRITICAL(&register_image_mux);
 }
 
-void initModbus() {
-  Serial2.begin(MODBUS_BAUDRATE, SERIAL_8N1, RXD, TXD);  // Using ESP32 UART2 for Modbus
-  modbus_client.begin(MODBUS_UNIT, Serial2);
-
-  // do we have a flow control pin?
-  if (RTS != NOT_A_PIN) {
-    // Init in receive mode
-    pinMode(RTS, OUTPUT);
-    digitalWrite(RTS, 0);
-
-    // Callbacks allow us to configure the RS485 transceiver correctly
-    modbus_client.preTransmission(preTransmission);
-    modbus_client.postTransmission(postTransmission);
-  }
-}
-
-bool _getModbusResultMsg(ModbusMaster *node, uint8_t result) {
-  String tmpstr2 = "";
-  switch (result) {
-    case node->ku8MBSuccess:
-      return true;
-      break;
-      case node->ku8MBIllegalFunction:
-      tmpstr2 += "Illegal Function";
-      break;
-    case node->ku8MBIllegalDataAddress:
-      tmpstr2 += "Illegal Data Address";
-      break;
-    case node->ku8MBIllegalDataValue:
-      tmpstr2 += "Illegal Data Value";
-      break;
-    case node->ku8MBSlaveDeviceFailure:
-      tmpstr2 += "Slave Device Failure";
-      break;
-    case node->ku8MBInvalidSlaveID:
-      tmpstr2 += "Invalid Slave ID";
-      break;
-    case node->ku8MBInvalidFunction:
-      tmpstr2 += "Invalid Function";
-      break;
-    case node->ku8MBResponseTimedOut:
-      tmpstr2 += "Response Timed Out";
-      break;
-    case node->ku8MBInvalidCRC:
-      tmpstr2 += "Invalid CRC";
-      break;
-    default:
-      tmpstr2 += "Unknown error: " + String(result);
-      break;
-  }
-  ESP_LOGV(TAG, "%s", tmpstr2.c_str());
-  return false;
-}
-
-bool _getModbusValue(uint16_t register_id, modbus_entity_t modbus_entity, uint16_t *value_ptr) {
-  ESP_LOGD(TAG, "Requesting data");
-  for (uint8_t i = 1; i <= MODBUS_RETRIES + 1; ++i) {
-    ESP_LOGV(TAG, "Trial %d/%d", i, MODBUS_RETRIES + 1);
-    switch (modbus_entity) {
-      case MODBUS_TYPE_HOLDING:
-        uint8_t result;
-        result = modbus_client.readHoldingRegisters(register_id, 1);
-        if (_getModbusResultMsg(&modbus_client, result)) {
-          *value_ptr = modbus_client.getResponseBuffer(0);
-          ESP_LOGV(TAG, "Data read: %x", *value_ptr);
-          return true;
-        }
-        break;
-      default:
-        ESP_LOGW(TAG, "Unsupported Modbus entity type");
-        value_ptr = nullptr;
-        return false;
-        break;
+bool updateRegisterImage(uint16_t register_id, uint16_t value) {
+  const int16_t i = findRegister(registers, REGISTER_NB, register_id, nullptr);
+  if (i < 0) {
+    return false;
+  }
+  _setRegisterImage(i, value);
+  return true;
+}
+
+bool getRegisterImage(uint16_t register_id, uint16_t *value_ptr, uint32_t *age_ms_ptr) {
+  const int16_t i = findRegister(registers, REGISTER_NB, register_id, nullptr);
+  if (i < 0) {
+    return false;
+  }
+  portENTER_CRITICAL(&register_image_mux);
+  const register_image_t entry = register_image[i];
+  portEXIT_CRITICAL(&register_image_mux);
+  if (!entry.valid) {
+    return false;
+  }
+  *value_ptr = entry.value;
+  *age_ms_ptr = millis() - entry.updated_ms;
+  return true;
+}
+
+#ifdef MODBUS_SNIFFER
+void _onSniffedRegister(uint8_t unit, uint16_t address, uint16_t value, bool is_write, void *context) {
+  if (!is_write && unit != MODBUS_UNIT) {
+    return;  // read response from another slave
+  }
+  if (updateRegisterImage(address, value)) {
+    BINLOG(LOG_SNIFFED_REGISTER, address, value, unit, is_write);
+#ifdef MODBUS_EDGES
+    onModbusEdgeSample(address, value);
+#endif  // MODBUS_EDGES
+  }
+}
+
+RtuSniffer sniffer(_onSniffedRegister, nullptr);
+
+void _onSniffedFrame(const uint8_t *frame, size_t len, void *context) {
+  sniffer.onFrame(frame, len);
+}
+
+RtuFramer sniffer_framer(MODBUS_BAUDRATE, _onSniffedFrame, nullptr);
+#else
+#ifdef MODBUS_TCP
+TcpMaster modbus_master(&bus_transport);
+#else
+RtuMaster modbus_master(&bus_transport, MODBUS_BAUDRATE);
+#endif  // MODBUS_TCP
+QueueHandle_t modbus_request_queue = NULL;
+QueueHandle_t modbus_urgent_queue = NULL;
+
+// result of the scan in progress for one entry of registers[]
+typedef struct {
+  TaskHandle_t task;  // notified on completion
+  uint8_t status;
+  uint16_t value;
+} scan_result_t;
+
+static scan_result_t scan_results[REGISTER_NB];
+
+// read plan of registers[]: neighbouring entries of the same Modbus entity share a request
+static modbus_block_t scan_blocks[REGISTER_NB];
+static uint8_t scan_block_nb = 0;
+
+// Urgent requests go through their own queue and overtake the polling requests not yet on the bus.
+bool submitModbusRequest(const rtu_request_t &request, TickType_t ticks_to_wait) {
+  QueueHandle_t queue = request.urgent ? modbus_urgent_queue : modbus_request_queue;
+  if (queue == NULL || xQueueSend(queue, &request, ticks_to_wait) != pdTRUE) {
+    return false;
+  }
+  modbus_transport.wake();
+  return true;
+}
+
+// bus round-trip time of the request being completed, only valid in completion callbacks
+uint32_t getModbusRoundTripUs() {
+  return modbus_master.roundTripUs();
+}
+
+void modbusBusToJson(ArduinoJson::JsonVariant variant) {
+  variant["transactions"] = modbus_master.transactions();
+  variant["retries"] = modbus_master.retries();
+  variant["timeouts"] = modbus_master.timeouts();
+  variant["round_trip_ms"] = modbus_master.roundTripUs() / 1000.0;
+#ifdef MODBUS_TCP
+  variant["late_answers"] = modbus_master.lateAnswers();
+#else
+  variant["crc_errors"] = modbus_master.crcErrors();
+#endif  // MODBUS_TCP
+#ifdef MODBUS_OVER_TCP
+  variant["connected"] = modbus_transport.connected();
+  variant["connections"] = modbus_transport.connections();
+  variant["disconnections"] = modbus_transport.disconnections();
+#endif  // MODBUS_OVER_TCP
+}
+
+// runs in the bus task: spreads the values read for a block to its entries
+void _onScanCompletion(const rtu_request_t *request, uint8_t status, const uint16_t *values, void *context) {
+  const modbus_block_t *block = static_cast<const modbus_block_t *>(context);
+  for (uint16_t i = block->first; i < block->first + block->entries; ++i) {
+    scan_results[i].status = status;
+    if (status == MODBUS_STATUS_SUCCESS) {
+      scan_results[i].value = blockRegisterValue(block, &registers[i], values);
+      _setRegisterImage(i, scan_results[i].value);
+    }
+  }
+  xTaskNotifyGive(scan_results[block->first].task);
+}
+
+// Queues a read for each of the count blocks in one go, so that the bus task chains them back to back,
+// then waits for all the answers.
+void _scanModbusBlocks(modbus_block_t *blocks, uint8_t count) {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  uint8_t submitted = 0;
+  for (uint8_t b = 0; b < count; ++b) {
+    modbus_block_t *block = &blocks[b];
+    for (uint16_t i = block->first; i < block->first + block->entries; ++i) {
+      scan_results[i].task = task;
+      scan_results[i].status = MODBUS_STATUS_INVALID_FUNCTION;
+    }
+    const uint8_t function = modbusReadFunction(block->modbus_entity);
+    if (function == 0) {
+      BINLOG(LOG_UNSUPPORTED_ENTITY);
+      continue;
     }
+    const rtu_request_t request = { MODBUS_UNIT, function, block->address, block->count, nullptr, MODBUS_RETRIES,
+                                    MODBUS_TIMEOUT, _onScanCompletion, block, false };
+    submitModbusRequest(request, portMAX_DELAY);
+    ++submitted;
+  }
+  for (uint8_t i = 0; i < submitted; ++i) {
+    ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
   }
-  // Time-out
-  ESP_LOGW(TAG, "Time-out");
-  value_ptr = nullptr;
-  return false;
 }
 
-String _toBinary(uint16_t input) {
-    String output;
-    while (input != 0) {
-      output = (input % 2 == 0 ? "0" : "1") + output;
-      input /= 2;
+// Replaces scan_blocks[b] by one block per entry
+void _splitScanBlock(uint8_t b) {
+  const modbus_block_t block = scan_blocks[b];
+  memmove(&scan_blocks[b + block.entries], &scan_blocks[b + 1], (scan_block_nb - b - 1) * sizeof(modbus_block_t));
+  for (uint8_t j = 0; j < block.entries; ++j) {
+    const modbus_register_t *reg = &registers[block.first + j];
+    scan_blocks[b + j] = { static_cast<uint8_t>(block.first + j), 1, reg->modbus_entity, reg->id,
+                           registerWidth(reg) };
+  }
+  scan_block_nb += block.entries - 1;
+}
+
+void _scanModbusRegisters() {
+  BINLOG(LOG_SCAN_REQUEST);
+  _scanModbusBlocks(scan_blocks, scan_block_nb);
+  // A block answered by an exception (e.g. it spans an address the slave does not implement) is read entry by
+  // entry from now on, starting with this scan
+  for (uint8_t b = 0; b < scan_block_nb; ++b) {
+    const modbus_block_t *block = &scan_blocks[b];
+    const uint8_t status = scan_results[block->first].status;
+    if (block->entries > 1 && status != MODBUS_STATUS_SUCCESS && status < MODBUS_STATUS_INVALID_SLAVE_ID) {
+      BINLOG(LOG_BLOCK_SPLIT, block->address, block->count, status);
+      const uint8_t entries = block->entries;
+      _splitScanBlock(b);
+      _scanModbusBlocks(&scan_blocks[b], entries);
+      b += entries - 1;
+    }
+  }
+}
+#endif  // MODBUS_SNIFFER
+
+// owns the UART: runs the RTU master (or the sniffer) whenever the transport has news
+void runModbusBusTask(void *pvParameters) {
+  for (;;) {
+#ifdef MODBUS_SNIFFER
+    uint8_t buffer[64];
+    for (;;) {
+      // after bytes handed over on the UART FIFO threshold, the frame goes on in the next ones however late they
+      // are read: only the receiver time-out ends it
+      const bool frame_open = bus_transport.rxFrameOpen();
+      const size_t n = bus_transport.receive(buffer, sizeof(buffer));
+      if (n == 0) {
+        break;
+      }
+      const uint32_t now = bus_transport.micros();
+      if (frame_open) {
+        sniffer_framer.hold(now);
+      }
+      for (size_t i = 0; i < n; ++i) {
+        sniffer_framer.push(buffer[i], now);
+      }
+    }
+    if (!bus_transport.rxFrameOpen()) {
+      sniffer_framer.poll(bus_transport.micros());
+    }
+    bus_transport.wait(sniffer_framer.pending() ? modbusT35(MODBUS_BAUDRATE) : UINT32_MAX);
+#else
+    rtu_request_t request;
+    while (!modbus_master.full() && xQueueReceive(modbus_urgent_queue, &request, 0) == pdTRUE) {
+      modbus_master.submit(request);
     }
-    return output;
+    // polling requests only take half of the master queue, the rest is kept for urgent ones
+    while (modbus_master.pending() < MODBUS_MASTER_QUEUE_SIZE / 2
+           && xQueueReceive(modbus_request_queue, &request, 0) == pdTRUE) {
+      modbus_master.submit(request);
+    }
+    const uint32_t delay_us = modbus_master.poll();
+    if ((!modbus_master.full() && uxQueueMessagesWaiting(modbus_urgent_queue) > 0)
+        || (modbus_master.pending() < MODBUS_MASTER_QUEUE_SIZE / 2
+            && uxQueueMessagesWaiting(modbus_request_queue) > 0)) {
+      continue;  // room freed by a completion
+    }
+    bus_transport.wait(delay_us);
+#endif  // MODBUS_SNIFFER
+  }
 }
 
-bool _decodeDiematicDecimal(uint16_t int_input, int8_t decimals, float *value_ptr) {
-  ESP_LOGV(TAG, "Decoding %#x with %d decimal(s)", int_input, decimals);
-  if (int_input == 65535) {
-    value_ptr = nullptr;
+#ifdef MODBUS_CAPTURE
+size_t dumpBusCapture(uint8_t *buffer, size_t size) {
+  return bus_capture.snapshot(buffer, size);
+}
+
+// frozen to keep the frames around an incident, restarted empty
+void setBusCaptureEnabled(bool enabled) {
+  if (enabled && !bus_capture.enabled()) {
+    bus_capture.clear();
+  }
+  bus_capture.setEnabled(enabled);
+}
+#endif  // MODBUS_CAPTURE
+
+void initModbus() {
+#ifdef METRICS_HTTP
+  uint16_t field_nb = DERIVED_NB;
+  for (uint8_t i = 0; i < REGISTER_NB; ++i) {
+    field_nb += registerFieldCount(&registers[i]);
+  }
+  if (field_nb > MODBUS_FIELD_CACHE_SIZE) {
+    ESP_LOGW(TAG, "Only %d fields of %d in metrics, see MODBUS_FIELD_CACHE_SIZE", MODBUS_FIELD_CACHE_SIZE, field_nb);
+  }
+#endif  // METRICS_HTTP
+#ifdef MODBUS_ADAPTIVE_SCAN
+  uint16_t watched_nb = DERIVED_NB;
+  for (uint8_t i = 0; i < REGISTER_NB; ++i) {
+    watched_nb += registerFieldCount(&registers[i]);
+  }
+  if (watched_nb > SCAN_RATE_MAX_FIELDS) {
+    ESP_LOGW(TAG, "Only %d fields of %d in volatility, see SCAN_RATE_MAX_FIELDS", SCAN_RATE_MAX_FIELDS, watched_nb);
+  }
+#endif  // MODBUS_ADAPTIVE_SCAN
+#ifndef MODBUS_FULL_RESOLUTION
+  uint16_t aggregated_nb = DERIVED_NB;
+  for (uint8_t i = 0; i < REGISTER_NB; ++i) {
+    aggregated_nb += registerFieldCount(&registers[i]);
+  }
+  if (aggregated_nb > AGGREGATOR_MAX_FIELDS) {
+    ESP_LOGE(TAG, "Only %d fields of %d published, see AGGREGATOR_MAX_FIELDS", AGGREGATOR_MAX_FIELDS, aggregated_nb);
+  }
+#endif  // MODBUS_FULL_RESOLUTION
+#ifdef MODBUS_OVER_TCP
+  // connected by the first request, once the network is up
+  if (!modbus_transport.begin(MODBUS_TCP_HOST, MODBUS_TCP_PORT)) {
+    ESP_LOGE(TAG, "Invalid Modbus server address %s", MODBUS_TCP_HOST);
+    return;
+  }
+#else
+  if (!modbus_transport.begin(MODBUS_BAUDRATE, RXD, TXD, RTS)) {
+    return;
+  }
+#endif  // MODBUS_OVER_TCP
+#ifdef MODBUS_SNIFFER
+  // Listen-only: nothing is ever sent, so the transceiver stays in receive mode
+  ESP_LOGI(TAG, "Modbus sniffer listening at %d bauds", MODBUS_BAUDRATE);
+#else
+  modbus_request_queue = xQueueCreate(REGISTER_NB, sizeof(rtu_request_t));
+  configASSERT(modbus_request_queue);
+  modbus_urgent_queue = xQueueCreate(MODBUS_URGENT_QUEUE_SIZE, sizeof(rtu_request_t));
+  configASSERT(modbus_urgent_queue);
+  scan_block_nb = planRegisterBlocks(registers, REGISTER_NB, MODBUS_BLOCK_MAX_GAP, scan_blocks);
+  ESP_LOGI(TAG, "%d registers read by %d requests", REGISTER_NB, scan_block_nb);
+#endif  // MODBUS_SNIFFER
+  xTaskCreatePinnedToCore(runModbusBusTask, "modbus_bus", MODBUS_BUS_STACK_SIZE, NULL, 3, &modbus_bus_task_handler,
+    APP_CPU_NUM);
+  configASSERT(modbus_bus_task_handler);
+}
+
+#ifndef MODBUS_SNIFFER
+bool _getScannedValue(uint8_t index, uint16_t *value_ptr) {
+  const scan_result_t *result = &scan_results[index];
+  if (result->status != MODBUS_STATUS_SUCCESS) {
+    BINLOG(LOG_REQUEST_STATUS, modbusStatusString(result->status), result->status);
     return false;
-  } else {
-    uint16_t masked_input = int_input & 0x7FFF;
-    float output = static_cast<float>(masked_input);
-    if (int_input >> 15 == 1) {
-      output = -output;
+  }
+  *value_ptr = result->value;
+  BINLOG(LOG_DATA_READ, *value_ptr);
+  return true;
+}
+#endif  // MODBUS_SNIFFER
+
+#ifdef MODBUS_SNIFFER
+bool _getSniffedValue(uint16_t register_id, uint16_t *value_ptr) {
+  uint32_t age_ms;
+  if (!getRegisterImage(register_id, value_ptr, &age_ms)) {
+    BINLOG(LOG_NOT_SNIFFED, register_id);
+    return false;
+  }
+  if (age_ms > MODBUS_SNIFFER_MAX_AGE * 1000UL) {
+    BINLOG(LOG_SNIFFED_TOO_OLD, register_id, age_ms);
+    return false;
+  }
+  return true;
+}
+#endif  // MODBUS_SNIFFER
+
+// raw value of this scan for the derived fields
+bool _getDerivedOperand(uint16_t register_id, uint16_t *value_ptr, void *context) {
+#ifdef MODBUS_SNIFFER
+  return _getSniffedValue(register_id, value_ptr);
+#else
+  const int16_t i = findRegister(registers, REGISTER_NB, register_id, nullptr);
+  if (i < 0 || scan_results[i].status != MODBUS_STATUS_SUCCESS) {
+    return false;
+  }
+  *value_ptr = scan_results[i].value;
+  return true;
+#endif  // MODBUS_SNIFFER
+}
+
+// name of a field of registers[] or derived_fields[], nullptr past the last one
+const char *getModbusFieldName(uint16_t field_id) {
+  for (uint8_t i = 0; i < REGISTER_NB; ++i) {
+    const modbus_register_t *reg = &registers[i];
+    const uint8_t field_nb = registerFieldCount(reg);
+    if (field_id < field_nb) {
+      return reg->type == REGISTER_TYPE_BITFIELD ? reg->optional_param.bitfield[field_id] : reg->name;
     }
-    *value_ptr = output / pow(10, decimals);
-    ESP_LOGV(TAG, "Decoded value: %f", *value_ptr);
-    return true;
+    field_id -= field_nb;
   }
+  return field_id < DERIVED_NB ? derived_fields[field_id].name : nullptr;
 }
 
-void readModbusRegisterToJson(uint16_t register_id, ArduinoJson::JsonVariant variant) {
-  // searchin for register matching register_id
-  const uint8_t item_nb = sizeof(registers) / sizeof(modbus_register_t);
-  for (uint8_t i = 0; i < item_nb; ++i) {
-    if (registers[i].id != register_id) {
-      // not this one
-      continue;
-    } else {
-      // register found
-      ESP_LOGD(TAG, "Register id=%d type=0x%x name=%s", registers[i].id, registers[i].type, registers[i].name);
-      uint16_t raw_value;
-      if (_getModbusValue(registers[i].id, registers[i].modbus_entity, &raw_value)) {
-        ESP_LOGV(TAG, "Raw value: %s=%#06x", registers[i].name, raw_value);
-        switch (registers[i].type) {
-          case REGISTER_TYPE_U16:
-            ESP_LOGV(TAG, "Value: %u", raw_value);
-            variant[registers[i].name] = raw_value;
-            break;
-          case REGISTER_TYPE_DIEMATIC_ONE_DECIMAL:
-            float final_value;
-            if (_decodeDiematicDecimal(raw_value, 1, &final_value)) {
-              ESP_LOGV(TAG, "Value: %.1f", final_value);
-              variant[registers[i].name] = final_value;
-            } else {
-              ESP_LOGD(TAG, "Value: Invalid Diematic value");
-            }
-            break;
-          case REGISTER_TYPE_BITFIELD:
-            for (uint8_t j = 0; j < 16; ++j) {
-              const char *bit_varname = registers[i].optional_param.bitfield[j];
-              if (bit_varname == nullptr) {
-                ESP_LOGV(TAG, " [bit%02d] end of bitfield reached", j);
-                break;
-              }
-              const uint8_t bit_value = raw_value >> j & 1;
-              ESP_LOGV(TAG, " [bit%02d] %s=%d", j, bit_varname, bit_value);
-              variant[bit_varname] = bit_value;
-            }
-            break;
-          case REGISTER_TYPE_DEBUG:
-            ESP_LOGI(TAG, "Raw DEBUG value: %s=%#06x %s", registers[i].name, raw_value, _toBinary(raw_value).c_str());
-            break;
-          default:
-            // Unsupported type
-            ESP_LOGW(TAG, "Unsupported register type");
-            break;
-        }
+// Measurement of a field in line protocol output: its register for bitfield bits, otherwise the first word of
+// its name (temperature, alarm, pulse...). Returns the length of the group name pointed by group_ptr.
+size_t getModbusFieldGroup(uint16_t field_id, const char **group_ptr) {
+  uint16_t first_field_id = 0;
+  const char *name = nullptr;
+  bool whole_name = false;
+  for (uint8_t i = 0; i < REGISTER_NB && name == nullptr; ++i) {
+    const modbus_register_t *reg = &registers[i];
+    const uint8_t field_nb = registerFieldCount(reg);
+    if (field_id < first_field_id + field_nb) {
+      name = reg->name;
+      whole_name = reg->type == REGISTER_TYPE_BITFIELD;
+    }
+    first_field_id += field_nb;
+  }
+  if (name == nullptr && field_id - first_field_id < DERIVED_NB) {
+    name = derived_fields[field_id - first_field_id].name;
+  }
+  if (name == nullptr) {
+    return 0;
+  }
+  *group_ptr = name;
+  const char *separator = strchr(name, '_');
+  if (whole_name || separator == nullptr) {
+    return strlen(name);
+  }
+  return separator - name;
+}
+
+void _readModbusRegister(uint8_t index, uint16_t field_id, modbus_field_callback_t callback, void *context) {
+  const modbus_register_t *reg = &registers[index];
+  BINLOG(LOG_REGISTER, reg->id, reg->type, reg->name);
+  uint16_t raw_value;
+#ifdef MODBUS_SNIFFER
+  if (_getSniffedValue(reg->id, &raw_value)) {
+#else
+  if (_getScannedValue(index, &raw_value)) {
+#endif  // MODBUS_SNIFFER
+    BINLOG(LOG_RAW_VALUE, reg->name, raw_value);
+    if (reg->type == REGISTER_TYPE_DEBUG) {
+      BINLOG(LOG_DEBUG_VALUE, reg->name, raw_value, raw_value);
+    } else if (decodeRegister(reg, raw_value, field_id, callback, context) == 0) {
+      if (reg->type == REGISTER_TYPE_DIEMATIC_ONE_DECIMAL) {
+        BINLOG(LOG_INVALID_DECIMAL);
       } else {
-        ESP_LOGW(TAG, "Request failed!");
+        BINLOG(LOG_UNSUPPORTED_TYPE, reg->type);
       }
-      return;  // break the loop and exit the function
     }
+  } else {
+    BINLOG(LOG_REQUEST_FAILED, reg->id);
+  }
+}
+
+void readModbusRegister(uint16_t register_id, modbus_field_callback_t callback, void *context) {
+  uint16_t field_id;
+  const int16_t i = findRegister(registers, REGISTER_NB, register_id, &field_id);
+  if (i < 0) {
+    return;  // register not found
+  }
+#ifndef MODBUS_SNIFFER
+  modbus_block_t block = { static_cast<uint8_t>(i), 1, registers[i].modbus_entity, registers[i].id,
+                           registerWidth(&registers[i]) };
+  _scanModbusBlocks(&block, 1);
+#endif  // MODBUS_SNIFFER
+  _readModbusRegister(i, field_id, callback, context);
+}
+
+#ifdef METRICS_HTTP
+void _cacheField(uint16_t field_id, const char *name, double value, void *context) {
+  if (field_id < MODBUS_FIELD_CACHE_SIZE) {
+    portENTER_CRITICAL(&field_cache_mux);
+    field_cache[field_id].name = name;
+    field_cache[field_id].value = value;
+    field_cache[field_id].updated_ms = millis();
+    if (field_id >= field_cache_nb) {
+      field_cache_nb = field_id + 1;
+    }
+    portEXIT_CRITICAL(&field_cache_mux);
   }
-  // register not found
+  const field_forward_t *forward = static_cast<const field_forward_t *>(context);
+  forward->callback(field_id, name, value, forward->context);
+}
+#endif  // METRICS_HTTP
+
+#ifdef MODBUS_ADAPTIVE_SCAN
+void _watchField(uint16_t field_id, const char *name, double value, void *context) {
+  scan_rate.addValue(field_id, value);
+  const field_forward_t *forward = static_cast<const field_forward_t *>(context);
+  forward->callback(field_id, name, value, forward->context);
+}
+
+// sampling period for the scans to come
+uint32_t getModbusScanPeriodMs() {
+  portENTER_CRITICAL(&scan_rate_mux);
+  const uint32_t period_ms = scan_rate.periodMs();
+  portEXIT_CRITICAL(&scan_rate_mux);
+  return period_ms;
+}
+
+void modbusScanRateToJson(ArduinoJson::JsonVariant variant) {
+  portENTER_CRITICAL(&scan_rate_mux);
+  const uint32_t period_ms = scan_rate.periodMs();
+  const uint32_t scan_us = scan_rate.scanUs();
+  const float utilization = scan_rate.utilization();
+  const float volatility = scan_rate.volatility();
+  portEXIT_CRITICAL(&scan_rate_mux);
+  variant["period_s"] = period_ms / 1000.0;
+  variant["scan_ms"] = scan_us / 1000.0;
+  variant["bus_utilization_pct"] = utilization * 100;
+  variant["volatility_pct"] = volatility * 100;
+}
+#endif  // MODBUS_ADAPTIVE_SCAN
+
+void parseModbusFields(modbus_field_callback_t callback, void *context) {
+#ifdef METRICS_HTTP
+  // every field goes through the cache on its way to the caller
+  field_forward_t cache_forward = { callback, context };
+  callback = _cacheField;
+  context = &cache_forward;
+#endif  // METRICS_HTTP
+#ifdef MODBUS_ADAPTIVE_SCAN
+  // and through the volatility measurement
+  field_forward_t rate_forward = { callback, context };
+  callback = _watchField;
+  context = &rate_forward;
+#endif  // MODBUS_ADAPTIVE_SCAN
+  BINLOG(LOG_SCAN_START);
+#ifdef MODBUS_SNIFFER
+  BINLOG(LOG_SNIFFER_FRAMES, sniffer_framer.frames(), sniffer_framer.crcErrors(), sniffer_framer.overruns());
+  BINLOG(LOG_SNIFFER_REGISTERS, sniffer.registers(), sniffer.ignored());
+#else
+#ifdef MODBUS_ADAPTIVE_SCAN
+  const uint32_t scan_start_us = micros();
+  _scanModbusRegisters();
+  const uint32_t scan_us = micros() - scan_start_us;
+#else
+  _scanModbusRegisters();
+#endif  // MODBUS_ADAPTIVE_SCAN
+  BINLOG(LOG_BUS_STATS, modbus_master.transactions(), modbus_master.retries(), modbus_master.timeouts(),
+    modbus_master.crcErrors());
+#endif  // MODBUS_SNIFFER
+  uint16_t field_id = 0;
+  for (uint8_t i = 0; i < REGISTER_NB; ++i) {
+    _readModbusRegister(i, field_id, callback, context);
+    field_id += registerFieldCount(&registers[i]);
+  }
+  derived.evaluate(_getDerivedOperand, nullptr, millis(), field_id, callback, context);
+#ifdef MODBUS_ADAPTIVE_SCAN
+  portENTER_CRITICAL(&scan_rate_mux);
+  const uint32_t previous_ms = scan_rate.periodMs();
+  const uint32_t period_ms = scan_rate.endScan(scan_us);
+  const uint32_t utilization_pct = scan_rate.utilization() * 100;
+  const uint32_t volatility_pct = scan_rate.volatility() * 100;
+  portEXIT_CRITICAL(&scan_rate_mux);
+  if (period_ms != previous_ms) {
+    BINLOG(LOG_SCAN_PERIOD, period_ms, scan_us / 1000, utilization_pct, volatility_pct);
+  }
+#endif  // MODBUS_ADAPTIVE_SCAN
+#ifdef METRICS_HTTP
+  portENTER_CRITICAL(&field_cache_mux);
+  ++scan_count;
+  last_scan_ms = millis();
+  portEXIT_CRITICAL(&field_cache_mux);
+#endif  // METRICS_HTTP
+}
+
+void _setJsonField(uint16_t field_id, const char *name, double value, void *context) {
+  (*static_cast<ArduinoJson::JsonVariant *>(context))[name] = value;
+}
+
+void readModbusRegisterToJson(uint16_t register_id, ArduinoJson::JsonVariant variant) {
+  readModbusRegister(register_id, _setJsonField, &variant);
 }
 
 void parseModbusToJson(ArduinoJson::JsonVariant variant) {
-  ESP_LOGI(TAG, "Parsing all Modbus registers (Logging Tag: %s)", TAG);
-  uint8_t item_nb = sizeof(registers) / sizeof(modbus_register_t);
-  for (uint8_t i = 0; i < item_nb; ++i) {
-    readModbusRegisterToJson(registers[i].id, variant);
+  parseModbusFields(_setJsonField, &variant);
+}
+
+#ifdef METRICS_HTTP
+void _writeMetric(PrometheusWriter *writer, const char *name, const char *help, const char *type, double value) {
+  writer->family(name, help, type);
+  writer->sample(name, value);
+}
+
+// Fields from the cache, the bus is not touched. A field missing from the last scans (read failure, sniffed
+// register not seen) is left out rather than reported with an outdated value.
+void modbusFieldsToMetrics(PrometheusWriter *writer, uint32_t max_age_ms) {
+  portENTER_CRITICAL(&field_cache_mux);
+  const uint16_t field_nb = field_cache_nb;
+  const uint32_t scans = scan_count;
+  const uint32_t scan_ms = last_scan_ms;
+  portEXIT_CRITICAL(&field_cache_mux);
+
+  writer->family("modbus_field_value", "Latest decoded value of a register field", "gauge");
+  for (uint16_t i = 0; i < field_nb; ++i) {
+    portENTER_CRITICAL(&field_cache_mux);
+    const field_cache_t entry = field_cache[i];
+    portEXIT_CRITICAL(&field_cache_mux);
+    if (entry.name == nullptr || millis() - entry.updated_ms > max_age_ms) {
+      continue;
+    }
+    const char *group_name;
+    char group[32] = "";
+    const size_t group_len = getModbusFieldGroup(i, &group_name);
+    snprintf(group, sizeof(group), "%.*s", static_cast<int>(group_len), group_name);
+    const prometheus_label_t labels[] = { { "field", entry.name }, { "group", group } };
+    writer->sample("modbus_field_value", labels, 2, entry.value);
+  }
+  _writeMetric(writer, "modbus_scans_total", "Register scans completed", "counter", scans);
+  if (scans > 0) {
+    _writeMetric(writer, "modbus_last_scan_age_seconds", "Time since the last scan", "gauge",
+      (millis() - scan_ms) / 1000.0);
   }
 }
+
+#ifndef MODBUS_SNIFFER
+void modbusBusToMetrics(PrometheusWriter *writer) {
+  _writeMetric(writer, "modbus_transactions_total", "Modbus requests completed", "counter",
+    modbus_master.transactions());
+  _writeMetric(writer, "modbus_retries_total", "Modbus requests sent again", "counter", modbus_master.retries());
+  _writeMetric(writer, "modbus_timeouts_total", "Modbus requests without answer", "counter",
+    modbus_master.timeouts());
+  _writeMetric(writer, "modbus_round_trip_seconds", "Bus round-trip time of the last request", "gauge",
+    modbus_master.roundTripUs() / 1000000.0);
+#ifdef MODBUS_TCP
+  _writeMetric(writer, "modbus_late_answers_total", "Answers received after the time-out of their request",
+    "counter", modbus_master.lateAnswers());
+#else
+  _writeMetric(writer, "modbus_crc_errors_total", "Frames dropped on a CRC error", "counter",
+    modbus_master.crcErrors());
+#endif  // MODBUS_TCP
+#ifdef MODBUS_OVER_TCP
+  _writeMetric(writer, "modbus_connected", "Connection to the Modbus server is up", "gauge",
+    modbus_transport.connected() ? 1 : 0);
+  _writeMetric(writer, "modbus_connections_total", "Connections to the Modbus server", "counter",
+    modbus_transport.connections());
+  _writeMetric(writer, "modbus_disconnections_total", "Connections to the Modbus server lost", "counter",
+    modbus_transport.disconnections());
+#endif  // MODBUS_OVER_TCP
+#ifdef MODBUS_ADAPTIVE_SCAN
+  portENTER_CRITICAL(&scan_rate_mux);
+  const uint32_t period_ms = scan_rate.periodMs();
+  const uint32_t scan_us = scan_rate.scanUs();
+  const float utilization = scan_rate.utilization();
+  const float volatility = scan_rate.volatility();
+  portEXIT_CRITICAL(&scan_rate_mux);
+  _writeMetric(writer, "modbus_scan_period_seconds", "Sampling period picked for the next scans", "gauge",
+    period_ms / 1000.0);
+  _writeMetric(writer, "modbus_scan_duration_seconds", "Smoothed time taken by a scan on the bus", "gauge",
+    scan_us / 1000000.0);
+  _writeMetric(writer, "modbus_bus_utilization_ratio", "Share of the bus time taken by the scans", "gauge",
+    utilization);
+  _writeMetric(writer, "modbus_field_volatility_ratio", "Smoothed share of the fields moving at each scan", "gauge",
+    volatility);
+#endif  // MODBUS_ADAPTIVE_SCAN
+}
+#endif  // MODBUS_SNIFFER
+#endif  // METRICS_HTTP
@@ -19,13 +19,47 @@
 #ifndef SRC_MODBUS_BASE_H_
 #define SRC_MODBUS_BASE_H_
 
-#include <ModbusMaster.h>
+#include "Arduino.h"
 #include <ArduinoJson.h>
+#include <RegisterMap.h>
+#include <RtuMaster.h>
+#ifdef METRICS_HTTP
+#include <PrometheusWriter.h>
+#endif  // METRICS_HTTP
+
+// response time-out (in milliseconds)
+#ifndef MODBUS_TIMEOUT
+#define MODBUS_TIMEOUT 2000
+#endif
 
-void preTransmission();
-void postTransmission();
 void initModbus();
+#ifndef MODBUS_SNIFFER
+bool submitModbusRequest(const rtu_request_t &request, TickType_t ticks_to_wait);
+uint32_t getModbusRoundTripUs();
+void modbusBusToJson(ArduinoJson::JsonVariant variant);
+#endif  // MODBUS_SNIFFER
+const modbus_register_t *getModbusRegisters(uint8_t *count_ptr);
+bool updateRegisterImage(uint16_t register_id, uint16_t value);
+bool getRegisterImage(uint16_t register_id, uint16_t *value_ptr, uint32_t *age_ms_ptr);
+const char *getModbusFieldName(uint16_t field_id);
+size_t getModbusFieldGroup(uint16_t field_id, const char **group_ptr);
+void readModbusRegister(uint16_t register_id, modbus_field_callback_t callback, void *context);
+void parseModbusFields(modbus_field_callback_t callback, void *context);
 void readModbusRegisterToJson(uint16_t register_id, ArduinoJson::JsonVariant variant);
 void parseModbusToJson(ArduinoJson::JsonVariant variant);
+#ifdef MODBUS_CAPTURE
+size_t dumpBusCapture(uint8_t *buffer, size_t size);
+void setBusCaptureEnabled(bool enabled);
+#endif  // MODBUS_CAPTURE
+#ifdef MODBUS_ADAPTIVE_SCAN
+uint32_t getModbusScanPeriodMs();
+void modbusScanRateToJson(ArduinoJson::JsonVariant variant);
+#endif  // MODBUS_ADAPTIVE_SCAN
+#ifdef METRICS_HTTP
+void modbusFieldsToMetrics(PrometheusWriter *writer, uint32_t max_age_ms);
+#ifndef MODBUS_SNIFFER
+void modbusBusToMetrics(PrometheusWriter *writer);
+#endif  // MODBUS_SNIFFER
+#endif  // METRICS_HTTP
 
 #endif  // SRC_MODBUS_BASE_H_
@@ -0,0 +1,39 @@
+/*
+ modbus_derived.h - Fields computed from several registers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SRC_MODBUS_DERIVED_H_
+#define SRC_MODBUS_DERIVED_H_
+
+#include <DerivedFields.h>
+
+// Published after the fields of registers[], from the raw values of the same scan (DEBUG registers included)
+const derived_field_t derived_fields[] = {
+    // 32-bit counters split across two registers, high word first
+    { "pulse_1", DERIVED_OP_WORDS, 2, { 251, 253 }, 0, 1, 0, 0 },
+    { "operating_1", DERIVED_OP_WORDS, 2, { 252, 254 }, 0, 1, 0, 0 },
+    { "pulse_2", DERIVED_OP_WORDS, 2, { 255, 257 }, 0, 1, 0, 0 },
+    { "operating_2", DERIVED_OP_WORDS, 2, { 256, 258 }, 0, 1, 0, 0 },
+    { "pulse_3", DERIVED_OP_WORDS, 2, { 259, 261 }, 0, 1, 0, 0 },
+    { "operating_3", DERIVED_OP_WORDS, 2, { 260, 262 }, 0, 1, 0, 0 },
+    // the _unit register counts up to 9999, the _ten register the tens of thousands
+    { "pulse_total", DERIVED_OP_COMBINE, 2, { 508, 507 }, 10000, 1, 0, 0 },
+    { "operating_total", DERIVED_OP_COMBINE, 2, { 510, 509 }, 10000, 1, 0, 0 },
+    { "pulse_per_hour", DERIVED_OP_COMBINE, 2, { 508, 507 }, 10000, 1, 0, 3600 },
+};
+
+#endif  // SRC_MODBUS_DERIVED_H_
@@ -0,0 +1,210 @@
+/*
+ modbus_edges.cpp - Bitfield transition events
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "modbus_edges.h"
+
+#include "Arduino.h"
+#include <sys/time.h>
+#include <ArduinoJson.h>
+#include <EdgeDetector.h>
+#include <RtuMaster.h>
+#include <SpscRing.h>
+#include <atomic>
+
+#include "log_base.h"
+#include "modbus_base.h"
+
+// transitions waiting to be published (power of 2)
+#ifndef MODBUS_EDGE_QUEUE_SIZE
+#define MODBUS_EDGE_QUEUE_SIZE 64
+#endif
+
+// transitions per published message
+#ifndef MODBUS_EDGE_BATCH
+#define MODBUS_EDGE_BATCH 16
+#endif
+
+static const char __attribute__((__unused__)) *TAG = "Modbus_edges";
+
+// all the bitfield registers of registers[] are tracked
+static EdgeDetector edge_detector;
+static portMUX_TYPE edge_mux = portMUX_INITIALIZER_UNLOCKED;
+// produced by the bus task, consumed by the publisher task
+static SpscRing<edge_event_t, MODBUS_EDGE_QUEUE_SIZE> edge_queue;
+static TaskHandle_t edge_notified_task = NULL;
+static uint32_t edge_notification_bits = 0;
+
+#ifndef MODBUS_SNIFFER
+// contiguous bitfield registers are read by a single request
+typedef struct {
+  uint16_t address;
+  uint16_t count;
+} edge_read_t;
+
+static edge_read_t edge_reads[EDGE_DETECTOR_MAX_REGISTERS];
+static uint8_t edge_read_nb = 0;
+static std::atomic<uint8_t> edge_reads_pending(0);  // incremented by the timer task, decremented by the bus task
+static uint32_t edge_overruns = 0;  // polling periods skipped, the previous reads being still in progress
+static TimerHandle_t edge_timer = NULL;
+#endif  // MODBUS_SNIFFER
+
+void _queueEdgeEvent(const edge_event_t &event, void *context) {
+  BINLOG(LOG_EDGE, event.register_id, event.bit, event.state, event.on_ms);
+  edge_queue.push(event);
+}
+
+// runs in the bus task
+void onModbusEdgeSample(uint16_t register_id, uint16_t value) {
+  portENTER_CRITICAL(&edge_mux);
+  const int8_t transitions = edge_detector.update(register_id, value, millis(), _queueEdgeEvent, nullptr);
+  portEXIT_CRITICAL(&edge_mux);
+  if (transitions > 0 && edge_notified_task != NULL) {
+    xTaskNotify(edge_notified_task, edge_notification_bits, eSetBits);
+  }
+}
+
+#ifndef MODBUS_SNIFFER
+// runs in the bus task
+void _onEdgeReadCompletion(const rtu_request_t *request, uint8_t status, const uint16_t *values, void *context) {
+  for (uint16_t i = 0; i < request->count; ++i) {
+    if (status == MODBUS_STATUS_SUCCESS) {
+      onModbusEdgeSample(request->address + i, values[i]);
+    } else {
+      portENTER_CRITICAL(&edge_mux);
+      edge_detector.invalidate(request->address + i, millis());
+      portEXIT_CRITICAL(&edge_mux);
+    }
+  }
+  --edge_reads_pending;
+}
+
+// runs in the timer task
+void _runEdgeTimer() {
+  if (edge_reads_pending > 0) {
+    ++edge_overruns;
+    BINLOG(LOG_EDGE_OVERRUN, edge_reads_pending.load());
+    return;
+  }
+  for (uint8_t i = 0; i < edge_read_nb; ++i) {
+    // urgent: the samples stay evenly spaced while a scan fills the bus
+    const rtu_request_t request = { MODBUS_UNIT, 0x03, edge_reads[i].address, edge_reads[i].count, nullptr, 0,
+                                    MODBUS_EDGE_PERIOD, _onEdgeReadCompletion, nullptr, true };
+    ++edge_reads_pending;
+    if (!submitModbusRequest(request, 0)) {
+      --edge_reads_pending;
+    }
+  }
+}
+#endif  // MODBUS_SNIFFER
+
+void initModbusEdges(TaskHandle_t notified_task, uint32_t notification_bits) {
+  edge_notified_task = notified_task;
+  edge_notification_bits = notification_bits;
+  uint8_t register_nb;
+  const modbus_register_t *regs = getModbusRegisters(&register_nb);
+  for (uint8_t i = 0; i < register_nb; ++i) {
+    if (regs[i].type != REGISTER_TYPE_BITFIELD || regs[i].modbus_entity != MODBUS_TYPE_HOLDING
+        || !edge_detector.addRegister(regs[i].id)) {
+      continue;
+    }
+#ifndef MODBUS_SNIFFER
+    edge_read_t *last = edge_read_nb > 0 ? &edge_reads[edge_read_nb - 1] : nullptr;
+    if (last != nullptr && last->address + last->count == regs[i].id) {
+      ++last->count;
+    } else {
+      edge_reads[edge_read_nb++] = { regs[i].id, 1 };
+    }
+#endif  // MODBUS_SNIFFER
+  }
+#ifndef MODBUS_SNIFFER
+  edge_timer = xTimerCreate("edge_timer", pdMS_TO_TICKS(MODBUS_EDGE_PERIOD), pdTRUE, NULL,
+    reinterpret_cast<TimerCallbackFunction_t>(_runEdgeTimer));
+  if (edge_timer == NULL || xTimerStart(edge_timer, 0) != pdPASS) {
+    ESP_LOGE(TAG, "Edge polling timer not started");
+  }
+#endif  // MODBUS_SNIFFER
+}
+
+const char *_getBitName(uint16_t register_id, uint8_t bit) {
+  uint8_t register_nb;
+  const modbus_register_t *regs = getModbusRegisters(&register_nb);
+  const int16_t i = findRegister(regs, register_nb, register_id, nullptr);
+  return i < 0 || bit >= registerFieldCount(&regs[i]) ? nullptr : regs[i].optional_param.bitfield[bit];
+}
+
+// Moves up to MODBUS_EDGE_BATCH transitions to array, oldest first: {"name":"io_burner_1","old":0,"new":1,
+// "t":1600000000123} with the wall clock time in ms ("uptime_ms" until set by NTP), and "on_ms" on falling
+// edges. Returns false when there was none.
+bool modbusEdgeEventsToJson(ArduinoJson::JsonArray array) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  const uint32_t now_ms = millis();
+  edge_event_t event;
+  uint8_t n = 0;
+  while (n < MODBUS_EDGE_BATCH && edge_queue.pop(&event)) {
+    JsonObject item = array.add<JsonObject>();
+    const char *name = _getBitName(event.register_id, event.bit);
+    if (name != nullptr) {
+      item["name"] = name;
+    } else {
+      item["register"] = event.register_id;
+      item["bit"] = event.bit;
+    }
+    item["old"] = event.state ^ 1;
+    item["new"] = event.state;
+    if (now.tv_sec >= 1600000000) {
+      item["t"] = static_cast<uint64_t>(now.tv_sec) * 1000ULL + now.tv_usec / 1000 - (now_ms - event.timestamp_ms);
+    } else {
+      item["uptime_ms"] = event.timestamp_ms;
+    }
+    if (!event.state) {
+      item["on_ms"] = event.on_ms;
+    }
+    ++n;
+  }
+  return n > 0;
+}
+
+// Counters and, for each bit that has been ON, its number of starts and cumulative ON time since boot
+void modbusEdgesToJson(ArduinoJson::JsonVariant variant) {
+  variant["events"] = edge_detector.events();
+  variant["dropped"] = edge_queue.dropped();
+#ifndef MODBUS_SNIFFER
+  variant["overruns"] = edge_overruns;
+#endif  // MODBUS_SNIFFER
+  JsonObject starts = variant["starts"].to<JsonObject>();
+  JsonObject on_time = variant["on_time_s"].to<JsonObject>();
+  const uint32_t now_ms = millis();
+  for (uint8_t i = 0; i < edge_detector.registers(); ++i) {
+    const uint16_t register_id = edge_detector.registerId(i);
+    for (uint8_t bit = 0; bit < 16; ++bit) {
+      const char *name = _getBitName(register_id, bit);
+      if (name == nullptr) {
+        break;
+      }
+      portENTER_CRITICAL(&edge_mux);
+      const uint32_t rises = edge_detector.rises(register_id, bit);
+      const uint64_t on_ms = edge_detector.onTimeMs(register_id, bit, now_ms);
+      portEXIT_CRITICAL(&edge_mux);
+      if (on_ms > 0) {
+        starts[name] = rises;
+        on_time[name] = on_ms / 1000;
+      }
+    }
+  }
+}
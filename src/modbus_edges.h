@@ -0,0 +1,35 @@
+/*
+ modbus_edges.h - Bitfield transition events headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SRC_MODBUS_EDGES_H_
+#define SRC_MODBUS_EDGES_H_
+
+#include "Arduino.h"
+#include <ArduinoJson.h>
+
+// bitfield registers polling period (in milliseconds)
+#ifndef MODBUS_EDGE_PERIOD
+#define MODBUS_EDGE_PERIOD 250
+#endif
+
+void initModbusEdges(TaskHandle_t notified_task, uint32_t notification_bits);
+void onModbusEdgeSample(uint16_t register_id, uint16_t value);
+bool modbusEdgeEventsToJson(ArduinoJson::JsonArray array);
+void modbusEdgesToJson(ArduinoJson::JsonVariant variant);
+
+#endif  // SRC_MODBUS_EDGES_H_
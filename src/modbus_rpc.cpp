@@ -0,0 +1,199 @@
+/*
+ modbus_rpc.cpp - Raw Modbus requests over MQTT
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "modbus_rpc.h"
+
+#include "Arduino.h"
+#include <esp_timer.h>
+#include <ArduinoJson.h>
+#include <RtuMaster.h>
+
+#include "modbus_base.h"
+
+// raw requests in progress (received but not published yet)
+#ifndef MODBUS_RPC_SLOTS
+#define MODBUS_RPC_SLOTS 8
+#endif
+
+static const char __attribute__((__unused__)) *TAG = "Modbus_rpc";
+
+typedef enum {
+  RPC_SLOT_FREE = 0,
+  RPC_SLOT_PENDING,  // on its way to the bus
+  RPC_SLOT_DONE      // waiting to be published
+} rpc_slot_state_t;
+
+typedef struct {
+  volatile uint8_t state;  // rpc_slot_state_t
+  char id[40];  // JSON representation of the request id, echoed in the answer
+  rtu_request_t request;
+  uint16_t values[RTU_MASTER_MAX_REGISTERS];  // values to write, then values read (bits packed 16 per value)
+  uint8_t status;
+  uint32_t received_us;
+  uint32_t latency_us;  // from the MQTT message to the answer of the slave
+  uint32_t round_trip_us;  // on the bus
+} rpc_slot_t;
+
+static rpc_slot_t rpc_slots[MODBUS_RPC_SLOTS];
+static portMUX_TYPE rpc_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t rpc_notified_task = NULL;
+static uint32_t rpc_notification_bits = 0;
+
+void initModbusRpc(TaskHandle_t notified_task, uint32_t notification_bits) {
+  rpc_notified_task = notified_task;
+  rpc_notification_bits = notification_bits;
+}
+
+// runs in the bus task
+void _onRpcCompletion(const rtu_request_t *request, uint8_t status, const uint16_t *values, void *context) {
+  rpc_slot_t *slot = static_cast<rpc_slot_t *>(context);
+  slot->status = status;
+  slot->latency_us = static_cast<uint32_t>(esp_timer_get_time()) - slot->received_us;
+  slot->round_trip_us = getModbusRoundTripUs();
+  if (values != nullptr && (request->function == 0x03 || request->function == 0x04)) {
+    memcpy(slot->values, values, request->count * sizeof(uint16_t));
+  } else if (values != nullptr && (request->function == 0x01 || request->function == 0x02)) {
+    memcpy(slot->values, values, (request->count + 15) / 16 * sizeof(uint16_t));
+  }
+  slot->state = RPC_SLOT_DONE;
+  if (rpc_notified_task != NULL) {
+    xTaskNotify(rpc_notified_task, rpc_notification_bits, eSetBits);
+  }
+}
+
+rpc_slot_t *_allocateRpcSlot() {
+  rpc_slot_t *slot = nullptr;
+  portENTER_CRITICAL(&rpc_mux);
+  for (uint8_t i = 0; i < MODBUS_RPC_SLOTS; ++i) {
+    if (rpc_slots[i].state == RPC_SLOT_FREE) {
+      slot = &rpc_slots[i];
+      slot->state = RPC_SLOT_PENDING;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&rpc_mux);
+  return slot;
+}
+
+// Payload: {"id":"scan-1","fc":3,"unit":10,"address":600,"count":10}, "values":[...] instead of count to write
+// (fc 6 or 16), count bits for fc 1 and 2. Returns false with the reason in error when the request is not queued.
+bool submitModbusRpc(const char *payload, size_t len, ArduinoJson::JsonVariant error) {
+  JsonDocument request_doc;
+  if (deserializeJson(request_doc, payload, len) != DeserializationError::Ok) {
+    error["error"] = "invalid JSON";
+    return false;
+  }
+  error["id"] = request_doc["id"];
+#ifdef MODBUS_SNIFFER
+  error["error"] = "not available in sniffer mode";
+  return false;
+#else
+  const int function = request_doc["fc"] | 0x03;
+  const int unit = request_doc["unit"] | MODBUS_UNIT;
+  const long address = request_doc["address"] | -1L;
+  JsonArrayConst write_values = request_doc["values"];
+  const bool is_write = function == 0x06 || function == 0x10;
+  const bool is_bit_read = function == 0x01 || function == 0x02;
+  const int count = is_write ? static_cast<int>(write_values.size()) : (request_doc["count"] | 1);
+  if (function != 0x03 && function != 0x04 && !is_write && !is_bit_read) {
+    error["error"] = "unsupported function code";
+    return false;
+  }
+  if (address < 0 || address > 0xFFFF || unit < 0 || unit > 247 || (unit == 0 && !is_write)) {
+    error["error"] = "invalid unit or address";
+    return false;
+  }
+  const int max_count = function == 0x06 ? 1 : (function == 0x10 ? RTU_MASTER_MAX_REGISTERS - 2
+                                                 : (is_bit_read ? RTU_MASTER_MAX_BITS : RTU_MASTER_MAX_REGISTERS));
+  if (count < 1 || count > max_count || address + count > 0x10000) {
+    error["error"] = "invalid count";
+    return false;
+  }
+  for (uint16_t i = 0; is_write && i < count; ++i) {
+    if (!write_values[i].is<uint16_t>()) {
+      error["error"] = "invalid value";
+      return false;
+    }
+  }
+  // echoed as is in the answer: truncated, it would not be JSON anymore
+  if (measureJson(request_doc["id"]) > sizeof(rpc_slot_t::id) - 1) {
+    error["error"] = "id too long";
+    return false;
+  }
+
+  rpc_slot_t *slot = _allocateRpcSlot();
+  if (slot == nullptr) {
+    error["error"] = "too many requests in progress";
+    return false;
+  }
+  slot->received_us = static_cast<uint32_t>(esp_timer_get_time());
+  serializeJson(request_doc["id"], slot->id, sizeof(slot->id));
+  for (uint16_t i = 0; is_write && i < count; ++i) {
+    slot->values[i] = write_values[i];
+  }
+  const rtu_request_t request = { static_cast<uint8_t>(unit), static_cast<uint8_t>(function),
+                                  static_cast<uint16_t>(address), static_cast<uint16_t>(count), slot->values, 0,
+                                  MODBUS_TIMEOUT, _onRpcCompletion, slot, true };
+  slot->request = request;
+  if (!submitModbusRequest(request, 0)) {
+    slot->state = RPC_SLOT_FREE;
+    error["error"] = "bus queue full";
+    return false;
+  }
+  ESP_LOGD(TAG, "Raw request queued: unit=%d fc=%d address=%ld count=%d", unit, function, address, count);
+  return true;
+#endif  // MODBUS_SNIFFER
+}
+
+// Fills variant with the answer of one completed request and frees it, returns false if there is none
+bool modbusRpcResultToJson(ArduinoJson::JsonVariant variant) {
+  for (uint8_t i = 0; i < MODBUS_RPC_SLOTS; ++i) {
+    rpc_slot_t *slot = &rpc_slots[i];
+    if (slot->state != RPC_SLOT_DONE) {
+      continue;
+    }
+    const rtu_request_t &request = slot->request;
+    variant["id"] = serialized(slot->id);
+    variant["fc"] = request.function;
+    variant["unit"] = request.unit;
+    variant["address"] = request.address;
+    variant["count"] = request.count;
+    variant["status"] = slot->status;
+    if (slot->status != MODBUS_STATUS_SUCCESS) {
+      variant["error"] = modbusStatusString(slot->status);
+    } else if (request.function == 0x03 || request.function == 0x04) {
+      JsonArray values = variant["values"].to<JsonArray>();
+      for (uint16_t j = 0; j < request.count; ++j) {
+        values.add(slot->values[j]);
+      }
+    } else if (request.function == 0x01 || request.function == 0x02) {
+      // "0110...", first bit first: up to 2000 bits would not fit as an array of numbers
+      String bits;
+      bits.reserve(request.count);
+      for (uint16_t j = 0; j < request.count; ++j) {
+        bits += slot->values[j / 16] >> (j % 16) & 1 ? '1' : '0';
+      }
+      variant["bits"] = bits;
+    }
+    variant["rtt_ms"] = slot->round_trip_us / 1000.0;
+    variant["latency_ms"] = slot->latency_us / 1000.0;
+    slot->state = RPC_SLOT_FREE;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,29 @@
+/*
+ modbus_rpc.h - Raw Modbus requests over MQTT headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SRC_MODBUS_RPC_H_
+#define SRC_MODBUS_RPC_H_
+
+#include "Arduino.h"
+#include <ArduinoJson.h>
+
+void initModbusRpc(TaskHandle_t notified_task, uint32_t notification_bits);
+bool submitModbusRpc(const char *payload, size_t len, ArduinoJson::JsonVariant error);
+bool modbusRpcResultToJson(ArduinoJson::JsonVariant variant);
+
+#endif  // SRC_MODBUS_RPC_H_
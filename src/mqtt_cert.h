@@ -0,0 +1,27 @@
+/*
+ mqtt_cert.h - MQTT broker CA Certificate
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SRC_MQTT_CERT_H_
+#define SRC_MQTT_CERT_H_
+
+// CA that signed the broker certificate, only used with -DMQTT_TLS. Without it, the broker certificate
+// must be pinned with -DMQTT_TLS_FINGERPRINT.
+// sed 's/^\(.*\)$/"\1\\n" \\/' ca.crt
+static const char* mqttCACertificate = nullptr;
+
+#endif  // SRC_MQTT_CERT_H_
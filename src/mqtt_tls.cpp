@@ -0,0 +1,421 @@
+/*
+ mqtt_tls.cpp - MQTT over TLS client
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "mqtt_tls.h"
+
+#include "Arduino.h"
+#include <mbedtls/sha256.h>
+
+static const char __attribute__((__unused__)) *TAG = "Mqtt_tls";
+
+// blocking reads give up after this delay (in milliseconds), so that deadlines are checked
+static const uint32_t MQTT_TLS_READ_TIMEOUT = 500;
+
+TlsMqttClient::TlsMqttClient()
+    : port_(8883), ca_pem_(nullptr), pinned_(false), hostname_(nullptr), task_(NULL), mutex_(NULL),
+      connected_(false), broken_(false), last_sent_ms_(0), packet_id_(0), has_session_(false),
+      reader_(rx_buffer_, sizeof(rx_buffer_)), stats_() {
+  snprintf(client_id_, sizeof(client_id_), "esp32-%06llx", ESP.getEfuseMac());
+}
+
+TlsMqttClient &TlsMqttClient::setServer(IPAddress ip, uint16_t port) {
+  ip_ = ip;
+  port_ = port;
+  return *this;
+}
+
+TlsMqttClient &TlsMqttClient::setCaCert(const char *pem) {
+  ca_pem_ = pem;
+  return *this;
+}
+
+TlsMqttClient &TlsMqttClient::setFingerprint(const char *sha256_hex) {
+  pinned_ = false;
+  if (sha256_hex == nullptr) {
+    return *this;
+  }
+  uint8_t n = 0;
+  for (const char *c = sha256_hex; *c != '\0' && n < 64; ++c) {  // accepts "AB:CD:..." as printed by openssl
+    if (!isxdigit(*c)) {
+      continue;
+    }
+    const uint8_t nibble = isdigit(*c) ? *c - '0' : (tolower(*c) - 'a' + 10);
+    fingerprint_[n / 2] = n % 2 == 0 ? nibble << 4 : fingerprint_[n / 2] | nibble;
+    ++n;
+  }
+  pinned_ = n == 64;
+  if (!pinned_) {
+    ESP_LOGE(TAG, "Invalid SHA-256 fingerprint: %s", sha256_hex);
+  }
+  return *this;
+}
+
+TlsMqttClient &TlsMqttClient::setHostname(const char *hostname) {
+  hostname_ = hostname;
+  return *this;
+}
+
+// TLS configuration and buffers are set up once, then reused by every connection
+bool TlsMqttClient::begin() {
+  if (ca_pem_ == nullptr && !pinned_) {
+    ESP_LOGE(TAG, "Neither CA certificate nor fingerprint: refusing to connect");
+    return false;
+  }
+  mutex_ = xSemaphoreCreateMutex();
+  mbedtls_entropy_init(&entropy_);
+  mbedtls_ctr_drbg_init(&drbg_);
+  mbedtls_x509_crt_init(&ca_);
+  mbedtls_ssl_config_init(&conf_);
+  mbedtls_ssl_init(&ssl_);
+  mbedtls_ssl_session_init(&session_);
+  mbedtls_net_init(&net_);
+
+  int ret = mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_,
+    reinterpret_cast<const unsigned char *>(client_id_), strlen(client_id_));
+  if (ret == 0) {
+    ret = mbedtls_ssl_config_defaults(&conf_, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+      MBEDTLS_SSL_PRESET_DEFAULT);
+  }
+  if (ret == 0 && ca_pem_ != nullptr) {
+    ret = mbedtls_x509_crt_parse(&ca_, reinterpret_cast<const unsigned char *>(ca_pem_), strlen(ca_pem_) + 1);
+    mbedtls_ssl_conf_ca_chain(&conf_, &ca_, nullptr);
+  }
+  if (ret != 0) {
+    ESP_LOGE(TAG, "TLS configuration failed: -0x%04x", -ret);
+    return false;
+  }
+  // without CA, the chain cannot be verified: the pinned fingerprint is checked after the handshake
+  mbedtls_ssl_conf_authmode(&conf_, ca_pem_ != nullptr ? MBEDTLS_SSL_VERIFY_REQUIRED : MBEDTLS_SSL_VERIFY_OPTIONAL);
+  mbedtls_ssl_conf_rng(&conf_, mbedtls_ctr_drbg_random, &drbg_);
+  mbedtls_ssl_conf_read_timeout(&conf_, MQTT_TLS_READ_TIMEOUT);
+#ifdef MBEDTLS_SSL_SESSION_TICKETS
+  mbedtls_ssl_conf_session_tickets(&conf_, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif  // MBEDTLS_SSL_SESSION_TICKETS
+  ret = mbedtls_ssl_setup(&ssl_, &conf_);
+  if (ret == 0 && hostname_ != nullptr) {
+    ret = mbedtls_ssl_set_hostname(&ssl_, hostname_);
+  }
+  if (ret != 0) {
+    ESP_LOGE(TAG, "TLS setup failed: -0x%04x", -ret);
+    return false;
+  }
+  return true;
+}
+
+void TlsMqttClient::connect() {
+  if (task_ == NULL) {
+    if (!begin()) {
+      return;
+    }
+    xTaskCreatePinnedToCore(run, "mqtt_tls", MQTT_TLS_STACK_SIZE, this, 1, &task_, PRO_CPU_NUM);
+    configASSERT(task_);
+  }
+  xTaskNotifyGive(task_);
+}
+
+void TlsMqttClient::run(void *client) {
+  TlsMqttClient *self = static_cast<TlsMqttClient *>(client);
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);  // connect() called
+    AsyncMqttClientDisconnectReason reason = AsyncMqttClientDisconnectReason::TCP_DISCONNECTED;
+    bool session_present = false;
+    if (self->open(&reason) && self->mqttConnect(&session_present, &reason)) {
+      self->connected_ = true;
+      if (self->on_connect_) {
+        self->on_connect_(session_present);
+      }
+      self->serve();
+      self->connected_ = false;
+    }
+    self->close();
+    if (self->on_disconnect_) {
+      self->on_disconnect_(reason);
+    }
+  }
+}
+
+bool TlsMqttClient::open(AsyncMqttClientDisconnectReason *reason_ptr) {
+  char port[6];
+  snprintf(port, sizeof(port), "%u", port_);
+  int ret = mbedtls_net_connect(&net_, ip_.toString().c_str(), port, MBEDTLS_NET_PROTO_TCP);
+  if (ret != 0) {
+    ESP_LOGW(TAG, "TCP connection failed: -0x%04x", -ret);
+    return false;
+  }
+  mbedtls_ssl_session_reset(&ssl_);  // keeps the record buffers allocated by mbedtls_ssl_setup()
+  mbedtls_ssl_set_bio(&ssl_, &net_, mbedtls_net_send, nullptr, mbedtls_net_recv_timeout);
+  if (!handshake()) {
+    return false;
+  }
+  if (pinned_ && !checkFingerprint()) {
+    *reason_ptr = AsyncMqttClientDisconnectReason::TLS_BAD_FINGERPRINT;
+    has_session_ = false;
+    return false;
+  }
+  return true;
+}
+
+bool TlsMqttClient::handshake() {
+  const bool resuming = has_session_ && mbedtls_ssl_set_session(&ssl_, &session_) == 0;
+  const uint32_t free_before = ESP.getFreeHeap();
+  uint32_t free_min = free_before;
+  const uint32_t start_ms = millis();
+  int ret = 0;
+  // step by step, to watch the heap and the deadline
+  while (ssl_.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+    ret = mbedtls_ssl_handshake_step(&ssl_);
+    const uint32_t free_now = ESP.getFreeHeap();
+    free_min = free_now < free_min ? free_now : free_min;
+    if (millis() - start_ms > MQTT_TLS_HANDSHAKE_TIMEOUT) {
+      ret = MBEDTLS_ERR_SSL_TIMEOUT;
+      break;
+    }
+    if (ret != 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE
+        && ret != MBEDTLS_ERR_SSL_TIMEOUT) {
+      break;
+    }
+    ret = 0;
+  }
+  stats_.handshake_ms = millis() - start_ms;
+  stats_.heap_peak = free_before - free_min;
+  if (ret != 0) {
+    ++stats_.failures;
+    has_session_ = false;  // the server may have rejected it
+    ESP_LOGW(TAG, "TLS handshake failed after %ums: -0x%04x (verify flags 0x%x)", stats_.handshake_ms, -ret,
+      mbedtls_ssl_get_verify_result(&ssl_));
+    return false;
+  }
+  ++stats_.handshakes;
+  if (stats_.handshake_ms > stats_.handshake_max_ms) {
+    stats_.handshake_max_ms = stats_.handshake_ms;
+  }
+  stats_.heap_used = free_before - ESP.getFreeHeap();
+
+  // a server resuming the session echoes its ID (also sent along a ticket)
+  const mbedtls_ssl_session *current = ssl_.session;
+  const bool resumed = resuming && current->id_len > 0 && current->id_len == session_.id_len
+                       && memcmp(current->id, session_.id, current->id_len) == 0;
+  if (resumed) {
+    ++stats_.resumed;
+  }
+  ESP_LOGI(TAG, "TLS %s handshake in %ums, %s, heap peak %u bytes", resumed ? "abbreviated" : "full",
+    stats_.handshake_ms, mbedtls_ssl_get_ciphersuite(&ssl_), stats_.heap_peak);
+  if (!resumed) {
+    mbedtls_ssl_session_free(&session_);
+    mbedtls_ssl_session_init(&session_);
+    has_session_ = mbedtls_ssl_get_session(&ssl_, &session_) == 0;
+  }
+  return true;
+}
+
+bool TlsMqttClient::checkFingerprint() {
+  const mbedtls_x509_crt *cert = mbedtls_ssl_get_peer_cert(&ssl_);
+  uint8_t digest[32];
+  if (cert == nullptr || mbedtls_sha256_ret(cert->raw.p, cert->raw.len, digest, 0) != 0
+      || memcmp(digest, fingerprint_, sizeof(digest)) != 0) {
+    ESP_LOGE(TAG, "Server certificate does not match the pinned fingerprint");
+    return false;
+  }
+  return true;
+}
+
+bool TlsMqttClient::write(const uint8_t *data, size_t len) {
+  while (len > 0) {
+    const int ret = mbedtls_ssl_write(&ssl_, data, len);
+    if (ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ) {
+      continue;
+    }
+    if (ret <= 0) {
+      broken_ = true;
+      return false;
+    }
+    data += ret;
+    len -= ret;
+  }
+  last_sent_ms_ = millis();
+  return true;
+}
+
+bool TlsMqttClient::send(const uint8_t *data, size_t len) {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  const bool sent = write(data, len);
+  xSemaphoreGive(mutex_);
+  return sent;
+}
+
+bool TlsMqttClient::mqttConnect(bool *session_present_ptr, AsyncMqttClientDisconnectReason *reason_ptr) {
+  uint8_t packet[64];
+  const size_t n = mqttEncodeConnect(packet, sizeof(packet), client_id_, MQTT_KEEP_ALIVE, true);
+  broken_ = false;
+  reader_.reset();
+  if (!send(packet, n)) {
+    return false;
+  }
+  const uint32_t start_ms = millis();
+  while (millis() - start_ms < MQTT_KEEP_ALIVE * 1000UL) {
+    uint8_t chunk[16];
+    const int ret = mbedtls_ssl_read(&ssl_, chunk, sizeof(chunk));
+    if (ret == MBEDTLS_ERR_SSL_TIMEOUT || ret == MBEDTLS_ERR_SSL_WANT_READ) {
+      continue;
+    }
+    if (ret <= 0) {
+      return false;
+    }
+    reader_.feed(chunk, ret);  // the broker sends nothing else before CONNACK
+    if (reader_.ready()) {
+      if (reader_.type() != MQTT_CONNACK || reader_.length() != 2) {
+        return false;
+      }
+      *session_present_ptr = reader_.body()[0] & 0x01;
+      const uint8_t return_code = reader_.body()[1];
+      reader_.next();
+      if (return_code != 0) {  // same values as the disconnection reasons
+        *reason_ptr = static_cast<AsyncMqttClientDisconnectReason>(return_code);
+        return false;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+// Reads and dispatches packets until the connection breaks, keeping it alive meanwhile
+void TlsMqttClient::serve() {
+  uint32_t ping_sent_ms = 0;
+  bool ping_pending = false;
+  while (!broken_) {
+    // waits for data without holding the mutex, publishers are free to write meanwhile
+    if (mbedtls_ssl_get_bytes_avail(&ssl_) == 0) {
+      const int ready = mbedtls_net_poll(&net_, MBEDTLS_NET_POLL_READ, 100);
+      if (ready < 0) {
+        return;
+      }
+      if (ready == 0) {
+        const uint32_t now = millis();
+        if (ping_pending && now - ping_sent_ms > MQTT_KEEP_ALIVE * 1000UL) {
+          ESP_LOGW(TAG, "No answer to keep-alive");
+          return;
+        }
+        if (!ping_pending && now - last_sent_ms_ >= MQTT_KEEP_ALIVE * 1000UL) {
+          uint8_t ping[2];
+          if (!send(ping, mqttEncodePingreq(ping, sizeof(ping)))) {
+            return;
+          }
+          ping_sent_ms = now;
+          ping_pending = true;
+        }
+        continue;
+      }
+    }
+    uint8_t chunk[256];
+    xSemaphoreTake(mutex_, portMAX_DELAY);
+    const int n = mbedtls_ssl_read(&ssl_, chunk, sizeof(chunk));
+    xSemaphoreGive(mutex_);
+    if (n == MBEDTLS_ERR_SSL_TIMEOUT || n == MBEDTLS_ERR_SSL_WANT_READ || n == MBEDTLS_ERR_SSL_WANT_WRITE) {
+      continue;
+    }
+    if (n <= 0) {
+      return;  // closed by the broker, or error
+    }
+    for (size_t offset = 0; offset < static_cast<size_t>(n);) {
+      offset += reader_.feed(chunk + offset, n - offset);
+      if (reader_.ready()) {
+        if (reader_.type() == MQTT_PINGRESP) {
+          ping_pending = false;
+        }
+        handlePacket();
+        reader_.next();
+      }
+    }
+  }
+}
+
+void TlsMqttClient::handlePacket() {
+  switch (reader_.type()) {
+    case MQTT_PUBLISH: {
+      mqtt_publish_t publish;
+      if (!reader_.parsePublish(&publish) || publish.topic_len >= sizeof(topic_)) {
+        break;
+      }
+      memcpy(topic_, publish.topic, publish.topic_len);
+      topic_[publish.topic_len] = '\0';
+      if (publish.qos == 1) {
+        uint8_t puback[4];
+        send(puback, mqttEncodePuback(puback, sizeof(puback), publish.packet_id));
+      }
+      if (on_message_) {
+        AsyncMqttClientMessageProperties properties = { publish.qos, publish.dup, publish.retain };
+        char *payload = reinterpret_cast<char *>(const_cast<uint8_t *>(publish.payload));
+        on_message_(topic_, payload, properties, publish.payload_len, 0, publish.payload_len);
+      }
+      break;
+    }
+    case MQTT_SUBACK:
+      if (reader_.length() >= 3 && on_subscribe_) {
+        on_subscribe_(reader_.body()[0] << 8 | reader_.body()[1], reader_.body()[2]);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+uint16_t TlsMqttClient::subscribe(const char *topic, uint8_t qos) {
+  if (!connected_) {
+    return 0;
+  }
+  packet_id_ = packet_id_ == 0xFFFF ? 1 : packet_id_ + 1;
+  uint8_t packet[160];
+  const size_t n = mqttEncodeSubscribe(packet, sizeof(packet), packet_id_, topic, qos);
+  return n > 0 && send(packet, n) ? packet_id_ : 0;
+}
+
+// QoS 1 and 2 are published as QoS 0. Returns 1 when sent, 0 otherwise.
+uint16_t TlsMqttClient::publish(const char *topic, uint8_t qos, bool retain, const char *payload, size_t length) {
+  if (!connected_) {
+    return 0;
+  }
+  uint8_t header[160];
+  const size_t n = mqttEncodePublishHeader(header, sizeof(header), topic, length, retain);
+  if (n == 0) {
+    return 0;
+  }
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  const bool sent = write(header, n) && (length == 0 || write(reinterpret_cast<const uint8_t *>(payload), length));
+  xSemaphoreGive(mutex_);
+  return sent ? 1 : 0;
+}
+
+void TlsMqttClient::close() {
+  connected_ = false;
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  mbedtls_ssl_close_notify(&ssl_);
+  mbedtls_net_free(&net_);
+  xSemaphoreGive(mutex_);
+}
+
+void TlsMqttClient::statsToJson(ArduinoJson::JsonVariant variant) const {
+  variant["handshakes"] = stats_.handshakes;
+  variant["resumed"] = stats_.resumed;
+  variant["failures"] = stats_.failures;
+  variant["handshake_ms"] = stats_.handshake_ms;
+  variant["handshake_max_ms"] = stats_.handshake_max_ms;
+  variant["heap_peak"] = stats_.heap_peak;
+  variant["heap_used"] = stats_.heap_used;
+  variant["dropped_packets"] = reader_.oversized();
+}
@@ -0,0 +1,144 @@
+/*
+ mqtt_tls.h - MQTT over TLS client headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SRC_MQTT_TLS_H_
+#define SRC_MQTT_TLS_H_
+
+#include "Arduino.h"
+#include <ArduinoJson.h>
+#include <AsyncMqttClient.h>  // callback argument types, shared with the plain TCP client
+#include <MqttCodec.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+#include <functional>
+
+// TCP connection and TLS handshake deadline (in milliseconds)
+#ifndef MQTT_TLS_HANDSHAKE_TIMEOUT
+#define MQTT_TLS_HANDSHAKE_TIMEOUT 10000
+#endif
+
+// largest incoming MQTT packet (in bytes), larger ones are dropped
+#ifndef MQTT_TLS_RX_SIZE
+#define MQTT_TLS_RX_SIZE 2048
+#endif
+
+#ifndef MQTT_TLS_STACK_SIZE
+#define MQTT_TLS_STACK_SIZE 8192
+#endif
+
+#ifndef MQTT_KEEP_ALIVE
+#define MQTT_KEEP_ALIVE 15
+#endif
+
+typedef struct {
+  uint32_t handshakes;
+  uint32_t resumed;  // abbreviated handshakes, the session of the previous connection being reused
+  uint32_t failures;
+  uint32_t handshake_ms;  // last one
+  uint32_t handshake_max_ms;
+  uint32_t heap_peak;  // largest heap drop during the last handshake (in bytes)
+  uint32_t heap_used;  // heap held by the connection after the last handshake
+} mqtt_tls_stats_t;
+
+// MQTT 3.1.1 client over mbedTLS, with the subset of the AsyncMqttClient interface used by the firmware
+// (QoS 0 publications, subscriptions). A task owns the connection: callbacks run in it. The TLS context is
+// set up once and the session of the last connection is offered again on reconnection (session ID or
+// ticket), so that a Wi-Fi flap costs an abbreviated handshake instead of a full one.
+class TlsMqttClient {
+ public:
+  typedef std::function<void(bool session_present)> OnConnectCallback;
+  typedef std::function<void(AsyncMqttClientDisconnectReason reason)> OnDisconnectCallback;
+  typedef std::function<void(uint16_t packet_id, uint8_t qos)> OnSubscribeCallback;
+  typedef std::function<void(uint16_t packet_id)> OnUnsubscribeCallback;
+  typedef std::function<void(char *topic, char *payload, AsyncMqttClientMessageProperties properties, size_t len,
+    size_t index, size_t total)> OnMessageCallback;
+  typedef std::function<void(uint16_t packet_id)> OnPublishCallback;
+
+  TlsMqttClient();
+
+  TlsMqttClient &onConnect(OnConnectCallback callback) { on_connect_ = callback; return *this; }
+  TlsMqttClient &onDisconnect(OnDisconnectCallback callback) { on_disconnect_ = callback; return *this; }
+  TlsMqttClient &onSubscribe(OnSubscribeCallback callback) { on_subscribe_ = callback; return *this; }
+  TlsMqttClient &onUnsubscribe(OnUnsubscribeCallback callback) { return *this; }  // never unsubscribes
+  TlsMqttClient &onMessage(OnMessageCallback callback) { on_message_ = callback; return *this; }
+  TlsMqttClient &onPublish(OnPublishCallback callback) { return *this; }  // QoS 0 only: no acknowledgment
+  TlsMqttClient &setServer(IPAddress ip, uint16_t port);
+  TlsMqttClient &setCaCert(const char *pem);  // verifies the server certificate chain
+  TlsMqttClient &setFingerprint(const char *sha256_hex);  // pins the server certificate
+  TlsMqttClient &setHostname(const char *hostname);  // SNI and certificate name check
+
+  void connect();  // asynchronous: onConnect or onDisconnect tells the outcome
+  bool connected() const { return connected_; }
+  uint16_t subscribe(const char *topic, uint8_t qos);
+  uint16_t publish(const char *topic, uint8_t qos, bool retain, const char *payload = nullptr, size_t length = 0);
+
+  const mqtt_tls_stats_t &stats() const { return stats_; }
+  void statsToJson(ArduinoJson::JsonVariant variant) const;
+
+ private:
+  static void run(void *client);
+  bool begin();
+  bool open(AsyncMqttClientDisconnectReason *reason_ptr);
+  bool handshake();
+  bool checkFingerprint();
+  bool mqttConnect(bool *session_present_ptr, AsyncMqttClientDisconnectReason *reason_ptr);
+  void serve();
+  void handlePacket();
+  bool write(const uint8_t *data, size_t len);  // with mutex_ held
+  bool send(const uint8_t *data, size_t len);
+  void close();
+
+  IPAddress ip_;
+  uint16_t port_;
+  const char *ca_pem_;
+  uint8_t fingerprint_[32];
+  bool pinned_;
+  const char *hostname_;
+  char client_id_[24];
+
+  OnConnectCallback on_connect_;
+  OnDisconnectCallback on_disconnect_;
+  OnSubscribeCallback on_subscribe_;
+  OnMessageCallback on_message_;
+
+  TaskHandle_t task_;
+  SemaphoreHandle_t mutex_;  // serializes the TLS context between the client task and publishers
+  volatile bool connected_;
+  volatile bool broken_;  // a write failed, the client task drops the connection
+  volatile uint32_t last_sent_ms_;
+  uint16_t packet_id_;
+
+  mbedtls_entropy_context entropy_;
+  mbedtls_ctr_drbg_context drbg_;
+  mbedtls_x509_crt ca_;
+  mbedtls_ssl_config conf_;
+  mbedtls_ssl_context ssl_;
+  mbedtls_net_context net_;
+  mbedtls_ssl_session session_;  // of the last connection, offered for resumption
+  bool has_session_;
+
+  uint8_t rx_buffer_[MQTT_TLS_RX_SIZE];
+  MqttReader reader_;
+  char topic_[128];
+  mqtt_tls_stats_t stats_;
+};
+
+#endif  // SRC_MQTT_TLS_H_
@@ -0,0 +1,128 @@
+/*
+ wifi_base.cpp - Wi-Fi connection functions
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "wifi_base.h"
+
+#include "Arduino.h"
+#include <esp_wifi.h>
+#include <Preferences.h>
+#include <WiFi.h>
+
+/* The following symbols can be passed via BUILD parameters
+#define WIFI_CACHED_IP  // also reuse the last IP lease (skips DHCP, the lease must be long enough)
+*/
+
+// reconnection attempts on the cached access point before falling back to a full scan
+#ifndef WIFI_CACHE_MAX_FAILURES
+#define WIFI_CACHE_MAX_FAILURES 2
+#endif
+
+static const char __attribute__((__unused__)) *TAG = "WiFi_base";
+static const char *WIFI_CACHE_NAMESPACE = "wifi_cache";
+
+// parameters of the last successful connection, reused to skip the scan (and DHCP) on the next one
+typedef struct {
+  uint8_t bssid[6];
+  int32_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+} wifi_cache_t;
+
+static wifi_cache_t wifi_cache;
+static bool wifi_cache_valid = false;
+static uint8_t wifi_cache_failures = 0;
+
+void initWifiCache() {
+  Preferences preferences;
+  preferences.begin(WIFI_CACHE_NAMESPACE, true);
+  wifi_cache_valid = preferences.getBytes("params", &wifi_cache, sizeof(wifi_cache)) == sizeof(wifi_cache);
+  preferences.end();
+  ESP_LOGD(TAG, "Cached Wi-Fi parameters %s", wifi_cache_valid ? "found" : "not found");
+}
+
+void _clearWifiCache() {
+  if (!wifi_cache_valid) {
+    return;
+  }
+  ESP_LOGI(TAG, "Dropping cached Wi-Fi parameters");
+  wifi_cache_valid = false;
+  Preferences preferences;
+  preferences.begin(WIFI_CACHE_NAMESPACE, false);
+  preferences.clear();
+  preferences.end();
+#ifdef WIFI_CACHED_IP
+  WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);  // back to DHCP
+#endif  // WIFI_CACHED_IP
+}
+
+// Connects with the credentials stored by WiFiManager, straight to the cached access point and channel
+// when known. Returns false without stored credentials (WiFiManager portal needed).
+bool beginWifi() {
+  wifi_config_t config;
+  if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK || config.sta.ssid[0] == '\0') {
+    return false;
+  }
+  if (!wifi_cache_valid) {
+    WiFi.begin();
+    return true;
+  }
+
+  char ssid[sizeof(config.sta.ssid) + 1];
+  char password[sizeof(config.sta.password) + 1];
+  strlcpy(ssid, reinterpret_cast<const char *>(config.sta.ssid), sizeof(ssid));
+  strlcpy(password, reinterpret_cast<const char *>(config.sta.password), sizeof(password));
+#ifdef WIFI_CACHED_IP
+  WiFi.config(IPAddress(wifi_cache.ip), IPAddress(wifi_cache.gateway), IPAddress(wifi_cache.subnet),
+    IPAddress(wifi_cache.dns));
+#endif  // WIFI_CACHED_IP
+  ESP_LOGD(TAG, "Connecting to '%s' on channel %d", ssid, wifi_cache.channel);
+  WiFi.begin(ssid, password, wifi_cache.channel, wifi_cache.bssid);
+  return true;
+}
+
+// to be called on SYSTEM_EVENT_STA_GOT_IP
+void onWifiConnected() {
+  wifi_cache_failures = 0;
+  wifi_cache_t current = {};
+  memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+  current.channel = WiFi.channel();
+  current.ip = WiFi.localIP();
+  current.gateway = WiFi.gatewayIP();
+  current.subnet = WiFi.subnetMask();
+  current.dns = WiFi.dnsIP();
+  if (wifi_cache_valid && memcmp(&current, &wifi_cache, sizeof(current)) == 0) {
+    return;  // spare the flash
+  }
+  Preferences preferences;
+  preferences.begin(WIFI_CACHE_NAMESPACE, false);
+  if (preferences.putBytes("params", &current, sizeof(current)) == sizeof(current)) {
+    wifi_cache = current;
+    wifi_cache_valid = true;
+    ESP_LOGD(TAG, "Wi-Fi parameters cached (channel %d)", current.channel);
+  }
+  preferences.end();
+}
+
+// to be called on SYSTEM_EVENT_STA_DISCONNECTED
+void onWifiDisconnected() {
+  if (wifi_cache_valid && ++wifi_cache_failures >= WIFI_CACHE_MAX_FAILURES) {
+    _clearWifiCache();  // the access point may have moved to another channel
+  }
+}
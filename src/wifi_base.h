@@ -0,0 +1,29 @@
+/*
+ wifi_base.h - Wi-Fi connection functions headers
+ Copyright (C) 2020 Germain Masse
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SRC_WIFI_BASE_H_
+#define SRC_WIFI_BASE_H_
+
+#include "Arduino.h"
+
+void initWifiCache();
+bool beginWifi();
+void onWifiConnected();
+void onWifiDisconnected();
+
+#endif  // SRC_WIFI_BASE_H_
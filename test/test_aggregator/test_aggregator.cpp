@@ -0,0 +1,82 @@
+#include <Aggregator.h>
+#include <unity.h>
+#include <math.h>
+
+
+void test_aggregator_stats(void) {
+  Aggregator aggregator;
+  aggregator.add(0, "temperature_boiler", 60.0);
+  aggregator.add(0, "temperature_boiler", 62.5);
+  aggregator.add(0, "temperature_boiler", 58.5);
+  TEST_ASSERT_EQUAL(1, aggregator.size());
+  TEST_ASSERT_EQUAL_STRING("temperature_boiler", aggregator.slot(0).name);
+  TEST_ASSERT_EQUAL(3, aggregator.slot(0).count);
+  TEST_ASSERT_EQUAL_FLOAT(58.5, aggregator.slot(0).min);
+  TEST_ASSERT_EQUAL_FLOAT(62.5, aggregator.slot(0).max);
+  TEST_ASSERT_EQUAL_FLOAT(58.5, aggregator.slot(0).last);
+  TEST_ASSERT_EQUAL_FLOAT(60.333333, aggregator.mean(0));
+}
+
+void test_aggregator_reset(void) {
+  Aggregator aggregator;
+  aggregator.add(0, "io_burner_1", 1);
+  aggregator.add(2, "io_pump_boiler", 0);
+  TEST_ASSERT_EQUAL(3, aggregator.size());
+  TEST_ASSERT_EQUAL(0, aggregator.slot(1).count);  // gap left by a missed read
+  aggregator.reset();
+  TEST_ASSERT_EQUAL(3, aggregator.size());
+  TEST_ASSERT_EQUAL(0, aggregator.slot(0).count);
+  TEST_ASSERT_TRUE(isnan(aggregator.mean(0)));
+  aggregator.add(0, "io_burner_1", 0);
+  TEST_ASSERT_EQUAL_FLOAT(0, aggregator.slot(0).max);
+}
+
+void test_aggregator_overflow(void) {
+  Aggregator aggregator;
+  TEST_ASSERT_FALSE(aggregator.add(AGGREGATOR_MAX_FIELDS, "overflow", 1));
+  TEST_ASSERT_EQUAL(0, aggregator.size());
+  TEST_ASSERT_EQUAL(1, aggregator.dropped());
+  aggregator.reset();
+  TEST_ASSERT_EQUAL(1, aggregator.dropped());
+}
+
+void test_aggregator_large_counter(void) {
+  Aggregator aggregator;
+  aggregator.add(0, "pulse_1", 16777217);  // a 32-bit counter past the integers a float holds
+  aggregator.add(0, "pulse_1", 16777219);
+  TEST_ASSERT_TRUE(aggregator.slot(0).min == 16777217.0);
+  TEST_ASSERT_TRUE(aggregator.slot(0).last == 16777219.0);
+  TEST_ASSERT_TRUE(aggregator.mean(0) == 16777218.0);
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_aggregator_stats);
+  RUN_TEST(test_aggregator_reset);
+  RUN_TEST(test_aggregator_overflow);
+  RUN_TEST(test_aggregator_large_counter);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
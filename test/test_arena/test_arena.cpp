@@ -0,0 +1,80 @@
+#include <Arena.h>
+#include <unity.h>
+#include <string.h>
+
+static uint64_t buffer[64];  // 512 bytes
+
+void test_arena_allocate(void) {
+  Arena arena(buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL(512, arena.capacity());
+  char *a = static_cast<char *>(arena.allocate(10));
+  char *b = static_cast<char *>(arena.allocate(1));
+  TEST_ASSERT_NOT_NULL(a);
+  TEST_ASSERT_NOT_NULL(b);
+  TEST_ASSERT_EQUAL(0, reinterpret_cast<uintptr_t>(b) % 8);
+  TEST_ASSERT_TRUE(arena.owns(a));
+  TEST_ASSERT_FALSE(arena.owns(&a));
+  TEST_ASSERT_EQUAL(10, arena.blockSize(a));
+  TEST_ASSERT_EQUAL(8 + 16 + 8 + 8, arena.used());
+  TEST_ASSERT_NULL(arena.allocate(512));
+  TEST_ASSERT_EQUAL(1, arena.failures());
+
+  arena.deallocate(a);
+  TEST_ASSERT_EQUAL(40, arena.used());  // a is not the last block
+  arena.deallocate(b);
+  TEST_ASSERT_EQUAL(0, arena.used());  // all released: the buffer is reused
+  TEST_ASSERT_EQUAL_PTR(a, arena.allocate(10));
+  TEST_ASSERT_EQUAL(40, arena.highWater());
+}
+
+void test_arena_reallocate(void) {
+  Arena arena(buffer, sizeof(buffer));
+  char *a = static_cast<char *>(arena.allocate(16));
+  memcpy(a, "0123456789abcdef", 16);
+  TEST_ASSERT_EQUAL_PTR(a, arena.reallocate(a, 100));  // last block: in place
+  TEST_ASSERT_EQUAL(8 + 104, arena.used());
+  TEST_ASSERT_EQUAL_PTR(a, arena.reallocate(a, 20));
+  TEST_ASSERT_EQUAL(8 + 24, arena.used());
+
+  char *b = static_cast<char *>(arena.allocate(8));
+  char *moved = static_cast<char *>(arena.reallocate(a, 32));
+  TEST_ASSERT_TRUE(moved > b);
+  TEST_ASSERT_EQUAL_MEMORY("0123456789abcdef", moved, 16);
+  TEST_ASSERT_NULL(arena.reallocate(moved, 1024));  // too large, the block is kept
+  TEST_ASSERT_EQUAL_MEMORY("0123456789abcdef", moved, 16);
+
+  arena.deallocate(b);
+  arena.deallocate(moved);
+  TEST_ASSERT_EQUAL(0, arena.used());
+  TEST_ASSERT_NOT_NULL(arena.reallocate(nullptr, 8));
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_arena_allocate);
+  RUN_TEST(test_arena_reallocate);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef TEST_TEST_BENCHMARK_BENCHMARK_BASELINE_H_
+#define TEST_TEST_BENCHMARK_BENCHMARK_BASELINE_H_
+
+#include <Benchmark.h>
+
+// Reference results, one line per benchmark as printed by `pio test -e native -f test_benchmark`.
+// Timings depend on the host: record them again on the machine running the checks (and commit them)
+// rather than loosening BENCHMARK_TOLERANCE. A benchmark without a line here is reported and ignored.
+static const benchmark_result_t BENCHMARK_BASELINE[] = {
+  { "register_lookup", 49.9, 0.00 },
+  { "decode_decimal", 3.1, 0.00 },
+  { "decode_bitfield", 55.1, 0.00 },
+};
+
+#endif  // TEST_TEST_BENCHMARK_BENCHMARK_BASELINE_H_
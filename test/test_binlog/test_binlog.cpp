@@ -0,0 +1,118 @@
+#include <BinLog.h>
+#include <unity.h>
+#include <string.h>
+
+enum { TAG_MAIN, TAG_MODBUS };
+static const char *const TAGS[] = { "Main", "Modbus_base" };
+enum { MSG_BOOT, MSG_REGISTER, MSG_DECIMAL, MSG_BITS };
+static const binlog_message_t MESSAGES[] = {
+  { TAG_MAIN, BINLOG_LEVEL_INFO, "Boot %u%%" },
+  { TAG_MODBUS, BINLOG_LEVEL_DEBUG, "Register id=%u name=%s value=%d" },
+  { TAG_MODBUS, BINLOG_LEVEL_VERBOSE, "Decimal %.1f from 0x%04x" },
+  { TAG_MODBUS, BINLOG_LEVEL_DEBUG, "Bits %b of %s" },
+};
+
+
+void test_binlog_format(void) {
+  BinLog *binlog = new BinLog(MESSAGES, 4, TAGS, 2, BINLOG_LEVEL_VERBOSE);
+  binlog->log(MSG_REGISTER, 10, 9, "temperature_exterior", -12);
+  binlog->log(MSG_DECIMAL, 20, 21.5f, static_cast<uint16_t>(0x80D7));
+  binlog->log(MSG_BITS, 30, static_cast<uint16_t>(0x0005), "io_burner");
+  binlog->log(MSG_BOOT, 40);
+
+  binlog_record_t record;
+  char text[64];
+  TEST_ASSERT_TRUE(binlog->read(&record));
+  TEST_ASSERT_EQUAL(10, record.timestamp_us);
+  binlog->format(record, text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING("Register id=9 name=temperature_exterior value=-12", text);
+  TEST_ASSERT_TRUE(binlog->read(&record));
+  binlog->format(record, text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING("Decimal 21.5 from 0x80d7", text);
+  TEST_ASSERT_TRUE(binlog->read(&record));
+  binlog->format(record, text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING("Bits 101 of io_burner", text);
+  TEST_ASSERT_TRUE(binlog->read(&record));
+  binlog->format(record, text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING("Boot ?%", text);  // missing argument
+  TEST_ASSERT_FALSE(binlog->read(&record));
+
+  binlog->log(MSG_REGISTER, 50, 9, "temperature_exterior", -12);
+  binlog->read(&record);
+  TEST_ASSERT_EQUAL(10, binlog->format(record, text, 11));  // truncated
+  TEST_ASSERT_EQUAL_STRING("Register i", text);
+  delete binlog;
+}
+
+void test_binlog_levels(void) {
+  BinLog *binlog = new BinLog(MESSAGES, 4, TAGS, 2, BINLOG_LEVEL_INFO);
+  binlog_record_t record;
+  binlog->log(MSG_REGISTER, 0, 1, "a", 2);
+  TEST_ASSERT_FALSE(binlog->read(&record));
+
+  TEST_ASSERT_TRUE(binlog->setLevel("Modbus_base", BINLOG_LEVEL_DEBUG));
+  TEST_ASSERT_FALSE(binlog->setLevel("Unknown", BINLOG_LEVEL_DEBUG));
+  binlog->log(MSG_REGISTER, 0, 1, "a", 2);
+  binlog->log(MSG_DECIMAL, 0, 1.0f, 2);
+  TEST_ASSERT_TRUE(binlog->read(&record));
+  TEST_ASSERT_EQUAL(MSG_REGISTER, record.id);
+  TEST_ASSERT_FALSE(binlog->read(&record));
+
+  TEST_ASSERT_TRUE(binlog->setLevel("*", BINLOG_LEVEL_NONE));
+  binlog->log(MSG_BOOT, 0, 1);
+  TEST_ASSERT_FALSE(binlog->read(&record));
+  delete binlog;
+}
+
+void test_binlog_flight_recorder(void) {
+  BinLog *binlog = new BinLog(MESSAGES, 4, TAGS, 2, BINLOG_LEVEL_INFO);
+  for (uint32_t i = 0; i < BINLOG_CAPACITY + 3; ++i) {
+    binlog->log(MSG_BOOT, i, i);
+  }
+  TEST_ASSERT_EQUAL(3, binlog->overwritten());
+
+  binlog_record_t record;
+  TEST_ASSERT_TRUE(binlog->read(&record));
+  TEST_ASSERT_EQUAL(3, record.timestamp_us);  // oldest records were overwritten
+
+  // snapshot keeps the records already read
+  static uint8_t dump[BINLOG_CAPACITY * sizeof(binlog_record_t)];
+  TEST_ASSERT_EQUAL(2 * sizeof(binlog_record_t), binlog->snapshot(dump, 2 * sizeof(binlog_record_t) + 1));
+  memcpy(&record, dump + sizeof(binlog_record_t), sizeof(record));
+  TEST_ASSERT_EQUAL(BINLOG_CAPACITY + 2, record.timestamp_us);
+  TEST_ASSERT_EQUAL(sizeof(dump), binlog->snapshot(dump, sizeof(dump)));
+  memcpy(&record, dump, sizeof(record));
+  TEST_ASSERT_EQUAL(3, record.timestamp_us);
+  delete binlog;
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_binlog_format);
+  RUN_TEST(test_binlog_levels);
+  RUN_TEST(test_binlog_flight_recorder);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef TEST_TEST_BUS_CAPTURE_CAPTURE_REPLAY_H_
+#define TEST_TEST_BUS_CAPTURE_CAPTURE_REPLAY_H_
+
+#include <BusCapture.h>
+#include <ModbusMaster.h>
+#include <RegisterMap.h>
+#include <ReplayTransport.h>
+#include <RtuMaster.h>
+#include <TcpMaster.h>
+#include <modbus_registers.h>
+#include <stdio.h>
+
+// Polling parameters of the firmware, to be changed with build flags to compare their effect on the same traffic
+#ifndef MODBUS_BAUDRATE
+#define MODBUS_BAUDRATE 9600
+#endif
+#ifndef MODBUS_UNIT
+#define MODBUS_UNIT 10
+#endif
+#ifndef MODBUS_RETRIES
+#define MODBUS_RETRIES 2
+#endif
+#ifndef MODBUS_TIMEOUT
+#define MODBUS_TIMEOUT 2000
+#endif
+#ifndef MODBUS_BLOCK_MAX_GAP
+#define MODBUS_BLOCK_MAX_GAP 0
+#endif
+// time between the start of two scans (in milliseconds)
+#ifndef CAPTURE_REPLAY_PERIOD
+#define CAPTURE_REPLAY_PERIOD 5000
+#endif
+#ifndef CAPTURE_REPLAY_MAX_SCANS
+#define CAPTURE_REPLAY_MAX_SCANS 10000
+#endif
+
+static uint8_t replay_dump[1 << 20];
+static const uint8_t REPLAY_REGISTER_NB = sizeof(registers) / sizeof(modbus_register_t);
+static modbus_block_t replay_blocks[REPLAY_REGISTER_NB];
+
+static void _onReplayedBlock(const rtu_request_t *request, uint8_t status, const uint16_t *values, void *context) {
+  if (status != MODBUS_STATUS_SUCCESS) {
+    ++*static_cast<uint32_t *>(context);
+  }
+}
+
+// Reads the register blocks of src/modbus_registers.h scan after scan, as modbus_base.cpp does, from the slave
+// recorded in the capture, until the whole capture has been played. Times are those of the simulated clock.
+void replayCaptureFile(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    printf("%s: cannot open\n", path);
+    return;
+  }
+  const size_t len = fread(replay_dump, 1, sizeof(replay_dump), file);
+  fclose(file);
+  ReplayTransport transport(replay_dump, len);
+  BusCaptureReader reader(replay_dump, len);
+  if (!transport.valid()) {
+    printf("%s: not a bus capture\n", path);
+    return;
+  }
+  RtuMaster rtu_master(&transport, MODBUS_BAUDRATE);
+  TcpMaster tcp_master(&transport);
+  ModbusMaster *master = reader.framing() == BUS_CAPTURE_TCP ? static_cast<ModbusMaster *>(&tcp_master)
+                                                            : static_cast<ModbusMaster *>(&rtu_master);
+  const uint8_t block_nb = planRegisterBlocks(registers, REPLAY_REGISTER_NB, MODBUS_BLOCK_MAX_GAP, replay_blocks);
+  printf("%s: %u records (%u dropped on the device), %u requests per scan\n", path, reader.records(),
+         reader.dropped(), block_nb);
+
+  uint32_t scan_nb = 0;
+  uint64_t total_us = 0;
+  uint32_t max_us = 0;
+  while (scan_nb < CAPTURE_REPLAY_MAX_SCANS) {
+    const uint32_t start_us = transport.micros();
+    const uint32_t matched = transport.matched();
+    uint32_t failed = 0;
+    uint8_t b = 0;
+    while (b < block_nb || master->pending() > 0) {
+      while (b < block_nb && !master->full()) {
+        const rtu_request_t request = { MODBUS_UNIT, modbusReadFunction(replay_blocks[b].modbus_entity),
+                                        replay_blocks[b].address, replay_blocks[b].count, nullptr, MODBUS_RETRIES,
+                                        MODBUS_TIMEOUT, _onReplayedBlock, &failed, false };
+        master->submit(request);
+        ++b;
+      }
+      transport.wait(master->poll());
+    }
+    if (transport.passes() > 0) {
+      break;  // this scan started the capture again
+    }
+    const uint32_t duration_us = transport.micros() - start_us;
+    total_us += duration_us;
+    max_us = duration_us > max_us ? duration_us : max_us;
+    ++scan_nb;
+    printf("scan %u: %.1f ms, %u failed blocks, capture at %.3f s\n", scan_nb, duration_us / 1000.0, failed,
+           transport.recordedTimeUs() / 1000000.0);
+    if (transport.matched() == matched) {
+      printf("no request of this scan was recorded: other registers, or a sniffer capture\n");
+      break;
+    }
+    if (duration_us < CAPTURE_REPLAY_PERIOD * 1000UL) {
+      transport.wait(CAPTURE_REPLAY_PERIOD * 1000UL - duration_us);
+    }
+  }
+  printf("%u scans, mean %.1f ms, max %.1f ms\n", scan_nb, scan_nb > 0 ? total_us / 1000.0 / scan_nb : 0,
+         max_us / 1000.0);
+  printf("requests: %u recorded, %u never recorded; transactions %u, retries %u, timeouts %u, crc errors %u\n",
+         transport.matched(), transport.unmatched(), master->transactions(), master->retries(), master->timeouts(),
+         master->crcErrors());
+}
+
+#endif  // TEST_TEST_BUS_CAPTURE_CAPTURE_REPLAY_H_
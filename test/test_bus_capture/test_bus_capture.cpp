@@ -0,0 +1,318 @@
+#include <BusCapture.h>
+#include <CaptureTransport.h>
+#include <ReplayTransport.h>
+#include <ModbusRtu.h>
+#include <RtuMaster.h>
+#include <TcpMaster.h>
+#include <unity.h>
+#include <string.h>
+
+// Slave on a simulated clock: reads return register i = address + i after latency_us, every drop_every-th request
+// is lost. The received bytes come back in two pieces, as from a UART driver: with fifo_threshold, the first piece
+// is that long and leaves the frame open until the second one, piece_gap_us later.
+class SimulatedSlave : public ModbusTransport {
+ public:
+  uint32_t now = 1000;
+  uint32_t latency_us = 20000;
+  uint32_t drop_every = 0;
+  bool tcp = false;
+  uint32_t requests = 0;
+  size_t fifo_threshold = 0;
+  uint32_t piece_gap_us = 500;
+
+  bool send(const uint8_t *data, size_t len) override {
+    if (drop_every > 0 && ++requests % drop_every == 0) {
+      return true;
+    }
+    const size_t header = tcp ? 7 : 1;
+    const uint16_t address = data[header + 1] << 8 | data[header + 2];
+    const uint16_t count = data[header + 3] << 8 | data[header + 4];
+    size_t n = header;
+    memcpy(response_, data, header);
+    response_[n++] = data[header];
+    response_[n++] = 2 * count;
+    for (uint16_t i = 0; i < count; ++i) {
+      response_[n++] = (address + i) >> 8;
+      response_[n++] = (address + i) & 0xFF;
+    }
+    if (tcp) {
+      response_[5] = n - 6;
+    } else {
+      const uint16_t crc = modbusCrc16(response_, n);
+      response_[n++] = crc & 0xFF;
+      response_[n++] = crc >> 8;
+    }
+    response_len_ = n;
+    delivered_ = 0;
+    due_us_ = now + latency_us;
+    return true;
+  }
+  size_t receive(uint8_t *buffer, size_t size) override {
+    if (delivered_ >= response_len_ || static_cast<int32_t>(now - due_us_) < 0) {
+      return 0;
+    }
+    size_t n = delivered_ > 0 ? response_len_ - delivered_ : fifo_threshold > 0 ? fifo_threshold : response_len_ / 2;
+    n = n < size ? n : size;
+    memcpy(buffer, &response_[delivered_], n);
+    delivered_ += n;
+    due_us_ = now + piece_gap_us;  // second piece
+    return n;
+  }
+  bool rxFrameOpen() override { return fifo_threshold > 0 && delivered_ > 0 && delivered_ < response_len_; }
+  void wait(uint32_t timeout_us) override {
+    if (delivered_ < response_len_ && static_cast<int32_t>(due_us_ - now) >= 0
+        && due_us_ - now < timeout_us) {
+      now = due_us_;
+    } else if (timeout_us != UINT32_MAX) {
+      now += timeout_us;
+    }
+  }
+  void wake() override {}
+  uint32_t micros() override { return now; }
+
+ private:
+  uint8_t response_[300];
+  size_t response_len_ = 0;
+  size_t delivered_ = 0;
+  uint32_t due_us_ = 0;
+};
+
+typedef struct {
+  uint8_t status;
+  uint16_t values[4];
+} result_t;
+
+static void _complete(const rtu_request_t *request, uint8_t status, const uint16_t *values, void *context) {
+  result_t *result = static_cast<result_t *>(context);
+  result->status = status;
+  for (uint16_t i = 0; values != nullptr && i < request->count && i < 4; ++i) {
+    result->values[i] = values[i];
+  }
+}
+
+// one scan of count reads, one at a time; returns the time it took
+static uint32_t _scan(ModbusMaster *master, ModbusTransport *transport, result_t *results, uint16_t count) {
+  const uint32_t start = transport->micros();
+  for (uint16_t i = 0; i < count; ++i) {
+    const rtu_request_t request = { 10, 0x03, static_cast<uint16_t>(600 + 10 * i), 2, nullptr, 1, 100, _complete,
+                                    &results[i], false };
+    master->submit(request);
+  }
+  while (master->pending() > 0) {
+    transport->wait(master->poll());
+  }
+  return transport->micros() - start;
+}
+
+void test_bus_capture_ring(void) {
+  BusCapture capture;
+  uint8_t frame[8] = { 10, 0x03, 0x02, 0x58, 0x00, 0x02, 0, 0 };
+  capture.record(BUS_CAPTURE_TX, frame, sizeof(frame), 5000);
+  capture.record(BUS_CAPTURE_RX, frame, 5, 5000 + 300000);
+  TEST_ASSERT_EQUAL(11 + 10, capture.used());  // varint deltas: 1 and 3 bytes
+
+  static uint8_t dump[BUS_CAPTURE_SIZE + BUS_CAPTURE_HEADER];
+  BusCaptureReader reader(dump, capture.snapshot(dump, sizeof(dump)));
+  TEST_ASSERT_TRUE(reader.valid());
+  TEST_ASSERT_EQUAL(2, reader.records());
+  bus_capture_record_t record;
+  TEST_ASSERT_TRUE(reader.next(&record));
+  TEST_ASSERT_EQUAL(BUS_CAPTURE_TX, record.direction);
+  TEST_ASSERT_EQUAL(5000, record.timestamp_us);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(frame, record.data, sizeof(frame));
+  TEST_ASSERT_TRUE(reader.next(&record));
+  TEST_ASSERT_EQUAL(BUS_CAPTURE_RX, record.direction);
+  TEST_ASSERT_EQUAL(305000, record.timestamp_us);
+  TEST_ASSERT_EQUAL(5, record.len);
+  TEST_ASSERT_FALSE(reader.next(&record));
+
+  // full: the oldest records go, timestamps stay absolute
+  for (uint32_t i = 0; i < 2000; ++i) {
+    frame[7] = i & 0xFF;
+    capture.record(BUS_CAPTURE_TX, frame, sizeof(frame), 400000 + 1000 * i);
+  }
+  TEST_ASSERT_TRUE(capture.dropped() > 0);
+  TEST_ASSERT_EQUAL(2002, capture.records() + capture.dropped());
+  TEST_ASSERT_TRUE(capture.used() <= BUS_CAPTURE_SIZE);
+  BusCaptureReader full(dump, capture.snapshot(dump, sizeof(dump)));
+  uint32_t count = 0;
+  uint32_t last_us = 0;
+  while (full.next(&record)) {
+    ++count;
+    last_us = record.timestamp_us;
+  }
+  TEST_ASSERT_EQUAL(capture.records(), count);
+  TEST_ASSERT_EQUAL(400000 + 1000 * 1999, last_us);
+  TEST_ASSERT_EQUAL(1999 & 0xFF, record.data[7]);
+
+  // a smaller buffer gets the latest records
+  BusCaptureReader latest(dump, capture.snapshot(dump, BUS_CAPTURE_HEADER + 10 * 12));
+  TEST_ASSERT_EQUAL(10, latest.records());
+  TEST_ASSERT_EQUAL(2002 - 10, latest.dropped());
+  TEST_ASSERT_TRUE(latest.next(&record));
+  TEST_ASSERT_EQUAL(400000 + 1000 * 1990, record.timestamp_us);
+
+  capture.clear();
+  TEST_ASSERT_EQUAL(0, capture.records());
+  TEST_ASSERT_EQUAL(BUS_CAPTURE_HEADER, capture.snapshot(dump, sizeof(dump)));
+}
+
+void test_capture_transport_frames(void) {
+  SimulatedSlave slave;
+  slave.drop_every = 3;
+  BusCapture capture;
+  CaptureTransport transport(&slave, &capture, modbusT35(9600));
+  RtuMaster master(&transport, 9600);
+  result_t results[3] = {};
+  _scan(&master, &transport, results, 3);
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_SUCCESS, results[2].status);  // after a retry
+
+  // TX, RX (the two pieces in one record), TX, RX, TX (lost), TX, RX
+  static uint8_t dump[BUS_CAPTURE_SIZE + BUS_CAPTURE_HEADER];
+  BusCaptureReader reader(dump, capture.snapshot(dump, sizeof(dump)));
+  const uint8_t directions[] = { BUS_CAPTURE_TX, BUS_CAPTURE_RX, BUS_CAPTURE_TX, BUS_CAPTURE_RX, BUS_CAPTURE_TX,
+                                 BUS_CAPTURE_TX, BUS_CAPTURE_RX };
+  TEST_ASSERT_EQUAL(sizeof(directions), reader.records());
+  bus_capture_record_t record;
+  bus_capture_record_t request;
+  for (uint8_t i = 0; i < sizeof(directions); ++i) {
+    TEST_ASSERT_TRUE(reader.next(&record));
+    TEST_ASSERT_EQUAL(directions[i], record.direction);
+    if (i == 0) {
+      request = record;
+    } else if (i == 1) {
+      TEST_ASSERT_EQUAL(9, record.len);  // 2 registers
+      TEST_ASSERT_EQUAL(20000, record.timestamp_us - request.timestamp_us);
+    }
+  }
+}
+
+// A response longer than the UART FIFO threshold, its second chunk read long after the first, is one record
+void test_capture_transport_split(void) {
+  SimulatedSlave slave;
+  slave.fifo_threshold = 120;
+  slave.piece_gap_us = 20000;
+  BusCapture capture;
+  CaptureTransport transport(&slave, &capture, modbusT35(9600));
+  RtuMaster master(&transport, 9600);
+  result_t result = {};
+  const rtu_request_t request = { 10, 0x03, 600, 100, nullptr, 0, 1000, _complete, &result, false };
+  master.submit(request);
+  while (master.pending() > 0) {
+    transport.wait(master.poll());
+  }
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_SUCCESS, result.status);
+  TEST_ASSERT_EQUAL(601, result.values[1]);
+
+  static uint8_t dump[BUS_CAPTURE_SIZE + BUS_CAPTURE_HEADER];
+  BusCaptureReader reader(dump, capture.snapshot(dump, sizeof(dump)));
+  TEST_ASSERT_EQUAL(2, reader.records());
+  bus_capture_record_t record;
+  reader.next(&record);
+  TEST_ASSERT_TRUE(reader.next(&record));
+  TEST_ASSERT_EQUAL(BUS_CAPTURE_RX, record.direction);
+  TEST_ASSERT_EQUAL(205, record.len);
+}
+
+void test_replay_rtu(void) {
+  SimulatedSlave slave;
+  slave.drop_every = 4;
+  BusCapture capture;
+  CaptureTransport recorder(&slave, &capture, modbusT35(9600));
+  RtuMaster recorded_master(&recorder, 9600);
+  result_t recorded[6] = {};
+  const uint32_t recorded_us = _scan(&recorded_master, &recorder, recorded, 6);
+
+  static uint8_t dump[BUS_CAPTURE_SIZE + BUS_CAPTURE_HEADER];
+  ReplayTransport replay(dump, capture.snapshot(dump, sizeof(dump)));
+  TEST_ASSERT_TRUE(replay.valid());
+  RtuMaster master(&replay, 9600);
+  result_t replayed[6] = {};
+  const uint32_t replayed_us = _scan(&master, &replay, replayed, 6);
+  for (uint8_t i = 0; i < 6; ++i) {
+    TEST_ASSERT_EQUAL(recorded[i].status, replayed[i].status);
+    TEST_ASSERT_EQUAL(recorded[i].values[1], replayed[i].values[1]);
+  }
+  TEST_ASSERT_EQUAL(recorded_master.timeouts(), master.timeouts());
+  TEST_ASSERT_EQUAL(recorded_master.retries(), master.retries());
+  TEST_ASSERT_TRUE(master.timeouts() > 0);
+  // frames are delivered whole, at the time of their first piece
+  TEST_ASSERT_INT_WITHIN(recorded_us / 20, recorded_us, replayed_us);
+  TEST_ASSERT_EQUAL(0, replay.unmatched());
+  TEST_ASSERT_EQUAL(0, replay.passes());
+
+  // a request never recorded is lost
+  result_t result = {};
+  const rtu_request_t request = { 10, 0x03, 700, 1, nullptr, 0, 100, _complete, &result, false };
+  master.submit(request);
+  while (master.pending() > 0) {
+    replay.wait(master.poll());
+  }
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_TIMEOUT, result.status);
+  TEST_ASSERT_EQUAL(1, replay.unmatched());
+}
+
+void test_replay_tcp(void) {
+  SimulatedSlave slave;
+  slave.tcp = true;
+  BusCapture capture(BUS_CAPTURE_TCP);
+  CaptureTransport recorder(&slave, &capture, 0);
+  TcpMaster recorded_master(&recorder, 1);
+  result_t recorded[3] = {};
+  _scan(&recorded_master, &recorder, recorded, 3);
+
+  static uint8_t dump[BUS_CAPTURE_SIZE + BUS_CAPTURE_HEADER];
+  ReplayTransport replay(dump, capture.snapshot(dump, sizeof(dump)));
+  TcpMaster master(&replay, 1);
+  result_t first[3] = {};
+  _scan(&master, &replay, first, 3);
+  result_t second[3] = {};
+  _scan(&master, &replay, second, 3);  // other transaction ids, capture played again
+  for (uint8_t i = 0; i < 3; ++i) {
+    TEST_ASSERT_EQUAL(MODBUS_STATUS_SUCCESS, second[i].status);
+    TEST_ASSERT_EQUAL(600 + 10 * i + 1, second[i].values[1]);
+  }
+  TEST_ASSERT_EQUAL(6, replay.matched());
+  TEST_ASSERT_EQUAL(1, replay.passes());
+  TEST_ASSERT_EQUAL(0, master.lateAnswers());
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_bus_capture_ring);
+  RUN_TEST(test_capture_transport_frames);
+  RUN_TEST(test_capture_transport_split);
+  RUN_TEST(test_replay_rtu);
+  RUN_TEST(test_replay_tcp);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+#ifdef CAPTURE_REPLAY_FILE
+#include "capture_replay.h"
+#endif  // CAPTURE_REPLAY_FILE
+
+int main(int argc, char **argv) {
+  process();
+#ifdef CAPTURE_REPLAY_FILE
+  replayCaptureFile(CAPTURE_REPLAY_FILE);
+#endif  // CAPTURE_REPLAY_FILE
+  return 0;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include <Deflate.h>
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char DICTIONARY[] = "{\"min\":,\"max\":,\"mean\":,\"last\":,\"count\":}"
+  "\"temperature_ambiant_circuit_a\":\"temperature_ambiant_circuit_b\":\"temperature_boiler\":"
+  "\"io_pump_a\":\"io_pump_b\":\"io_valve_a_open\":\"io_valve_b_open\":";
+
+static size_t _writeBatch(char *buffer, size_t size, uint8_t samples) {
+  size_t n = 0;
+  for (uint8_t i = 0; i < samples; ++i) {
+    n += snprintf(&buffer[n], size - n,
+      "%c\"temperature_ambiant_circuit_a\":{\"min\":%d.5,\"max\":21.%d,\"mean\":20.9,\"last\":21,\"count\":12},"
+      "\"temperature_ambiant_circuit_b\":{\"min\":19.%d,\"max\":20,\"mean\":19.7,\"last\":19.8,\"count\":12},"
+      "\"io_pump_a\":{\"min\":0,\"max\":1,\"mean\":0.%d,\"last\":1,\"count\":12}%c",
+      i == 0 ? '[' : ',', 20 + i % 2, i % 10, (i * 3) % 10, i % 10, i + 1 == samples ? ']' : '}');
+  }
+  return n;
+}
+
+void test_deflate_adler32(void) {
+  TEST_ASSERT_EQUAL_HEX32(0x11E60398, adler32(reinterpret_cast<const uint8_t *>("Wikipedia"), 9));
+  TEST_ASSERT_EQUAL_HEX32(1, adler32(nullptr, 0));
+}
+
+void test_deflate_round_trip(void) {
+  static DeflateCompressor compressor;
+  char payload[2048];
+  uint8_t compressed[1024];
+  uint8_t inflated[2048];
+
+  for (uint8_t samples = 1; samples <= 8; samples *= 2) {
+    const size_t len = _writeBatch(payload, sizeof(payload), samples);
+    const size_t n = compressor.compress(reinterpret_cast<uint8_t *>(payload), len, compressed, sizeof(compressed));
+    TEST_ASSERT_GREATER_THAN(0, n);
+    TEST_ASSERT_LESS_THAN(samples == 1 ? len * 2 / 3 : len / 3, n);  // batches compress better
+    TEST_ASSERT_EQUAL_HEX8(0x38, compressed[0]);  // deflate, 2 KB window
+    TEST_ASSERT_EQUAL(0, (compressed[0] << 8 | compressed[1]) % 31);
+    TEST_ASSERT_EQUAL(len, zlibInflate(compressed, n, nullptr, 0, inflated, sizeof(inflated)));
+    TEST_ASSERT_EQUAL_MEMORY(payload, inflated, len);
+  }
+
+  // empty input, and a long run (matches overlapping themselves)
+  size_t n = compressor.compress(reinterpret_cast<const uint8_t *>(""), 0, compressed, sizeof(compressed));
+  TEST_ASSERT_EQUAL(8, n);  // header, end of block, checksum
+  memset(payload, 'a', 1000);
+  n = compressor.compress(reinterpret_cast<uint8_t *>(payload), 1000, compressed, sizeof(compressed));
+  TEST_ASSERT_LESS_THAN(20, n);
+  TEST_ASSERT_EQUAL(1000, zlibInflate(compressed, n, nullptr, 0, inflated, sizeof(inflated)));
+  TEST_ASSERT_EQUAL_MEMORY(payload, inflated, 1000);
+
+  // corrupted stream
+  compressed[n / 2] ^= 0x10;
+  TEST_ASSERT_EQUAL(0, zlibInflate(compressed, n, nullptr, 0, inflated, sizeof(inflated)));
+}
+
+void test_deflate_dictionary(void) {
+  static DeflateCompressor plain;
+  static DeflateCompressor compressor;
+  compressor.setDictionary(reinterpret_cast<const uint8_t *>(DICTIONARY), strlen(DICTIONARY));
+  TEST_ASSERT_EQUAL_HEX32(adler32(reinterpret_cast<const uint8_t *>(DICTIONARY), strlen(DICTIONARY)),
+    compressor.dictionaryId());
+  char payload[512];
+  uint8_t compressed[512];
+  uint8_t inflated[512];
+
+  // a single sample: the keys only appear once, the dictionary makes the difference
+  const size_t len = _writeBatch(payload, sizeof(payload), 1);
+  const size_t plain_n = plain.compress(reinterpret_cast<uint8_t *>(payload), len, compressed, sizeof(compressed));
+  const size_t n = compressor.compress(reinterpret_cast<uint8_t *>(payload), len, compressed, sizeof(compressed));
+  TEST_ASSERT_GREATER_THAN(0, n);
+  TEST_ASSERT_LESS_THAN(plain_n * 2 / 3, n);
+  TEST_ASSERT_EQUAL_HEX8(0x20, compressed[1] & 0x20);  // FDICT
+  TEST_ASSERT_EQUAL(len, zlibInflate(compressed, n, reinterpret_cast<const uint8_t *>(DICTIONARY),
+    strlen(DICTIONARY), inflated, sizeof(inflated)));
+  TEST_ASSERT_EQUAL_MEMORY(payload, inflated, len);
+  // another dictionary is refused
+  TEST_ASSERT_EQUAL(0, zlibInflate(compressed, n, reinterpret_cast<const uint8_t *>(DICTIONARY), 10, inflated,
+    sizeof(inflated)));
+
+  // output too small, e.g. for data that does not compress
+  uint8_t noise[256];
+  uint32_t seed = 1;
+  for (size_t i = 0; i < sizeof(noise); ++i) {
+    seed = seed * 1103515245 + 12345;
+    noise[i] = seed >> 16;
+  }
+  TEST_ASSERT_EQUAL(0, compressor.compress(noise, sizeof(noise), compressed, sizeof(noise)));
+  TEST_ASSERT_EQUAL(0, compressor.compress(reinterpret_cast<uint8_t *>(payload), len, compressed, n - 1));
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_deflate_adler32);
+  RUN_TEST(test_deflate_round_trip);
+  RUN_TEST(test_deflate_dictionary);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,119 @@
+#include <DerivedFields.h>
+#include <unity.h>
+
+// register image of the test: id, value, available
+static struct {
+  uint16_t id;
+  uint16_t value;
+  bool available;
+} image[] = {
+  { 251, 0x0001, true }, { 253, 0x86A0, true },  // 100000
+  { 507, 1234, true }, { 508, 56, true },
+  { 601, 100, true }, { 602, 200, false },
+};
+
+static bool _source(uint16_t register_id, uint16_t *value_ptr, void *context) {
+  for (size_t i = 0; i < sizeof(image) / sizeof(image[0]); ++i) {
+    if (image[i].id == register_id && image[i].available) {
+      *value_ptr = image[i].value;
+      return true;
+    }
+  }
+  return false;
+}
+
+typedef struct {
+  uint16_t field_ids[8];
+  double values[8];
+  uint8_t count;
+} fields_t;
+
+static void _addField(uint16_t field_id, const char *name, double value, void *context) {
+  fields_t *fields = static_cast<fields_t *>(context);
+  fields->field_ids[fields->count] = field_id;
+  fields->values[fields->count++] = value;
+}
+
+static const derived_field_t DERIVED[] = {
+  { "pulse_1", DERIVED_OP_WORDS, 2, { 251, 253 }, 0, 1, 0, 0 },
+  { "pulse_burner", DERIVED_OP_COMBINE, 2, { 508, 507 }, 10000, 1, 0, 0 },
+  { "temperature_sum", DERIVED_OP_SUM, 2, { 601, 602 }, 0, 1, 0, 0 },
+  { "temperature_kelvin", DERIVED_OP_SUM, 1, { 601 }, 0, 0.1, 273.15, 0 },
+  { "pulse_per_hour", DERIVED_OP_COMBINE, 2, { 508, 507 }, 10000, 1, 0, 3600 },
+};
+
+void test_derived_fields_values(void) {
+  DerivedFields derived(DERIVED, sizeof(DERIVED) / sizeof(DERIVED[0]));
+  fields_t fields = {};
+  TEST_ASSERT_EQUAL(3, derived.evaluate(_source, nullptr, 1000, 40, _addField, &fields));
+  TEST_ASSERT_EQUAL(40, fields.field_ids[0]);
+  TEST_ASSERT_EQUAL_FLOAT(100000, fields.values[0]);
+  TEST_ASSERT_EQUAL(41, fields.field_ids[1]);
+  TEST_ASSERT_EQUAL_FLOAT(561234, fields.values[1]);
+  TEST_ASSERT_EQUAL(43, fields.field_ids[2]);  // 602 missing: no sum, the field ids do not move
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 283.15, fields.values[2]);
+}
+
+void test_derived_fields_rate(void) {
+  DerivedFields derived(&DERIVED[4], 1);
+  fields_t fields = {};
+  image[2].value = 1000;
+  TEST_ASSERT_EQUAL(0, derived.evaluate(_source, nullptr, 0, 0, _addField, &fields));  // reference
+  image[2].value = 1030;
+  TEST_ASSERT_EQUAL(1, derived.evaluate(_source, nullptr, 60000, 0, _addField, &fields));
+  TEST_ASSERT_EQUAL_FLOAT(1800, fields.values[0]);  // 30 in a minute
+
+  image[3].available = false;  // missed scan: no rate over two periods
+  TEST_ASSERT_EQUAL(0, derived.evaluate(_source, nullptr, 120000, 0, _addField, &fields));
+  image[3].available = true;
+  TEST_ASSERT_EQUAL(0, derived.evaluate(_source, nullptr, 180000, 0, _addField, &fields));
+  image[2].value = 1040;
+  TEST_ASSERT_EQUAL(1, derived.evaluate(_source, nullptr, 240000, 0, _addField, &fields));
+  TEST_ASSERT_EQUAL_FLOAT(600, fields.values[1]);
+}
+
+void test_derived_fields_large_counter(void) {
+  DerivedFields derived(DERIVED, 1);
+  fields_t fields = {};
+  image[0].value = 0x0100;  // 16777217, the first integer a float cannot hold
+  image[1].value = 0x0001;
+  TEST_ASSERT_EQUAL(1, derived.evaluate(_source, nullptr, 0, 0, _addField, &fields));
+  TEST_ASSERT_TRUE(fields.values[0] == 16777217.0);
+  image[0].value = 0xFFFF;
+  image[1].value = 0xFFFF;
+  TEST_ASSERT_EQUAL(1, derived.evaluate(_source, nullptr, 0, 0, _addField, &fields));
+  TEST_ASSERT_TRUE(fields.values[1] == 4294967295.0);
+  image[0].value = 0x0001;
+  image[1].value = 0x86A0;
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_derived_fields_values);
+  RUN_TEST(test_derived_fields_rate);
+  RUN_TEST(test_derived_fields_large_counter);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include <EdgeDetector.h>
+#include <unity.h>
+
+typedef struct {
+  edge_event_t events[16];
+  uint8_t count;
+} events_t;
+
+static void _addEvent(const edge_event_t &event, void *context) {
+  events_t *events = static_cast<events_t *>(context);
+  events->events[events->count++] = event;
+}
+
+void test_edge_detector_transitions(void) {
+  EdgeDetector detector;
+  TEST_ASSERT_TRUE(detector.addRegister(474));
+  TEST_ASSERT_FALSE(detector.addRegister(474));
+  events_t events = {};
+  TEST_ASSERT_EQUAL(0, detector.update(474, 0x0001, 1000, _addEvent, &events));  // reference
+  TEST_ASSERT_EQUAL(-1, detector.update(475, 0x0001, 1000, _addEvent, &events));
+  TEST_ASSERT_EQUAL(0, detector.update(474, 0x0001, 1200, _addEvent, &events));
+  TEST_ASSERT_EQUAL(2, detector.update(474, 0x0002, 1400, _addEvent, &events));
+  TEST_ASSERT_EQUAL(2, events.count);
+  TEST_ASSERT_EQUAL(0, events.events[0].bit);  // lowest bit first
+  TEST_ASSERT_EQUAL(0, events.events[0].state);
+  TEST_ASSERT_EQUAL(400, events.events[0].on_ms);
+  TEST_ASSERT_EQUAL(1, events.events[1].bit);
+  TEST_ASSERT_EQUAL(1, events.events[1].state);
+  TEST_ASSERT_EQUAL(1400, events.events[1].timestamp_ms);
+  TEST_ASSERT_EQUAL(474, events.events[1].register_id);
+  TEST_ASSERT_EQUAL(2, detector.events());
+}
+
+void test_edge_detector_on_time(void) {
+  EdgeDetector detector;
+  detector.addRegister(700);
+  detector.update(700, 0x0000, 0, nullptr, nullptr);
+  for (uint32_t t = 0; t < 10; ++t) {  // 10 starts of 150ms, every second
+    detector.update(700, 0x0004, t * 1000 + 100, nullptr, nullptr);
+    detector.update(700, 0x0000, t * 1000 + 250, nullptr, nullptr);
+  }
+  TEST_ASSERT_EQUAL(10, detector.rises(700, 2));
+  TEST_ASSERT_EQUAL(1500, detector.onTimeMs(700, 2, 20000));
+  detector.update(700, 0x0004, 20000, nullptr, nullptr);
+  TEST_ASSERT_EQUAL(1800, detector.onTimeMs(700, 2, 20300));  // current period included
+
+  detector.invalidate(700, 20500);  // read failure: accounted until then
+  detector.update(700, 0x0004, 30000, nullptr, nullptr);  // new reference, no event
+  TEST_ASSERT_EQUAL(10 * 2 + 1, detector.events());
+  TEST_ASSERT_EQUAL(2000 + 100, detector.onTimeMs(700, 2, 30100));
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_edge_detector_transitions);
+  RUN_TEST(test_edge_detector_on_time);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
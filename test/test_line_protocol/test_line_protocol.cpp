@@ -0,0 +1,99 @@
+#include <LineProtocol.h>
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+
+
+void test_line_protocol_lines(void) {
+  char buffer[256];
+  LineProtocolWriter writer(buffer, sizeof(buffer));
+  writer.setTag(0, "host", "ESP-MM-ABCDEF012345");
+  writer.setTag(1, "unit", "10");
+
+  const char *name = "temperature_boiler";
+  TEST_ASSERT_TRUE(writer.beginLine(name, strchr(name, '_') - name));
+  TEST_ASSERT_TRUE(writer.addField("temperature_boiler", 60.5f));
+  TEST_ASSERT_TRUE(writer.addField("temperature_tank", -2.0f));
+  TEST_ASSERT_TRUE(writer.endLine(1600000000123456000ULL));
+  TEST_ASSERT_TRUE(writer.beginLine("bits_base", SIZE_MAX));
+  TEST_ASSERT_TRUE(writer.addField("io_pump_aux", 1.0f));
+  TEST_ASSERT_TRUE(writer.addField("count", static_cast<int32_t>(6)));
+  TEST_ASSERT_TRUE(writer.endLine(0));
+  TEST_ASSERT_EQUAL(2, writer.lines());
+  TEST_ASSERT_EQUAL_STRING(
+    "temperature,host=ESP-MM-ABCDEF012345,unit=10 temperature_boiler=60.5,temperature_tank=-2 1600000000123456000\n"
+    "bits_base,host=ESP-MM-ABCDEF012345,unit=10 io_pump_aux=1,count=6i", writer.data());
+  TEST_ASSERT_EQUAL(strlen(buffer), writer.length());
+}
+
+void test_line_protocol_escaping(void) {
+  char buffer[128];
+  LineProtocolWriter writer(buffer, sizeof(buffer));
+  writer.setTag(0, "site name", "a=b,c");
+  writer.setTag(1, "empty", "");  // skipped, not valid in line protocol
+  writer.beginLine("my measurement,1", SIZE_MAX);
+  TEST_ASSERT_FALSE(writer.addField("nan", NAN));
+  writer.addField("a=b", 1.25f);
+  writer.endLine(0);
+  TEST_ASSERT_EQUAL_STRING("my\\ measurement\\,1,site\\ name=a\\=b\\,c a\\=b=1.25", writer.data());
+
+  writer.clear();
+  writer.beginLine("empty", SIZE_MAX);
+  TEST_ASSERT_FALSE(writer.endLine(0));  // no field
+  TEST_ASSERT_EQUAL(0, writer.length());
+}
+
+void test_line_protocol_overflow(void) {
+  char buffer[40];
+  LineProtocolWriter writer(buffer, sizeof(buffer));
+  writer.beginLine("m", SIZE_MAX);
+  writer.addField("field_1", 1.0f);
+  TEST_ASSERT_TRUE(writer.endLine(0));
+  const size_t length = writer.length();
+
+  writer.beginLine("m", SIZE_MAX);
+  writer.addField("field_2", 2.0f);
+  TEST_ASSERT_FALSE(writer.addField("field_3_with_a_long_name", 3.0f));
+  TEST_ASSERT_FALSE(writer.addField("field_4", 4.0f));
+  TEST_ASSERT_FALSE(writer.endLine(0));
+  TEST_ASSERT_EQUAL(1, writer.dropped());
+  TEST_ASSERT_EQUAL(length, writer.length());  // only complete lines are kept
+  TEST_ASSERT_EQUAL_STRING("m field_1=1", writer.data());
+
+  writer.clear();  // flushed: the line now fits
+  writer.beginLine("m", SIZE_MAX);
+  writer.addField("field_2", 2.0f);
+  TEST_ASSERT_TRUE(writer.addField("field_3_with_a_long_name", 3.0f));
+  TEST_ASSERT_TRUE(writer.endLine(0));
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_line_protocol_lines);
+  RUN_TEST(test_line_protocol_escaping);
+  RUN_TEST(test_line_protocol_overflow);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
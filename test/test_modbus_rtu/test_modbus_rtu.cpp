@@ -0,0 +1,169 @@
+#include <ModbusRtu.h>
+#include <RtuSniffer.h>
+#include <unity.h>
+
+// Diematic traffic recorded at 9600 bauds (t3.5 = 4010us)
+static const uint8_t READ_REQUEST[] = { 0x0A, 0x03, 0x02, 0x59, 0x00, 0x02, 0x14, 0xDB };  // 601-602
+static const uint8_t READ_RESPONSE[] = { 0x0A, 0x03, 0x04, 0x00, 0xE1, 0x80, 0x0F, 0x31, 0x01 };
+static const uint8_t WRITE_MULTIPLE[] = { 0x00, 0x10, 0x02, 0x5A, 0x00, 0x02, 0x04, 0x02, 0x58, 0x01, 0x2C,
+                                          0xEB, 0x56 };  // 602-603
+static const uint8_t WRITE_SINGLE[] = { 0x0A, 0x06, 0x01, 0xDA, 0x00, 0x03, 0xE8, 0xB7 };  // 474
+
+typedef struct {
+  uint16_t address[8];
+  uint16_t value[8];
+  bool is_write[8];
+  uint8_t count;
+} captured_t;
+
+static void _capture(uint8_t unit, uint16_t address, uint16_t value, bool is_write, void *context) {
+  captured_t *captured = static_cast<captured_t *>(context);
+  if (captured->count < 8) {
+    captured->address[captured->count] = address;
+    captured->value[captured->count] = value;
+    captured->is_write[captured->count] = is_write;
+  }
+  ++captured->count;
+}
+
+static void _sniff(const uint8_t *frame, size_t len, void *context) {
+  static_cast<RtuSniffer *>(context)->onFrame(frame, len);
+}
+
+// replays a frame byte by byte at 9600 bauds (1146us per character)
+static uint32_t _replay(RtuFramer *framer, const uint8_t *frame, size_t len, uint32_t t) {
+  for (size_t i = 0; i < len; ++i) {
+    framer->push(frame[i], t);
+    t += 1146;
+  }
+  return t;
+}
+
+void test_modbus_crc(void) {
+  TEST_ASSERT_EQUAL_HEX16(0xDB14, modbusCrc16(READ_REQUEST, 6));
+  TEST_ASSERT_TRUE(modbusCheckCrc(READ_RESPONSE, sizeof(READ_RESPONSE)));
+  TEST_ASSERT_FALSE(modbusCheckCrc(READ_RESPONSE, sizeof(READ_RESPONSE) - 1));
+  TEST_ASSERT_EQUAL(4010, modbusT35(9600));
+  TEST_ASSERT_EQUAL(1750, modbusT35(115200));
+}
+
+void test_modbus_framer_silence(void) {
+  captured_t captured = {};
+  RtuSniffer sniffer(_capture, &captured);
+  RtuFramer framer(9600, _sniff, &sniffer);
+
+  uint32_t t = _replay(&framer, READ_REQUEST, sizeof(READ_REQUEST), 1000);
+  t = _replay(&framer, READ_RESPONSE, sizeof(READ_RESPONSE), t + 5000);
+  framer.poll(t + 2000);  // not silent long enough yet
+  TEST_ASSERT_EQUAL(1, framer.frames());
+  framer.poll(t + 4000);
+  TEST_ASSERT_EQUAL(2, framer.frames());
+
+  TEST_ASSERT_EQUAL(2, captured.count);
+  TEST_ASSERT_EQUAL(601, captured.address[0]);
+  TEST_ASSERT_EQUAL_HEX16(0x00E1, captured.value[0]);
+  TEST_ASSERT_EQUAL(602, captured.address[1]);
+  TEST_ASSERT_EQUAL_HEX16(0x800F, captured.value[1]);
+  TEST_ASSERT_FALSE(captured.is_write[0]);
+}
+
+void test_modbus_framer_burst(void) {
+  captured_t captured = {};
+  RtuSniffer sniffer(_capture, &captured);
+  RtuFramer framer(9600, _sniff, &sniffer);
+
+  // both writes received in a single burst, without timing information
+  for (size_t i = 0; i < sizeof(WRITE_MULTIPLE); ++i) framer.push(WRITE_MULTIPLE[i], 0);
+  for (size_t i = 0; i < sizeof(WRITE_SINGLE); ++i) framer.push(WRITE_SINGLE[i], 0);
+  framer.flush();
+
+  TEST_ASSERT_EQUAL(2, framer.frames());
+  TEST_ASSERT_EQUAL(0, framer.crcErrors());
+  TEST_ASSERT_EQUAL(3, captured.count);
+  TEST_ASSERT_EQUAL(602, captured.address[0]);
+  TEST_ASSERT_EQUAL_HEX16(0x0258, captured.value[0]);
+  TEST_ASSERT_EQUAL(603, captured.address[1]);
+  TEST_ASSERT_EQUAL_HEX16(0x012C, captured.value[1]);
+  TEST_ASSERT_EQUAL(474, captured.address[2]);
+  TEST_ASSERT_EQUAL_HEX16(0x0003, captured.value[2]);
+  TEST_ASSERT_TRUE(captured.is_write[2]);
+}
+
+// A frame longer than the UART FIFO threshold is read in two chunks, the second one long after the first
+void test_modbus_framer_hold(void) {
+  uint8_t frame[MODBUS_RTU_MAX_FRAME] = { 0x0A, 0x03, 200 };
+  for (uint16_t i = 3; i < 203; ++i) {
+    frame[i] = i;
+  }
+  const uint16_t crc = modbusCrc16(frame, 203);
+  frame[203] = crc & 0xFF;
+  frame[204] = crc >> 8;
+  RtuFramer framer(9600, nullptr, nullptr);
+  for (size_t i = 0; i < 120; ++i) framer.push(frame[i], 1000);
+  framer.hold(60000);  // the receiver has not seen the line idle yet
+  framer.poll(60000);
+  TEST_ASSERT_TRUE(framer.pending());
+  for (size_t i = 120; i < 205; ++i) framer.push(frame[i], 60000);
+  framer.poll(70000);
+  TEST_ASSERT_EQUAL(1, framer.frames());
+  TEST_ASSERT_EQUAL(0, framer.crcErrors());
+}
+
+void test_modbus_framer_corrupted(void) {
+  captured_t captured = {};
+  RtuSniffer sniffer(_capture, &captured);
+  RtuFramer framer(9600, _sniff, &sniffer);
+
+  uint8_t corrupted[sizeof(READ_RESPONSE)];
+  for (size_t i = 0; i < sizeof(corrupted); ++i) corrupted[i] = READ_RESPONSE[i];
+  corrupted[4] ^= 0x01;
+
+  uint32_t t = _replay(&framer, READ_REQUEST, sizeof(READ_REQUEST), 0);
+  t = _replay(&framer, corrupted, sizeof(corrupted), t + 5000);
+  framer.poll(t + 5000);
+  TEST_ASSERT_EQUAL(1, framer.frames());
+  TEST_ASSERT_EQUAL(1, framer.crcErrors());
+  TEST_ASSERT_EQUAL(0, captured.count);
+}
+
+void test_modbus_sniffer_unpaired_response(void) {
+  captured_t captured = {};
+  RtuSniffer sniffer(_capture, &captured);
+  sniffer.onFrame(READ_RESPONSE, sizeof(READ_RESPONSE));  // request was missed
+  TEST_ASSERT_EQUAL(0, captured.count);
+  TEST_ASSERT_EQUAL(1, sniffer.ignored());
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_modbus_crc);
+  RUN_TEST(test_modbus_framer_silence);
+  RUN_TEST(test_modbus_framer_burst);
+  RUN_TEST(test_modbus_framer_hold);
+  RUN_TEST(test_modbus_framer_corrupted);
+  RUN_TEST(test_modbus_sniffer_unpaired_response);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
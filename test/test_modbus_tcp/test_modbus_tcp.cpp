@@ -0,0 +1,283 @@
+#include <ModbusRtu.h>
+#include <RtuMaster.h>
+#include <SocketTransport.h>
+#include <TcpMaster.h>
+#include <unity.h>
+#include <string.h>
+
+// Records everything sent, the test plays the server
+class FakeTransport : public ModbusTransport {
+ public:
+  uint32_t now = 0;
+  uint8_t sent[1024];
+  size_t sent_len = 0;
+  uint8_t rx[1024];
+  size_t rx_len = 0;
+
+  bool send(const uint8_t *data, size_t len) override {
+    memcpy(sent + sent_len, data, len);
+    sent_len += len;
+    return true;
+  }
+  size_t receive(uint8_t *buffer, size_t size) override {
+    const size_t n = rx_len < size ? rx_len : size;
+    memcpy(buffer, rx, n);
+    memmove(rx, rx + n, rx_len - n);
+    rx_len -= n;
+    return n;
+  }
+  void wait(uint32_t timeout_us) override { now += timeout_us; }
+  void wake() override {}
+  uint32_t micros() override { return now; }
+
+  uint16_t transactionId(size_t frame) const {  // of the frame-th 12-byte read request sent
+    return sent[12 * frame] << 8 | sent[12 * frame + 1];
+  }
+  void answer(uint16_t transaction_id, uint16_t value) {  // to a 1-register read
+    const uint8_t frame[] = { static_cast<uint8_t>(transaction_id >> 8), static_cast<uint8_t>(transaction_id), 0, 0,
+                              0, 5, 10, 0x03, 0x02, static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value) };
+    memcpy(rx + rx_len, frame, sizeof(frame));
+    rx_len += sizeof(frame);
+  }
+};
+
+typedef struct {
+  uint8_t status;
+  uint16_t values[4];
+  uint8_t calls;
+  uint8_t order;  // completion rank
+} result_t;
+
+static uint8_t completions = 0;
+
+static void _complete(const rtu_request_t *request, uint8_t status, const uint16_t *values, void *context) {
+  result_t *result = static_cast<result_t *>(context);
+  result->status = status;
+  for (uint16_t i = 0; values != nullptr && i < request->count && i < 4; ++i) {
+    result->values[i] = values[i];
+  }
+  ++result->calls;
+  result->order = ++completions;
+}
+
+static rtu_request_t _read(uint16_t address, uint16_t count, result_t *result) {
+  rtu_request_t request = { 10, 0x03, address, count, nullptr, 1, 1000, _complete, result, false };
+  return request;
+}
+
+void test_tcp_master_pipeline(void) {
+  FakeTransport transport;
+  TcpMaster master(&transport, 2);
+  result_t results[3] = {};
+  for (uint16_t i = 0; i < 3; ++i) {
+    master.submit(_read(601 + i, 1, &results[i]));
+  }
+  master.poll();
+  TEST_ASSERT_EQUAL(24, transport.sent_len);  // 2 requests in flight, without waiting
+  const uint8_t expected[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x0A, 0x03, 0x02, 0x59, 0x00, 0x01 };
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, transport.sent, sizeof(expected));
+
+  // answers out of order, in a single segment
+  transport.answer(transport.transactionId(1), 0x0202);
+  transport.answer(transport.transactionId(0), 0x0101);
+  transport.now += 5000;
+  master.poll();
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_SUCCESS, results[0].status);
+  TEST_ASSERT_EQUAL_HEX16(0x0101, results[0].values[0]);
+  TEST_ASSERT_EQUAL_HEX16(0x0202, results[1].values[0]);
+  TEST_ASSERT_TRUE(results[1].order < results[0].order);
+  TEST_ASSERT_EQUAL(5000, master.roundTripUs());
+  TEST_ASSERT_EQUAL(36, transport.sent_len);  // the third one took a free slot
+
+  transport.answer(transport.transactionId(2), 0x0303);
+  master.poll();
+  TEST_ASSERT_EQUAL_HEX16(0x0303, results[2].values[0]);
+  TEST_ASSERT_EQUAL(0, master.pending());
+}
+
+void test_tcp_master_timeout(void) {
+  FakeTransport transport;
+  TcpMaster master(&transport);
+  result_t result = {};
+  master.submit(_read(601, 1, &result));
+  master.poll();
+  const uint16_t first_id = transport.transactionId(0);
+  transport.now += 1000000;
+  master.poll();  // timed out, sent again with another transaction id
+  TEST_ASSERT_EQUAL(24, transport.sent_len);
+  TEST_ASSERT_NOT_EQUAL(first_id, transport.transactionId(1));
+  TEST_ASSERT_EQUAL(1, master.retries());
+
+  transport.answer(first_id, 0x0101);  // too late
+  transport.answer(transport.transactionId(1), 0x0202);
+  master.poll();
+  TEST_ASSERT_EQUAL(1, result.calls);
+  TEST_ASSERT_EQUAL_HEX16(0x0202, result.values[0]);
+  TEST_ASSERT_EQUAL(1, master.lateAnswers());
+  TEST_ASSERT_EQUAL(1, master.timeouts());
+}
+
+#ifndef ARDUINO
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Local simulator: answers reads with register i = address + i, framed as Modbus TCP or as RTU over TCP
+class Simulator {
+ public:
+  explicit Simulator(bool rtu) : rtu_(rtu), client_(-1), len_(0), requests_(0) {
+    listener_ = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_len = sizeof(address);
+    bind(listener_, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+    getsockname(listener_, reinterpret_cast<struct sockaddr *>(&address), &address_len);
+    port_ = ntohs(address.sin_port);
+    listen(listener_, 1);
+    fcntl(listener_, F_SETFL, O_NONBLOCK);
+  }
+  ~Simulator() {
+    if (client_ >= 0) {
+      close(client_);
+    }
+    close(listener_);
+  }
+  uint16_t port() const { return port_; }
+  uint32_t requests() const { return requests_; }
+
+  void serve() {
+    if (client_ < 0) {
+      client_ = accept(listener_, nullptr, nullptr);
+      if (client_ < 0) {
+        return;
+      }
+      fcntl(client_, F_SETFL, O_NONBLOCK);
+    }
+    const ssize_t n = recv(client_, buffer_ + len_, sizeof(buffer_) - len_, 0);
+    if (n > 0) {
+      len_ += n;
+    }
+    const size_t header = rtu_ ? 1 : 7;  // the PDU follows the unit id, or the MBAP header
+    const size_t request_len = header + 5 + (rtu_ ? 2 : 0);
+    while (len_ >= request_len) {
+      const uint16_t address = buffer_[header + 1] << 8 | buffer_[header + 2];
+      const uint16_t count = buffer_[header + 3] << 8 | buffer_[header + 4];
+      uint8_t response[300];
+      size_t response_len = header;
+      memcpy(response, buffer_, header);
+      response[response_len++] = 0x03;
+      response[response_len++] = 2 * count;
+      for (uint16_t i = 0; i < count; ++i) {
+        response[response_len++] = (address + i) >> 8;
+        response[response_len++] = (address + i) & 0xFF;
+      }
+      if (rtu_) {
+        const uint16_t crc = modbusCrc16(response, response_len);
+        response[response_len++] = crc & 0xFF;
+        response[response_len++] = crc >> 8;
+      } else {
+        response[4] = (response_len - 6) >> 8;
+        response[5] = (response_len - 6) & 0xFF;
+      }
+      send(client_, response, response_len, 0);
+      memmove(buffer_, buffer_ + request_len, len_ - request_len);
+      len_ -= request_len;
+      ++requests_;
+    }
+  }
+
+ private:
+  bool rtu_;
+  int listener_;
+  int client_;
+  uint16_t port_;
+  uint8_t buffer_[1024];
+  size_t len_;
+  uint32_t requests_;
+};
+
+static void _run(ModbusMaster *master, SocketTransport *transport, Simulator *simulator, uint8_t count) {
+  for (int i = 0; i < 500 && completions < count; ++i) {
+    const uint32_t delay = master->poll();
+    simulator->serve();
+    transport->wait(delay < 2000 ? delay : 2000);
+  }
+}
+
+void test_tcp_master_loopback(void) {
+  Simulator simulator(false);
+  SocketTransport transport;
+  TEST_ASSERT_TRUE(transport.begin("127.0.0.1", simulator.port()));
+  TEST_ASSERT_FALSE(transport.begin("localhost", simulator.port()));
+  TcpMaster master(&transport);
+  result_t results[8] = {};
+  completions = 0;
+  for (uint16_t i = 0; i < 8; ++i) {
+    master.submit(_read(600 + 10 * i, 2, &results[i]));
+  }
+  _run(&master, &transport, &simulator, 8);
+  for (uint16_t i = 0; i < 8; ++i) {
+    TEST_ASSERT_EQUAL(MODBUS_STATUS_SUCCESS, results[i].status);
+    TEST_ASSERT_EQUAL(600 + 10 * i + 1, results[i].values[1]);
+  }
+  TEST_ASSERT_EQUAL(8, simulator.requests());
+  TEST_ASSERT_EQUAL(1, transport.connections());  // a single persistent connection
+}
+
+void test_rtu_over_tcp_loopback(void) {
+  Simulator simulator(true);
+  SocketTransport transport;
+  TEST_ASSERT_TRUE(transport.begin("127.0.0.1", simulator.port()));
+  RtuMaster master(&transport, 115200);
+  result_t results[3] = {};
+  completions = 0;
+  for (uint16_t i = 0; i < 3; ++i) {
+    master.submit(_read(700 + i, 3, &results[i]));
+  }
+  _run(&master, &transport, &simulator, 3);
+  for (uint16_t i = 0; i < 3; ++i) {
+    TEST_ASSERT_EQUAL(MODBUS_STATUS_SUCCESS, results[i].status);
+    TEST_ASSERT_EQUAL(700 + i + 2, results[i].values[2]);
+  }
+  TEST_ASSERT_EQUAL(1, transport.connections());
+}
+
+#endif  // ARDUINO
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_tcp_master_pipeline);
+  RUN_TEST(test_tcp_master_timeout);
+#ifndef ARDUINO
+  RUN_TEST(test_tcp_master_loopback);
+  RUN_TEST(test_rtu_over_tcp_loopback);
+#endif  // ARDUINO
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
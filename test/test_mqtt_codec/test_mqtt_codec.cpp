@@ -0,0 +1,96 @@
+#include <MqttCodec.h>
+#include <unity.h>
+#include <string.h>
+
+void test_mqtt_codec_connect(void) {
+  uint8_t buffer[64];
+  const uint8_t expected[] = { 0x10, 0x12, 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02, 0x00, 0x0F,
+                               0x00, 0x06, 'e', 's', 'p', '-', '4', '2' };
+  TEST_ASSERT_EQUAL(sizeof(expected), mqttEncodeConnect(buffer, sizeof(buffer), "esp-42", 15, true));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, buffer, sizeof(expected));
+  TEST_ASSERT_EQUAL(0, mqttEncodeConnect(buffer, 10, "esp-42", 15, true));
+}
+
+void test_mqtt_codec_publish_header(void) {
+  uint8_t buffer[16];
+  // 2 + 3 + 200 = 205 bytes of remaining length: 2 bytes to encode it
+  TEST_ASSERT_EQUAL(1 + 2 + 2 + 3, mqttEncodePublishHeader(buffer, sizeof(buffer), "a/b", 200, true));
+  TEST_ASSERT_EQUAL_HEX8(0x31, buffer[0]);
+  TEST_ASSERT_EQUAL_HEX8(0xCD, buffer[1]);  // 205 = 0x4D | continuation
+  TEST_ASSERT_EQUAL_HEX8(0x01, buffer[2]);
+  TEST_ASSERT_EQUAL_HEX8('a', buffer[5]);
+}
+
+void test_mqtt_codec_subscribe(void) {
+  uint8_t buffer[32];
+  const uint8_t expected[] = { 0x82, 0x08, 0x00, 0x01, 0x00, 0x03, 'a', '/', '#', 0x01 };
+  TEST_ASSERT_EQUAL(sizeof(expected), mqttEncodeSubscribe(buffer, sizeof(buffer), 1, "a/#", 1));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, buffer, sizeof(expected));
+}
+
+void test_mqtt_codec_reader(void) {
+  uint8_t buffer[16];
+  MqttReader reader(buffer, sizeof(buffer));
+  const uint8_t stream[] = {
+    0x20, 0x02, 0x00, 0x00,  // CONNACK
+    0x32, 0x09, 0x00, 0x03, 'a', '/', 'b', 0x12, 0x34, 'o', 'k',  // PUBLISH QoS 1
+    0x30, 0x14, 0x00, 0x01, 'x', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // too large, skipped
+    0xD0, 0x00  // PINGRESP
+  };
+  size_t offset = reader.feed(stream, 3);  // split in the middle of a packet
+  TEST_ASSERT_FALSE(reader.ready());
+  offset += reader.feed(stream + offset, sizeof(stream) - offset);
+  TEST_ASSERT_TRUE(reader.ready());
+  TEST_ASSERT_EQUAL(MQTT_CONNACK, reader.type());
+  TEST_ASSERT_EQUAL(2, reader.length());
+  reader.next();
+
+  offset += reader.feed(stream + offset, sizeof(stream) - offset);
+  mqtt_publish_t publish;
+  TEST_ASSERT_TRUE(reader.parsePublish(&publish));
+  TEST_ASSERT_EQUAL(1, publish.qos);
+  TEST_ASSERT_EQUAL_HEX16(0x1234, publish.packet_id);
+  TEST_ASSERT_EQUAL(3, publish.topic_len);
+  TEST_ASSERT_EQUAL_STRING_LEN("a/b", publish.topic, 3);
+  TEST_ASSERT_EQUAL(2, publish.payload_len);
+  TEST_ASSERT_EQUAL_STRING_LEN("ok", reinterpret_cast<const char *>(publish.payload), 2);
+  reader.next();
+
+  offset += reader.feed(stream + offset, sizeof(stream) - offset);
+  TEST_ASSERT_EQUAL(sizeof(stream), offset);
+  TEST_ASSERT_TRUE(reader.ready());
+  TEST_ASSERT_EQUAL(MQTT_PINGRESP, reader.type());
+  TEST_ASSERT_EQUAL(1, reader.oversized());
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_mqtt_codec_connect);
+  RUN_TEST(test_mqtt_codec_publish_header);
+  RUN_TEST(test_mqtt_codec_subscribe);
+  RUN_TEST(test_mqtt_codec_reader);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,152 @@
+#include <MqttRouter.h>
+#include <unity.h>
+#include <string.h>
+
+static char received[4096];
+static size_t received_len = 0;
+static const char *received_by = nullptr;
+static uint8_t calls = 0;
+
+static void _store(const char *by, const char *payload, size_t len) {
+  memcpy(received, payload, len);
+  received_len = len;
+  received_by = by;
+  ++calls;
+}
+
+static void _onBinlog(const char *payload, size_t len) { _store("binlog", payload, len); }
+static void _onLogLevel(const char *payload, size_t len) { _store("loglevel", payload, len); }
+static void _onModbus(const char *payload, size_t len) { _store("modbus", payload, len); }
+static void _onUpgrade(const char *payload, size_t len) { _store("upgrade", payload, len); }
+
+static const mqtt_command_t COMMANDS[] = {
+  { "binlog", _onBinlog, 0 },
+  { "loglevel", _onLogLevel, 31 },
+  { "modbus", _onModbus, 3000 },
+  { "upgrade", _onUpgrade, 0 },
+};
+
+static const char PREFIX[] = "MyTopic/ESP-MM-ABCDEF012345/action/";
+
+static void _reset() {
+  received_len = 0;
+  received_by = nullptr;
+  calls = 0;
+}
+
+void test_mqtt_router_dispatch(void) {
+  _reset();
+  MqttRouter router(COMMANDS, sizeof(COMMANDS) / sizeof(COMMANDS[0]));
+  TEST_ASSERT_TRUE(router.begin(PREFIX));
+  for (size_t i = 0; i < sizeof(COMMANDS) / sizeof(COMMANDS[0]); ++i) {
+    char topic[128];
+    strcpy(topic, PREFIX);
+    strcat(topic, COMMANDS[i].suffix);
+    TEST_ASSERT_EQUAL_PTR(&COMMANDS[i], router.find(topic));
+  }
+  TEST_ASSERT_NULL(router.find("MyTopic/ESP-MM-ABCDEF012345/action/"));
+  TEST_ASSERT_NULL(router.find("MyTopic/ESP-MM-ABCDEF012345/action/modbusx"));
+  TEST_ASSERT_NULL(router.find("Other/ESP-MM-ABCDEF012345/action/modbus"));
+
+  const char payload[] = "debugXXX";  // not null-terminated: only the first 5 bytes belong to the message
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_DISPATCHED,
+    router.route("MyTopic/ESP-MM-ABCDEF012345/action/loglevel", payload, 5, 0, 5));
+  TEST_ASSERT_EQUAL_STRING("loglevel", received_by);
+  TEST_ASSERT_EQUAL(5, received_len);
+  TEST_ASSERT_EQUAL_MEMORY("debug", received, 5);
+
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_DISPATCHED, router.route("MyTopic/ESP-MM-ABCDEF012345/action/upgrade", "1", 1, 0, 1));
+  TEST_ASSERT_EQUAL(0, received_len);  // payload ignored
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_UNKNOWN, router.route("MyTopic/ESP-MM-ABCDEF012345/action/reboot", "", 0, 0, 0));
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_TOO_LARGE,
+    router.route("MyTopic/ESP-MM-ABCDEF012345/action/loglevel", received, 64, 0, 64));
+  TEST_ASSERT_EQUAL(2, calls);
+  TEST_ASSERT_EQUAL(2, router.dispatched());
+  TEST_ASSERT_EQUAL(2, router.rejected());
+}
+
+void test_mqtt_router_unsorted(void) {
+  const mqtt_command_t unsorted[] = {
+    { "modbus", _onModbus, 0 },
+    { "binlog", _onBinlog, 0 },
+  };
+  MqttRouter router(unsorted, 2);
+  TEST_ASSERT_FALSE(router.begin(PREFIX));
+  char long_prefix[MQTT_ROUTER_MAX_PREFIX + 1];
+  memset(long_prefix, 'a', sizeof(long_prefix) - 1);
+  long_prefix[sizeof(long_prefix) - 1] = '\0';
+  MqttRouter sorted(COMMANDS, sizeof(COMMANDS) / sizeof(COMMANDS[0]));
+  TEST_ASSERT_FALSE(sorted.begin(long_prefix));
+}
+
+void test_mqtt_router_chunks(void) {
+  _reset();
+  MqttRouter router(COMMANDS, sizeof(COMMANDS) / sizeof(COMMANDS[0]));
+  router.begin(PREFIX);
+  const char *topic = "MyTopic/ESP-MM-ABCDEF012345/action/modbus";
+  char payload[1500];
+  for (size_t i = 0; i < sizeof(payload); ++i) {
+    payload[i] = 'a' + i % 26;
+  }
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_PENDING, router.route(topic, payload, 600, 0, sizeof(payload)));
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_PENDING, router.route(topic, &payload[600], 600, 600, sizeof(payload)));
+  TEST_ASSERT_EQUAL(0, calls);
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_DISPATCHED, router.route(topic, &payload[1200], 300, 1200, sizeof(payload)));
+  TEST_ASSERT_EQUAL(1, calls);
+  TEST_ASSERT_EQUAL(sizeof(payload), received_len);
+  TEST_ASSERT_EQUAL_MEMORY(payload, received, sizeof(payload));
+
+  // a lost chunk drops the message
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_PENDING, router.route(topic, payload, 600, 0, sizeof(payload)));
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_OUT_OF_SEQUENCE, router.route(topic, &payload[1200], 300, 1200, sizeof(payload)));
+  TEST_ASSERT_EQUAL(1, router.rejected());
+  // an incomplete message is replaced by the next one
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_PENDING, router.route(topic, payload, 600, 0, sizeof(payload)));
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_DISPATCHED, router.route(topic, "{}", 2, 0, 2));
+  TEST_ASSERT_EQUAL(2, received_len);
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_OUT_OF_SEQUENCE, router.route(topic, &payload[600], 600, 600, sizeof(payload)));
+  TEST_ASSERT_EQUAL(2, router.rejected());
+
+  // larger than the reassembly buffer, every chunk is rejected
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_TOO_LARGE, router.route(topic, payload, 1000, 0, MQTT_ROUTER_BUFFER_SIZE + 1));
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_TOO_LARGE, router.route(topic, payload, 1000, 1000, MQTT_ROUTER_BUFFER_SIZE + 1));
+  TEST_ASSERT_EQUAL(3, router.rejected());
+  TEST_ASSERT_EQUAL(2, calls);
+
+  // payload ignored: dispatched with the last chunk
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_PENDING, router.route("MyTopic/ESP-MM-ABCDEF012345/action/binlog", payload, 10, 0, 20));
+  TEST_ASSERT_EQUAL(MQTT_ROUTE_DISPATCHED,
+    router.route("MyTopic/ESP-MM-ABCDEF012345/action/binlog", payload, 10, 10, 20));
+  TEST_ASSERT_EQUAL_STRING("binlog", received_by);
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_mqtt_router_dispatch);
+  RUN_TEST(test_mqtt_router_unsorted);
+  RUN_TEST(test_mqtt_router_chunks);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,213 @@
+#include <PrometheusWriter.h>
+#include <MetricsServer.h>
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+  char page[4096];
+  size_t len;
+  uint32_t flushes;
+  uint32_t fail_at;  // flush number refused, 0 for none
+} sink_t;
+
+static bool _collect(const char *data, size_t len, void *context) {
+  sink_t *sink = static_cast<sink_t *>(context);
+  if (++sink->flushes == sink->fail_at) {
+    return false;
+  }
+  memcpy(sink->page + sink->len, data, len);
+  sink->len += len;
+  sink->page[sink->len] = '\0';
+  return true;
+}
+
+void test_prometheus_format(void) {
+  char buffer[256];
+  sink_t sink = {};
+  PrometheusWriter writer(buffer, sizeof(buffer), _collect, &sink);
+  writer.family("modbus_field_value", "Latest \"decoded\" value\\", "gauge");
+  const prometheus_label_t labels[] = { { "field", "temperature_boiler" }, { "group", "a\"b\\c\nd" } };
+  writer.sample("modbus_field_value", labels, 2, 45.5);
+  writer.sample("modbus_transactions_total", 1234567);
+  writer.sample("modbus_round_trip_seconds", NAN);
+  writer.sample("modbus_limit", -INFINITY);
+  TEST_ASSERT_TRUE(writer.finish());
+  TEST_ASSERT_EQUAL_STRING("# HELP modbus_field_value Latest \"decoded\" value\\\\\n"
+                           "# TYPE modbus_field_value gauge\n"
+                           "modbus_field_value{field=\"temperature_boiler\",group=\"a\\\"b\\\\c\\nd\"} 45.5\n"
+                           "modbus_transactions_total 1234567\n"
+                           "modbus_round_trip_seconds NaN\n"
+                           "modbus_limit -Inf\n", sink.page);
+  TEST_ASSERT_EQUAL(sink.len, writer.written());
+  TEST_ASSERT_EQUAL(1, sink.flushes);
+}
+
+void test_prometheus_streaming(void) {
+  char buffer[16];  // smaller than a single line
+  sink_t sink = {};
+  PrometheusWriter writer(buffer, sizeof(buffer), _collect, &sink);
+  char name[32];
+  for (int i = 0; i < 100; ++i) {
+    snprintf(name, sizeof(name), "field_%d", i);
+    const prometheus_label_t label = { "field", name };
+    writer.sample("modbus_field_value", &label, 1, i);
+  }
+  TEST_ASSERT_TRUE(writer.finish());
+  TEST_ASSERT_EQUAL(sink.len, writer.written());
+  TEST_ASSERT_EQUAL((sink.len + sizeof(buffer) - 1) / sizeof(buffer), sink.flushes);
+  TEST_ASSERT_NOT_NULL(strstr(sink.page, "modbus_field_value{field=\"field_99\"} 99\n"));
+
+  // a refused flush aborts the page
+  sink_t broken = {};
+  broken.fail_at = 2;
+  PrometheusWriter aborted(buffer, sizeof(buffer), _collect, &broken);
+  for (int i = 0; i < 10; ++i) {
+    aborted.sample("modbus_transactions_total", i);
+  }
+  TEST_ASSERT_FALSE(aborted.finish());
+  TEST_ASSERT_TRUE(aborted.failed());
+  TEST_ASSERT_EQUAL(sizeof(buffer), broken.len);
+}
+
+#ifndef ARDUINO
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// simulated register map, large enough for the page to take several chunks
+static void _render(PrometheusWriter *writer, void *context) {
+  const int *field_nb = static_cast<const int *>(context);
+  writer->family("modbus_field_value", "Latest decoded value of a register field", "gauge");
+  char name[32];
+  for (int i = 0; i < *field_nb; ++i) {
+    snprintf(name, sizeof(name), "field_%d", i);
+    const prometheus_label_t label = { "field", name };
+    writer->sample("modbus_field_value", &label, 1, i / 10.0);
+  }
+}
+
+// sends a request to the server, serves it and returns the whole response
+static size_t _fetch(MetricsServer *server, const char *request, char *response, size_t size) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(server->port());
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0) {
+    close(fd);
+    return 0;
+  }
+  send(fd, request, strlen(request), 0);
+  server->poll(1000);  // the response fits in the socket buffers
+  size_t len = 0;
+  ssize_t n;
+  while (len < size - 1 && (n = recv(fd, response + len, size - 1 - len, 0)) > 0) {
+    len += n;
+  }
+  response[len] = '\0';
+  close(fd);
+  return len;
+}
+
+// body of a chunked response
+static size_t _dechunk(const char *response, char *body) {
+  const char *p = strstr(response, "\r\n\r\n") + 4;
+  size_t len = 0;
+  for (;;) {
+    unsigned int chunk_len;
+    if (sscanf(p, "%x", &chunk_len) != 1 || chunk_len == 0) {
+      return len;
+    }
+    p = strstr(p, "\r\n") + 2;
+    memcpy(body + len, p, chunk_len);
+    len += chunk_len;
+    body[len] = '\0';
+    p += chunk_len + 2;
+  }
+}
+
+static char response[32768];
+static char body[32768];
+
+void test_metrics_server_loopback(void) {
+  int field_nb = 200;
+  MetricsServer server(_render, &field_nb);
+  TEST_ASSERT_TRUE(server.begin(0));
+  TEST_ASSERT_NOT_EQUAL(0, server.port());
+
+  TEST_ASSERT_TRUE(_fetch(&server, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n", response, sizeof(response)) > 0);
+  TEST_ASSERT_EQUAL(0, strncmp(response, "HTTP/1.1 200 OK\r\n", 17));
+  TEST_ASSERT_NOT_NULL(strstr(response, "Content-Type: text/plain; version=0.0.4"));
+  TEST_ASSERT_NOT_NULL(strstr(response, "Transfer-Encoding: chunked\r\n"));
+  const size_t len = _dechunk(response, body);
+  TEST_ASSERT_EQUAL(server.lastPageBytes(), len);
+  TEST_ASSERT_TRUE(len > 2 * METRICS_SERVER_CHUNK_SIZE);
+  TEST_ASSERT_EQUAL(0, strncmp(body, "# HELP modbus_field_value ", 26));
+  TEST_ASSERT_NOT_NULL(strstr(body, "\nmodbus_field_value{field=\"field_199\"} 19.9\n"));
+  TEST_ASSERT_EQUAL(1, server.scrapes());
+
+  // HTTP/1.0: the page ends with the connection
+  _fetch(&server, "GET /metrics?x=1 HTTP/1.0\r\n\r\n", response, sizeof(response));
+  TEST_ASSERT_NULL(strstr(response, "Transfer-Encoding"));
+  TEST_ASSERT_EQUAL_STRING(body, strstr(response, "\r\n\r\n") + 4);
+
+  _fetch(&server, "GET / HTTP/1.1\r\n\r\n", response, sizeof(response));
+  TEST_ASSERT_EQUAL(0, strncmp(response, "HTTP/1.1 404 Not Found\r\n", 24));
+  _fetch(&server, "POST /metrics HTTP/1.1\r\nContent-Length: 2\r\n\r\nab", response, sizeof(response));
+  TEST_ASSERT_EQUAL(0, strncmp(response, "HTTP/1.1 405 Method Not Allowed\r\n", 33));
+  TEST_ASSERT_EQUAL(2, server.scrapes());
+  TEST_ASSERT_EQUAL(2, server.errors());
+
+  server.poll(10);  // nobody
+  TEST_ASSERT_EQUAL(2, server.scrapes());
+}
+
+#endif  // ARDUINO
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_prometheus_format);
+  RUN_TEST(test_prometheus_streaming);
+#ifndef ARDUINO
+  RUN_TEST(test_metrics_server_loopback);
+#endif  // ARDUINO
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+#ifdef METRICS_SERVE_SECONDS
+  // for manual checks: curl -v http://localhost:9100/metrics
+  int field_nb = 100;
+  MetricsServer server(_render, &field_nb);
+  if (server.begin(9100)) {
+    for (time_t end = time(nullptr) + METRICS_SERVE_SECONDS; time(nullptr) < end;) {
+      server.poll(1000);
+    }
+  }
+#endif  // METRICS_SERVE_SECONDS
+  return 0;
+}
+
+#endif
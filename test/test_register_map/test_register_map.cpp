@@ -0,0 +1,122 @@
+#include <RegisterMap.h>
+#include <unity.h>
+
+static const modbus_register_t table[] = {
+  { 474, MODBUS_TYPE_HOLDING, REGISTER_TYPE_BITFIELD, "bits", { .bitfield = { "bit_0", "bit_1", "bit_2" } } },
+  { 500, MODBUS_TYPE_HOLDING, REGISTER_TYPE_U16, "alarm", {} },
+  { 503, MODBUS_TYPE_HOLDING, REGISTER_TYPE_DEBUG, "power", {} },
+  { 601, MODBUS_TYPE_HOLDING, REGISTER_TYPE_DIEMATIC_ONE_DECIMAL, "temperature", {} },
+};
+
+typedef struct {
+  uint16_t field_ids[16];
+  double values[16];
+  uint8_t count;
+} fields_t;
+
+static void _addField(uint16_t field_id, const char *name, double value, void *context) {
+  fields_t *fields = static_cast<fields_t *>(context);
+  fields->field_ids[fields->count] = field_id;
+  fields->values[fields->count++] = value;
+}
+
+void test_register_map_decimal(void) {
+  double value = 0;
+  TEST_ASSERT_TRUE(decodeDiematicDecimal(0x00E1, 1, &value));
+  TEST_ASSERT_EQUAL_FLOAT(22.5, value);
+  TEST_ASSERT_TRUE(decodeDiematicDecimal(0x800F, 1, &value));  // sign and magnitude
+  TEST_ASSERT_EQUAL_FLOAT(-1.5, value);
+  TEST_ASSERT_FALSE(decodeDiematicDecimal(0xFFFF, 1, &value));
+  TEST_ASSERT_EQUAL_FLOAT(-1.5, value);  // untouched
+}
+
+void test_register_map_find(void) {
+  uint16_t field_id = 0;
+  TEST_ASSERT_EQUAL(3, findRegister(table, 4, 601, &field_id));
+  TEST_ASSERT_EQUAL(4, field_id);  // 3 bits, 1 alarm, no field for DEBUG
+  TEST_ASSERT_EQUAL(1, findRegister(table, 4, 500, nullptr));
+  TEST_ASSERT_EQUAL(-1, findRegister(table, 4, 602, &field_id));
+}
+
+void test_register_map_decode(void) {
+  fields_t fields = {};
+  TEST_ASSERT_EQUAL(3, decodeRegister(&table[0], 0x0005, 10, _addField, &fields));
+  TEST_ASSERT_EQUAL(3, fields.count);
+  TEST_ASSERT_EQUAL(12, fields.field_ids[2]);
+  TEST_ASSERT_EQUAL_FLOAT(1, fields.values[0]);
+  TEST_ASSERT_EQUAL_FLOAT(0, fields.values[1]);
+  TEST_ASSERT_EQUAL_FLOAT(1, fields.values[2]);
+  TEST_ASSERT_EQUAL(0, decodeRegister(&table[2], 0x1234, 0, _addField, &fields));
+  TEST_ASSERT_EQUAL(0, decodeRegister(&table[3], 0xFFFF, 0, _addField, &fields));
+  TEST_ASSERT_EQUAL(3, fields.count);
+}
+
+void test_register_map_blocks(void) {
+  static const modbus_register_t plan_table[] = {
+    { 500, MODBUS_TYPE_HOLDING, REGISTER_TYPE_U16, "alarm_critical", {} },
+    { 501, MODBUS_TYPE_HOLDING, REGISTER_TYPE_U16, "alarm_major", {} },
+    { 503, MODBUS_TYPE_HOLDING, REGISTER_TYPE_U16, "power", {} },  // gap of 1
+    { 503, MODBUS_TYPE_INPUT, REGISTER_TYPE_U16, "flow", {} },
+    { 10, MODBUS_TYPE_COIL, REGISTER_TYPE_BITFIELD, "pumps", { .bitfield = { "pump_1", "pump_2", "pump_3" } } },
+    { 13, MODBUS_TYPE_COIL, REGISTER_TYPE_U16, "valve", {} },
+    { 2010, MODBUS_TYPE_COIL, REGISTER_TYPE_U16, "too_far", {} },  // more than 2000 bits from coil 10
+  };
+  modbus_block_t blocks[7];
+  TEST_ASSERT_EQUAL(5, planRegisterBlocks(plan_table, 7, 0, blocks));
+  TEST_ASSERT_EQUAL(4, planRegisterBlocks(plan_table, 7, 1, blocks));
+  TEST_ASSERT_EQUAL(0, blocks[0].first);
+  TEST_ASSERT_EQUAL(3, blocks[0].entries);
+  TEST_ASSERT_EQUAL(500, blocks[0].address);
+  TEST_ASSERT_EQUAL(4, blocks[0].count);
+  TEST_ASSERT_EQUAL(MODBUS_TYPE_INPUT, blocks[1].modbus_entity);
+  TEST_ASSERT_EQUAL(4, blocks[2].first);
+  TEST_ASSERT_EQUAL(2, blocks[2].entries);
+  TEST_ASSERT_EQUAL(4, blocks[2].count);  // 3 named bits and a single one
+  TEST_ASSERT_EQUAL(2010, blocks[3].address);
+  TEST_ASSERT_EQUAL(0x01, modbusReadFunction(blocks[3].modbus_entity));
+  TEST_ASSERT_EQUAL(0, modbusReadFunction(MODBUS_TYPE_COUNT));
+
+  const uint16_t words[] = { 0x1111, 0x2222, 0x3333, 0x4444 };
+  TEST_ASSERT_EQUAL_HEX16(0x4444, blockRegisterValue(&blocks[0], &plan_table[2], words));
+
+  // coils 10-12 then 13 read as 0b1101, then a bitfield straddling two values
+  const uint16_t bits[] = { 0x800D, 0x0003 };
+  TEST_ASSERT_EQUAL_HEX16(0x5, blockRegisterValue(&blocks[2], &plan_table[4], bits));
+  TEST_ASSERT_EQUAL_HEX16(0x1, blockRegisterValue(&blocks[2], &plan_table[5], bits));
+  const modbus_register_t straddling = { 25, MODBUS_TYPE_COIL, REGISTER_TYPE_BITFIELD, "x",
+                                         { .bitfield = { "x_0", "x_1", "x_2" } } };
+  const modbus_block_t block = { 0, 1, MODBUS_TYPE_COIL, 10, 32 };
+  TEST_ASSERT_EQUAL_HEX16(0x7, blockRegisterValue(&block, &straddling, bits));  // bits 15, 16 and 17
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_register_map_decimal);
+  RUN_TEST(test_register_map_find);
+  RUN_TEST(test_register_map_decode);
+  RUN_TEST(test_register_map_blocks);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,435 @@
+#include <ModbusRtu.h>
+#include <RtuMaster.h>
+#include <unity.h>
+#include <string.h>
+
+// Deterministic transport: the test controls the clock and what the slave answers
+class FakeTransport : public ModbusTransport {
+ public:
+  uint32_t now = 0;
+  uint8_t sent[MODBUS_RTU_MAX_FRAME];
+  size_t sent_len = 0;
+  uint32_t sent_at = 0;
+  uint32_t frames_sent = 0;
+  uint8_t rx[MODBUS_RTU_MAX_FRAME];
+  size_t rx_len = 0;
+  bool frame_open = false;  // the bytes in rx were handed over on a FIFO threshold
+
+  bool send(const uint8_t *data, size_t len) override {
+    memcpy(sent, data, len);
+    sent_len = len;
+    sent_at = now;
+    ++frames_sent;
+    return true;
+  }
+  size_t receive(uint8_t *buffer, size_t size) override {
+    const size_t n = rx_len < size ? rx_len : size;
+    memcpy(buffer, rx, n);
+    memmove(rx, rx + n, rx_len - n);
+    rx_len -= n;
+    return n;
+  }
+  void wait(uint32_t timeout_us) override { now += timeout_us; }
+  void wake() override {}
+  uint32_t micros() override { return now; }
+  bool rxFrameOpen() override { return frame_open; }
+
+  void answer(const uint8_t *frame, size_t len) {  // appends CRC
+    memcpy(rx + rx_len, frame, len);
+    const uint16_t crc = modbusCrc16(frame, len);
+    rx[rx_len + len] = crc & 0xFF;
+    rx[rx_len + len + 1] = crc >> 8;
+    rx_len += len + 2;
+  }
+  void feed(const uint8_t *data, size_t len) {  // raw bytes, e.g. a part of a frame
+    memcpy(rx + rx_len, data, len);
+    rx_len += len;
+  }
+};
+
+// frame of len bytes plus its CRC, in frame
+static size_t _withCrc(uint8_t *frame, size_t len) {
+  const uint16_t crc = modbusCrc16(frame, len);
+  frame[len] = crc & 0xFF;
+  frame[len + 1] = crc >> 8;
+  return len + 2;
+}
+
+typedef struct {
+  uint8_t status;
+  uint16_t values[RTU_MASTER_MAX_REGISTERS];
+  uint8_t calls;
+} result_t;
+
+static void _complete(const rtu_request_t *request, uint8_t status, const uint16_t *values, void *context) {
+  result_t *result = static_cast<result_t *>(context);
+  result->status = status;
+  for (uint16_t i = 0; values != nullptr && i < request->count && i < RTU_MASTER_MAX_REGISTERS; ++i) {
+    result->values[i] = values[i];
+  }
+  ++result->calls;
+}
+
+static rtu_request_t _read(uint16_t address, uint16_t count, result_t *result) {
+  rtu_request_t request = { 10, 0x03, address, count, nullptr, 2, 1000, _complete, result, false };
+  return request;
+}
+
+void test_rtu_master_read(void) {
+  FakeTransport transport;
+  RtuMaster master(&transport, 9600);
+  result_t result = {};
+  TEST_ASSERT_TRUE(master.submit(_read(601, 2, &result)));
+
+  transport.now = 10000;  // bus idle for more than t3.5
+  master.poll();
+  TEST_ASSERT_EQUAL(1, transport.frames_sent);
+  const uint8_t expected[] = { 0x0A, 0x03, 0x02, 0x59, 0x00, 0x02, 0x14, 0xDB };
+  TEST_ASSERT_EQUAL(sizeof(expected), transport.sent_len);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, transport.sent, sizeof(expected));
+
+  const uint8_t response[] = { 0x0A, 0x03, 0x04, 0x00, 0xE1, 0x80, 0x0F };
+  transport.answer(response, sizeof(response));
+  transport.now += 20000;
+  master.poll();
+  TEST_ASSERT_EQUAL(1, result.calls);
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_SUCCESS, result.status);
+  TEST_ASSERT_EQUAL_HEX16(0x00E1, result.values[0]);
+  TEST_ASSERT_EQUAL_HEX16(0x800F, result.values[1]);
+  TEST_ASSERT_EQUAL(0, master.pending());
+}
+
+void test_rtu_master_timeout_retries(void) {
+  FakeTransport transport;
+  RtuMaster master(&transport, 9600);
+  result_t result = {};
+  master.submit(_read(601, 1, &result));
+
+  transport.now = 10000;
+  for (int i = 0; i < 10 && result.calls == 0; ++i) {
+    transport.wait(master.poll());  // sleep exactly as long as asked
+  }
+  TEST_ASSERT_EQUAL(1, result.calls);
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_TIMEOUT, result.status);
+  TEST_ASSERT_EQUAL(3, transport.frames_sent);  // 1 trial + 2 retries
+  TEST_ASSERT_EQUAL(2, master.retries());
+  TEST_ASSERT_EQUAL(3, master.timeouts());
+}
+
+void test_rtu_master_rejected(void) {
+  FakeTransport transport;
+  RtuMaster master(&transport, 9600);
+  result_t result = {};
+  master.submit(_read(601, 1, &result));
+  transport.now = 10000;
+  master.poll();
+  const uint8_t response[] = { 0x0A, 0x03, 0x02, 0x00, 0xE1 };
+  transport.answer(response, sizeof(response));
+  transport.now += 20000;
+  master.poll();
+  const uint32_t round_trip_us = master.roundTripUs();
+
+  rtu_request_t request = _read(601, 1, &result);
+  request.function = 0x2B;  // not supported by the master
+  master.submit(request);
+  transport.now += 10000;
+  master.poll();
+  TEST_ASSERT_EQUAL(2, result.calls);
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_INVALID_FUNCTION, result.status);
+  TEST_ASSERT_EQUAL(1, transport.frames_sent);
+  TEST_ASSERT_EQUAL(0, master.retries());
+  TEST_ASSERT_EQUAL(round_trip_us, master.roundTripUs());
+  TEST_ASSERT_EQUAL(0, master.pending());
+}
+
+void test_rtu_master_exception(void) {
+  FakeTransport transport;
+  RtuMaster master(&transport, 9600);
+  result_t result = {};
+  master.submit(_read(9999, 1, &result));
+  transport.now = 10000;
+  master.poll();
+  const uint8_t exception[] = { 0x0A, 0x83, 0x02 };
+  transport.answer(exception, sizeof(exception));
+  master.poll();
+  TEST_ASSERT_EQUAL(1, result.calls);
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_ILLEGAL_DATA_ADDRESS, result.status);
+  TEST_ASSERT_EQUAL(1, transport.frames_sent);  // not retried
+}
+
+void test_rtu_master_invalid_exception(void) {
+  FakeTransport transport;
+  RtuMaster master(&transport, 9600);
+  result_t result = {};
+  rtu_request_t request = _read(9999, 1, &result);
+  request.retries = 0;
+  master.submit(request);
+  transport.now = 10000;
+  master.poll();
+  const uint8_t exception[] = { 0x0A, 0x83, 0x00 };  // code 0 would read as a success
+  transport.answer(exception, sizeof(exception));
+  master.poll();
+  TEST_ASSERT_EQUAL(1, result.calls);
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_INVALID_RESPONSE, result.status);
+
+  uint16_t values[1];
+  const uint8_t pdu[] = { 0x83, 0xE2 };  // out of range, not a time-out
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_INVALID_RESPONSE, modbusDecodeResponse(request, pdu, 2, values));
+}
+
+// A response longer than the UART FIFO threshold reaches the master in two chunks, the second one read long after
+// the first: the frame is only over once the receiver saw the line idle.
+void test_rtu_master_split_response(void) {
+  FakeTransport transport;
+  RtuMaster master(&transport, 9600);
+  result_t result = {};
+  master.submit(_read(1000, 100, &result));
+  transport.now = 10000;
+  master.poll();
+
+  uint8_t response[MODBUS_RTU_MAX_FRAME] = { 0x0A, 0x03, 200 };
+  for (uint16_t i = 0; i < 100; ++i) {
+    response[3 + 2 * i] = i >> 8;
+    response[4 + 2 * i] = i & 0xFF;
+  }
+  const size_t len = _withCrc(response, 203);
+  TEST_ASSERT_EQUAL(205, len);
+  transport.feed(response, 120);
+  transport.frame_open = true;
+  master.poll();
+  transport.now += 50000;  // way past t3.5 by the clock of the task
+  master.poll();
+  TEST_ASSERT_EQUAL(0, result.calls);
+  TEST_ASSERT_EQUAL(0, master.crcErrors());
+
+  transport.feed(&response[120], len - 120);
+  transport.frame_open = false;
+  transport.now += 50000;
+  master.poll();
+  TEST_ASSERT_EQUAL(1, result.calls);
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_SUCCESS, result.status);
+  TEST_ASSERT_EQUAL_HEX16(0, result.values[0]);
+  TEST_ASSERT_EQUAL_HEX16(99, result.values[99]);
+}
+
+void test_rtu_master_pipeline(void) {
+  FakeTransport transport;
+  RtuMaster master(&transport, 9600);
+  result_t first = {}, second = {};
+  master.submit(_read(601, 1, &first));
+  master.submit(_read(602, 1, &second));
+  TEST_ASSERT_EQUAL(2, master.pending());
+
+  transport.now = 10000;
+  master.poll();
+  const uint8_t response[] = { 0x0A, 0x03, 0x02, 0x01, 0x02 };
+  transport.answer(response, sizeof(response));
+  transport.now += 30000;
+  const uint32_t delay = master.poll();  // first completes, second waits for t3.5
+  TEST_ASSERT_EQUAL(1, first.calls);
+  TEST_ASSERT_EQUAL(1, transport.frames_sent);
+  TEST_ASSERT_EQUAL(modbusT35(9600), delay);
+  transport.wait(delay);
+  master.poll();
+  TEST_ASSERT_EQUAL(2, transport.frames_sent);
+  TEST_ASSERT_EQUAL_HEX8(0x5A, transport.sent[3]);  // address 602 (0x025A)
+}
+
+void test_rtu_master_urgent(void) {
+  FakeTransport transport;
+  RtuMaster master(&transport, 9600);
+  result_t first = {}, second = {}, urgent_1 = {}, urgent_2 = {};
+  master.submit(_read(601, 1, &first));
+  master.submit(_read(602, 1, &second));
+  transport.now = 10000;
+  master.poll();  // 601 on the bus
+  const uint32_t sent_end = transport.now + 8 * (11UL * 1000000 / 9600);
+
+  rtu_request_t request = _read(700, 1, &urgent_1);
+  request.urgent = true;
+  master.submit(request);
+  request = _read(701, 1, &urgent_2);
+  request.urgent = true;
+  master.submit(request);
+  TEST_ASSERT_EQUAL(4, master.pending());
+
+  const uint8_t response[] = { 0x0A, 0x03, 0x02, 0x01, 0x02 };
+  const uint16_t expected[] = { 700, 701, 602 };  // urgent ones first, in order
+  transport.answer(response, sizeof(response));
+  transport.now += 30000;
+  master.poll();
+  TEST_ASSERT_EQUAL(1, first.calls);
+  TEST_ASSERT_EQUAL(transport.now - sent_end, master.roundTripUs());
+  for (uint8_t i = 0; i < 3; ++i) {
+    transport.wait(master.poll());  // t3.5
+    master.poll();
+    TEST_ASSERT_EQUAL(2 + i, transport.frames_sent);
+    TEST_ASSERT_EQUAL_HEX8(expected[i] & 0xFF, transport.sent[3]);
+    transport.answer(response, sizeof(response));
+    transport.now += 30000;
+    master.poll();
+  }
+  TEST_ASSERT_EQUAL(1, urgent_1.calls);
+  TEST_ASSERT_EQUAL(1, urgent_2.calls);
+  TEST_ASSERT_EQUAL(1, second.calls);
+}
+
+void test_rtu_master_write(void) {
+  FakeTransport transport;
+  RtuMaster master(&transport, 9600);
+  result_t result = {};
+  const uint16_t values[] = { 0x0258, 0x012C };
+  rtu_request_t request = { 10, 0x10, 602, 2, values, 0, 1000, _complete, &result, false };
+  master.submit(request);
+  transport.now = 10000;
+  master.poll();
+  TEST_ASSERT_EQUAL(13, transport.sent_len);
+  TEST_ASSERT_EQUAL(4, transport.sent[6]);
+  const uint8_t response[] = { 0x0A, 0x10, 0x02, 0x5A, 0x00, 0x02 };
+  transport.answer(response, sizeof(response));
+  master.poll();
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_SUCCESS, result.status);
+}
+
+void test_rtu_master_read_coils(void) {
+  FakeTransport transport;
+  RtuMaster master(&transport, 9600);
+  result_t result = {};
+  rtu_request_t request = { 10, 0x01, 20, 19, nullptr, 0, 1000, _complete, &result, false };
+  master.submit(request);
+  transport.now = 10000;
+  master.poll();
+  const uint8_t expected[] = { 0x0A, 0x01, 0x00, 0x14, 0x00, 0x13 };
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, transport.sent, sizeof(expected));
+  const uint8_t response[] = { 0x0A, 0x01, 0x03, 0xCD, 0x6B, 0x05 };  // coils 20-27, 28-35, 36-38
+  transport.answer(response, sizeof(response));
+  master.poll();
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_SUCCESS, result.status);
+  TEST_ASSERT_EQUAL_HEX16(0x6BCD, result.values[0]);
+  TEST_ASSERT_EQUAL_HEX16(0x0005, result.values[1]);
+
+  request.count = RTU_MASTER_MAX_BITS + 1;
+  master.submit(request);
+  transport.now += 10000;
+  master.poll();
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_ILLEGAL_DATA_VALUE, result.status);
+  TEST_ASSERT_EQUAL(1, transport.frames_sent);
+}
+
+// The largest coil read: 250 bytes of bits, across two UART FIFO chunks
+void test_rtu_master_read_coils_split(void) {
+  FakeTransport transport;
+  RtuMaster master(&transport, 9600);
+  result_t result = {};
+  const rtu_request_t request = { 10, 0x01, 0, RTU_MASTER_MAX_BITS, nullptr, 0, 1000, _complete, &result, false };
+  master.submit(request);
+  transport.now = 10000;
+  master.poll();
+
+  uint8_t response[MODBUS_RTU_MAX_FRAME] = { 0x0A, 0x01, 250 };
+  for (uint16_t i = 0; i < 250; ++i) {
+    response[3 + i] = i;
+  }
+  const size_t len = _withCrc(response, 253);
+  transport.feed(response, 120);
+  transport.frame_open = true;
+  master.poll();
+  transport.now += 50000;
+  master.poll();
+  TEST_ASSERT_EQUAL(0, result.calls);
+  transport.feed(&response[120], len - 120);
+  transport.frame_open = false;
+  master.poll();
+  TEST_ASSERT_EQUAL(1, result.calls);
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_SUCCESS, result.status);
+  TEST_ASSERT_EQUAL_HEX16(0x0100, result.values[0]);  // bytes 0 and 1
+  TEST_ASSERT_EQUAL_HEX16(0xF9F8, result.values[124]);  // bytes 248 and 249
+}
+
+#ifndef ARDUINO
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <PosixSerialTransport.h>
+
+// Same engine over a real pty, against a simulated slave answering holding registers
+void test_rtu_master_pty(void) {
+  const int pty = posix_openpt(O_RDWR | O_NOCTTY);
+  TEST_ASSERT_TRUE(pty >= 0);
+  TEST_ASSERT_EQUAL(0, grantpt(pty));
+  TEST_ASSERT_EQUAL(0, unlockpt(pty));
+  const int slave = PosixSerialTransport::open(ptsname(pty), 9600);
+  TEST_ASSERT_TRUE(slave >= 0);
+
+  PosixSerialTransport transport(pty);
+  PosixSerialTransport slave_transport(slave);
+  RtuMaster master(&transport, 9600);
+  result_t result = {};
+  master.submit(_read(601, 2, &result));
+
+  uint8_t request[MODBUS_RTU_MAX_FRAME];
+  size_t request_len = 0;
+  for (int i = 0; i < 200 && result.calls == 0; ++i) {
+    const uint32_t delay = master.poll();
+    request_len += slave_transport.receive(request + request_len, sizeof(request) - request_len);
+    if (request_len == 8 && modbusCheckCrc(request, request_len)) {
+      uint8_t response[] = { request[0], 0x03, 0x04, 0x00, 0xE1, 0x80, 0x0F, 0x00, 0x00 };
+      const uint16_t crc = modbusCrc16(response, 7);
+      response[7] = crc & 0xFF;
+      response[8] = crc >> 8;
+      slave_transport.send(response, sizeof(response));
+      request_len = 0;
+    }
+    transport.wait(delay < 5000 ? delay : 5000);
+  }
+  TEST_ASSERT_EQUAL(1, result.calls);
+  TEST_ASSERT_EQUAL(MODBUS_STATUS_SUCCESS, result.status);
+  TEST_ASSERT_EQUAL_HEX16(0x800F, result.values[1]);
+  close(slave);
+  close(pty);
+}
+
+#endif  // ARDUINO
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_rtu_master_read);
+  RUN_TEST(test_rtu_master_timeout_retries);
+  RUN_TEST(test_rtu_master_rejected);
+  RUN_TEST(test_rtu_master_exception);
+  RUN_TEST(test_rtu_master_invalid_exception);
+  RUN_TEST(test_rtu_master_split_response);
+  RUN_TEST(test_rtu_master_pipeline);
+  RUN_TEST(test_rtu_master_urgent);
+  RUN_TEST(test_rtu_master_write);
+  RUN_TEST(test_rtu_master_read_coils);
+  RUN_TEST(test_rtu_master_read_coils_split);
+#ifndef ARDUINO
+  RUN_TEST(test_rtu_master_pty);
+#endif  // ARDUINO
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#include <ScanRate.h>
+#include <unity.h>
+
+static const uint16_t FIELD_NB = 40;
+
+// one scan of FIELD_NB fields, moving of the first ones by step, the other ones by noise under the deadband
+static uint32_t _scan(ScanRate *rate, uint32_t scan, uint16_t moving, float step, uint32_t busy_us) {
+  for (uint16_t i = 0; i < FIELD_NB; ++i) {
+    const float base = 20.0f + i;
+    rate->addValue(i, i < moving ? base + step * scan : base + (scan % 2) * 0.1f);
+  }
+  return rate->endScan(busy_us);
+}
+
+void test_scan_rate_stable(void) {
+  ScanRate rate(5000, 1000, 60000, 50, 0.2f);
+  TEST_ASSERT_EQUAL(5000, _scan(&rate, 0, 0, 0, 200000));  // first scan: nothing to compare
+  TEST_ASSERT_EQUAL(6250, _scan(&rate, 1, 0, 0, 200000));
+  TEST_ASSERT_EQUAL(7812, _scan(&rate, 2, 0, 0, 200000));
+  for (uint32_t scan = 3; scan < 30; ++scan) {
+    _scan(&rate, scan, 0, 0, 200000);
+  }
+  TEST_ASSERT_EQUAL(60000, rate.periodMs());
+  TEST_ASSERT_EQUAL_FLOAT(0, rate.volatility());
+  TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.2f / 60, rate.utilization());
+  TEST_ASSERT_EQUAL(30, rate.scans());
+}
+
+void test_scan_rate_volatile(void) {
+  ScanRate rate(30000, 1000, 60000, 50, 0.2f);
+  _scan(&rate, 0, 0, 0, 200000);
+  // heat-up: a quarter of the fields move, the period is halved at each scan down to the minimum
+  TEST_ASSERT_EQUAL(15000, _scan(&rate, 1, 10, 1.0f, 200000));
+  TEST_ASSERT_EQUAL(7500, _scan(&rate, 2, 10, 1.0f, 200000));
+  for (uint32_t scan = 3; scan < 10; ++scan) {
+    _scan(&rate, scan, 10, 1.0f, 200000);
+  }
+  TEST_ASSERT_EQUAL(1000, rate.periodMs());
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.25f, rate.volatility());
+  // values drop back, then settle: the period grows again once the average calms down
+  for (uint32_t scan = 10; scan < 14; ++scan) {
+    TEST_ASSERT_EQUAL(1000, _scan(&rate, scan, 0, 0, 200000));
+  }
+  TEST_ASSERT_EQUAL(1250, _scan(&rate, 14, 0, 0, 200000));
+}
+
+void test_scan_rate_bus_limit(void) {
+  // 800 ms scans at 9600 bauds may only take half of the bus: never faster than 1.6 s
+  ScanRate rate(5000, 1000, 60000, 50, 0.2f);
+  for (uint32_t scan = 0; scan < 10; ++scan) {
+    _scan(&rate, scan, FIELD_NB, 5.0f, 800000);
+  }
+  TEST_ASSERT_EQUAL(1600, rate.periodMs());
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.5f, rate.utilization());
+  // a scan slowed down by time-outs pushes the period at once
+  TEST_ASSERT_EQUAL(6000, _scan(&rate, 10, FIELD_NB, 5.0f, 3000000));
+  // the upper bound wins over the utilization target
+  ScanRate bounded(5000, 1000, 2000, 50, 0.2f);
+  TEST_ASSERT_EQUAL(2000, _scan(&bounded, 0, 0, 0, 1500000));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.75f, bounded.utilization());
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_scan_rate_stable);
+  RUN_TEST(test_scan_rate_volatile);
+  RUN_TEST(test_scan_rate_bus_limit);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
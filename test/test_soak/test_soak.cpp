@@ -0,0 +1,268 @@
+#include <Aggregator.h>
+#include <ArduinoJson.h>
+#include <Benchmark.h>
+#include <DerivedFields.h>
+#include <ModbusRtu.h>
+#include <MqttCodec.h>
+#include <RegisterMap.h>
+#include <RtuMaster.h>
+#include <SpscRing.h>
+#include <json_arena.h>
+#include <modbus_derived.h>
+#include <modbus_registers.h>
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs the firmware pipeline (read the blocks of registers[] from a simulated slave, decode, derive, queue, aggregate,
+// serialize the window to JSON, frame the MQTT message) over and over, and fails if the steady state allocates
+// at all: a heap used by periodic work ends up fragmented after weeks of uptime.
+
+// poll cycles after the warm-up, e.g. -DSOAK_CYCLES=10000000 for a longer run
+#ifndef SOAK_CYCLES
+#define SOAK_CYCLES 1000000
+#endif
+#define SOAK_WARMUP_CYCLES 100
+// cycles per published window, as MODBUS_SCANRATE / MODBUS_SAMPLERATE
+#define SOAK_WINDOW 6
+// larger than DATA_JSON_ARENA_SIZE: ArduinoJson slots take more room on a 64-bit host than on the ESP32
+#ifndef SOAK_JSON_ARENA_SIZE
+#define SOAK_JSON_ARENA_SIZE 32768
+#endif
+
+static const uint8_t REGISTER_NB = sizeof(registers) / sizeof(modbus_register_t);
+
+// Answers every read right away, with values changing on each cycle
+class SimulatedSlave : public ModbusTransport {
+ public:
+  uint32_t now = 0;
+  uint32_t cycle = 0;
+  uint32_t requests = 0;
+
+  bool send(const uint8_t *data, size_t len) override {
+    ++requests;
+    const uint16_t address = data[2] << 8 | data[3];
+    const uint16_t count = data[4] << 8 | data[5];
+    size_t n = 0;
+    rx_[n++] = data[0];
+    rx_[n++] = data[1];
+    if (data[1] == 0x01 || data[1] == 0x02) {
+      const uint8_t bytes = (count + 7) / 8;
+      rx_[n++] = bytes;
+      for (uint8_t i = 0; i < bytes; ++i) {
+        rx_[n++] = static_cast<uint8_t>(cycle * 37 + i);
+      }
+    } else {
+      rx_[n++] = 2 * count;
+      for (uint16_t i = 0; i < count; ++i) {
+        const uint16_t value = (3 * (address + i) + cycle) & 0x7FFF;
+        rx_[n++] = value >> 8;
+        rx_[n++] = value & 0xFF;
+      }
+    }
+    const uint16_t crc = modbusCrc16(rx_, n);
+    rx_[n++] = crc & 0xFF;
+    rx_[n++] = crc >> 8;
+    rx_len_ = n;
+    return true;
+  }
+  size_t receive(uint8_t *buffer, size_t size) override {
+    const size_t n = rx_len_ < size ? rx_len_ : size;
+    memcpy(buffer, rx_, n);
+    memmove(rx_, rx_ + n, rx_len_ - n);
+    rx_len_ -= n;
+    return n;
+  }
+  void wait(uint32_t timeout_us) override { now += timeout_us; }
+  void wake() override {}
+  uint32_t micros() override { return now; }
+
+ private:
+  uint8_t rx_[MODBUS_RTU_MAX_FRAME];
+  size_t rx_len_ = 0;
+};
+
+// Frames each PUBLISH (as the TLS client does) and drops it
+class StubMqttClient {
+ public:
+  uint32_t messages = 0;
+  uint64_t bytes = 0;
+
+  bool publish(const char *topic, const char *payload, size_t len) {
+    uint8_t header[160];
+    const size_t n = mqttEncodePublishHeader(header, sizeof(header), topic, len, true);
+    if (n == 0) {
+      return false;
+    }
+    ++messages;
+    bytes += n + len;
+    return true;
+  }
+};
+
+typedef struct {
+  const char *name;
+  double value;
+  uint16_t field_id;
+} sample_t;
+
+static modbus_block_t blocks[REGISTER_NB];
+static uint8_t block_nb = 0;
+static uint16_t raw_values[REGISTER_NB];
+static uint32_t failed_reads = 0;
+static SpscRing<sample_t, 256> sample_queue;
+static DerivedFields derived(derived_fields, sizeof(derived_fields) / sizeof(derived_field_t));
+static Aggregator aggregator;
+static uint64_t json_buffer[SOAK_JSON_ARENA_SIZE / sizeof(uint64_t)];
+static JsonArenaAllocator json_allocator(json_buffer, sizeof(json_buffer));
+static char payload[6144];
+static const char TOPIC[] = "MyTopic/ESP-MM-ABCDEF012345/data";
+
+static void _onBlockRead(const rtu_request_t *request, uint8_t status, const uint16_t *values, void *context) {
+  const modbus_block_t *block = static_cast<const modbus_block_t *>(context);
+  if (status != MODBUS_STATUS_SUCCESS) {
+    ++failed_reads;
+    return;
+  }
+  for (uint16_t i = block->first; i < block->first + block->entries; ++i) {
+    raw_values[i] = blockRegisterValue(block, &registers[i], values);
+  }
+}
+
+static void _queueSample(uint16_t field_id, const char *name, double value, void *context) {
+  const sample_t sample = { name, value, field_id };
+  sample_queue.push(sample);
+}
+
+static bool _getOperand(uint16_t register_id, uint16_t *value_ptr, void *context) {
+  const int16_t i = findRegister(registers, REGISTER_NB, register_id, nullptr);
+  if (i < 0) {
+    return false;
+  }
+  *value_ptr = raw_values[i];
+  return true;
+}
+
+// bus task and poller task: reads every block, then decodes the registers
+static void _scan(RtuMaster *master, SimulatedSlave *slave) {
+  uint8_t b = 0;
+  while (b < block_nb || master->pending() > 0) {
+    while (b < block_nb && !master->full()) {
+      const rtu_request_t request = { 10, modbusReadFunction(blocks[b].modbus_entity), blocks[b].address,
+                                      blocks[b].count, nullptr, 2, 2000, _onBlockRead, &blocks[b], false };
+      master->submit(request);
+      ++b;
+    }
+    const uint32_t delay_us = master->poll();
+    if (master->pending() > 0) {
+      slave->wait(delay_us);
+    }
+  }
+  uint16_t field_id = 0;
+  for (uint8_t i = 0; i < REGISTER_NB; ++i) {
+    decodeRegister(&registers[i], raw_values[i], field_id, _queueSample, nullptr);
+    field_id += registerFieldCount(&registers[i]);
+  }
+  derived.evaluate(_getOperand, nullptr, slave->now / 1000, field_id, _queueSample, nullptr);
+}
+
+// publisher task: same document as aggregatorToJson()
+static void _publishWindow(StubMqttClient *mqtt, ArduinoJson::Allocator *allocator) {
+  JsonDocument json_doc(allocator);
+  JsonVariant variant = json_doc.to<JsonVariant>();
+  for (uint16_t i = 0; i < aggregator.size(); ++i) {
+    const aggregator_slot_t &slot = aggregator.slot(i);
+    if (slot.count == 0) {
+      continue;
+    }
+    JsonObject field = variant[slot.name].to<JsonObject>();
+    field["min"] = slot.min;
+    field["max"] = slot.max;
+    field["mean"] = aggregator.mean(i);
+    field["last"] = slot.last;
+    field["count"] = slot.count;
+  }
+  const size_t n = serializeJson(json_doc, payload, sizeof(payload));
+  mqtt->publish(TOPIC, payload, n);
+  aggregator.reset();
+}
+
+static void _cycle(RtuMaster *master, SimulatedSlave *slave, StubMqttClient *mqtt, ArduinoJson::Allocator *allocator) {
+  _scan(master, slave);
+  sample_t sample;
+  while (sample_queue.pop(&sample)) {
+    aggregator.add(sample.field_id, sample.name, sample.value);
+  }
+  if (++slave->cycle % SOAK_WINDOW == 0) {
+    _publishWindow(mqtt, allocator);
+  }
+}
+
+void test_soak_poll_cycles(void) {
+  block_nb = planRegisterBlocks(registers, REGISTER_NB, 0, blocks);
+  SimulatedSlave slave;
+  RtuMaster master(&slave, 9600);
+  StubMqttClient mqtt;
+  for (uint32_t i = 0; i < SOAK_WARMUP_CYCLES; ++i) {
+    _cycle(&master, &slave, &mqtt, &json_allocator);
+  }
+  const uint32_t warmup_messages = mqtt.messages;
+
+  const uint64_t allocations = benchmarkAllocations();
+  const uint64_t allocated_bytes = benchmarkAllocatedBytes();
+  const uint64_t start_ns = benchmarkNowNs();
+  for (uint32_t i = 0; i < SOAK_CYCLES; ++i) {
+    _cycle(&master, &slave, &mqtt, &json_allocator);
+  }
+  const double elapsed_us = (benchmarkNowNs() - start_ns) / 1000.0;
+  const uint64_t cycle_allocations = benchmarkAllocations() - allocations;
+  const uint64_t cycle_bytes = benchmarkAllocatedBytes() - allocated_bytes;
+  printf("soak: %u cycles, %u requests, %u messages, %.2f us/cycle, %.4f allocs/cycle, %.2f bytes/cycle, "
+    "JSON arena %u/%u bytes\n", SOAK_CYCLES, slave.requests, mqtt.messages - warmup_messages,
+    elapsed_us / SOAK_CYCLES, static_cast<double>(cycle_allocations) / SOAK_CYCLES,
+    static_cast<double>(cycle_bytes) / SOAK_CYCLES, static_cast<unsigned>(json_allocator.arena().highWater()),
+    static_cast<unsigned>(json_allocator.arena().capacity()));
+
+  TEST_ASSERT_EQUAL(0, failed_reads);
+  TEST_ASSERT_EQUAL(0, sample_queue.dropped());
+  TEST_ASSERT_EQUAL((SOAK_WARMUP_CYCLES + SOAK_CYCLES) / SOAK_WINDOW - SOAK_WARMUP_CYCLES / SOAK_WINDOW,
+    mqtt.messages - warmup_messages);
+  TEST_ASSERT_EQUAL_MESSAGE(0, json_allocator.fallbacks(), "JSON arena too small, raise SOAK_JSON_ARENA_SIZE");
+  TEST_ASSERT_EQUAL_MESSAGE(0, cycle_allocations, "the steady state allocates");
+}
+
+// ArduinoJson's default allocator
+class HeapAllocator : public ArduinoJson::Allocator {
+ public:
+  void *allocate(size_t size) override { return malloc(size); }
+  void deallocate(void *ptr) override { free(ptr); }
+  void *reallocate(void *ptr, size_t size) override { return realloc(ptr, size); }
+};
+
+// the interposed allocator does see what the pipeline would allocate from the heap
+void test_soak_heap_document(void) {
+  block_nb = planRegisterBlocks(registers, REGISTER_NB, 0, blocks);
+  HeapAllocator heap_allocator;
+  SimulatedSlave slave;
+  RtuMaster master(&slave, 9600);
+  StubMqttClient mqtt;
+  const uint64_t allocations = benchmarkAllocations();
+  for (uint32_t i = 0; i < SOAK_WINDOW; ++i) {
+    _cycle(&master, &slave, &mqtt, &heap_allocator);
+  }
+  TEST_ASSERT_EQUAL(1, mqtt.messages);
+  TEST_ASSERT_TRUE(benchmarkAllocations() > allocations);
+}
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_soak_poll_cycles);
+  RUN_TEST(test_soak_heap_document);
+  UNITY_END();
+}
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
@@ -0,0 +1,100 @@
+#include <SpscRing.h>
+#include <unity.h>
+
+
+void test_spsc_ring_fifo(void) {
+  SpscRing<uint32_t, 4> ring;
+  TEST_ASSERT_EQUAL(0, ring.size());
+  for (uint32_t i = 0; i < 4; ++i) {
+    TEST_ASSERT_TRUE(ring.push(i));
+  }
+  TEST_ASSERT_FALSE(ring.push(4));  // full
+  TEST_ASSERT_EQUAL(1, ring.dropped());
+  TEST_ASSERT_EQUAL(4, ring.highWater());
+
+  uint32_t item;
+  for (uint32_t i = 0; i < 4; ++i) {
+    TEST_ASSERT_TRUE(ring.pop(&item));
+    TEST_ASSERT_EQUAL(i, item);
+  }
+  TEST_ASSERT_FALSE(ring.pop(&item));
+}
+
+void test_spsc_ring_wrap(void) {
+  SpscRing<uint32_t, 4> ring;
+  uint32_t item;
+  for (uint32_t i = 0; i < 100; ++i) {
+    ring.push(i);
+    ring.push(i + 1000);
+    TEST_ASSERT_TRUE(ring.pop(&item));
+    TEST_ASSERT_EQUAL(i, item);
+    TEST_ASSERT_TRUE(ring.pop(&item));
+    TEST_ASSERT_EQUAL(i + 1000, item);
+  }
+  TEST_ASSERT_EQUAL(2, ring.highWater());
+  TEST_ASSERT_EQUAL(0, ring.dropped());
+}
+
+#ifndef ARDUINO
+
+#include <thread>
+
+// producer and consumer on two threads: every item arrives once, in order
+void test_spsc_ring_threads(void) {
+  static SpscRing<uint32_t, 64> ring;
+  const uint32_t count = 100000;
+  std::thread producer([]() {
+    for (uint32_t i = 0; i < count; ++i) {
+      while (!ring.push(i)) std::this_thread::yield();
+    }
+  });
+  uint32_t expected = 0;
+  bool ordered = true;
+  while (expected < count) {
+    uint32_t item;
+    if (ring.pop(&item)) {
+      ordered = ordered && item == expected;
+      ++expected;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  TEST_ASSERT_TRUE(ordered);
+  TEST_ASSERT_EQUAL(0, ring.size());
+}
+
+#endif  // ARDUINO
+
+void process() {
+  UNITY_BEGIN();
+  RUN_TEST(test_spsc_ring_fifo);
+  RUN_TEST(test_spsc_ring_wrap);
+#ifndef ARDUINO
+  RUN_TEST(test_spsc_ring_threads);
+#endif  // ARDUINO
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  process();
+}
+
+void loop() {
+}
+
+#else
+
+int main(int argc, char **argv) {
+  process();
+  return 0;
+}
+
+#endif
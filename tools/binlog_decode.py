@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+#
+# binlog_decode.py - Decodes a binary log dump of esp-modbus-mqtt
+# Copyright (C) 2020 Germain Masse
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#
+# Usage:
+#   mosquitto_sub -h <broker> -t '<topic>/<hostname>/binlog' -C 1 > binlog.bin &
+#   mosquitto_pub -h <broker> -t '<topic>/<hostname>/action/binlog' -n
+#   tools/binlog_decode.py binlog.bin --elf .pio/build/fm-devkit/firmware.elf
+#
+# The message catalogue (src/log_messages.h) must match the firmware that produced the dump.
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+RECORD = struct.Struct('<IHBB4I')  # binlog_record_t on ESP32
+ARG_INT, ARG_UINT, ARG_FLOAT, ARG_STRING = range(4)
+SPEC = re.compile(r'%([-+ #0]*)(\d*)(?:\.(\d+))?[hlzjtL]*([diuxXofeEgGcsb%])')
+
+
+def parse_catalogue(path):
+    with open(path) as f:
+        text = f.read()
+    tags = re.findall(r'X\((\w+), "([^"]*)"\)', text)
+    tag_names = {tag_id: name for tag_id, name in tags}
+    messages = []
+    for tag_id, level, fmt in re.findall(r'X\(\w+, (\w+), BINLOG_LEVEL_(\w+), "((?:[^"\\]|\\.)*)"\)', text):
+        messages.append((tag_names.get(tag_id, tag_id), level[0], fmt))
+    return messages
+
+
+class ElfStrings:
+    """Resolves string arguments from the firmware ELF (.pio/build/<env>/firmware.elf)"""
+
+    def __init__(self, path):
+        self.sections = []
+        with open(path, 'rb') as f:
+            data = f.read()
+        if data[:4] != b'\x7fELF' or data[4] != 1:
+            raise ValueError('%s is not a 32-bit ELF file' % path)
+        shoff, = struct.unpack_from('<I', data, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', data, 0x2E)
+        for i in range(shnum):
+            _, sh_type, _, addr, offset, size = struct.unpack_from('<6I', data, shoff + i * shentsize)
+            if sh_type == 1 and addr != 0:  # SHT_PROGBITS, loaded
+                self.sections.append((addr, data[offset:offset + size]))
+
+    def get(self, address):
+        for addr, content in self.sections:
+            if addr <= address < addr + len(content):
+                start = address - addr
+                end = content.find(b'\0', start)
+                return content[start:end if end >= 0 else len(content)].decode('utf-8', 'replace')
+        return None
+
+
+def format_message(fmt, args, types, strings=None):
+    out = []
+    pos = 0
+    index = 0
+    for match in SPEC.finditer(fmt):
+        out.append(fmt[pos:match.start()])
+        pos = match.end()
+        flags, width, precision, conversion = match.groups()
+        if conversion == '%':
+            out.append('%')
+            continue
+        if index >= len(args):
+            out.append('?')
+            continue
+        value, kind = args[index], types[index]
+        index += 1
+        if kind == ARG_FLOAT:
+            value = struct.unpack('<f', struct.pack('<I', value))[0]
+        elif kind == ARG_INT:
+            value = struct.unpack('<i', struct.pack('<I', value))[0]
+        if conversion == 'b':
+            out.append(format(int(value) & 0xFFFF, 'b'))
+        elif conversion == 's':
+            # strings stay in the flash of the device, only their address was recorded
+            text = strings.get(value) if strings is not None and kind == ARG_STRING else None
+            if text is None:
+                text = '@0x%08x' % value if kind == ARG_STRING else '?'
+            out.append(text)
+        else:
+            if conversion in 'fFeEgG':
+                value = float(value)
+            elif conversion in 'diouxXc':
+                value = int(value)
+            if conversion == 'u':
+                conversion = 'd'
+            spec = '%' + flags + width + ('.' + precision if precision else '') + conversion
+            out.append(spec % value)
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def decode(data, messages, strings=None):
+    for offset in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        timestamp_us, msg_id, argc, types, *args = RECORD.unpack_from(data, offset)
+        arg_types = [(types >> (2 * i)) & 0x03 for i in range(argc)]
+        if msg_id >= len(messages):
+            yield '[%6u][?][?] unknown message %u' % (timestamp_us // 1000, msg_id)
+            continue
+        tag, level, fmt = messages[msg_id]
+        yield '[%6u][%s][%s] %s' % (timestamp_us // 1000, level, tag, format_message(fmt, args[:argc], arg_types, strings))
+
+
+def main():
+    default_catalogue = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src', 'log_messages.h')
+    parser = argparse.ArgumentParser(description='Decode a binary log dump of esp-modbus-mqtt')
+    parser.add_argument('dump', help='binary log dump (payload of the binlog topic), - for stdin')
+    parser.add_argument('--catalogue', default=default_catalogue, help='message catalogue (src/log_messages.h)')
+    parser.add_argument('--elf', help='firmware ELF, to resolve the string arguments')
+    args = parser.parse_args()
+
+    messages = parse_catalogue(args.catalogue)
+    strings = ElfStrings(args.elf) if args.elf else None
+    if args.dump == '-':
+        data = sys.stdin.buffer.read()
+    else:
+        with open(args.dump, 'rb') as f:
+            data = f.read()
+    for line in decode(data, messages, strings):
+        print(line)
+
+
+if __name__ == '__main__':
+    main()
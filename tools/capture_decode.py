@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+#
+# capture_decode.py - Lists the frames of a Modbus bus capture of esp-modbus-mqtt
+# Copyright (C) 2020 Germain Masse
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#
+# Usage:
+#   mosquitto_sub -h <broker> -t '<topic>/<hostname>/capture' -C 1 > capture.bin &
+#   mosquitto_pub -h <broker> -t '<topic>/<hostname>/action/capture' -n
+#   tools/capture_decode.py capture.bin
+#
+# The format is described in lib/BusCapture/BusCapture.h.
+
+import argparse
+import struct
+import sys
+
+HEADER = struct.Struct('<4sBB2xIII')
+FRAMINGS = ('RTU', 'TCP')
+
+
+def read_varint(data, offset):
+    value = 0
+    shift = 0
+    while offset < len(data):
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, offset
+        shift += 7
+    raise ValueError('truncated record')
+
+
+def decode(data):
+    if len(data) < HEADER.size:
+        raise ValueError('not a bus capture')
+    magic, version, framing, timestamp_us, count, dropped = HEADER.unpack_from(data)
+    if magic != b'MBCP' or version != 1:
+        raise ValueError('not a bus capture')
+    yield '# %s framing, %u records, %u dropped' % (FRAMINGS[framing] if framing < len(FRAMINGS) else '?', count,
+                                                  dropped)
+    offset = HEADER.size
+    previous_us = None
+    for _ in range(count):
+        delta_us, offset = read_varint(data, offset)
+        direction = data[offset]
+        length, offset = read_varint(data, offset + 1)
+        frame = data[offset:offset + length]
+        offset += length
+        timestamp_us = (timestamp_us + delta_us) & 0xFFFFFFFF if previous_us is not None else timestamp_us
+        gap = '' if previous_us is None else ' +%.3f ms' % (((timestamp_us - previous_us) & 0xFFFFFFFF) / 1000)
+        previous_us = timestamp_us
+        yield '[%12.6f]%s %s %s' % (timestamp_us / 1e6, gap, 'TX' if direction == 0 else 'RX', frame.hex(' '))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='List the frames of a Modbus bus capture of esp-modbus-mqtt')
+    parser.add_argument('dump', help='bus capture (payload of the capture topic), - for stdin')
+    args = parser.parse_args()
+
+    if args.dump == '-':
+        data = sys.stdin.buffer.read()
+    else:
+        with open(args.dump, 'rb') as f:
+            data = f.read()
+    for line in decode(data):
+        print(line)
+
+
+if __name__ == '__main__':
+    main()